@@ -0,0 +1,514 @@
+/** @file aadaptation.cpp
+ * @brief Implementation of solution-adaptive refinement and coarsening
+ * @author Aditya Kashi
+ */
+
+#include "aadaptation.hpp"
+#include <algorithm>
+#include <limits>
+#include <chrono>
+
+namespace acfd {
+
+MeshAdapter::MeshAdapter(const UMesh2dh& base, const int max_level)
+	: maxlevel(max_level), valid(true), nbase(base.gnelem()), nbtag(base.gnbtag()),
+	  ndtag(base.gndtag())
+{
+	for(a_int iel = 0; iel < base.gnelem(); iel++)
+		if(base.gnnode(iel) != 3 && base.gnnode(iel) != 4) {
+			std::cout << " ! MeshAdapter: Only linear meshes can be adapted!\n";
+			valid = false;
+			return;
+		}
+
+	px.resize(base.gnpoin());
+	py.resize(base.gnpoin());
+	for(a_int ip = 0; ip < base.gnpoin(); ip++) {
+		px[ip] = base.gcoords(ip,0);
+		py[ip] = base.gcoords(ip,1);
+	}
+	basevolregions = base.vol_regions;
+
+	cells.resize(base.gnelem());
+	pieceleaf.resize(base.gnelem());
+	piecearea.resize(base.gnelem());
+	for(a_int iel = 0; iel < base.gnelem(); iel++)
+	{
+		TreeCell& c = cells[iel];
+		c.nv = base.gnnode(iel);
+		for(int iv = 0; iv < c.nv; iv++)
+			c.v[iv] = base.ginpoel(iel,iv);
+		c.level = 0;
+		c.root = iel;
+		c.parent = c.child = -1;
+		c.refined = false;
+		c.area = polygonArea(c.v, c.nv);
+		countEdges(iel, 1);
+
+		pieceleaf[iel] = iel;
+		piecearea[iel] = c.area;
+	}
+
+	btags.resize(base.gnface()*nbtag);
+	for(a_int iface = 0; iface < base.gnface(); iface++) {
+		bedges[edgeKey(base.gbface(iface,0), base.gbface(iface,1))] = iface;
+		for(int j = 0; j < nbtag; j++)
+			btags[iface*nbtag+j] = base.gbface(iface,2+j);
+	}
+}
+
+a_real MeshAdapter::polygonArea(const a_int *const v, const int nv) const
+{
+	a_real area2 = 0;
+	for(int iv = 0; iv < nv; iv++) {
+		const int jv = (iv+1)%nv;
+		area2 += px[v[iv]]*py[v[jv]] - px[v[jv]]*py[v[iv]];
+	}
+	return std::abs(0.5*area2);
+}
+
+a_int MeshAdapter::midpoint(const a_int a, const a_int b)
+{
+	const std::uint64_t key = edgeKey(a,b);
+	const auto it = midpoints.find(key);
+	if(it != midpoints.end())
+		return it->second;
+
+	const a_int m = (a_int)px.size();
+	px.push_back(0.5*(px[a]+px[b]));
+	py.push_back(0.5*(py[a]+py[b]));
+	midpoints[key] = m;
+
+	// the halves of a boundary edge keep its tags
+	const auto bt = bedges.find(key);
+	if(bt != bedges.end()) {
+		const a_int itags = bt->second;
+		bedges[edgeKey(a,m)] = itags;
+		bedges[edgeKey(m,b)] = itags;
+	}
+	return m;
+}
+
+int MeshAdapter::edgeUse(const a_int a, const a_int b) const
+{
+	const auto it = edgeuse.find(edgeKey(a,b));
+	return it == edgeuse.end() ? 0 : it->second;
+}
+
+void MeshAdapter::countEdges(const a_int icell, const int increment)
+{
+	const TreeCell& c = cells[icell];
+	for(int iv = 0; iv < c.nv; iv++) {
+		const std::uint64_t key = edgeKey(c.v[iv], c.v[(iv+1)%c.nv]);
+		const int count = (edgeuse[key] += increment);
+		if(count == 0)
+			edgeuse.erase(key);
+	}
+}
+
+bool MeshAdapter::isHanging(const a_int a, const a_int b) const
+{
+	const auto it = midpoints.find(edgeKey(a,b));
+	if(it == midpoints.end())
+		return false;
+	// only leaves on the other side can use parts of the edge; they may be several levels finer
+	const a_int m = it->second;
+	return edgeUse(a,m) > 0 || edgeUse(m,b) > 0 || isHanging(a,m) || isHanging(m,b);
+}
+
+void MeshAdapter::refine(const a_int icell)
+{
+	countEdges(icell, -1);
+
+	if(cells[icell].child < 0)
+	{
+		// cells may be reallocated below
+		const TreeCell pc = cells[icell];
+		a_int mids[4];
+		for(int iv = 0; iv < pc.nv; iv++)
+			mids[iv] = midpoint(pc.v[iv], pc.v[(iv+1)%pc.nv]);
+
+		a_int cv[4][4];
+		if(pc.nv == 3)
+		{
+			const a_int cvt[4][4] = { {pc.v[0], mids[0], mids[2], -1},
+				{mids[0], pc.v[1], mids[1], -1},
+				{mids[2], mids[1], pc.v[2], -1},
+				{mids[0], mids[1], mids[2], -1} };
+			std::copy(&cvt[0][0], &cvt[0][0]+16, &cv[0][0]);
+		}
+		else
+		{
+			const a_int centre = (a_int)px.size();
+			px.push_back(0.25*(px[pc.v[0]]+px[pc.v[1]]+px[pc.v[2]]+px[pc.v[3]]));
+			py.push_back(0.25*(py[pc.v[0]]+py[pc.v[1]]+py[pc.v[2]]+py[pc.v[3]]));
+			const a_int cvq[4][4] = { {pc.v[0], mids[0], centre, mids[3]},
+				{mids[0], pc.v[1], mids[1], centre},
+				{centre, mids[1], pc.v[2], mids[2]},
+				{mids[3], centre, mids[2], pc.v[3]} };
+			std::copy(&cvq[0][0], &cvq[0][0]+16, &cv[0][0]);
+		}
+
+		const a_int first = (a_int)cells.size();
+		for(int k = 0; k < 4; k++)
+		{
+			TreeCell c;
+			c.nv = pc.nv;
+			std::copy(cv[k], cv[k]+4, c.v);
+			c.level = pc.level+1;
+			c.root = pc.root;
+			c.parent = icell;
+			c.child = -1;
+			c.refined = false;
+			c.area = polygonArea(c.v, c.nv);
+			cells.push_back(c);
+		}
+		cells[icell].child = first;
+	}
+
+	cells[icell].refined = true;
+	for(int k = 0; k < 4; k++)
+		countEdges(cells[icell].child+k, 1);
+}
+
+void MeshAdapter::coarsen(const a_int icell)
+{
+	for(int k = 0; k < 4; k++)
+		countEdges(cells[icell].child+k, -1);
+	cells[icell].refined = false;
+	countEdges(icell, 1);
+}
+
+bool MeshAdapter::needsClosure(const a_int icell) const
+{
+	const TreeCell& c = cells[icell];
+	int nhanging = 0;
+	for(int iv = 0; iv < c.nv; iv++)
+	{
+		const a_int a = c.v[iv], b = c.v[(iv+1)%c.nv];
+		if(!isHanging(a,b))
+			continue;
+		nhanging++;
+		const a_int m = midpoints.at(edgeKey(a,b));
+		if(isHanging(a,m) || isHanging(m,b))
+			return true;
+	}
+	return nhanging > 1;
+}
+
+int MeshAdapter::splitLeaf(const a_int icell, std::vector<a_int>& elnodes,
+		std::vector<int>& nnodes) const
+{
+	const TreeCell& c = cells[icell];
+	int ih = -1;
+	for(int iv = 0; iv < c.nv; iv++)
+		if(isHanging(c.v[iv], c.v[(iv+1)%c.nv])) {
+			ih = iv;
+			break;
+		}
+
+	if(ih < 0) {
+		elnodes.insert(elnodes.end(), c.v, c.v+c.nv);
+		nnodes.push_back(c.nv);
+		return 1;
+	}
+
+	// vertices starting from the hanging edge
+	a_int w[4];
+	for(int iv = 0; iv < c.nv; iv++)
+		w[iv] = c.v[(ih+iv)%c.nv];
+	const a_int m = midpoints.at(edgeKey(w[0],w[1]));
+
+	if(c.nv == 3) {
+		const a_int tris[] = {w[0], m, w[2],  m, w[1], w[2]};
+		elnodes.insert(elnodes.end(), tris, tris+6);
+		nnodes.insert(nnodes.end(), 2, 3);
+		return 2;
+	}
+	else {
+		const a_int tris[] = {w[0], m, w[3],  m, w[1], w[2],  m, w[2], w[3]};
+		elnodes.insert(elnodes.end(), tris, tris+9);
+		nnodes.insert(nnodes.end(), 3, 3);
+		return 3;
+	}
+}
+
+/// Lists the current leaves of the tree, depth first from each base cell
+template <typename Cells>
+static void collectLeaves(const Cells& cells, const a_int nroots, std::vector<a_int>& leaves)
+{
+	leaves.clear();
+	std::vector<a_int> stack;
+	for(a_int iroot = 0; iroot < nroots; iroot++)
+	{
+		stack.push_back(iroot);
+		while(!stack.empty()) {
+			const a_int ic = stack.back();
+			stack.pop_back();
+			if(!cells[ic].refined)
+				leaves.push_back(ic);
+			else
+				for(int k = 3; k >= 0; k--)
+					stack.push_back(cells[ic].child+k);
+		}
+	}
+}
+
+bool MeshAdapter::adapt(const a_real *const indicator, const a_real refine_fraction,
+		const a_real coarsen_fraction, const MVector& u, UMesh2dh& newmesh, MVector& unew)
+{
+	if(!valid)
+		return false;
+	if(u.rows() != numCells()) {
+		std::cout << " ! MeshAdapter: adapt(): The solution is not on the current mesh!\n";
+		return false;
+	}
+	// the thresholds below are meaningless if the solution has diverged
+	for(a_int ip = 0; ip < numCells(); ip++)
+		if(!std::isfinite(indicator[ip])) {
+			std::cout << " ! MeshAdapter: adapt(): The indicator is not finite in cell " << ip
+				<< "; not adapting.\n";
+			return false;
+		}
+	const auto start = std::chrono::steady_clock::now();
+
+	const int nvars = (int)u.cols();
+	const a_int ncellsold = (a_int)cells.size();
+
+	/* Averages and indicators of the current leaves. The cells of the current mesh tile the
+	 * leaves exactly, so averaging with their areas conserves the integral of the solution.
+	 */
+	std::vector<a_real> cellu(ncellsold*nvars, 0), cellarea(ncellsold, 0), cellind(ncellsold, 0);
+	std::vector<char> oldleaf(ncellsold, 0), wasrefined(ncellsold, 0);
+	for(a_int ip = 0; ip < numCells(); ip++)
+	{
+		const a_int il = pieceleaf[ip];
+		for(int j = 0; j < nvars; j++)
+			cellu[il*nvars+j] += piecearea[ip]*u(ip,j);
+		cellarea[il] += piecearea[ip];
+		cellind[il] = std::max(cellind[il], indicator[ip]);
+		oldleaf[il] = 1;
+	}
+	for(a_int ic = 0; ic < ncellsold; ic++)
+	{
+		wasrefined[ic] = cells[ic].refined;
+		if(oldleaf[ic])
+			for(int j = 0; j < nvars; j++)
+				cellu[ic*nvars+j] /= cellarea[ic];
+	}
+
+	std::vector<a_int> leaves;
+	collectLeaves(cells, nbase, leaves);
+	const a_int nleaves = (a_int)leaves.size();
+
+	// thresholds for the given fractions of leaves
+	std::vector<a_real> sorted(nleaves);
+	for(a_int i = 0; i < nleaves; i++)
+		sorted[i] = cellind[leaves[i]];
+	const a_int nref = std::min((a_int)(refine_fraction*nleaves), nleaves);
+	const a_int ncoa = std::min((a_int)(coarsen_fraction*nleaves), nleaves);
+	a_real refthreshold = std::numeric_limits<a_real>::max(), coathreshold = -1;
+	if(nref > 0) {
+		std::nth_element(sorted.begin(), sorted.begin()+(nleaves-nref), sorted.end());
+		refthreshold = sorted[nleaves-nref];
+	}
+	if(ncoa > 0) {
+		std::nth_element(sorted.begin(), sorted.begin()+(ncoa-1), sorted.end());
+		coathreshold = sorted[ncoa-1];
+	}
+
+	// families of leaves all of which have small indicators are merged first
+	a_int ncoarsened = 0;
+	if(ncoa > 0)
+		for(a_int ic = 0; ic < ncellsold; ic++)
+		{
+			if(!cells[ic].refined)
+				continue;
+			bool merge = true;
+			for(int k = 0; k < 4 && merge; k++) {
+				const a_int ich = cells[ic].child+k;
+				merge = !cells[ich].refined && cellind[ich] <= coathreshold
+					&& cellind[ich] < refthreshold;
+			}
+			if(merge) {
+				coarsen(ic);
+				ncoarsened++;
+			}
+		}
+
+	a_int nrefined = 0;
+	for(a_int i = 0; i < nleaves; i++) {
+		const a_int ic = leaves[i];
+		// leaves just merged have small indicators, so they are not split again here
+		if(!cells[ic].refined && cellind[ic] >= refthreshold && cells[ic].level < maxlevel) {
+			refine(ic);
+			nrefined++;
+		}
+	}
+
+	// closure: refine until every leaf has at most one hanging node
+	a_int nclosure = 0;
+	std::vector<char> needed;
+	while(true)
+	{
+		collectLeaves(cells, nbase, leaves);
+		needed.assign(leaves.size(), 0);
+#pragma omp parallel for default(shared) schedule(dynamic, 1024)
+		for(a_int i = 0; i < (a_int)leaves.size(); i++)
+			needed[i] = needsClosure(leaves[i]);
+
+		a_int nneeded = 0;
+		for(a_int i = 0; i < (a_int)leaves.size(); i++)
+			if(needed[i]) {
+				refine(leaves[i]);
+				nneeded++;
+			}
+		if(nneeded == 0)
+			break;
+		nclosure += nneeded;
+	}
+
+	/* Values of the new leaves. Merged cells get the average of their children; children
+	 * always come after their parent, so a backward pass does deeper cells first. Cells
+	 * that were split get the value of the old leaf containing them.
+	 */
+	for(a_int ic = ncellsold-1; ic >= 0; ic--)
+	{
+		if(!wasrefined[ic] || cells[ic].refined)
+			continue;
+		a_real area = 0;
+		for(int j = 0; j < nvars; j++)
+			cellu[ic*nvars+j] = 0;
+		for(int k = 0; k < 4; k++) {
+			const a_int ich = cells[ic].child+k;
+			for(int j = 0; j < nvars; j++)
+				cellu[ic*nvars+j] += cellarea[ich]*cellu[ich*nvars+j];
+			area += cellarea[ich];
+		}
+		for(int j = 0; j < nvars; j++)
+			cellu[ic*nvars+j] /= area;
+		cellarea[ic] = area;
+	}
+
+	auto leafValue = [&](a_int ic) -> const a_real* {
+		while(ic >= ncellsold || !(oldleaf[ic] || wasrefined[ic]))
+			ic = cells[ic].parent;
+		return &cellu[ic*nvars];
+	};
+
+	// cells of the new mesh
+	std::vector<a_int> elnodes, newpieceleaf;
+	std::vector<int> nnodes;
+	elnodes.reserve(4*leaves.size());
+	for(a_int i = 0; i < (a_int)leaves.size(); i++) {
+		const int npieces = splitLeaf(leaves[i], elnodes, nnodes);
+		newpieceleaf.insert(newpieceleaf.end(), npieces, leaves[i]);
+	}
+	const a_int nelem = (a_int)nnodes.size();
+
+	// only the nodes in use are kept, in the order of creation
+	std::vector<a_int> pointmap(px.size(), -1);
+	for(size_t k = 0; k < elnodes.size(); k++)
+		pointmap[elnodes[k]] = 0;
+	a_int npoin = 0;
+	for(size_t ip = 0; ip < px.size(); ip++)
+		if(pointmap[ip] == 0)
+			pointmap[ip] = npoin++;
+
+	std::vector<a_int> elstart(nelem+1, 0);
+	for(a_int iel = 0; iel < nelem; iel++)
+		elstart[iel+1] = elstart[iel] + nnodes[iel];
+
+	// boundary faces
+	std::vector<a_int> bfaces;
+	for(a_int iel = 0; iel < nelem; iel++)
+		for(int in = 0; in < nnodes[iel]; in++) {
+			const a_int a = elnodes[elstart[iel]+in];
+			const a_int b = elnodes[elstart[iel]+(in+1)%nnodes[iel]];
+			const auto bt = bedges.find(edgeKey(a,b));
+			if(bt != bedges.end()) {
+				bfaces.push_back(a);
+				bfaces.push_back(b);
+				bfaces.push_back(bt->second);
+			}
+		}
+
+	newmesh.ndim = 2;
+	newmesh.nnofa = 2;
+	newmesh.nbtag = nbtag;
+	newmesh.ndtag = ndtag;
+	newmesh.npoin = npoin;
+	newmesh.nelem = nelem;
+	newmesh.nface = (a_int)bfaces.size()/3;
+	newmesh.alloc_jacobians = false;
+	newmesh.isBoundaryMaps = false;
+	newmesh.setupElements(&nnodes[0], nullptr);
+	newmesh.coords.setup(npoin, 2);
+	newmesh.vol_regions.setup(nelem, ndtag);
+	newmesh.bface.setup(newmesh.nface, newmesh.nnofa+nbtag);
+	unew.resize(nelem, nvars);
+	pieceleaf.swap(newpieceleaf);
+	piecearea.resize(nelem);
+
+#pragma omp parallel default(shared)
+	{
+#pragma omp for
+		for(a_int ip = 0; ip < (a_int)px.size(); ip++)
+			if(pointmap[ip] >= 0) {
+				newmesh.coords(pointmap[ip],0) = px[ip];
+				newmesh.coords(pointmap[ip],1) = py[ip];
+			}
+
+#pragma omp for
+		for(a_int iel = 0; iel < nelem; iel++)
+		{
+			for(int in = 0; in < nnodes[iel]; in++)
+				newmesh.inpoel(iel,in) = pointmap[elnodes[elstart[iel]+in]];
+			const TreeCell& c = cells[pieceleaf[iel]];
+			for(int j = 0; j < ndtag; j++)
+				newmesh.vol_regions(iel,j) = basevolregions.get(c.root,j);
+			piecearea[iel] = polygonArea(&elnodes[elstart[iel]], nnodes[iel]);
+
+			const a_real *const val = leafValue(pieceleaf[iel]);
+			for(int j = 0; j < nvars; j++)
+				unew(iel,j) = val[j];
+		}
+
+#pragma omp for
+		for(a_int iface = 0; iface < newmesh.nface; iface++) {
+			newmesh.bface(iface,0) = pointmap[bfaces[3*iface]];
+			newmesh.bface(iface,1) = pointmap[bfaces[3*iface+1]];
+			for(int j = 0; j < nbtag; j++)
+				newmesh.bface(iface,2+j) = btags[bfaces[3*iface+2]*nbtag+j];
+		}
+	}
+
+	newmesh.flag_bpoin.setup(npoin,1);
+	newmesh.flag_bpoin.zeros();
+	for(a_int i = 0; i < newmesh.nface; i++)
+		for(int j = 0; j < newmesh.nnofa; j++)
+			newmesh.flag_bpoin(newmesh.bface(i,j)) = 1;
+
+	const std::chrono::duration<double> tadapt = std::chrono::steady_clock::now() - start;
+
+	newmesh.compute_topological();
+	newmesh.compute_areas();
+	newmesh.compute_jacobians();
+	newmesh.compute_face_data();
+
+	const std::chrono::duration<double> ttotal = std::chrono::steady_clock::now() - start;
+
+	int maxlev = 0;
+	for(a_int i = 0; i < (a_int)leaves.size(); i++)
+		maxlev = std::max(maxlev, cells[leaves[i]].level);
+
+	std::cout << "MeshAdapter: adapt(): Refined " << nrefined << " and merged " << ncoarsened
+		<< " cells; " << nclosure << " more refined for closure.\n";
+	std::cout << "MeshAdapter: adapt(): New mesh has " << nelem << " cells, " << npoin
+		<< " points, " << leaves.size() << " leaves up to level " << maxlev << ".\n";
+	std::cout << "MeshAdapter: adapt(): Took " << ttotal.count() << "s, of which "
+		<< ttotal.count()-tadapt.count() << "s for the topology of the new mesh.\n";
+	return true;
+}
+
+}
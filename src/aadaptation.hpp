@@ -0,0 +1,149 @@
+/** @file aadaptation.hpp
+ * @brief Solution-adaptive refinement and coarsening of hybrid meshes
+ * @author Aditya Kashi
+ */
+
+#ifndef __AADAPTATION_H
+#define __AADAPTATION_H 1
+
+#ifndef __AMESH2DH_H
+#include "amesh2dh.hpp"
+#endif
+
+#include <unordered_map>
+#include <cstdint>
+
+namespace acfd {
+
+/// Adapts a mesh by refining cells where an indicator is large and coarsening where it is small
+/** The cells of the initial mesh are the roots of a refinement tree. A cell is refined by
+ * splitting it into 4, through the midpoints of its edges - and, for quadrangles, the average
+ * of its vertices. Refined cells are never deleted: coarsening a cell only marks it as a leaf
+ * again, and refining it again later reuses its children and their nodes.
+ *
+ * The leaves of the tree may have hanging nodes where neighbours differ in level. Leaves with
+ * more than one hanging node, or whose neighbour is more than one level finer, are refined
+ * until there are none. The remaining hanging nodes are removed by splitting the leaves that
+ * have them - triangles into 2 triangles (green refinement), and quadrangles into 3 triangles.
+ * These transition cells are not part of the tree; they are regenerated in every cycle, so
+ * that refining a neighbour never splits them further and quality does not degrade.
+ *
+ * The number of leaves using each edge of the tree, which tells whether an edge has a hanging
+ * node, is kept up to date as cells are split and merged, so that an adaptation step only does
+ * work for cells that change and the leaves checked for hanging nodes. The arrays of the new
+ * mesh are then generated and its topology recomputed in one parallel pass.
+ *
+ * The solution is transferred conservatively: a new cell gets the value of the old cell
+ * containing it, and a cell that replaces several old cells gets their area-weighted average.
+ *
+ * Only linear meshes are supported. New nodes on the boundary are placed on the straight
+ * boundary faces, so curved boundaries are not represented any better on refined meshes.
+ */
+class MeshAdapter
+{
+public:
+	/// Sets up the refinement tree with the cells of a mesh as roots
+	/** \param[in] base A linear mesh whose topology and areas have been computed
+	 * \param[in] max_level Number of times a cell of the base mesh may be refined
+	 */
+	MeshAdapter(const UMesh2dh& base, const int max_level);
+
+	/// Refines and coarsens the current mesh and transfers a solution to the new mesh
+	/** The current mesh is the base mesh at first, and afterwards the mesh generated by the
+	 * last call.
+	 * \param[in] indicator A non-negative value for each cell of the current mesh; larger
+	 *   values mean more need for refinement
+	 * \param[in] refine_fraction The fraction of cells with the largest indicators to refine
+	 * \param[in] coarsen_fraction The fraction of cells with the smallest indicators that may
+	 *   be merged; a cell is only merged with its siblings if they are all in this fraction
+	 * \param[in] u The solution on the current mesh
+	 * \param[out] newmesh The adapted mesh, ready for use
+	 * \param[out] unew The solution on the adapted mesh; resized as needed
+	 * \return False if the base mesh could not be adapted or the indicator is not finite
+	 *   everywhere, in which case the current mesh is kept
+	 */
+	bool adapt(const a_real *const indicator, const a_real refine_fraction,
+			const a_real coarsen_fraction, const MVector& u, UMesh2dh& newmesh, MVector& unew);
+
+	/// Number of cells of the current mesh
+	a_int numCells() const { return (a_int)pieceleaf.size(); }
+
+private:
+	/// A cell of the refinement tree
+	struct TreeCell
+	{
+		a_int v[4];					///< Vertices, counter-clockwise
+		int nv;						///< Number of vertices
+		int level;					///< Number of times a base cell was split to get this cell
+		a_int root;					///< The base cell containing this cell
+		a_int parent;				///< The parent cell, or -1 for a base cell
+		a_int child;				///< The first of the 4 consecutive children, or -1 if never split
+		bool refined;				///< Whether the children are currently in use
+		a_real area;
+	};
+
+	const int maxlevel;
+	bool valid;						///< False if the base mesh has cells that cannot be split
+	a_int nbase;					///< Number of base cells, which come first in \ref cells
+
+	int nbtag;						///< Number of tags of boundary faces
+	int ndtag;						///< Number of tags of cells
+	amat::Array2d<int> basevolregions;	///< Tags of base cells
+
+	std::vector<a_real> px, py;		///< Coordinates of all nodes ever created
+	std::vector<TreeCell> cells;
+
+	/// Midpoint of each edge that has been split
+	std::unordered_map<std::uint64_t, a_int> midpoints;
+
+	/// Number of leaves of the tree having each edge
+	std::unordered_map<std::uint64_t, int> edgeuse;
+
+	/// Index into \ref btags of the tags of each boundary edge, including those of split edges
+	std::unordered_map<std::uint64_t, a_int> bedges;
+	std::vector<int> btags;
+
+	/// The leaf containing each cell of the current mesh
+	std::vector<a_int> pieceleaf;
+	/// Areas of the cells of the current mesh
+	std::vector<a_real> piecearea;
+
+	/// Key of the edge between two nodes, independent of their order
+	static std::uint64_t edgeKey(const a_int a, const a_int b) {
+		return a < b ? ((std::uint64_t)a << 32) | (std::uint64_t)b
+			: ((std::uint64_t)b << 32) | (std::uint64_t)a;
+	}
+
+	/// Area of a polygon with counter-clockwise vertices
+	a_real polygonArea(const a_int *const v, const int nv) const;
+
+	/// Returns the midpoint of an edge, creating it if needed
+	a_int midpoint(const a_int a, const a_int b);
+
+	/// Number of leaves using an edge
+	int edgeUse(const a_int a, const a_int b) const;
+
+	/// Adds the edges of a cell to, or removes them from, the edge use counts
+	void countEdges(const a_int icell, const int increment);
+
+	/// Whether the neighbours across an edge of a leaf are finer, ie., there is a node in its middle
+	bool isHanging(const a_int a, const a_int b) const;
+
+	/// Splits a leaf into its children
+	void refine(const a_int icell);
+
+	/// Makes a cell whose children are all leaves a leaf again
+	void coarsen(const a_int icell);
+
+	/// Whether a leaf has to be refined to keep at most one hanging node per cell, and
+	/// at most one level of difference between neighbours
+	bool needsClosure(const a_int icell) const;
+
+	/// Appends the cells of the mesh that make up a leaf, as lists of nodes
+	/** \return The number of cells appended
+	 */
+	int splitLeaf(const a_int icell, std::vector<a_int>& elnodes, std::vector<int>& nnodes) const;
+};
+
+}
+#endif
@@ -22,6 +22,10 @@
 #include <aconstants.hpp>
 #endif
 
+#ifndef __AMEMORY_H
+#include "amemory.hpp"
+#endif
+
 #ifndef MATRIX_DOUBLE_PRECISION
 #define MATRIX_DOUBLE_PRECISION 14
 #endif
@@ -52,6 +56,9 @@ inline a_real minmod(a_real a, a_real b)
  * \class Array2d
  * \brief Stores a dense row-major matrix.
  * 
+ * Storage is allocated through acfd::memory, so it is zeroed, aligned to a cache line and,
+ * if large, first touched by all threads.
+ *
  * Notes:
  * If A is a column-major matrix, A[i][j] == A[j * nrows + i] where i is the row-index and j is the column index.
  */
@@ -88,7 +95,7 @@ public:
 		}
 		nrows = nr; ncols = nc;
 		size = nrows*ncols;
-		elems = new T[nrows*ncols];
+		elems = acfd::memory::allocateArray<T>(nrows*ncols);
 		isalloc = true;
 	}
 
@@ -97,7 +104,7 @@ public:
 		nrows = other.nrows;
 		ncols = other.ncols;
 		size = nrows*ncols;
-		elems = new T[nrows*ncols];
+		elems = acfd::memory::allocateArray<T>(nrows*ncols);
 		isalloc = true;
 		for(a_int i = 0; i < nrows*ncols; i++)
 		{
@@ -108,7 +115,7 @@ public:
 	~Array2d()
 	{
 		if(isalloc == true)	
-			delete [] elems;
+			acfd::memory::deallocate(elems);
 		isalloc = false;
 	}
 
@@ -121,8 +128,8 @@ public:
 		ncols = rhs.ncols;
 		size = nrows*ncols;
 		if(isalloc == true)
-			delete [] elems;
-		elems = new T[nrows*ncols];
+			acfd::memory::deallocate(elems);
+		elems = acfd::memory::allocateArray<T>(nrows*ncols);
 		isalloc = true;
 		for(a_int i = 0; i < nrows*ncols; i++)
 		{
@@ -149,8 +156,8 @@ public:
 		nrows = nr; ncols = nc;
 		size = nrows*ncols;
 		if(isalloc == true)
-			delete [] elems;
-		elems = new T[nrows*ncols];
+			acfd::memory::deallocate(elems);
+		elems = acfd::memory::allocateArray<T>(nrows*ncols);
 		isalloc = true;
 	}
 	
@@ -170,11 +177,23 @@ public:
 		nrows = nr; ncols = nc;
 		size = nrows*ncols;
 		if(isalloc == true)
-			delete [] elems;
-		elems = new T[nrows*ncols];
+			acfd::memory::deallocate(elems);
+		elems = acfd::memory::allocateArray<T>(nrows*ncols);
 		isalloc = true;
 	}
 
+	/// Releases the memory; the array is then empty until it is set up again
+	void clear()
+	{
+		if(isalloc == true)
+			acfd::memory::deallocate(elems);
+		nrows = 0; ncols = 0; size = 0;
+		isalloc = false;
+	}
+
+	/// Memory used by the entries in bytes
+	size_t bytes() const { return (size_t)size*sizeof(T); }
+
 	/// Setup without deleting earlier allocation: use in case of Array2d<t>* (pointer to Array2d<t>)
 	void setupraw(a_int nr, a_int nc)
 	{
@@ -191,7 +210,7 @@ public:
 		}
 		nrows = nr; ncols = nc;
 		size = nrows*ncols;
-		elems = new T[nrows*ncols];
+		elems = acfd::memory::allocateArray<T>(nrows*ncols);
 		isalloc = true;
 	}
 	
@@ -285,8 +304,8 @@ public:
 	{
 		infile >> nrows; infile >> ncols;
 		size = nrows*ncols;
-		delete [] elems;
-		elems = new T[nrows*ncols];
+		acfd::memory::deallocate(elems);
+		elems = acfd::memory::allocateArray<T>(nrows*ncols);
 		for(a_int i = 0; i < nrows; i++)
 			for(a_int j = 0; j < ncols; j++)
 				infile >> elems[i*ncols + j];
@@ -0,0 +1,131 @@
+/** @file aasyncoutput.cpp
+ * @brief Implementation of background solution output
+ * @author Aditya Kashi
+ */
+
+#include "aasyncoutput.hpp"
+#include "aoutput.hpp"
+#include "aperf.hpp"
+#include <chrono>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace acfd {
+
+AsyncOutput::AsyncOutput(const UMesh2dh *const mesh, const int num_threads)
+	: m(mesh), nthreads(num_threads), filling(0), pending(false), quit(false), current(0),
+	space(nullptr), unreported(false), entropy(0), writetime(0), nsnapshots(0), waittime(0)
+{
+	worker = std::thread(&AsyncOutput::run, this);
+}
+
+AsyncOutput::~AsyncOutput()
+{
+	{
+		std::unique_lock<std::mutex> lock(mtx);
+		cv.wait(lock, [this]() { return !pending; });
+		report();
+		quit = true;
+	}
+	cv.notify_all();
+	worker.join();
+}
+
+void AsyncOutput::run()
+{
+	perf::Registry::setBackgroundThread();
+#ifdef _OPENMP
+	if(nthreads > 0)
+		omp_set_num_threads(nthreads);
+#endif
+
+	std::unique_lock<std::mutex> lock(mtx);
+	while(true)
+	{
+		cv.wait(lock, [this]() { return pending || quit; });
+		if(!pending)
+			break;
+
+		// the buffer being written and the request details are not changed while pending
+		const MVector& u = snap[current];
+		const EulerFV *const sp = space;
+		const std::string fname = filename;
+		lock.unlock();
+
+		const auto start = std::chrono::steady_clock::now();
+		amat::Array2d<a_real> scalars, velocities;
+		std::string scalarnames[] = {"density", "mach-number", "pressure"};
+		a_real serr;
+		{
+			perf::ScopedTimer tmr(perf::OUTPUT);
+			sp->compute_point_data(u, scalars, velocities);
+			serr = sp->compute_entropy_error(u);
+		}
+		writeScalarsVectorToVtu_PointData(fname, *m, scalars, scalarnames, velocities,
+				"velocity", false);
+		const std::chrono::duration<double> dt = std::chrono::steady_clock::now() - start;
+
+		lock.lock();
+		donefile = fname;
+		entropy = serr;
+		writetime = dt.count();
+		unreported = true;
+		pending = false;
+		cv.notify_all();
+	}
+}
+
+void AsyncOutput::report()
+{
+	if(!unreported)
+		return;
+	std::cout << " AsyncOutput: Wrote " << donefile << " in " << writetime
+		<< "s; log10 of entropy error = " << log10(entropy) << '\n';
+	unreported = false;
+}
+
+void AsyncOutput::request(const EulerFV& spatial, const MVector& u, const std::string fname)
+{
+	// the output thread only reads the other buffer, so the copy overlaps with its work
+	MVector& buf = snap[filling];
+	if(buf.rows() != u.rows() || buf.cols() != u.cols())
+		buf.resize(u.rows(), u.cols());
+#pragma omp parallel for default(shared)
+	for(a_int iel = 0; iel < u.rows(); iel++)
+		for(int j = 0; j < u.cols(); j++)
+			buf(iel,j) = u(iel,j);
+
+	const auto start = std::chrono::steady_clock::now();
+	{
+		std::unique_lock<std::mutex> lock(mtx);
+		cv.wait(lock, [this]() { return !pending; });
+		report();
+
+		current = filling;
+		space = &spatial;
+		filename = fname;
+		pending = true;
+	}
+	cv.notify_all();
+	const std::chrono::duration<double> dt = std::chrono::steady_clock::now() - start;
+	waittime += dt.count();
+
+	filling = 1-filling;
+	nsnapshots++;
+}
+
+void AsyncOutput::finish()
+{
+	const auto start = std::chrono::steady_clock::now();
+	{
+		std::unique_lock<std::mutex> lock(mtx);
+		cv.wait(lock, [this]() { return !pending; });
+		report();
+	}
+	const std::chrono::duration<double> dt = std::chrono::steady_clock::now() - start;
+	waittime += dt.count();
+}
+
+}
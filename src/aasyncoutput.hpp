@@ -0,0 +1,96 @@
+/** @file aasyncoutput.hpp
+ * @brief Post-processing and writing of solutions on a background thread
+ * @author Aditya Kashi
+ *
+ * Computing nodal quantities and writing a VTU file take a while on large meshes, and doing
+ * so in the middle of a run would hold up the solver. Instead, the state is copied into a
+ * snapshot and the rest is done by an output thread while the iterations go on. There are two
+ * snapshot buffers, so that a new snapshot can be copied while the previous one is still being
+ * written; the solver only waits if it hands over a snapshot before the previous one is done.
+ *
+ * The output thread uses OpenMP threads of its own for the nodal averaging, and so competes
+ * with the solver for cores while intermediate solutions are written.
+ */
+
+#ifndef __AASYNCOUTPUT_H
+#define __AASYNCOUTPUT_H 1
+
+#ifndef __ASPATIAL_H
+#include "aspatial.hpp"
+#endif
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace acfd {
+
+/// Writes snapshots of the solution as nodal data in VTU files on a background thread
+class AsyncOutput
+{
+	const UMesh2dh *const m;
+	const int nthreads;					///< Size of the output thread's OpenMP team
+
+	MVector snap[2];					///< Snapshot buffers
+	int filling;						///< Index of the buffer into which the next snapshot goes
+
+	std::thread worker;
+	std::mutex mtx;
+	std::condition_variable cv;
+
+	/// Whether a snapshot has been handed over and is not yet written
+	bool pending;
+	/// Set when the output thread should exit
+	bool quit;
+
+	int current;						///< Index of the buffer being written
+	const EulerFV* space;				///< Discretization used to post-process it
+	std::string filename;				///< File it is written to
+
+	/// Details of the last completed output, reported by the calling thread
+	bool unreported;
+	std::string donefile;
+	a_real entropy;
+	double writetime;
+
+	int nsnapshots;						///< Number of snapshots requested so far
+	double waittime;					///< Time for which callers were blocked
+
+	/// Work loop of the output thread
+	void run();
+
+	/// Prints the details of the last completed output if not done yet; needs the lock
+	void report();
+
+public:
+	/// Starts the output thread
+	/** \param[in] mesh The mesh on which solutions are given
+	 * \param[in] num_threads Number of OpenMP threads used for post-processing; if zero,
+	 *   the OpenMP default is used.
+	 */
+	AsyncOutput(const UMesh2dh *const mesh, const int num_threads = 0);
+
+	/// Waits for the last snapshot to be written and stops the output thread
+	~AsyncOutput();
+
+	/// Copies a solution and has it written in the background
+	/** Blocks only until the previous snapshot, if any, has been written.
+	 * \param[in] spatial The discretization that computes nodal quantities; it is only read,
+	 *   but must not be changed (eg. by loaddata) until the output has been written
+	 * \param[in] u The state of all cells
+	 * \param[in] fname Name of the VTU file
+	 */
+	void request(const EulerFV& spatial, const MVector& u, const std::string fname);
+
+	/// Waits until all snapshots requested so far have been written
+	void finish();
+
+	/// Number of snapshots requested so far
+	int numSnapshots() const { return nsnapshots; }
+
+	/// Total time for which \ref request and \ref finish blocked the caller
+	double blockedTime() const { return waittime; }
+};
+
+}
+#endif
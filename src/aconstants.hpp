@@ -31,6 +31,12 @@
 #define NVARS 4
 #define NGAUSS 1
 
+/// Number of flow cases advanced together in ensemble mode
+/** Values of one variable for all members of an ensemble are contiguous, so this is best
+ * chosen as a multiple of the number of doubles in a SIMD register.
+ */
+#define NENSEMBLE 4
+
 #ifndef MESHDATA_DOUBLE_PRECISION
 #define MESHDATA_DOUBLE_PRECISION 20
 #endif
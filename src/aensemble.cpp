@@ -0,0 +1,515 @@
+/** @file aensemble.cpp
+ * @brief Implementation of ensemble discretization and pseudo-time solver
+ * @author Aditya Kashi
+ */
+
+#include "aensemble.hpp"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace acfd {
+
+EulerFVEnsemble::EulerFVEnsemble(const UMesh2dh *const mesh, std::string invflux,
+		std::string jacflux, std::string reconst, std::string limiter)
+	: m(mesh), members(NENSEMBLE, nullptr)
+{
+	std::cout << " EulerFVEnsemble: Setting up " << NENSEMBLE << " members.\n";
+	for(int k = 0; k < NENSEMBLE; k++) {
+		members[k] = new EulerFV(mesh, invflux, jacflux, "NONE", "NONE");
+		// face states of the whole ensemble are computed here, not by the members
+		members[k]->releaseWorkspace();
+		active[k] = true;
+	}
+
+	const int nv = NVARS*NENSEMBLE;
+	integ.setup(m->gnelem(), NENSEMBLE);
+	ug.setup(m->gnbface(), nv);
+	dudx.setup(m->gnelem(), nv);
+	dudy.setup(m->gnelem(), nv);
+	uleft.setup(m->gnaface(), nv);
+	uright.setup(m->gnaface(), nv);
+
+	// all members share the geometric data of the first
+	const EulerFV& geom = *members[0];
+
+	secondOrderRequested = true;
+	if(reconst == "LEASTSQUARES") {
+		rec = new WeightedLeastSquaresReconstruction<NVARS*NENSEMBLE>(m, &geom.rc, &geom.rcg);
+		std::cout << " EulerFVEnsemble: Weighted least-squares reconstruction will be used.\n";
+	}
+	else if(reconst == "GREENGAUSS") {
+		rec = new GreenGaussReconstruction<NVARS*NENSEMBLE>(m, &geom.rc, &geom.rcg);
+		std::cout << " EulerFVEnsemble: Green-Gauss reconstruction will be used.\n";
+	}
+	else {
+		rec = new ConstantReconstruction<NVARS*NENSEMBLE>(m, &geom.rc, &geom.rcg);
+		std::cout << " EulerFVEnsemble: No reconstruction; first order solution.\n";
+		secondOrderRequested = false;
+	}
+
+	if(limiter == "VANALBADA") {
+		lim = new VanAlbadaLimiter<NVARS*NENSEMBLE>(m, &geom.rcg, &geom.rc, geom.gr);
+		std::cout << " EulerFVEnsemble: Van Albada limiter selected.\n";
+	}
+	else {
+		if(limiter != "NONE")
+			std::cout << " ! EulerFVEnsemble: Limiter " << limiter
+				<< " is not available for ensembles; no limiter will be used.\n";
+		lim = new NoLimiter<NVARS*NENSEMBLE>(m, &geom.rcg, &geom.rc, geom.gr);
+	}
+}
+
+EulerFVEnsemble::~EulerFVEnsemble()
+{
+	delete rec;
+	delete lim;
+	for(int k = 0; k < NENSEMBLE; k++)
+		delete members[k];
+}
+
+void EulerFVEnsemble::loaddata(const int k, const short inittype, const a_real Minf,
+		const a_real vinf, const a_real a, const a_real rhoinf, MVector& u)
+{
+	MVector single(m->gnelem(), NVARS);
+	members[k]->loaddata(inittype, Minf, vinf, a, rhoinf, single);
+	insertMember(single, k, u);
+}
+
+void EulerFVEnsemble::extractMember(const MVector& ens, const int k, MVector& single)
+{
+#pragma omp parallel for default(shared)
+	for(a_int iel = 0; iel < ens.rows(); iel++)
+		for(int ivar = 0; ivar < NVARS; ivar++)
+			single(iel,ivar) = ens(iel, ivar*NENSEMBLE+k);
+}
+
+void EulerFVEnsemble::insertMember(const MVector& single, const int k, MVector& ens)
+{
+#pragma omp parallel for default(shared)
+	for(a_int iel = 0; iel < ens.rows(); iel++)
+		for(int ivar = 0; ivar < NVARS; ivar++)
+			ens(iel, ivar*NENSEMBLE+k) = single(iel,ivar);
+}
+
+void EulerFVEnsemble::compute_boundary_states(const amat::Array2d<a_real>& ins,
+		amat::Array2d<a_real>& bs)
+{
+	perf::ScopedTimer tmr(perf::BOUNDARY_STATES);
+#pragma omp parallel for default(shared)
+	for(a_int ied = 0; ied < m->gnbface(); ied++)
+	{
+		for(int k = 0; k < NENSEMBLE; k++)
+		{
+			if(!active[k])
+				continue;
+			a_real uin[NVARS], ubound[NVARS];
+			for(int ivar = 0; ivar < NVARS; ivar++)
+				uin[ivar] = ins.get(ied, ivar*NENSEMBLE+k);
+			members[k]->compute_boundary_state(ied, uin, ubound);
+			for(int ivar = 0; ivar < NVARS; ivar++)
+				bs(ied, ivar*NENSEMBLE+k) = ubound[ivar];
+		}
+	}
+}
+
+void EulerFVEnsemble::compute_residual(const MVector& u, MVector& __restrict residual,
+		const bool gettimesteps, amat::Array2d<a_real>& __restrict dtm)
+{
+	perf::ScopedTimer rtmr(perf::RESIDUAL);
+	const int nv = NVARS*NENSEMBLE;
+
+#pragma omp parallel default(shared)
+	{
+#pragma omp for
+		for(a_int iel = 0; iel < m->gnelem(); iel++)
+			for(int k = 0; k < NENSEMBLE; k++)
+				integ(iel,k) = 0;
+
+		// cell-centred values of boundary cells as left-side values of boundary faces
+#pragma omp for
+		for(a_int ied = 0; ied < m->gnbface(); ied++)
+		{
+			const a_int ielem = m->gintfac(ied,0);
+#pragma omp simd
+			for(int i = 0; i < nv; i++)
+				uleft(ied,i) = u(ielem,i);
+		}
+	}
+
+	if(secondOrderRequested)
+	{
+		compute_boundary_states(uleft, ug);
+		{
+			perf::ScopedTimer tmr(perf::GRADIENTS);
+			rec->compute_gradients(&u, &ug, &dudx, &dudy);
+		}
+		{
+			perf::ScopedTimer tmr(perf::LIMITER);
+			lim->compute_face_values(u, ug, dudx, dudy, uleft, uright);
+		}
+	}
+	else
+	{
+#pragma omp parallel for default(shared)
+		for(a_int ied = m->gnbface(); ied < m->gnaface(); ied++)
+		{
+			const a_int ielem = m->gintfac(ied,0);
+			const a_int jelem = m->gintfac(ied,1);
+#pragma omp simd
+			for(int i = 0; i < nv; i++) {
+				uleft(ied,i) = u(ielem,i);
+				uright(ied,i) = u(jelem,i);
+			}
+		}
+	}
+
+	compute_boundary_states(uleft, uright);
+
+	/* The geometry and connectivity of each face are loaded once for all members.
+	 * Numerical fluxes are computed member by member, only for active members.
+	 */
+	{
+		perf::ScopedTimer tmr(perf::FLUX);
+		const a_real g = members[0]->g;
+#pragma omp parallel for default(shared)
+		for(a_int ied = 0; ied < m->gnaface(); ied++)
+		{
+			a_real n[NDIM];
+			n[0] = m->ggallfa(ied,0);
+			n[1] = m->ggallfa(ied,1);
+			const a_real len = m->ggallfa(ied,2);
+			const a_int lelem = m->gintfac(ied,0);
+			const a_int relem = m->gintfac(ied,1);
+
+			for(int k = 0; k < NENSEMBLE; k++)
+			{
+				if(!active[k])
+					continue;
+
+				a_real ul[NVARS], ur[NVARS], fluxes[NVARS];
+				for(int ivar = 0; ivar < NVARS; ivar++) {
+					ul[ivar] = uleft(ied, ivar*NENSEMBLE+k);
+					ur[ivar] = uright(ied, ivar*NENSEMBLE+k);
+				}
+
+				members[k]->inviflux->get_flux(ul, ur, n, fluxes);
+
+				const a_real pi = (g-1)*(ul[3] - 0.5*(ul[1]*ul[1]+ul[2]*ul[2])/ul[0]);
+				const a_real pj = (g-1)*(ur[3] - 0.5*(ur[1]*ur[1]+ur[2]*ur[2])/ur[0]);
+				const a_real ci = sqrt(g*pi/ul[0]);
+				const a_real cj = sqrt(g*pj/ur[0]);
+				const a_real vni = (ul[1]*n[0] + ul[2]*n[1])/ul[0];
+				const a_real vnj = (ur[1]*n[0] + ur[2]*n[1])/ur[0];
+
+				for(int ivar = 0; ivar < NVARS; ivar++) {
+#pragma omp atomic
+					residual(lelem, ivar*NENSEMBLE+k) += fluxes[ivar]*len;
+				}
+#pragma omp atomic
+				integ(lelem,k) += (fabs(vni)+ci)*len;
+
+				if(relem < m->gnelem()) {
+					for(int ivar = 0; ivar < NVARS; ivar++) {
+#pragma omp atomic
+						residual(relem, ivar*NENSEMBLE+k) -= fluxes[ivar]*len;
+					}
+#pragma omp atomic
+					integ(relem,k) += (fabs(vnj)+cj)*len;
+				}
+			}
+		}
+	}
+
+	if(gettimesteps)
+	{
+		perf::ScopedTimer tmr(perf::TIMESTEP);
+#pragma omp parallel for default(shared)
+		for(a_int iel = 0; iel < m->gnelem(); iel++)
+			for(int k = 0; k < NENSEMBLE; k++)
+				dtm(iel,k) = active[k] ? m->garea(iel)/integ(iel,k) : 0;
+	}
+}
+
+SteadyEnsembleSolver::SteadyEnsembleSolver(const UMesh2dh *const mesh,
+		EulerFVEnsemble *const spatial, EulerFVEnsemble *const starterfv,
+		const int num_members, const short use_starter, const bool implicit_ts,
+		const double cfl_init, const double cfl_fin, const int ramp_start, const int ramp_end,
+		const double toler, const int maxits,
+		const double ftoler, const int fmaxits, const double fcfl_n,
+		const double lin_tol, const int linmaxiter_start, const int linmaxiter_end,
+		std::string linearsolver, std::string precond, const int mrestart,
+		const short nbuildsweeps, const short napplysweeps)
+	: m(mesh), eul(spatial), starter(starterfv), nmembers(num_members),
+	usestarter(use_starter), implicit(implicit_ts),
+	cflinit(cfl_init), cflfin(cfl_fin), rampstart(ramp_start), rampend(ramp_end),
+	tol(toler), maxiter(maxits), starttol(ftoler), startmaxiter(fmaxits), startcfl(fcfl_n),
+	lintol(lin_tol), linmaxiterstart(linmaxiter_start), linmaxiterend(linmaxiter_end),
+	A(nullptr), prec(nullptr), linsolv(nullptr)
+{
+	u.resize(m->gnelem(), NVARS*NENSEMBLE);
+	residual.resize(m->gnelem(), NVARS*NENSEMBLE);
+	memory::firstTouch(u);
+	memory::firstTouch(residual);
+	dtm.setup(m->gnelem(), NENSEMBLE);
+
+	for(int k = 0; k < NENSEMBLE; k++) {
+		nsteps[k] = 0;
+		relres[k] = 1.0;
+	}
+
+	if(!implicit)
+		return;
+
+	du.resize(m->gnelem(), NVARS*NENSEMBLE);
+	memory::firstTouch(du);
+	uk.resize(m->gnelem(), NVARS);
+	resk.resize(m->gnelem(), NVARS);
+	duk.resize(m->gnelem(), NVARS);
+	memory::firstTouch(uk);
+	memory::firstTouch(resk);
+	memory::firstTouch(duk);
+
+	A = new blasted::DLUMatrix<NVARS>(m, nbuildsweeps, napplysweeps);
+
+	if(precond == "J")
+		prec = new Jacobi<NVARS>(A);
+	else if(precond == "SGS")
+		prec = new SGS<NVARS>(A);
+	else if(precond == "ILU0")
+		prec = new ILU0<NVARS>(A);
+	else if(precond == "LINEJ")
+		prec = new LineJacobi<NVARS>(A);
+	else if(precond == "LINESGS")
+		prec = new LineSGS<NVARS>(A);
+	else if(precond == "POLY")
+		prec = new Polynomial<NVARS>(A, napplysweeps);
+	else if(precond == "ASILU0")
+		prec = new AdditiveSchwarz<NVARS>(A, nbuildsweeps);
+	else
+		prec = new NoPrec<NVARS>(A);
+
+	if(linearsolver == "BCGSTB")
+		linsolv = new BiCGSTAB<NVARS>(m, A, prec);
+	else if(linearsolver == "GMRES")
+		linsolv = new GMRES<NVARS>(m, A, prec, mrestart);
+	else if(linearsolver == "GCRODR")
+		linsolv = new GCRODR<NVARS>(m, A, prec, mrestart, std::max(1,mrestart/4));
+	else if(linearsolver == "ANDERSON")
+		linsolv = new RichardsonSolver<NVARS>(m, A, prec, mrestart);
+	else
+		linsolv = new RichardsonSolver<NVARS>(m, A, prec);
+
+	std::cout << " SteadyEnsembleSolver: Implicit time stepping with " << linearsolver
+		<< " solver and " << precond << " preconditioner, one member at a time.\n";
+}
+
+SteadyEnsembleSolver::~SteadyEnsembleSolver()
+{
+	delete linsolv;
+	delete prec;
+	delete A;
+}
+
+int SteadyEnsembleSolver::step(EulerFVEnsemble *const space, const double cfl,
+		const int linmaxiter, a_real *const resnorms)
+{
+#pragma omp parallel for default(shared)
+	for(a_int iel = 0; iel < m->gnelem(); iel++)
+		for(int i = 0; i < NVARS*NENSEMBLE; i++)
+			residual(iel,i) = 0;
+
+	space->compute_residual(u, residual, true, dtm);
+
+	int linsteps = 0;
+	if(!implicit)
+	{
+#pragma omp parallel for default(shared)
+		for(a_int iel = 0; iel < m->gnelem(); iel++)
+		{
+			const a_real fac = cfl/m->garea(iel);
+			for(int ivar = 0; ivar < NVARS; ivar++)
+#pragma omp simd
+				for(int k = 0; k < NENSEMBLE; k++)
+					u(iel,ivar*NENSEMBLE+k) -= fac*dtm(iel,k)*residual(iel,ivar*NENSEMBLE+k);
+		}
+	}
+	else
+	{
+		int nactive = 0;
+
+		for(int k = 0; k < NENSEMBLE; k++)
+		{
+			if(!space->isActive(k))
+				continue;
+			nactive++;
+
+			EulerFVEnsemble::extractMember(u, k, uk);
+			EulerFVEnsemble::extractMember(residual, k, resk);
+			EulerFVEnsemble::extractMember(du, k, duk);
+
+			A->setAllZero();
+			space->member(k).compute_jacobian(uk, A);
+
+#pragma omp parallel for default(shared)
+			for(a_int iel = 0; iel < m->gnelem(); iel++)
+			{
+				Matrix<a_real,NVARS,NVARS,RowMajor> db
+					= Matrix<a_real,NVARS,NVARS,RowMajor>::Zero();
+				for(short i = 0; i < NVARS; i++)
+					db(i,i) = m->garea(iel) / (cfl*dtm(iel,k));
+				A->updateDiagBlock(iel*NVARS, db.data(), NVARS);
+			}
+
+			// as in SteadyBackwardEulerSolver, the last update is the initial guess
+			linsolv->setupPreconditioner();
+			linsolv->setParams(lintol, linmaxiter);
+			linsteps += linsolv->solve(resk, duk);
+
+#pragma omp parallel for default(shared)
+			for(a_int iel = 0; iel < m->gnelem(); iel++)
+				uk.row(iel) += duk.row(iel);
+			EulerFVEnsemble::insertMember(uk, k, u);
+			EulerFVEnsemble::insertMember(duk, k, du);
+		}
+
+		if(nactive > 0)
+			linsteps /= nactive;
+	}
+
+	a_real errmass[NENSEMBLE];
+	for(int k = 0; k < NENSEMBLE; k++)
+		errmass[k] = 0;
+
+#pragma omp parallel for default(shared) reduction(+:errmass[:NENSEMBLE])
+	for(a_int iel = 0; iel < m->gnelem(); iel++)
+		for(int k = 0; k < NENSEMBLE; k++)
+			errmass[k] += residual(iel,k)*residual(iel,k)*m->garea(iel);
+
+	for(int k = 0; k < NENSEMBLE; k++)
+		if(space->isActive(k))
+			resnorms[k] = sqrt(errmass[k]);
+
+	return linsteps;
+}
+
+void SteadyEnsembleSolver::solve(std::string logfile, const int firstcase)
+{
+	struct timeval time1, time2;
+	gettimeofday(&time1, NULL);
+	double initialwtime = (double)time1.tv_sec + (double)time1.tv_usec * 1.0e-6;
+	double initialctime = (double)clock() / (double)CLOCKS_PER_SEC;
+
+	a_real resnorms[NENSEMBLE], initres[NENSEMBLE];
+	int linsteps = 0;
+
+	std::ofstream convout[NENSEMBLE];
+	for(int k = 0; k < nmembers; k++)
+		convout[k].open(logfile + "-case" + std::to_string(firstcase+k) + ".conv",
+				std::ofstream::app);
+
+	if(usestarter == 1)
+	{
+		for(int k = 0; k < NENSEMBLE; k++)
+			starter->setActive(k, k < nmembers);
+
+		int step = 0, nactive = nmembers;
+		while(nactive > 0 && step < startmaxiter)
+		{
+			linsteps = this->step(starter, startcfl, linmaxiterstart, resnorms);
+
+			for(int k = 0; k < nmembers; k++)
+			{
+				if(!starter->isActive(k))
+					continue;
+				if(step == 0)
+					initres[k] = resnorms[k];
+				if(resnorms[k]/initres[k] < starttol) {
+					starter->setActive(k, false);
+					nactive--;
+				}
+			}
+
+			if(step % 10 == 0)
+				std::cout << "  SteadyEnsembleSolver: solve(): Initial step " << step
+					<< ", " << nactive << " members active, lin iters " << linsteps << std::endl;
+			step++;
+		}
+		std::cout << "  SteadyEnsembleSolver: solve(): Initial approximate solve done, steps = "
+			<< step << ".\n";
+	}
+
+	for(int k = 0; k < NENSEMBLE; k++)
+		eul->setActive(k, k < nmembers);
+
+	std::cout << "  SteadyEnsembleSolver: solve(): Starting main solver.\n";
+	int step = 0, nactive = nmembers;
+	while(nactive > 0 && step < maxiter)
+	{
+		// as in SteadyForwardEulerSolver, the explicit scheme uses a fixed CFL number
+		double curCFL; int curlinmaxiter;
+		if(step < rampstart || !implicit) {
+			curCFL = cflinit;
+			curlinmaxiter = linmaxiterstart;
+		}
+		else if(step < rampend && rampend-rampstart > 0) {
+			curCFL = cflinit + (cflfin-cflinit)/(rampend-rampstart)*(step-rampstart);
+			curlinmaxiter = int(linmaxiterstart
+					+ double(linmaxiterend-linmaxiterstart)/(rampend-rampstart)*(step-rampstart));
+		}
+		else {
+			curCFL = cflfin;
+			curlinmaxiter = linmaxiterend;
+		}
+
+		linsteps = this->step(eul, curCFL, curlinmaxiter, resnorms);
+
+		for(int k = 0; k < nmembers; k++)
+		{
+			if(!eul->isActive(k))
+				continue;
+			if(step == 0)
+				initres[k] = resnorms[k];
+			relres[k] = resnorms[k]/initres[k];
+			nsteps[k] = step+1;
+			convout[k] << step+1 << " " << std::setw(10) << relres[k] << '\n';
+
+			// converged members drop out of the active set
+			if(relres[k] < tol) {
+				eul->setActive(k, false);
+				nactive--;
+				std::cout << "  SteadyEnsembleSolver: solve(): Case " << firstcase+k
+					<< " converged in " << step+1 << " steps.\n";
+			}
+		}
+
+		if(step % 50 == 0)
+			std::cout << "  SteadyEnsembleSolver: solve(): Step " << step << ", " << nactive
+				<< " members active, lin iters " << linsteps << std::endl;
+		step++;
+	}
+
+	for(int k = 0; k < nmembers; k++) {
+		convout[k].close();
+		if(eul->isActive(k))
+			std::cout << "! SteadyEnsembleSolver: solve(): Case " << firstcase+k
+				<< " exceeded max iterations!\n";
+	}
+
+	gettimeofday(&time2, NULL);
+	const double walltime = (double)time2.tv_sec + (double)time2.tv_usec*1.0e-6 - initialwtime;
+	const double cputime = (double)clock() / (double)CLOCKS_PER_SEC - initialctime;
+	std::cout << " SteadyEnsembleSolver: solve(): Time taken for " << nmembers << " cases:\n";
+	std::cout << " \t\tWall time = " << walltime << ", CPU time = " << cputime << "\n\n";
+
+	int numthreads = 0;
+#ifdef _OPENMP
+	numthreads = omp_get_max_threads();
+#endif
+	std::ofstream outf; outf.open(logfile, std::ofstream::app);
+	outf << "\t" << numthreads << "\t" << nmembers << "\t" << walltime << "\t" << cputime << "\n";
+	outf.close();
+}
+
+}
@@ -0,0 +1,191 @@
+/** @file aensemble.hpp
+ * @brief Simultaneous solution of the Euler equations at several flow conditions on one mesh
+ * @author Aditya Kashi
+ *
+ * An ensemble consists of NENSEMBLE independent cases, for example the points of a polar.
+ * The states of all members are stored in one multi-vector with NVARS*NENSEMBLE columns,
+ * laid out as [cell][variable][member]: the value of variable ivar of member k in cell iel is
+ * u(iel, ivar*NENSEMBLE + k). One traversal of the mesh then serves all members, so the
+ * connectivity and geometry are read once per sweep instead of once per case, and loops over
+ * the members of one variable are contiguous and vectorize.
+ *
+ * Members can be deactivated, for instance once they have converged; their states are then
+ * left unchanged and the numerical fluxes are not computed for them.
+ */
+
+#ifndef __AENSEMBLE_H
+#define __AENSEMBLE_H 1
+
+#ifndef __AODESOLVER_H
+#include "aodesolver.hpp"
+#endif
+
+namespace acfd {
+
+/// Finite volume discretization of the Euler equations for an ensemble of flow conditions
+/** Each member has its own free-stream state, and therefore its own boundary conditions.
+ * Gradients and face values are computed for all members together, by the
+ * reconstruction and limiter schemes instantiated for NVARS*NENSEMBLE values per cell.
+ */
+class EulerFVEnsemble
+{
+protected:
+	const UMesh2dh *const m;
+
+	/// Discretization of each member, used for boundary states, Jacobians and output
+	std::vector<EulerFV*> members;
+
+	/// Whether each member takes part in residual computations
+	bool active[NENSEMBLE];
+
+	Reconstruction* rec;					///< Gradients of all members
+	FaceDataComputation* lim;				///< Face values of all members
+	bool secondOrderRequested;
+
+	amat::Array2d<a_real> integ;			///< Integrated spectral radii, one column per member
+	amat::Array2d<a_real> ug;				///< Ghost cell states
+	amat::Array2d<a_real> dudx;				///< X-gradients at cell centres
+	amat::Array2d<a_real> dudy;				///< Y-gradients at cell centres
+	amat::Array2d<a_real> uleft;			///< Left states at faces
+	amat::Array2d<a_real> uright;			///< Right states at faces
+
+	/// Computes ghost states of active members from the interior states at boundary faces
+	void compute_boundary_states(const amat::Array2d<a_real>& instates,
+			amat::Array2d<a_real>& bounstates);
+
+public:
+	/// Sets up the members and the numerics shared by them
+	/** \param[in] invflux The inviscid flux to use - VANLEER, ROE, HLL, HLLC, LLF
+	 * \param[in] jacflux The inviscid flux used for computing the first-order Jacobian
+	 * \param[in] reconst The method used for gradient reconstruction
+	 *   - NONE, GREENGAUSS, LEASTSQUARES
+	 * \param[in] limiter NONE or VANALBADA; other limiters are not available for ensembles
+	 */
+	EulerFVEnsemble(const UMesh2dh *const mesh, std::string invflux, std::string jacflux,
+			std::string reconst, std::string limiter);
+
+	~EulerFVEnsemble();
+
+	/// Sets the free-stream condition of a member and initializes its part of u
+	/** \param[in] k Index of the member
+	 * The other parameters are as in EulerFV::loaddata.
+	 */
+	void loaddata(const int k, const short inittype, const a_real Minf, const a_real vinf,
+			const a_real a, const a_real rhoinf, MVector& u);
+
+	/// Adds the residuals of all active members to residual and computes their time steps
+	/** \param[in] u States of all members in ensemble layout
+	 * \param[in|out] residual The residual is added to this, in ensemble layout
+	 * \param[in] gettimesteps Whether time-step computation is required
+	 * \param[out] dtm Local time steps, one column per member; zero for inactive members
+	 */
+	void compute_residual(const MVector& u, MVector& __restrict residual,
+			const bool gettimesteps, amat::Array2d<a_real>& __restrict dtm);
+
+	/// Includes or excludes a member from subsequent residual computations
+	void setActive(const int k, const bool act) { active[k] = act; }
+
+	bool isActive(const int k) const { return active[k]; }
+
+	/// The discretization of one member, for Jacobians and output
+	EulerFV& member(const int k) { return *members[k]; }
+
+	/// Copies the state of one member out of an ensemble multi-vector
+	static void extractMember(const MVector& ens, const int k, MVector& single);
+
+	/// Copies the state of one member into an ensemble multi-vector
+	static void insertMember(const MVector& single, const int k, MVector& ens);
+};
+
+/// Pseudo-time iteration to steady state of all members of an ensemble
+/** The residual of the whole ensemble is computed in one sweep. In the explicit case, all
+ * members are then updated together. In the implicit case, the first-order Jacobian of each
+ * active member is assembled into one DLU matrix in turn and its linear system solved;
+ * the linear algebra is therefore not shared between members.
+ *
+ * Each member is deactivated as soon as its relative residual falls below the tolerance.
+ * Optionally runs a `starter' loop with another ensemble discretization first, as
+ * SteadyForwardEulerSolver and SteadyBackwardEulerSolver do.
+ */
+class SteadyEnsembleSolver
+{
+protected:
+	const UMesh2dh *const m;
+	EulerFVEnsemble *const eul;
+	EulerFVEnsemble *const starter;
+	const int nmembers;						///< Number of members holding actual cases
+	const short usestarter;
+	const bool implicit;
+
+	MVector u;								///< States in ensemble layout
+	MVector residual;						///< Residuals in ensemble layout
+	amat::Array2d<a_real> dtm;				///< Local time steps of each member
+	MVector du;								///< Last implicit update of each member
+	MVector uk;								///< State of the member being solved implicitly
+	MVector resk;							///< Residual of the member being solved implicitly
+	MVector duk;							///< Update of the member being solved implicitly
+
+	const double cflinit, cflfin;
+	const int rampstart, rampend;
+	const double tol;
+	const int maxiter;
+	const double starttol;
+	const int startmaxiter;
+	const double startcfl;
+
+	const double lintol;
+	const int linmaxiterstart, linmaxiterend;
+
+	blasted::DLUMatrix<NVARS>* A;			///< Jacobian storage reused by all members
+	Preconditioner<NVARS>* prec;
+	IterativeSolver<NVARS>* linsolv;
+
+	int nsteps[NENSEMBLE];					///< Number of main-loop steps taken by each member
+	a_real relres[NENSEMBLE];				///< Last relative residual of each member
+
+	/// Takes one pseudo-time step of all active members of a discretization
+	/** \param[out] resnorms Residual norm of each member; not set for inactive members
+	 * \return Average number of linear solver iterations, or zero for explicit steps
+	 */
+	int step(EulerFVEnsemble *const space, const double cfl, const int linmaxiter,
+			a_real *const resnorms);
+
+public:
+	/** The parameters are as in SteadyBackwardEulerSolver; the linear solver parameters are
+	 * only used for implicit time stepping, for which only DLU matrices are supported.
+	 * Explicit time stepping uses cfl_init throughout.
+	 * \param[in] num_members Number of members that hold cases; further members are never
+	 *   activated
+	 * \param[in] implicit_ts Whether to use backward Euler rather than forward Euler
+	 */
+	SteadyEnsembleSolver(const UMesh2dh *const mesh, EulerFVEnsemble *const spatial,
+			EulerFVEnsemble *const starterfv, const int num_members, const short use_starter,
+			const bool implicit_ts,
+			const double cfl_init, const double cfl_fin, const int ramp_start, const int ramp_end,
+			const double toler, const int maxits,
+			const double ftoler, const int fmaxits, const double fcfl_n,
+			const double lin_tol, const int linmaxiter_start, const int linmaxiter_end,
+			std::string linearsolver, std::string precond, const int mrestart,
+			const short nbuildsweeps, const short napplysweeps);
+
+	~SteadyEnsembleSolver();
+
+	/// Write access to the states of all members
+	MVector& unknowns() { return u; }
+
+	/// Solves all members to steady state
+	/** \param[in] logfile Run times are appended to this file, and the convergence history
+	 *   of member k is written to logfile-case<firstcase+k>.conv
+	 * \param[in] firstcase Index of the case held by the first member, for log files
+	 */
+	void solve(std::string logfile, const int firstcase);
+
+	/// Number of main-loop steps needed by a member
+	int steps(const int k) const { return nsteps[k]; }
+
+	/// Final relative residual of a member
+	a_real relativeResidual(const int k) const { return relres[k]; }
+};
+
+}
+#endif
@@ -31,12 +31,14 @@ void FaceDataComputation::setup(const UMesh2dh* mesh,
 	ng = gr[0].rows();
 }
 
-NoLimiter::NoLimiter(const UMesh2dh* mesh, const amat::Array2d<a_real>* ghost_centres, 
+template <short nvars>
+NoLimiter<nvars>::NoLimiter(const UMesh2dh* mesh, const amat::Array2d<a_real>* ghost_centres, 
 		const amat::Array2d<a_real>* c_centres, const amat::Array2d<a_real>* gauss_r)
 	: FaceDataComputation(mesh, ghost_centres, c_centres, gauss_r)
 { }
 
-void NoLimiter::compute_face_values(const Matrix<a_real,Dynamic,Dynamic,RowMajor>& u, 
+template <short nvars>
+void NoLimiter<nvars>::compute_face_values(const Matrix<a_real,Dynamic,Dynamic,RowMajor>& u, 
 		const amat::Array2d<a_real>& ug,
 		const amat::Array2d<a_real>& dudx, const amat::Array2d<a_real>& dudy, 
 		amat::Array2d<a_real>& ufl, amat::Array2d<a_real>& ufr)
@@ -54,7 +56,7 @@ void NoLimiter::compute_face_values(const Matrix<a_real,Dynamic,Dynamic,RowMajor
 			//cout << "VanAlbadaLimiter: compute_interface_values(): iterate over gauss points..\n";
 			for(int ig = 0; ig < NGAUSS; ig++)      // iterate over gauss points
 			{
-				for(int i = 0; i < NVARS; i++)
+				for(int i = 0; i < nvars; i++)
 				{
 
 					ufl(ied,i) = u(ielem,i) 
@@ -75,7 +77,7 @@ void NoLimiter::compute_face_values(const Matrix<a_real,Dynamic,Dynamic,RowMajor
 
 			for(int ig = 0; ig < NGAUSS; ig++)
 			{
-				for(int i = 0; i < NVARS; i++)
+				for(int i = 0; i < nvars; i++)
 					ufl(ied,i) = u(ielem,i) 
 						+ dudx(ielem,i)*(gr[ied].get(ig,0)-ri->get(ielem,0)) 
 						+ dudy(ielem,i)*(gr[ied].get(ig,1)-ri->get(ielem,1));
@@ -184,17 +186,19 @@ void WENOLimiter::compute_face_values(const Matrix<a_real,Dynamic,Dynamic,RowMaj
 	} // end parallel region
 }
 
-VanAlbadaLimiter::VanAlbadaLimiter(const UMesh2dh* mesh, const amat::Array2d<a_real>* ghost_centres, 
+template <short nvars>
+VanAlbadaLimiter<nvars>::VanAlbadaLimiter(const UMesh2dh* mesh, const amat::Array2d<a_real>* ghost_centres, 
 		const amat::Array2d<a_real>* r_centres, const amat::Array2d<a_real>* gauss_r)
 	: FaceDataComputation(mesh, ghost_centres, r_centres, gauss_r)
 {
 	eps = 1e-8;
 	k = 1.0/3.0;
-	phi_l.resize(m->gnaface(), NVARS);
-	phi_r.resize(m->gnaface(), NVARS);
+	phi_l.resize(m->gnaface(), nvars);
+	phi_r.resize(m->gnaface(), nvars);
 }
 
-void VanAlbadaLimiter::compute_face_values(const Matrix<a_real,Dynamic,Dynamic,RowMajor>& u, 
+template <short nvars>
+void VanAlbadaLimiter<nvars>::compute_face_values(const Matrix<a_real,Dynamic,Dynamic,RowMajor>& u, 
 		const amat::Array2d<a_real>& ug,
 		const amat::Array2d<a_real>& dudx, const amat::Array2d<a_real>& dudy, 
 		amat::Array2d<a_real>& ufl, amat::Array2d<a_real>& ufr)
@@ -204,7 +208,7 @@ void VanAlbadaLimiter::compute_face_values(const Matrix<a_real,Dynamic,Dynamic,R
 	for(a_int ied = 0; ied < m->gnbface(); ied++)
 	{
 		int lel = m->gintfac(ied,0);
-		for(int i = 0; i < NVARS; i++)
+		for(int i = 0; i < nvars; i++)
 		{
 			a_real deltam;
 			deltam = 2 * ( dudx(lel,i)*(rb->get(ied,0)-ri->get(lel,0)) 
@@ -220,7 +224,7 @@ void VanAlbadaLimiter::compute_face_values(const Matrix<a_real,Dynamic,Dynamic,R
 	{
 		a_int lel = m->gintfac(ied,0);
 		a_int rel = m->gintfac(ied,1);
-		for(int i = 0; i < NVARS; i++)
+		for(int i = 0; i < nvars; i++)
 		{
 			a_real deltam, deltap;
 			deltam = 2 * ( dudx(lel,i)*(ri->get(rel,0)-ri->get(lel,0)) 
@@ -250,7 +254,7 @@ void VanAlbadaLimiter::compute_face_values(const Matrix<a_real,Dynamic,Dynamic,R
 		//cout << "VanAlbadaLimiter: compute_interface_values(): iterate over gauss points..\n";
 		for(int ig = 0; ig < ng; ig++)      // iterate over gauss points
 		{
-			for(int i = 0; i < NVARS; i++)
+			for(int i = 0; i < nvars; i++)
 			{
 				a_real deltam, deltap;
 				deltam = 2 * ( dudx(ielem,i)*(ri->get(jelem,0)-ri->get(ielem,0)) 
@@ -417,5 +421,9 @@ void VenkatakrishnanLimiter::compute_face_values(const Matrix<a_real,Dynamic,Dyn
 	}
 }
 
-} // end namespace
+template class NoLimiter<NVARS>;
+template class VanAlbadaLimiter<NVARS>;
+template class NoLimiter<NVARS*NENSEMBLE>;
+template class VanAlbadaLimiter<NVARS*NENSEMBLE>;
 
+} // end namespace
@@ -51,13 +51,19 @@ public:
 			const amat::Array2d<a_real>& x_deriv, const amat::Array2d<a_real>& y_deriv,
 			amat::Array2d<a_real>& uface_left, amat::Array2d<a_real>& uface_right) = 0;
 
+	/// Memory used by the data of the limiter in bytes
+	virtual size_t bytes() const { return 0; }
+
 	virtual ~FaceDataComputation();
 };
 
 /// Calculate values of variables at left and right sides of each face 
 /// based on computed derivatives but without limiter.
 /** ug (cell centered flow variables at ghost cells) are not used for this
+ * \tparam nvars Number of values per cell; this can be the number of variables times the
+ *   number of members of an ensemble, as each value is extrapolated independently
  */
+template <short nvars>
 class NoLimiter : public FaceDataComputation
 {
 public:
@@ -99,9 +105,14 @@ public:
 			const amat::Array2d<a_real>& unknow_ghost, 
 			const amat::Array2d<a_real>& x_deriv, const amat::Array2d<a_real>& y_deriv, 
 			amat::Array2d<a_real>& uface_left, amat::Array2d<a_real>& uface_right);
+
+	size_t bytes() const { return ldudx.bytes() + ldudy.bytes(); }
 };
 
 /// Computes face values using the `3rd-order' MUSCL scheme with Van-Albada limiter
+/** \tparam nvars Number of values per cell; the limiter acts on each value independently
+ */
+template <short nvars>
 class VanAlbadaLimiter : public FaceDataComputation
 {
     a_real eps;							///< Small number
@@ -118,6 +129,8 @@ public:
 			const amat::Array2d<a_real>& unknow_ghost, 
 			const amat::Array2d<a_real>& x_deriv, const amat::Array2d<a_real>& y_deriv, 
 			amat::Array2d<a_real>& uface_left, amat::Array2d<a_real>& uface_right);
+
+	size_t bytes() const { return phi_l.bytes() + phi_r.bytes(); }
 };
 
 /// Non-differentiable multidimensional slope limiter
@@ -158,6 +171,8 @@ public:
 			const amat::Array2d<a_real>& unknow_ghost, 
 			const amat::Array2d<a_real>& x_deriv, const amat::Array2d<a_real>& y_deriv, 
 			amat::Array2d<a_real>& uface_left, amat::Array2d<a_real>& uface_right);
+
+	size_t bytes() const { return clength.capacity()*sizeof(a_real); }
 };
 
 } // end namespace
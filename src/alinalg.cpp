@@ -2,6 +2,15 @@
 #include <algorithm>
 #include <Eigen/LU>
 #include <Eigen/QR>
+#include <Eigen/Eigenvalues>
+#include <numeric>
+#include <complex>
+#include <limits>
+#include <unordered_set>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #define THREAD_CHUNK_SIZE 200
 
@@ -9,15 +18,21 @@ namespace blasted {
 
 template <int bs>
 DLUMatrix<bs>::DLUMatrix(const acfd::UMesh2dh *const mesh, 
-	const short n_buildsweeps, const short n_applysweeps)
+	const short n_buildsweeps, const short n_applysweeps,
+	const acfd::HaloExchange *const haloexchange)
 	: LinearOperator<a_real,a_int>('d'),
-	  m(mesh), D(nullptr), L(nullptr), U(nullptr), luD(nullptr), luL(nullptr), luU(nullptr),
+	  m(mesh), D(nullptr), L(nullptr), U(nullptr), halo(haloexchange), B(nullptr),
+	  luD(nullptr), luL(nullptr), luU(nullptr), inplace(false),
 	  nbuildsweeps(n_buildsweeps), napplysweeps(n_applysweeps),
-	  thread_chunk_size(200)
+	  thread_chunk_size(200), lineD(nullptr), schwarzoverlap(0)
 {
-	D = new Matrix<a_real,bs,bs,RowMajor>[m->gnelem()];
-	L = new Matrix<a_real,bs,bs,RowMajor>[m->gnaface()-m->gnbface()];
-	U = new Matrix<a_real,bs,bs,RowMajor>[m->gnaface()-m->gnbface()];
+	D = acfd::memory::allocateArray<Matrix<a_real,bs,bs,RowMajor>>(m->gnelem());
+	L = acfd::memory::allocateArray<Matrix<a_real,bs,bs,RowMajor>>(m->gnaface()-m->gnbface());
+	U = acfd::memory::allocateArray<Matrix<a_real,bs,bs,RowMajor>>(m->gnaface()-m->gnbface());
+	if(halo) {
+		B = acfd::memory::allocateArray<Matrix<a_real,bs,bs,RowMajor>>(m->gnbface());
+		xhalo = MVector::Zero(m->gnbface(),bs);
+	}
 #ifdef DEBUG
 	std::cout << " DLUMatrix: Setting up\n";
 #endif
@@ -26,16 +41,24 @@ DLUMatrix<bs>::DLUMatrix(const acfd::UMesh2dh *const mesh,
 template <int bs>
 DLUMatrix<bs>::~DLUMatrix()
 {
-	delete [] D;
-	delete [] U;
-	delete [] L;
-	if(luD)
-		delete [] luD;
-	if(luL)
-		delete [] luL;
-	if(luU)
-		delete [] luU;
-	D=L=U=luD=luU=luL = nullptr;
+	acfd::memory::deallocate(D);
+	acfd::memory::deallocate(U);
+	acfd::memory::deallocate(L);
+	acfd::memory::deallocate(B);
+	// factors computed in place are not separately allocated
+	if(luD && luD != D)
+		acfd::memory::deallocate(luD);
+	if(luL && luL != L)
+		acfd::memory::deallocate(luL);
+	if(luU && luU != U)
+		acfd::memory::deallocate(luU);
+	if(lineD)
+		acfd::memory::deallocate(lineD);
+	for(size_t isd = 0; isd < subdomains.size(); isd++) {
+		acfd::memory::deallocate(subdomains[isd].Dinv);
+		acfd::memory::deallocate(subdomains[isd].off);
+	}
+	D=L=U=luD=luU=luL=lineD = nullptr;
 }
 
 template <int bs>
@@ -54,6 +77,9 @@ void DLUMatrix<bs>::setAllZero()
 				L[ifa](i,j) = 0;
 				U[ifa](i,j) = 0;
 			}
+	if(B)
+		for(a_int iface = 0; iface < m->gnbface(); iface++)
+			B[iface] = Matrix<a_real,bs,bs,RowMajor>::Zero();
 }
 
 template <int bs>
@@ -82,6 +108,11 @@ void DLUMatrix<bs>::submitBlock(const a_int starti, const a_int startj,
 	else if(lud == 2)
 		for(int i = 0; i < bs2; i++)
 			U[faceid].data()[i] = buffer[i];
+	else if(lud == 3) {
+		if(B)
+			for(int i = 0; i < bs2; i++)
+				B[faceid].data()[i] = buffer[i];
+	}
 	else {
 		std::cout << "! DLUMatrix: submitBlock: Error in face index!!\n";
 	}
@@ -128,6 +159,10 @@ void DLUMatrix<bs>::apply(const a_real q, const a_real *const xx,
 	Eigen::Map<const MVector> x(xx, m->gnelem(),bs);
 	Eigen::Map<MVector> z(zz, m->gnelem(),bs);
 
+	// the local product overlaps the communication of x
+	if(halo)
+		halo->beginCells(xx, bs);
+
 #pragma omp parallel for default(shared)
 	for(a_int iel = 0; iel < m->gnelem(); iel++)
 	{
@@ -151,6 +186,22 @@ void DLUMatrix<bs>::apply(const a_real q, const a_real *const xx,
 			}
 		}
 	}
+
+	if(halo)
+		addHaloProducts(q, z);
+}
+
+template <int bs>
+void DLUMatrix<bs>::addHaloProducts(const a_real a, Eigen::Map<MVector>& z) const
+{
+	halo->end(xhalo.data());
+	// a cell can have more than one shared face, and there are few such faces
+	for(a_int i = 0; i < halo->numFaces(); i++)
+	{
+		const a_int iface = halo->face(i);
+		const a_int iel = m->gintfac(iface,0);
+		z.row(iel).noalias() += a*xhalo.row(iface)*B[iface].transpose();
+	}
 }
 
 
@@ -163,6 +214,9 @@ void DLUMatrix<bs>::gemv3(const a_real a, const a_real *const __restrict xx, con
 	Eigen::Map<const MVector> y(yy, m->gnelem(),bs);
 	Eigen::Map<MVector> z(zz, m->gnelem(),bs);
 
+	if(halo)
+		halo->beginCells(xx, bs);
+
 #pragma omp parallel for default(shared)
 	for(a_int iel = 0; iel < m->gnelem(); iel++)
 	{
@@ -187,6 +241,9 @@ void DLUMatrix<bs>::gemv3(const a_real a, const a_real *const __restrict xx, con
 		}
 	}
 
+	if(halo)
+		addHaloProducts(a, z);
+
 /* We can also express the computation without if statement as follows.
  * We first loop over cells to compute contributions from diagonal blocks,
  * and then loop over faces, to *scatter* contributions from L and U blocks.
@@ -210,14 +267,16 @@ void DLUMatrix<bs>::gemv3(const a_real a, const a_real *const __restrict xx, con
 template <int bs>
 void DLUMatrix<bs>::precJacobiSetup()
 {
-	if(!luD) {
-		luD = new Matrix<a_real,bs,bs,RowMajor>[m->gnelem()];
+	if(!luD && inplace)
+		luD = D;
+	else if(!luD) {
+		luD = acfd::memory::allocateArray<Matrix<a_real,bs,bs,RowMajor>>(m->gnelem());
 		std::cout << " DLUMatrix: allocating lu D\n";
 	}
 
 #pragma omp parallel for default(shared)
 	for(a_int iel = 0; iel < m->gnelem(); iel++)
-		luD[iel] = D[iel].inverse();
+		luD[iel] = D[iel].inverse().eval();
 }
 
 template <int bs>
@@ -236,7 +295,8 @@ void DLUMatrix<bs>::precJacobiApply(const a_real *const rr, a_real *const __rest
 template <int bs>
 void DLUMatrix<bs>::allocTempVector()
 {
-	y = MVector::Zero(m->gnelem(),bs);
+	y.resize(m->gnelem(),bs);
+	acfd::memory::firstTouch(y);
 }
 
 /** \warning allocTempVector() must have been called prior to calling this method.
@@ -291,29 +351,42 @@ void DLUMatrix<bs>::precSGSApply(const a_real *const rr, a_real *const __restric
 template <int bs>
 void DLUMatrix<bs>::precILUSetup()
 {
+	/* In one sweep, each block of the factors is computed from the same block of the matrix
+	 * and blocks of the factors computed before it, so the factors can overwrite the matrix.
+	 */
+	if(inplace && nbuildsweeps == 1 && !luD) {
+		luD = D;
+		luL = L;
+		luU = U;
+	}
 	if(!luD)
 	{
-		luD = new Matrix<a_real,bs,bs,RowMajor>[m->gnelem()];
+		luD = acfd::memory::allocateArray<Matrix<a_real,bs,bs,RowMajor>>(m->gnelem());
 		for(a_int iel = 0; iel < m->gnelem(); iel++)
 			luD[iel] = D[iel];
 		std::cout << " DLUMatrix: allocating lu D\n";
 	}
 	if(!luL)
 	{
-		luL = new Matrix<a_real,bs,bs,RowMajor>[m->gnaface()-m->gnbface()];
+		luL = acfd::memory::allocateArray<Matrix<a_real,bs,bs,RowMajor>>(m->gnaface()-m->gnbface());
 		for(a_int iface = 0; iface < m->gnaface()-m->gnbface(); iface++)
 			luL[iface] = L[iface];
 		std::cout << " DLUMatrix: allocating lu L\n";
 	}
 	if(!luU)
 	{
-		luU = new Matrix<a_real,bs,bs,RowMajor>[m->gnaface()-m->gnbface()];
+		luU = acfd::memory::allocateArray<Matrix<a_real,bs,bs,RowMajor>>(m->gnaface()-m->gnbface());
 		for(a_int iface = 0; iface < m->gnaface()-m->gnbface(); iface++)
 			luU[iface] = U[iface];
 		std::cout << " DLUMatrix: allocating lu U\n";
 	}
-	if(y.size() <= 0)
-		y = MVector::Zero(m->gnelem(),bs);
+	if(y.size() <= 0) {
+		y.resize(m->gnelem(),bs);
+		acfd::memory::firstTouch(y);
+	}
+
+	if(ilurowstart.empty())
+		computeILUSchedule();
 
 	// BILU factorization
 	for(short isweep = 0; isweep < nbuildsweeps; isweep++)	
@@ -321,99 +394,115 @@ void DLUMatrix<bs>::precILUSetup()
 #pragma omp parallel for default(shared) schedule(dynamic, thread_chunk_size)
 		for(a_int iel = 0; iel < m->gnelem(); iel++)
 		{
-			/* Get lists of faces corresponding to blocks in this block-row and
-			 * sort by element index.
-			 * We do all this circus as we want to carry out factorization in
-			 * a `Gaussian elimination' ordering; specifically in this case,
-			 * the lexicographic ordering.
-			 */
-			
-			struct LIndex { 
-				a_int face;
-				a_int elem;
-			};
-			std::vector<LIndex> lowers; lowers.reserve(m->gnfael(iel));
-			std::vector<LIndex> uppers; uppers.reserve(m->gnfael(iel));
-
-			for(int ifael = 0; ifael < m->gnfael(iel); ifael++)
-			{
-				a_int face = m->gelemface(iel,ifael) - m->gnbface();
-				a_int nbdelem = m->gesuel(iel,ifael);
-
-				if(nbdelem < m->gnelem())
-				{
-					if(nbdelem < iel) {
-						LIndex lower; lower.face = face; lower.elem = nbdelem;
-						lowers.push_back(lower);
-					}
-					else {
-						LIndex upper; upper.face = face; upper.elem = nbdelem;
-						uppers.push_back(upper);
-					}
-				}
-			}
-			auto comp = [](LIndex i, LIndex j) { return i.elem < j.elem; };
-			std::sort(lowers.begin(),lowers.end(), comp);
-			std::sort(uppers.begin(),uppers.end(), comp);
-
 			// L_ij := A_ij - sum_{k= 1 to j-1}(L_ik U_kj) U_jj^(-1)
-			for(size_t j = 0; j < lowers.size(); j++)
+			for(a_int e = ilurowstart[iel]; e < ilurowupper[iel]; e++)
 			{
 				Matrix<a_real,bs,bs,RowMajor> sum=Matrix<a_real,bs,bs,RowMajor>::Zero();
-				
-				for(size_t k = 0; k < j; k++) 
-				{
-					// first, find U_kj and see if it is non zero
-					a_int otherface = -1;
-					for(int ifael = 0; ifael < m->gnfael(lowers[k].elem); ifael++)
-						if(lowers[j].elem == m->gesuel(lowers[k].elem,ifael)) {
-							otherface = m->gelemface(lowers[k].elem,ifael);
-							break;
-						}
-
-					// if it's non zero, add its contribution
-					if(otherface != -1)	{
-						otherface -= m->gnbface();
-						sum += luL[lowers[k].face] * luU[otherface];
-					}
-				}
+				for(a_int iu = iluupdstart[e]; iu < iluupdstart[e+1]; iu++)
+					sum += luL[iluupdates[2*iu]] * luU[iluupdates[2*iu+1]];
 
-				luL[lowers[j].face] = (L[lowers[j].face] - sum) * luD[lowers[j].elem].inverse();
+				luL[ilufaces[e]] = (L[ilufaces[e]] - sum) * luD[iluelems[e]].inverse();
 			}
 
 			// D_ii := A_ii - sum_{k= 1 to i-1} L_ik U_ki
 			Matrix<a_real,bs,bs,RowMajor> sum = Matrix<a_real,bs,bs,RowMajor>::Zero();
-			for(size_t k = 0; k < lowers.size(); k++) 
-			{
-				sum += luL[lowers[k].face] * luU[lowers[k].face];
-			}
+			for(a_int e = ilurowstart[iel]; e < ilurowupper[iel]; e++)
+				sum += luL[ilufaces[e]] * luU[ilufaces[e]];
 			luD[iel] = D[iel] - sum;
 
 			// U_ij := A_ij - sum_{k= 1 to i-1} L_ik U_kj
-			for(size_t j = 0; j < uppers.size(); j++)
+			for(a_int e = ilurowupper[iel]; e < ilurowstart[iel+1]; e++)
 			{
 				Matrix<a_real,bs,bs,RowMajor> sum=Matrix<a_real,bs,bs,RowMajor>::Zero();
+				for(a_int iu = iluupdstart[e]; iu < iluupdstart[e+1]; iu++)
+					sum += luL[iluupdates[2*iu]] * luU[iluupdates[2*iu+1]];
 
-				for(size_t k = 0; k < lowers.size(); k++)
-				{
-					// first, find U_kj
-					a_int otherface = -1;
-					for(int ifael = 0; ifael < m->gnfael(lowers[k].elem); ifael++)
-						if(uppers[j].elem == m->gesuel(lowers[k].elem,ifael)) {
-							otherface = m->gelemface(lowers[k].elem,ifael);
-							break;
-						}
+				luU[ilufaces[e]] = U[ilufaces[e]] - sum;
+			}
+		}
+	}
+}
 
-					// if it's non zero, add its contribution
-					if(otherface != -1)	{
-						otherface -= m->gnbface();
-						sum += luL[lowers[k].face] * luU[otherface];
-					}
+template <int bs>
+void DLUMatrix<bs>::computeILUSchedule()
+{
+	const a_int nelem = m->gnelem();
+	ilurowstart.assign(nelem+1, 0);
+	ilurowupper.resize(nelem);
+	ilufaces.clear();
+	iluelems.clear();
+	iluupdstart.assign(1, 0);
+	iluupdates.clear();
+	ilufaces.reserve(m->gnaface()-m->gnbface());
+	iluelems.reserve(m->gnaface()-m->gnbface());
+
+	/* Sort the blocks of each block-row by element index, as we want to carry out
+	 * factorization in a `Gaussian elimination' ordering; specifically in this case,
+	 * the lexicographic ordering.
+	 */
+	struct LIndex { 
+		a_int face;
+		a_int elem;
+	};
+	auto comp = [](LIndex i, LIndex j) { return i.elem < j.elem; };
+	std::vector<LIndex> lowers, uppers;
+
+	// interior face between cells i and j, or -1 if they are not neighbours
+	auto commonFace = [this](const a_int i, const a_int j) {
+		for(int ifael = 0; ifael < m->gnfael(i); ifael++)
+			if(j == m->gesuel(i,ifael))
+				return m->gelemface(i,ifael) - m->gnbface();
+		return (a_int)-1;
+	};
+
+	for(a_int iel = 0; iel < nelem; iel++)
+	{
+		lowers.clear();
+		uppers.clear();
+		for(int ifael = 0; ifael < m->gnfael(iel); ifael++)
+		{
+			LIndex nbd;
+			nbd.face = m->gelemface(iel,ifael) - m->gnbface();
+			nbd.elem = m->gesuel(iel,ifael);
+			if(nbd.elem < iel)
+				lowers.push_back(nbd);
+			else if(nbd.elem < nelem)
+				uppers.push_back(nbd);
+		}
+		std::sort(lowers.begin(),lowers.end(), comp);
+		std::sort(uppers.begin(),uppers.end(), comp);
+
+		// L_ij is updated by L_ik U_kj for the lower blocks k before j
+		for(size_t j = 0; j < lowers.size(); j++)
+		{
+			ilufaces.push_back(lowers[j].face);
+			iluelems.push_back(lowers[j].elem);
+			for(size_t k = 0; k < j; k++) {
+				const a_int otherface = commonFace(lowers[k].elem, lowers[j].elem);
+				if(otherface != -1) {
+					iluupdates.push_back(lowers[k].face);
+					iluupdates.push_back(otherface);
 				}
+			}
+			iluupdstart.push_back((a_int)iluupdates.size()/2);
+		}
+		ilurowupper[iel] = (a_int)ilufaces.size();
 
-				luU[uppers[j].face] = U[uppers[j].face] - sum;
+		// U_ij is updated by L_ik U_kj for all lower blocks k
+		for(size_t j = 0; j < uppers.size(); j++)
+		{
+			ilufaces.push_back(uppers[j].face);
+			iluelems.push_back(uppers[j].elem);
+			for(size_t k = 0; k < lowers.size(); k++) {
+				const a_int otherface = commonFace(lowers[k].elem, uppers[j].elem);
+				if(otherface != -1) {
+					iluupdates.push_back(lowers[k].face);
+					iluupdates.push_back(otherface);
+				}
 			}
+			iluupdstart.push_back((a_int)iluupdates.size()/2);
 		}
+		ilurowstart[iel+1] = (a_int)ilufaces.size();
 	}
 }
 
@@ -463,6 +552,481 @@ void DLUMatrix<bs>::precILUApply(const a_real *const rr, a_real *const __restric
 	}
 }
 
+template <int bs>
+void DLUMatrix<bs>::extractLines()
+{
+	// cells whose connections differ less than this in strength are not put on lines
+	const a_real minratio = 4.0;
+
+	const a_int nelem = m->gnelem();
+	const a_int nintfa = m->gnaface()-m->gnbface();
+
+	// vertex averages of cells
+	std::vector<a_real> xc(nelem,0), yc(nelem,0);
+#pragma omp parallel for default(shared)
+	for(a_int iel = 0; iel < nelem; iel++) {
+		const int nv = m->gnfael(iel);
+		for(int iv = 0; iv < nv; iv++) {
+			xc[iel] += m->gcoords(m->ginpoel(iel,iv),0)/nv;
+			yc[iel] += m->gcoords(m->ginpoel(iel,iv),1)/nv;
+		}
+	}
+
+	// strength of the connection across each interior face
+	std::vector<a_real> weight(nintfa);
+#pragma omp parallel for default(shared)
+	for(a_int iface = 0; iface < nintfa; iface++) {
+		const a_int lelem = m->gintfac(iface+m->gnbface(),0);
+		const a_int relem = m->gintfac(iface+m->gnbface(),1);
+		const a_real dist = std::sqrt((xc[relem]-xc[lelem])*(xc[relem]-xc[lelem])
+				+ (yc[relem]-yc[lelem])*(yc[relem]-yc[lelem]));
+		weight[iface] = m->ggallfa(iface+m->gnbface(),2)/dist;
+	}
+
+	// anisotropy of each cell, its weakest connection and its two strongest connections
+	// (local face indices)
+	std::vector<a_real> ratio(nelem), weakest(nelem);
+	std::vector<int> strongest(2*nelem);
+#pragma omp parallel for default(shared)
+	for(a_int iel = 0; iel < nelem; iel++)
+	{
+		a_real wmin = std::numeric_limits<a_real>::max(), w1 = 0, w2 = 0;
+		int f1 = -1, f2 = -1;
+		for(int ifael = 0; ifael < m->gnfael(iel); ifael++) {
+			if(m->gesuel(iel,ifael) >= nelem)
+				continue;
+			const a_real w = weight[m->gelemface(iel,ifael)-m->gnbface()];
+			wmin = std::min(wmin,w);
+			if(w > w1) {
+				w2 = w1; f2 = f1;
+				w1 = w; f1 = ifael;
+			}
+			else if(w > w2) {
+				w2 = w; f2 = ifael;
+			}
+		}
+		strongest[2*iel] = f1;
+		strongest[2*iel+1] = f2;
+		weakest[iel] = wmin;
+		ratio[iel] = f2 >= 0 ? w1/wmin : 1.0;
+	}
+
+	// whether the connection across a local face of a cell is among its two strongest, and
+	// much stronger than its weakest
+	auto isStrong = [&](const a_int iel, const int ifael) {
+		return (strongest[2*iel] == ifael || strongest[2*iel+1] == ifael)
+			&& weight[m->gelemface(iel,ifael)-m->gnbface()] >= minratio*weakest[iel];
+	};
+
+	// the neighbour across the strongest connection of a cell, other than a given cell,
+	// if that can be added to a line; -1 otherwise
+	std::vector<a_int> lineof(nelem,-1);
+	auto nextCell = [&](const a_int cur, const a_int prev, a_int& face) -> a_int {
+		a_real wmax = 0;
+		a_int next = -1;
+		for(int ifael = 0; ifael < m->gnfael(cur); ifael++) {
+			const a_int nbd = m->gesuel(cur,ifael);
+			if(nbd >= nelem || nbd == prev)
+				continue;
+			const a_int f = m->gelemface(cur,ifael)-m->gnbface();
+			if(weight[f] > wmax) {
+				wmax = weight[f];
+				next = nbd;
+				face = f;
+			}
+		}
+		if(next < 0 || lineof[next] >= 0 || wmax < minratio*weakest[cur])
+			return -1;
+		for(int ifael = 0; ifael < m->gnfael(next); ifael++)
+			if(m->gesuel(next,ifael) == cur)
+				return isStrong(next,ifael) ? next : -1;
+		return -1;
+	};
+
+	std::vector<a_int> order(nelem);
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(),
+			[&ratio](const a_int a, const a_int b) { return ratio[a] > ratio[b]; });
+
+	// grow lines in both directions from the most anisotropic cells
+	std::vector<std::vector<a_int>> lines, faces;
+	for(a_int iord = 0; iord < nelem && ratio[order[iord]] >= minratio; iord++)
+	{
+		const a_int seed = order[iord];
+		if(lineof[seed] >= 0)
+			continue;
+		const a_int iline = (a_int)lines.size();
+		std::vector<a_int> fwd(1,seed), fwdfaces, bwd, bwdfaces;
+		lineof[seed] = iline;
+
+		a_int prev = -1, cur = seed, face = -1, next;
+		while((next = nextCell(cur, prev, face)) >= 0) {
+			fwd.push_back(next);
+			fwdfaces.push_back(face);
+			lineof[next] = iline;
+			prev = cur; cur = next;
+		}
+		prev = fwd.size() > 1 ? fwd[1] : -1; cur = seed;
+		while((next = nextCell(cur, prev, face)) >= 0) {
+			bwd.push_back(next);
+			bwdfaces.push_back(face);
+			lineof[next] = iline;
+			prev = cur; cur = next;
+		}
+
+		if(fwd.size()+bwd.size() < 2) {
+			lineof[seed] = -1;
+			continue;
+		}
+		std::vector<a_int> cells(bwd.rbegin(), bwd.rend());
+		cells.insert(cells.end(), fwd.begin(), fwd.end());
+		std::vector<a_int> lfaces(bwdfaces.rbegin(), bwdfaces.rend());
+		lfaces.insert(lfaces.end(), fwdfaces.begin(), fwdfaces.end());
+		lines.push_back(cells);
+		faces.push_back(lfaces);
+	}
+	const a_int nlong = (a_int)lines.size();
+	a_int nlinecells = 0;
+	for(a_int iline = 0; iline < nlong; iline++)
+		nlinecells += (a_int)lines[iline].size();
+
+	// the remaining cells are lines by themselves
+	for(a_int iel = 0; iel < nelem; iel++)
+		if(lineof[iel] < 0) {
+			lines.push_back(std::vector<a_int>(1,iel));
+			faces.push_back(std::vector<a_int>());
+		}
+
+	// order the lines by their first cells, so that sweeps over lines roughly follow the
+	// ordering of the cells
+	std::vector<a_int> lorder(lines.size());
+	std::iota(lorder.begin(), lorder.end(), 0);
+	std::vector<a_int> firstcell(lines.size());
+	for(size_t iline = 0; iline < lines.size(); iline++)
+		firstcell[iline] = *std::min_element(lines[iline].begin(), lines[iline].end());
+	std::sort(lorder.begin(), lorder.end(),
+			[&firstcell](const a_int a, const a_int b) { return firstcell[a] < firstcell[b]; });
+
+	linecells.resize(nelem);
+	linefaces.assign(nelem,-1);
+	linestart.resize(lines.size()+1);
+	cellpos.resize(nelem);
+	linestart[0] = 0;
+	for(size_t il = 0; il < lines.size(); il++)
+	{
+		const std::vector<a_int>& cells = lines[lorder[il]];
+		const a_int start = linestart[il];
+		for(size_t k = 0; k < cells.size(); k++) {
+			linecells[start+k] = cells[k];
+			cellpos[cells[k]] = start+k;
+			if(k+1 < cells.size())
+				linefaces[start+k] = faces[lorder[il]][k];
+		}
+		linestart[il+1] = start + (a_int)cells.size();
+	}
+
+	std::cout << " DLUMatrix: Extracted " << nlong << " lines containing " << nlinecells
+		<< " of " << nelem << " cells";
+	if(nlong > 0)
+		std::cout << ", of average length " << (a_real)nlinecells/nlong;
+	std::cout << std::endl;
+}
+
+template <int bs>
+void DLUMatrix<bs>::precLineSetup()
+{
+	if(linestart.empty())
+		extractLines();
+	if(!lineD)
+		lineD = acfd::memory::allocateArray<Matrix<a_real,bs,bs,RowMajor>>(m->gnelem());
+
+#pragma omp parallel for default(shared) schedule(dynamic, 16)
+	for(a_int iline = 0; iline < numLines(); iline++)
+	{
+		// the pivot of each cell is its diagonal block minus the elimination of the previous
+		lineD[linestart[iline]] = D[linecells[linestart[iline]]].inverse();
+		for(a_int k = linestart[iline]+1; k < linestart[iline+1]; k++)
+		{
+			const a_int prev = linecells[k-1], cur = linecells[k], face = linefaces[k-1];
+			lineD[k] = (D[cur] - offDiagBlock(cur,prev,face) * lineD[k-1] 
+					* offDiagBlock(prev,cur,face)).inverse();
+		}
+	}
+}
+
+template <int bs>
+void DLUMatrix<bs>::lineSolve(const a_int iline, MVector& b, Eigen::Map<MVector>& z) const
+{
+	const a_int start = linestart[iline], end = linestart[iline+1];
+
+	// forward elimination, in place
+	b.row(linecells[start]) = lineD[start]*b.row(linecells[start]).transpose();
+	for(a_int k = start+1; k < end; k++)
+	{
+		const a_int prev = linecells[k-1], cur = linecells[k];
+		const Matrix<a_real,1,bs> inter 
+			= b.row(cur) - b.row(prev)*offDiagBlock(cur,prev,linefaces[k-1]).transpose();
+		b.row(cur) = lineD[k]*inter.transpose();
+	}
+
+	// back substitution
+	z.row(linecells[end-1]) = b.row(linecells[end-1]);
+	for(a_int k = end-2; k >= start; k--)
+	{
+		const a_int cur = linecells[k], next = linecells[k+1];
+		const Matrix<a_real,1,bs> inter = z.row(next)*offDiagBlock(cur,next,linefaces[k]).transpose();
+		z.row(cur) = b.row(cur) - (lineD[k]*inter.transpose()).transpose();
+	}
+}
+
+template <int bs>
+void DLUMatrix<bs>::precLineJacobiApply(const a_real *const rr, a_real *const __restrict zz) const
+{
+	Eigen::Map<const MVector> r(rr, m->gnelem(),bs);
+	Eigen::Map<MVector> z(zz, m->gnelem(),bs);
+	if(y.rows() != m->gnelem())
+		y.resize(m->gnelem(),bs);
+
+#pragma omp parallel for default(shared) schedule(dynamic, 16)
+	for(a_int iline = 0; iline < numLines(); iline++)
+	{
+		for(a_int k = linestart[iline]; k < linestart[iline+1]; k++)
+			y.row(linecells[k]) = r.row(linecells[k]);
+		lineSolve(iline, y, z);
+	}
+}
+
+template <int bs>
+void DLUMatrix<bs>::precLineSGSApply(const a_real *const rr, a_real *const __restrict zz) const
+{
+	Eigen::Map<const MVector> r(rr, m->gnelem(),bs);
+	Eigen::Map<MVector> z(zz, m->gnelem(),bs);
+	const a_int nlines = numLines();
+
+#pragma omp parallel for simd default(shared)
+	for(a_int i = 0; i < m->gnelem()*bs; i++)
+		zz[i] = 0;
+
+	// right hand side of a line: r minus the coupling to cells not next to each other on it
+	auto lineRHS = [&](const a_int iline) {
+		for(a_int k = linestart[iline]; k < linestart[iline+1]; k++)
+		{
+			const a_int iel = linecells[k];
+			Matrix<a_real,1,bs> inter = Matrix<a_real,1,bs>::Zero();
+			for(int ifael = 0; ifael < m->gnfael(iel); ifael++)
+			{
+				const a_int nbdelem = m->gesuel(iel,ifael);
+				if(nbdelem >= m->gnelem())
+					continue;
+				const a_int face = m->gelemface(iel,ifael) - m->gnbface();
+				if((k > linestart[iline] && face == linefaces[k-1]) || face == linefaces[k])
+					continue;
+				inter += z.row(nbdelem)*offDiagBlock(iel,nbdelem,face).transpose();
+			}
+			y.row(iel) = r.row(iel) - inter;
+		}
+	};
+
+	for(short isweep = 0; isweep < napplysweeps; isweep++)
+	{
+#pragma omp parallel for default(shared) schedule(dynamic, 16)
+		for(a_int iline = 0; iline < nlines; iline++)
+		{
+			lineRHS(iline);
+			lineSolve(iline, y, z);
+		}
+
+#pragma omp parallel for default(shared) schedule(dynamic, 16)
+		for(a_int iline = nlines-1; iline >= 0; iline--)
+		{
+			lineRHS(iline);
+			lineSolve(iline, y, z);
+		}
+	}
+}
+
+template <int bs>
+void DLUMatrix<bs>::setupSubdomains(const int overlap)
+{
+#ifdef _OPENMP
+	const int nsd = omp_get_max_threads();
+#else
+	const int nsd = 1;
+#endif
+	const a_int nelem = m->gnelem();
+
+	for(size_t isd = 0; isd < subdomains.size(); isd++) {
+		acfd::memory::deallocate(subdomains[isd].Dinv);
+		acfd::memory::deallocate(subdomains[isd].off);
+	}
+	subdomains.clear();
+	subdomains.resize(nsd);
+	schwarzoverlap = overlap;
+
+	// with a static schedule of one subdomain per iteration, each thread sets up the
+	//  subdomain it will later work on, so its storage is placed near that thread
+#pragma omp parallel for default(shared) schedule(static,1)
+	for(int isd = 0; isd < nsd; isd++)
+	{
+		Subdomain& sd = subdomains[isd];
+		sd.ownstart = (a_int)((long long)nelem*isd/nsd);
+		sd.ownend = (a_int)((long long)nelem*(isd+1)/nsd);
+
+		// layers of overlap, each consisting of the cells adjacent to the previous one
+		std::vector<a_int> front, next;
+		front.reserve(sd.ownend-sd.ownstart);
+		for(a_int iel = sd.ownstart; iel < sd.ownend; iel++)
+			front.push_back(iel);
+		std::unordered_set<a_int> added;
+		for(int il = 0; il < overlap; il++)
+		{
+			next.clear();
+			for(size_t i = 0; i < front.size(); i++)
+				for(int ifael = 0; ifael < m->gnfael(front[i]); ifael++)
+				{
+					const a_int nbdelem = m->gesuel(front[i],ifael);
+					if(nbdelem < nelem && (nbdelem < sd.ownstart || nbdelem >= sd.ownend)
+							&& added.insert(nbdelem).second)
+						next.push_back(nbdelem);
+				}
+			front.swap(next);
+		}
+
+		sd.cells.reserve(sd.ownend-sd.ownstart + added.size());
+		for(a_int iel = sd.ownstart; iel < sd.ownend; iel++)
+			sd.cells.push_back(iel);
+		sd.cells.insert(sd.cells.end(), added.begin(), added.end());
+		std::sort(sd.cells.begin(), sd.cells.end());
+
+		// neighbours of each cell within the subdomain, in increasing order
+		const a_int n = (a_int)sd.cells.size();
+		sd.nbstart.assign(n+1, 0);
+		sd.nbupper.resize(n);
+		std::vector<std::pair<a_int,a_int>> nbs;
+		for(a_int p = 0; p < n; p++)
+		{
+			const a_int iel = sd.cells[p];
+			nbs.clear();
+			for(int ifael = 0; ifael < m->gnfael(iel); ifael++)
+			{
+				const a_int nbdelem = m->gesuel(iel,ifael);
+				if(nbdelem >= nelem)
+					continue;
+				const auto it = std::lower_bound(sd.cells.begin(), sd.cells.end(), nbdelem);
+				if(it != sd.cells.end() && *it == nbdelem)
+					nbs.push_back(std::make_pair((a_int)(it-sd.cells.begin()),
+							m->gelemface(iel,ifael) - m->gnbface()));
+			}
+			std::sort(nbs.begin(), nbs.end());
+
+			sd.nbupper[p] = sd.nbstart[p];
+			for(size_t i = 0; i < nbs.size(); i++) {
+				sd.nbpos.push_back(nbs[i].first);
+				sd.nbface.push_back(nbs[i].second);
+				if(nbs[i].first < p)
+					sd.nbupper[p]++;
+			}
+			sd.nbstart[p+1] = (a_int)sd.nbpos.size();
+		}
+
+		sd.Dinv = acfd::memory::allocateArray<Matrix<a_real,bs,bs,RowMajor>>(n);
+		sd.off = acfd::memory::allocateArray<Matrix<a_real,bs,bs,RowMajor>>(sd.nbpos.size());
+		sd.y = MVector::Zero(n,bs);
+	}
+
+	a_int ntotal = 0;
+	for(int isd = 0; isd < nsd; isd++)
+		ntotal += (a_int)subdomains[isd].cells.size();
+	std::cout << " DLUMatrix: Set up " << nsd << " thread subdomains with " << overlap
+		<< " layers of overlap, having " << ntotal-nelem << " overlap cells in all\n";
+}
+
+template <int bs>
+void DLUMatrix<bs>::precSchwarzSetup(const int overlap)
+{
+#ifdef _OPENMP
+	const int nsd = omp_get_max_threads();
+#else
+	const int nsd = 1;
+#endif
+	if((int)subdomains.size() != nsd || overlap != schwarzoverlap)
+		setupSubdomains(overlap);
+
+#pragma omp parallel for default(shared) schedule(static,1)
+	for(int isd = 0; isd < (int)subdomains.size(); isd++)
+	{
+		Subdomain& sd = subdomains[isd];
+
+		// row-wise (IKJ) ILU0: each row is copied from the matrix and then eliminated
+		//  with the rows before it, whose factors are complete
+		for(a_int p = 0; p < (a_int)sd.cells.size(); p++)
+		{
+			const a_int iel = sd.cells[p];
+			sd.Dinv[p] = D[iel];
+			for(a_int e = sd.nbstart[p]; e < sd.nbstart[p+1]; e++)
+				sd.off[e] = offDiagBlock(iel, sd.cells[sd.nbpos[e]], sd.nbface[e]);
+
+			for(a_int e = sd.nbstart[p]; e < sd.nbupper[p]; e++)
+			{
+				const a_int k = sd.nbpos[e];
+				sd.off[e] = sd.off[e]*sd.Dinv[k];
+
+				// subtract L_pk U_kj from the entries of row p in the pattern
+				for(a_int f = sd.nbupper[k]; f < sd.nbstart[k+1]; f++)
+				{
+					const a_int j = sd.nbpos[f];
+					if(j == p) {
+						sd.Dinv[p] -= sd.off[e]*sd.off[f];
+						continue;
+					}
+					for(a_int g = sd.nbstart[p]; g < sd.nbstart[p+1]; g++)
+						if(sd.nbpos[g] == j) {
+							sd.off[g] -= sd.off[e]*sd.off[f];
+							break;
+						}
+				}
+			}
+
+			sd.Dinv[p] = sd.Dinv[p].inverse().eval();
+		}
+	}
+}
+
+template <int bs>
+void DLUMatrix<bs>::precSchwarzApply(const a_real *const rr, a_real *const __restrict zz) const
+{
+	Eigen::Map<const MVector> r(rr, m->gnelem(),bs);
+	Eigen::Map<MVector> z(zz, m->gnelem(),bs);
+
+#pragma omp parallel for default(shared) schedule(static,1)
+	for(int isd = 0; isd < (int)subdomains.size(); isd++)
+	{
+		const Subdomain& sd = subdomains[isd];
+		const a_int n = (a_int)sd.cells.size();
+
+		for(a_int p = 0; p < n; p++)
+		{
+			Matrix<a_real,1,bs> t = r.row(sd.cells[p]);
+			for(a_int e = sd.nbstart[p]; e < sd.nbupper[p]; e++)
+				t -= sd.y.row(sd.nbpos[e])*sd.off[e].transpose();
+			sd.y.row(p) = t;
+		}
+
+		for(a_int p = n-1; p >= 0; p--)
+		{
+			Matrix<a_real,1,bs> t = sd.y.row(p);
+			for(a_int e = sd.nbupper[p]; e < sd.nbstart[p+1]; e++)
+				t -= sd.y.row(sd.nbpos[e])*sd.off[e].transpose();
+			sd.y.row(p).noalias() = t*sd.Dinv[p].transpose();
+
+			// restricted: overlap cells are left to the subdomains owning them
+			const a_int iel = sd.cells[p];
+			if(iel >= sd.ownstart && iel < sd.ownend)
+				z.row(iel) = sd.y.row(p);
+		}
+	}
+}
+
 template <int bs>
 void DLUMatrix<bs>::printDiagnostic(const char choice) const
 {
@@ -479,6 +1043,39 @@ void DLUMatrix<bs>::printDiagnostic(const char choice) const
 		std::cout << "! DLUMatrix: printDiagnostics: Invalid choice!\n";
 }
 
+template <int bs>
+void DLUMatrix<bs>::reportMemory(acfd::memory::Report& report, const std::string& name) const
+{
+	typedef Matrix<a_real,bs,bs,RowMajor> Block;
+	const a_int nelem = m->gnelem(), ninface = m->gnaface()-m->gnbface();
+
+	report.add(name, "D", nelem*sizeof(Block));
+	report.add(name, "L and U", 2*ninface*sizeof(Block));
+	if(halo)
+		report.add(name, "halo blocks and vector", m->gnbface()*sizeof(Block)
+				+ xhalo.size()*sizeof(a_real));
+	if(luD && luD != D)
+		report.add(name, "factor D", nelem*sizeof(Block));
+	if(luL && luL != L)
+		report.add(name, "factor L", ninface*sizeof(Block));
+	if(luU && luU != U)
+		report.add(name, "factor U", ninface*sizeof(Block));
+	report.add(name, "temporary vector", y.size()*sizeof(a_real));
+	report.add(name, "lines", (linecells.capacity() + linestart.capacity()
+				+ linefaces.capacity() + cellpos.capacity())*sizeof(a_int)
+			+ (lineD ? nelem*sizeof(Block) : 0));
+	report.add(name, "ILU schedule", (ilurowstart.capacity() + ilurowupper.capacity()
+				+ ilufaces.capacity() + iluelems.capacity() + iluupdstart.capacity()
+				+ iluupdates.capacity())*sizeof(a_int));
+
+	size_t sdbytes = 0;
+	for(const Subdomain& sd : subdomains)
+		sdbytes += (sd.cells.capacity() + sd.nbstart.capacity() + sd.nbupper.capacity()
+				+ sd.nbpos.capacity() + sd.nbface.capacity())*sizeof(a_int)
+			+ (sd.cells.size() + sd.nbpos.size())*sizeof(Block) + sd.y.size()*sizeof(a_real);
+	report.add(name, "Schwarz subdomains", sdbytes);
+}
+
 template class DLUMatrix<NVARS>;
 template class DLUMatrix<1>;
 
@@ -486,10 +1083,404 @@ template class DLUMatrix<1>;
 
 namespace acfd {
 
+SolverWorkspace::SolverWorkspace() : nallocs(0), nbytes(0)
+{ }
+
+void SolverWorkspace::setup(const int nvecs, const a_int nrows, const int ncols,
+		const int nbasis)
+{
+	if(static_cast<int>(vecs.size()) < nvecs)
+		vecs.resize(nvecs);
+	for(int i = 0; i < nvecs; i++)
+		if(vecs[i].rows() != nrows || vecs[i].cols() != ncols) {
+			vecs[i].resize(nrows, ncols);
+			acfd::memory::firstTouch(vecs[i]);
+			nallocs++;
+			nbytes += nrows*ncols*sizeof(a_real);
+		}
+
+	if(nbasis > 0 && (basis.rows() != nrows*ncols || basis.cols() != nbasis)) {
+		basis.resize(nrows*ncols, nbasis);
+		acfd::memory::firstTouch(basis);
+		nallocs++;
+		nbytes += basis.size()*sizeof(a_real);
+	}
+}
+
+size_t SolverWorkspace::bytes() const
+{
+	size_t size = basis.size();
+	for(const MVector& v : vecs)
+		size += v.size();
+	return size*sizeof(a_real);
+}
+
+template <short nvars>
+MatrixFreeLUSGS<nvars>::MatrixFreeLUSGS(const UMesh2dh *const mesh)
+	: Preconditioner<nvars>(nullptr), m(mesh), space(nullptr), u(nullptr), dtm(nullptr),
+	Dinv(memory::allocateArray<a_real>(mesh->gnelem()*nvars*nvars)),
+	facerad(memory::allocateArray<a_real>(mesh->gnaface()))
+{
+	y.resize(m->gnelem(), nvars);
+	memory::firstTouch(y);
+}
+
+template <short nvars>
+MatrixFreeLUSGS<nvars>::~MatrixFreeLUSGS()
+{
+	memory::deallocate(Dinv);
+	memory::deallocate(facerad);
+}
+
+template <short nvars>
+void MatrixFreeLUSGS<nvars>::setState(Spatial<nvars> *const spatial, const MVector& state,
+		const amat::Array2d<a_real>& timesteps)
+{
+	space = spatial;
+	u = &state;
+	dtm = &timesteps;
+}
+
+template <short nvars>
+void MatrixFreeLUSGS<nvars>::compute()
+{
+	perf::ScopedTimer tmr(perf::PREC_SETUP);
+	if(!space) {
+		std::cout << " ! MatrixFreeLUSGS: State not set!\n";
+		std::abort();
+	}
+	if(!space->compute_lusgs_diagonal(*u, *dtm, Dinv, facerad)) {
+		std::cout << " ! MatrixFreeLUSGS: The spatial discretization does not provide"
+			<< " matrix-free LU-SGS!\n";
+		std::abort();
+	}
+}
+
+template <short nvars>
+void MatrixFreeLUSGS<nvars>::apply(const a_real *const r, a_real *const __restrict z)
+{
+	perf::ScopedTimer tmr(perf::PREC_APPLY);
+	space->apply_lusgs(*u, Dinv, facerad, r, y.data(), z);
+}
+
+template <short nvars>
+void MatrixFreeLUSGS<nvars>::reportMemory(memory::Report& report, const std::string& name) const
+{
+	report.add(name, "inverted diagonal blocks", m->gnelem()*nvars*nvars*sizeof(a_real));
+	report.add(name, "face spectral radii", m->gnaface()*sizeof(a_real));
+	report.add(name, "temporary vector", y.size()*sizeof(a_real));
+}
+
+template <short nvars>
+Polynomial<nvars>::Polynomial(LinearOperator<a_real,a_int> *const op, const int degree)
+	: Preconditioner<nvars>(op), maxdegree(std::max(degree,1)), curdegree(0)
+{ }
+
+template <short nvars>
+void Polynomial<nvars>::scaledApply(const a_real *const x, a_real *const __restrict z)
+{
+	a_real *const ax = work.vec(3).data();
+	A->apply(1.0, x, ax);
+	A->precJacobiApply(ax, z);
+}
+
+template <short nvars>
+void Polynomial<nvars>::compute()
+{
+	perf::ScopedTimer tmr(perf::PREC_SETUP);
+	typedef Matrix<a_real,Dynamic,Dynamic> DMatrix;
+	const a_int N = A->dim();
+
+	A->precJacobiSetup();
+	work.setup(4, N/nvars, nvars, maxdegree+1);
+	Matrix<a_real,Dynamic,Dynamic,Eigen::ColMajor>& V = work.basisVectors();
+
+	// fixed start vector, so that the polynomial only depends on the matrix
+	a_real *const v0 = V.col(0).data();
+#pragma omp parallel for simd default(shared)
+	for(a_int i = 0; i < N; i++) {
+		unsigned int h = (unsigned int)i*2654435761u;
+		h ^= h >> 15; h *= 2246822519u; h ^= h >> 13;
+		v0[i] = (a_real)h/4294967295.0 - 0.5;
+	}
+	const a_real v0norm = std::sqrt(dot(N, v0,v0));
+#pragma omp parallel for simd default(shared)
+	for(a_int i = 0; i < N; i++)
+		v0[i] /= v0norm;
+
+	// Arnoldi with modified Gram-Schmidt
+	DMatrix H = DMatrix::Zero(maxdegree+1, maxdegree);
+	int k = 0;
+	bool invariant = false;
+	for(int j = 0; j < maxdegree; j++)
+	{
+		a_real *const w = V.col(j+1).data();
+		scaledApply(V.col(j).data(), w);
+		for(int i = 0; i <= j; i++) {
+			H(i,j) = dot(N, V.col(i).data(), w);
+			axpby(N, 1.0,w, -H(i,j),V.col(i).data());
+		}
+		H(j+1,j) = std::sqrt(dot(N, w,w));
+		k = j+1;
+		if(H(j+1,j) <= 1e-12*H.col(j).norm()) {
+			invariant = true;
+			break;
+		}
+		const a_real hinv = 1.0/H(j+1,j);
+#pragma omp parallel for simd default(shared)
+		for(a_int i = 0; i < N; i++)
+			w[i] *= hinv;
+	}
+
+	// harmonic Ritz values are the eigenvalues of H_k + h_(k+1,k)^2 H_k^(-T) e_k e_k^T;
+	//  if the subspace is invariant, the Ritz values are exact
+	DMatrix Hk = H.topLeftCorner(k,k);
+	if(!invariant) {
+		Eigen::FullPivLU<DMatrix> lu(Hk.transpose());
+		if(lu.isInvertible()) {
+			Matrix<a_real,Dynamic,1> ek = Matrix<a_real,Dynamic,1>::Zero(k);
+			ek(k-1) = 1.0;
+			Hk.col(k-1) += H(k,k-1)*H(k,k-1)*lu.solve(ek);
+		}
+	}
+	Eigen::EigenSolver<DMatrix> es(Hk, false);
+
+	std::vector<std::complex<a_real>> cand;
+	if(es.info() == Eigen::Success) {
+		a_real maxmod = 0;
+		for(int i = 0; i < k; i++)
+			maxmod = std::max(maxmod, std::abs(es.eigenvalues()(i)));
+		for(int i = 0; i < k; i++) {
+			const std::complex<a_real> theta = es.eigenvalues()(i);
+			if(theta.imag() >= 0 && std::abs(theta) > 1e-12*maxmod)
+				cand.push_back(theta);
+		}
+	}
+
+	// modified Leja ordering: the root of largest modulus first, then each time the root
+	//  farthest, in the sense of the product of distances, from those already chosen
+	roots.clear();
+	curdegree = 0;
+	std::vector<a_real> logdist(cand.size(), 0);
+	while(!cand.empty())
+	{
+		size_t best = 0;
+		for(size_t i = 1; i < cand.size(); i++)
+			if(roots.empty() ? std::abs(cand[i]) > std::abs(cand[best])
+					: logdist[i] > logdist[best])
+				best = i;
+
+		const std::complex<a_real> theta = cand[best];
+		roots.push_back(theta);
+		curdegree += theta.imag() > 0 ? 2 : 1;
+		cand.erase(cand.begin()+best);
+		logdist.erase(logdist.begin()+best);
+
+		for(size_t i = 0; i < cand.size(); i++) {
+			logdist[i] += std::log(std::abs(cand[i]-theta) + 1e-300);
+			if(theta.imag() > 0)
+				logdist[i] += std::log(std::abs(cand[i]-std::conj(theta)) + 1e-300);
+		}
+	}
+
+	if(roots.empty()) {
+		std::cout << " ! Polynomial: Could not compute the roots; using block-Jacobi.\n";
+		roots.push_back(1.0);
+		curdegree = 1;
+	}
+}
+
+template <short nvars>
+void Polynomial<nvars>::apply(const a_real *const r, a_real *const __restrict z)
+{
+	perf::ScopedTimer tmr(perf::PREC_APPLY);
+	const a_int N = A->dim();
+	a_real *const res = work.vec(0).data();
+	a_real *const w = work.vec(1).data();
+	a_real *const bw = work.vec(2).data();
+
+	// the residual D^(-1) r - B z is kept in res
+	A->precJacobiApply(r, res);
+#pragma omp parallel for simd default(shared)
+	for(a_int i = 0; i < N; i++)
+		z[i] = 0;
+
+	int deg = 0;
+	for(size_t k = 0; k < roots.size(); k++)
+	{
+		const a_real a = roots[k].real(), b = roots[k].imag();
+		if(b == 0)
+		{
+			deg++;
+			const a_real ainv = 1.0/a;
+			if(deg == curdegree) {
+#pragma omp parallel for simd default(shared)
+				for(a_int i = 0; i < N; i++)
+					z[i] += ainv*res[i];
+			}
+			else {
+				scaledApply(res, bw);
+#pragma omp parallel for simd default(shared)
+				for(a_int i = 0; i < N; i++) {
+					z[i] += ainv*res[i];
+					res[i] -= ainv*bw[i];
+				}
+			}
+		}
+		else
+		{
+			// (1 - B/theta)(1 - B/conj(theta)) = 1 - B (2a - B)/|theta|^2
+			deg += 2;
+			const a_real minv = 1.0/(a*a+b*b);
+			scaledApply(res, bw);
+#pragma omp parallel for simd default(shared)
+			for(a_int i = 0; i < N; i++) {
+				w[i] = minv*(2.0*a*res[i] - bw[i]);
+				z[i] += w[i];
+			}
+			if(deg < curdegree) {
+				scaledApply(w, bw);
+#pragma omp parallel for simd default(shared)
+				for(a_int i = 0; i < N; i++)
+					res[i] -= bw[i];
+			}
+		}
+	}
+}
+
+AndersonAccelerator::AndersonAccelerator(const int m, const a_real mixing,
+		const a_real restart_factor)
+	: depth(m), beta(mixing), restartfactor(restart_factor), N(0),
+	haveprev(false), fprevnorm(0), nhist(0), newest(-1), nrestarts(0)
+{ }
+
+void AndersonAccelerator::setup(const a_int nrows, const int ncols)
+{
+	N = nrows*ncols;
+	work.setup(2, nrows, ncols, 2*depth);
+	gram.resize(depth, depth);
+	G.resize(depth, depth);
+	rhs.resize(depth);
+	gamma.resize(depth);
+	nrestarts = 0;
+	reset();
+}
+
+void AndersonAccelerator::reset()
+{
+	haveprev = false;
+	nhist = 0;
+	newest = -1;
+}
+
+void AndersonAccelerator::update(MVector& x, const MVector& f)
+{
+	if(depth <= 0) {
+		axpby(N, 1.0, x.data(), beta, f.data());
+		return;
+	}
+
+	a_real *const xprev = work.vec(0).data();
+	a_real *const fprev = work.vec(1).data();
+	const a_real fnorm = std::sqrt(dot(N, f.data(), f.data()));
+
+	if(haveprev && restartfactor > 0 && fnorm > restartfactor*fprevnorm) {
+		nhist = 0;
+		nrestarts++;
+	}
+	else if(haveprev)
+	{
+		// store the newest differences, over the oldest if the history is full
+		newest = (newest+1) % depth;
+		nhist = std::min(nhist+1, depth);
+		a_real *const dxn = dx(newest);
+		a_real *const dfn = df(newest);
+		const a_real *const xx = x.data();
+		const a_real *const ff = f.data();
+#pragma omp parallel for simd default(shared)
+		for(a_int i = 0; i < N; i++) {
+			dxn[i] = xx[i] - xprev[i];
+			dfn[i] = ff[i] - fprev[i];
+		}
+
+		for(int j = 0; j < nhist; j++) {
+			const int sj = slot(j);
+			gram(newest,sj) = gram(sj,newest) = dot(N, dfn, df(sj));
+		}
+	}
+
+	{
+		const a_real *const xx = x.data();
+		const a_real *const ff = f.data();
+#pragma omp parallel for simd default(shared)
+		for(a_int i = 0; i < N; i++) {
+			xprev[i] = xx[i];
+			fprev[i] = ff[i];
+		}
+	}
+	fprevnorm = fnorm;
+	haveprev = true;
+
+	// right hand sides of the normal equations, before any differences are dropped
+	for(int j = 0; j < nhist; j++)
+		rhs(j) = dot(N, df(slot(j)), f.data());
+
+	// solve the normal equations, scaled to unit diagonal, dropping the oldest differences
+	// while they are ill-conditioned
+	int first = 0;
+	for( ; first < nhist; first++)
+	{
+		const int k = nhist-first;
+		bool singular = false;
+		for(int i = 0; i < k; i++)
+			if(gram(slot(first+i),slot(first+i)) <= 0)
+				singular = true;
+		if(singular)
+			continue;
+
+		for(int i = 0; i < k; i++)
+			for(int j = 0; j < k; j++)
+				G(i,j) = gram(slot(first+i),slot(first+j))
+					/ std::sqrt(gram(slot(first+i),slot(first+i))*gram(slot(first+j),slot(first+j)));
+		ldlt.compute(G.topLeftCorner(k,k));
+		const a_real dmax = ldlt.vectorD().cwiseAbs().maxCoeff();
+		const a_real dmin = ldlt.vectorD().cwiseAbs().minCoeff();
+		if(ldlt.info() == Eigen::Success && dmin > 1e-12*dmax)
+			break;
+	}
+
+	const int k = nhist-first;
+	if(k > 0) {
+		for(int i = 0; i < k; i++)
+			gamma(i) = rhs(first+i) / std::sqrt(gram(slot(first+i),slot(first+i)));
+		gamma.head(k) = ldlt.solve(gamma.head(k));
+		for(int i = 0; i < k; i++)
+			gamma(i) /= std::sqrt(gram(slot(first+i),slot(first+i)));
+	}
+	// the dropped differences will not be needed again
+	nhist = k;
+
+	// x <- x + beta f - (dX + beta dF) gamma
+	a_real *const xx = x.data();
+	const a_real *const ff = f.data();
+	const a_real *const basis = work.basisVectors().data();
+	const a_int n = N;
+#pragma omp parallel for default(shared)
+	for(a_int i = 0; i < n; i++) {
+		a_real corr = 0;
+		for(int j = 0; j < k; j++) {
+			const int sj = slot(j);
+			corr += gamma(j) * (basis[sj*n+i] + beta*basis[(depth+sj)*n+i]);
+		}
+		xx[i] += beta*ff[i] - corr;
+	}
+}
+
 IterativeSolverBase::IterativeSolverBase(const UMesh2dh *const mesh)
 	: LinearSolver(mesh)
 {
 	walltime = 0; cputime = 0;
+	setupwalltime = 0; setupcputime = 0;
 }
 
 template <short nvars>
@@ -513,20 +1504,26 @@ void IterativeSolver<nvars>::setupPreconditioner()
 	double finalwtime = (double)time2.tv_sec + (double)time2.tv_usec * 1.0e-6;
 	double finalctime = (double)clock() / (double)CLOCKS_PER_SEC;
 	walltime += (finalwtime-initialwtime); cputime += (finalctime-initialctime);
+	setupwalltime += (finalwtime-initialwtime); setupcputime += (finalctime-initialctime);
 }
 
 // Richardson iteration
 template <short nvars>
 RichardsonSolver<nvars>::RichardsonSolver(const UMesh2dh *const mesh, 
 		LinearOperator<a_real,a_int> *const mat,
-		Preconditioner<nvars> *const precond)
-	: IterativeSolver<nvars>(mesh, mat, precond)
-{ }
+		Preconditioner<nvars> *const precond, const int anderson_depth)
+	: IterativeSolver<nvars>(mesh, mat, precond), accel(anderson_depth)
+{
+	work.setup(2, m->gnelem(), nvars);
+	if(anderson_depth > 0)
+		accel.setup(m->gnelem(), nvars);
+}
 
 template <short nvars>
 int RichardsonSolver<nvars>::solve(const MVector& res, 
 		MVector& __restrict du) const
 {
+	perf::ScopedTimer tmr(perf::LINEAR_SOLVE);
 	struct timeval time1, time2;
 	gettimeofday(&time1, NULL);
 	double initialwtime = (double)time1.tv_sec + (double)time1.tv_usec * 1.0e-6;
@@ -535,12 +1532,16 @@ int RichardsonSolver<nvars>::solve(const MVector& res,
 	a_real resnorm = 100.0, bnorm = 0;
 	int step = 0;
 	const a_int N = m->gnelem()*nvars;
-	MVector s(m->gnelem(),nvars);
-	MVector ddu(m->gnelem(),nvars);
+	MVector& s = work.vec(0);
+	MVector& ddu = work.vec(1);
 
 	// norm of RHS
 	bnorm = std::sqrt(dot(N, res.data(),res.data()));
 
+	const bool accelerate = accel.historyDepth() > 0;
+	if(accelerate)
+		accel.reset();
+
 	while(step < maxiter)
 	{
 		A->gemv3(-1.0,du.data(), -1.0,res.data(), s.data());
@@ -550,7 +1551,10 @@ int RichardsonSolver<nvars>::solve(const MVector& res,
 
 		prec->apply(s.data(), ddu.data());
 
-		axpby(N, 1.0, du.data(), 1.0, ddu.data());
+		if(accelerate)
+			accel.update(du, ddu);
+		else
+			axpby(N, 1.0, du.data(), 1.0, ddu.data());
 
 		step++;
 	}
@@ -567,25 +1571,30 @@ BiCGSTAB<nvars>::BiCGSTAB(const UMesh2dh *const mesh,
 		LinearOperator<a_real,a_int> *const mat,
 		Preconditioner<nvars> *const precond)
 	: IterativeSolver<nvars>(mesh, mat, precond)
-{ }
+{
+	work.setup(7, m->gnelem(), nvars);
+}
 
 template <short nvars>
 int BiCGSTAB<nvars>::solve(const MVector& res, 
 		MVector& __restrict du) const
 {
+	perf::ScopedTimer tmr(perf::LINEAR_SOLVE);
+
 	a_real resnorm = 100.0, bnorm = 0;
 	int step = 0;
 	const a_int N = m->gnelem()*nvars;
 
 	a_real omega = 1.0, rho, rhoold = 1.0, alpha = 1.0, beta;
-	MVector r(m->gnelem(),nvars);
-	MVector rhat(m->gnelem(), nvars);
-	MVector p = MVector::Zero(m->gnelem(),nvars);
-	MVector v = MVector::Zero(m->gnelem(),nvars);
-	MVector y(m->gnelem(),nvars);
-	MVector z(m->gnelem(),nvars);
-	MVector t(m->gnelem(),nvars);
-	MVector g(m->gnelem(),nvars);
+	MVector& r = work.vec(0);
+	MVector& rhat = work.vec(1);
+	MVector& p = work.vec(2);
+	MVector& v = work.vec(3);
+	MVector& y = work.vec(4);
+	MVector& z = work.vec(5);
+	MVector& t = work.vec(6);
+	p.setZero();
+	v.setZero();
 
 	struct timeval time1, time2;
 	gettimeofday(&time1, NULL);
@@ -602,7 +1611,7 @@ int BiCGSTAB<nvars>::solve(const MVector& res,
 		bnorm += res.row(iel).squaredNorm();
 		rhat.row(iel) = r.row(iel);
 	}
-	bnorm = std::sqrt(bnorm);
+	bnorm = std::sqrt(commSum(bnorm));
 
 	while(step < maxiter)
 	{
@@ -667,24 +1676,27 @@ GMRES<nvars>::GMRES(const UMesh2dh *const mesh,
 		LinearOperator<a_real,a_int> *const mat,
 		Preconditioner<nvars> *const precond,
 		int m_restart)
-	: IterativeSolver<nvars>(mesh, mat, precond), mrestart(m_restart)
-{ }
+	: IterativeSolver<nvars>(mesh, mat, precond), mrestart(m_restart),
+	H(mrestart+1,mrestart), be1(mrestart+1), z(mrestart), qr(mrestart+1,mrestart)
+{
+	work.setup(3, m->gnelem(), nvars, mrestart);
+}
 
 template <short nvars>
 int GMRES<nvars>::solve(const MVector& res, 
 		MVector& __restrict du) const
 {
+	perf::ScopedTimer tmr(perf::LINEAR_SOLVE);
+
 	const a_int N = m->gnelem()*nvars;
 	int step = 0;
 
-	MVector r(m->gnelem(),nvars);
-	Matrix<a_real,Dynamic,Dynamic, ColMajor> V 
-		= Matrix<a_real,Dynamic,Dynamic>::Zero(N, mrestart);
-	Matrix<a_real,Dynamic,1> w = Matrix<a_real,Dynamic,1>::Zero(N);
-	Matrix<a_real,Dynamic,1> y = Matrix<a_real,Dynamic,1>::Zero(N);
-	Matrix<a_real,Dynamic,Dynamic> H(mrestart+1,mrestart);
-	
-	Matrix<a_real,Dynamic,1> be1 = Matrix<a_real,Dynamic,1>::Zero(mrestart+1);
+	MVector& r = work.vec(0);
+	MVector& w = work.vec(1);
+	MVector& y = work.vec(2);
+	Matrix<a_real,Dynamic,Dynamic,ColMajor>& V = work.basisVectors();
+	H.setZero();
+	be1.setZero();
 
 	struct timeval time1, time2;
 	gettimeofday(&time1, NULL);
@@ -700,13 +1712,16 @@ int GMRES<nvars>::solve(const MVector& res,
 		be1(0) = dot(N, V.data(),V.data());
 		be1(0) = std::sqrt(be1(0));
 		
+		{
+			perf::ScopedTimer vtmr(perf::KRYLOV_VECOPS);
 #pragma omp parallel for simd default(shared)
-		for(a_int k = 0; k < N; k++)
-			V(k,0) = V(k,0)/be1(0);
+			for(a_int k = 0; k < N; k++)
+				V(k,0) = V(k,0)/be1(0);
+		}
 
 		for(int j = 0; j < mrestart; j++)
 		{
-			A->apply(1.0, &V(0,j), &y(0));
+			A->apply(1.0, &V(0,j), y.data());
 			prec->apply(y.data(), w.data());
 
 			for(int i = 0; i <= j; i++)
@@ -717,26 +1732,28 @@ int GMRES<nvars>::solve(const MVector& res,
 			}
 			H(j+1,j) = std::sqrt( dot(N, w.data(),w.data()) );
 			
-			if(j < mrestart-1)
+			if(j < mrestart-1) {
+				perf::ScopedTimer vtmr(perf::KRYLOV_VECOPS);
 #pragma omp parallel for simd default(shared)
 				for(a_int k=0; k < N; k++)
-					V(k,j+1) = w(k)/H(j+1,j);
+					V(k,j+1) = w.data()[k]/H(j+1,j);
+			}
 		}
 
-		Matrix<a_real,Dynamic,1> z(mrestart);
-
 		// Solve least-squares to get z
-		Eigen::HouseholderQR<Matrix<a_real,Dynamic,Dynamic>> qr(mrestart+1,mrestart);
 		qr.compute(H);
 		z = qr.solve(be1);
 		//z = H.householderQr().solve();
 
-#pragma omp parallel default(shared)
-		for(int i = 0; i < mrestart; i++)
 		{
+			perf::ScopedTimer vtmr(perf::KRYLOV_VECOPS);
+#pragma omp parallel default(shared)
+			for(int i = 0; i < mrestart; i++)
+			{
 #pragma omp for simd
-			for(a_int k = 0; k < N; k++)
-				du.data()[k] += z(i) * V(k,i);
+				for(a_int k = 0; k < N; k++)
+					du.data()[k] += z(i) * V(k,i);
+			}
 		}
 
 		step++;
@@ -755,6 +1772,271 @@ int GMRES<nvars>::solve(const MVector& res,
 	return step+1;
 }
 
+template <short nvars>
+GCRODR<nvars>::GCRODR(const UMesh2dh *const mesh, 
+		LinearOperator<a_real,a_int> *const mat,
+		Preconditioner<nvars> *const precond,
+		const int m_restart, const int n_recycle)
+	: IterativeSolver<nvars>(mesh, mat, precond), mrestart(m_restart),
+	nrecycle(std::max(0, std::min(n_recycle, m_restart/2))), nrec(0),
+	ucol(mrestart+1), ccol(ucol+nrecycle), tcol(ccol+nrecycle),
+	G(mrestart+1,mrestart), R(mrestart+1,mrestart), g(mrestart+1), cs(mrestart), sn(mrestart),
+	d(std::max(nrecycle,1)), z(mrestart), t(mrestart+1)
+{
+	// Arnoldi vectors, followed by U, C and space for the next U and C
+	work.setup(2, m->gnelem(), nvars, mrestart+1 + 4*nrecycle);
+}
+
+template <short nvars>
+void GCRODR<nvars>::updateRecycledImages() const
+{
+	const a_int N = m->gnelem()*nvars;
+	MVector& y = work.vec(0);
+
+	for(int i = 0; i < nrec; i++) {
+		A->apply(1.0, col(ucol+i), y.data());
+		prec->apply(y.data(), col(ccol+i));
+	}
+
+	// modified Gram-Schmidt on C, applying the same operations to U to keep C = M^(-1) A U;
+	//  vectors that have become linearly dependent are dropped
+	int nkept = 0;
+	for(int i = 0; i < nrec; i++)
+	{
+		a_real *const ci = col(ccol+i);
+		a_real *const ui = col(ucol+i);
+		const a_real cnorm = std::sqrt(dot(N, ci,ci));
+		for(int j = 0; j < nkept; j++) {
+			const a_real rji = dot(N, col(ccol+j), ci);
+			axpby(N, 1.0,ci, -rji,col(ccol+j));
+			axpby(N, 1.0,ui, -rji,col(ucol+j));
+		}
+		const a_real rii = std::sqrt(dot(N, ci,ci));
+		if(rii <= 1e-10*cnorm)
+			continue;
+
+		a_real *const ck = col(ccol+nkept);
+		a_real *const uk = col(ucol+nkept);
+#pragma omp parallel for simd default(shared)
+		for(a_int l = 0; l < N; l++) {
+			ck[l] = ci[l]/rii;
+			uk[l] = ui[l]/rii;
+		}
+		nkept++;
+	}
+	nrec = nkept;
+}
+
+template <short nvars>
+void GCRODR<nvars>::updateRecycledSpace(const int q) const
+{
+	typedef Matrix<a_real,Dynamic,Dynamic> DMatrix;
+	const a_int N = m->gnelem()*nvars;
+	const int kk = nrec, s = kk+q;
+	const int knew = std::min(nrecycle, s);
+	if(knew == 0)
+		return;
+
+	/* The cycle's search space is W = [U D, V_0..V_(q-1)] and its image under the operator
+	 * is in [C, V_0..V_q] times G. Harmonic Ritz vectors W p solve
+	 *   G^T G p = theta G^T [C, V]^T W p.
+	 */
+	DMatrix VW = DMatrix::Zero(s+1,s);
+	for(int j = 0; j < kk; j++) {
+		for(int i = 0; i < kk; i++)
+			VW(i,j) = d(j)*dot(N, col(ccol+i), col(ucol+j));
+		for(int i = 0; i <= q; i++)
+			VW(kk+i,j) = d(j)*dot(N, col(i), col(ucol+j));
+	}
+	for(int j = 0; j < q; j++)
+		VW(kk+j,kk+j) = 1.0;
+
+	const DMatrix Gs = G.topLeftCorner(s+1,s);
+	Eigen::FullPivLU<DMatrix> lu(Gs.transpose()*VW);
+	if(!lu.isInvertible())
+		return;
+	Eigen::EigenSolver<DMatrix> es(lu.solve(Gs.transpose()*Gs));
+	if(es.info() != Eigen::Success)
+		return;
+
+	// eigenvectors of the smallest harmonic Ritz values; complex pairs contribute their
+	//  real and imaginary parts
+	std::vector<int> order(s);
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&es](const int a, const int b) {
+			return std::abs(es.eigenvalues()(a)) < std::abs(es.eigenvalues()(b)); });
+
+	DMatrix P(s,knew);
+	int np = 0;
+	for(int i = 0; i < s && np < knew; i++)
+	{
+		const std::complex<a_real> theta = es.eigenvalues()(order[i]);
+		if(theta.imag() < 0)
+			continue;
+		P.col(np++) = es.eigenvectors().col(order[i]).real();
+		if(theta.imag() > 0 && np < knew)
+			P.col(np++) = es.eigenvectors().col(order[i]).imag();
+	}
+
+	// G P = Q Rq; the new C is [C, V] Q and the new U is W P Rq^(-1)
+	const DMatrix GP = Gs*P.leftCols(np);
+	Eigen::HouseholderQR<DMatrix> qrf(GP);
+	const DMatrix Q = qrf.householderQ() * DMatrix::Identity(s+1,np);
+	const DMatrix Rq = qrf.matrixQR().topLeftCorner(np,np).template triangularView<Eigen::Upper>();
+	for(int i = 0; i < np; i++)
+		if(std::abs(Rq(i,i)) <= 1e-14*Rq.cwiseAbs().maxCoeff())
+			return;
+	const DMatrix PR = Rq.transpose().template triangularView<Eigen::Lower>()
+		.solve(P.leftCols(np).transpose()).transpose();
+
+	{
+		perf::ScopedTimer vtmr(perf::KRYLOV_VECOPS);
+#pragma omp parallel for default(shared)
+		for(a_int l = 0; l < N; l++)
+		{
+			for(int jn = 0; jn < np; jn++)
+			{
+				a_real unew = 0, cnew = 0;
+				for(int i = 0; i < kk; i++) {
+					unew += PR(i,jn)*d(i)*col(ucol+i)[l];
+					cnew += Q(i,jn)*col(ccol+i)[l];
+				}
+				for(int j = 0; j < q; j++)
+					unew += PR(kk+j,jn)*col(j)[l];
+				for(int j = 0; j <= q; j++)
+					cnew += Q(kk+j,jn)*col(j)[l];
+				col(tcol+jn)[l] = unew;
+				col(tcol+nrecycle+jn)[l] = cnew;
+			}
+		}
+	}
+
+	std::swap(ucol, tcol);
+	ccol = ucol+nrecycle;
+	nrec = np;
+}
+
+template <short nvars>
+int GCRODR<nvars>::solve(const MVector& res, 
+		MVector& __restrict du) const
+{
+	perf::ScopedTimer tmr(perf::LINEAR_SOLVE);
+	struct timeval time1, time2;
+	gettimeofday(&time1, NULL);
+	double initialwtime = (double)time1.tv_sec + (double)time1.tv_usec * 1.0e-6;
+	double initialctime = (double)clock() / (double)CLOCKS_PER_SEC;
+
+	const a_int N = m->gnelem()*nvars;
+	MVector& r = work.vec(0);
+	MVector& rho = work.vec(1);
+	int iter = 0;
+
+	// r := -res - A du, and the preconditioned residual rho := M^(-1) r
+	A->gemv3(-1.0,du.data(), -1.0,res.data(), r.data());
+	prec->apply(r.data(), rho.data());
+	const a_real beta0 = std::sqrt(dot(N, rho.data(),rho.data()));
+	a_real beta = beta0;
+
+	// solve in the recycled space first: du := du + U C^T rho, rho := rho - C C^T rho
+	if(beta0 > 0 && nrec > 0)
+	{
+		updateRecycledImages();
+		for(int i = 0; i < nrec; i++) {
+			const a_real ci = dot(N, col(ccol+i), rho.data());
+			axpby(N, 1.0,du.data(), ci,col(ucol+i));
+			axpby(N, 1.0,rho.data(), -ci,col(ccol+i));
+		}
+		beta = std::sqrt(dot(N, rho.data(),rho.data()));
+	}
+
+	while(beta > tol*beta0 && iter < maxiter)
+	{
+		const int kk = nrec;
+
+		axpby(N, 0.0,col(0), 1.0/beta,rho.data());
+		G.setZero(); R.setZero(); g.setZero();
+		g(kk) = beta;
+		for(int i = 0; i < kk; i++) {
+			d(i) = 1.0/std::sqrt(dot(N, col(ucol+i), col(ucol+i)));
+			G(i,i) = R(i,i) = d(i);
+		}
+
+		// Arnoldi process orthogonal to C, with the least-squares problem kept triangular
+		int q = 0;
+		for(int j = 0; j < mrestart-kk && iter < maxiter; j++)
+		{
+			a_real *const w = col(j+1);
+			A->apply(1.0, col(j), r.data());
+			prec->apply(r.data(), w);
+
+			for(int i = 0; i < kk; i++) {
+				G(i,kk+j) = dot(N, col(ccol+i), w);
+				axpby(N, 1.0,w, -G(i,kk+j),col(ccol+i));
+			}
+			for(int i = 0; i <= j; i++) {
+				G(kk+i,kk+j) = dot(N, col(i), w);
+				axpby(N, 1.0,w, -G(kk+i,kk+j),col(i));
+			}
+			G(kk+j+1,kk+j) = std::sqrt(dot(N, w,w));
+			if(G(kk+j+1,kk+j) > 0) {
+				const a_real hinv = 1.0/G(kk+j+1,kk+j);
+#pragma omp parallel for simd default(shared)
+				for(a_int l = 0; l < N; l++)
+					w[l] *= hinv;
+			}
+
+			R.col(kk+j) = G.col(kk+j);
+			for(int i = 0; i < j; i++) {
+				const a_real a = R(kk+i,kk+j), b = R(kk+i+1,kk+j);
+				R(kk+i,kk+j) = cs(i)*a + sn(i)*b;
+				R(kk+i+1,kk+j) = -sn(i)*a + cs(i)*b;
+			}
+			const a_real a = R(kk+j,kk+j), b = R(kk+j+1,kk+j);
+			const a_real rad = std::sqrt(a*a+b*b);
+			cs(j) = rad > 0 ? a/rad : 1.0;
+			sn(j) = rad > 0 ? b/rad : 0.0;
+			R(kk+j,kk+j) = rad;
+			R(kk+j+1,kk+j) = 0;
+			g(kk+j+1) = -sn(j)*g(kk+j);
+			g(kk+j) = cs(j)*g(kk+j);
+
+			iter++;
+			q = j+1;
+			if(std::abs(g(kk+j+1)) < tol*beta0 || G(kk+j+1,kk+j) == 0)
+				break;
+		}
+
+		const int s = kk+q;
+		z.head(s) = R.topLeftCorner(s,s).template triangularView<Eigen::Upper>().solve(g.head(s));
+
+		// du := du + [U D, V] z, and rho := [C, V] (beta e_kk - G z)
+		t.head(s+1) = -G.topLeftCorner(s+1,s)*z.head(s);
+		t(kk) += beta;
+		for(int i = 0; i < kk; i++)
+			axpby(N, 1.0,du.data(), z(i)*d(i),col(ucol+i));
+		for(int j = 0; j < q; j++)
+			axpby(N, 1.0,du.data(), z(kk+j),col(j));
+		axpby(N, 0.0,rho.data(), t(kk),col(0));
+		for(int i = 0; i < kk; i++)
+			axpby(N, 1.0,rho.data(), t(i),col(ccol+i));
+		for(int j = 1; j <= q; j++)
+			axpby(N, 1.0,rho.data(), t(kk+j),col(j));
+		beta = std::sqrt(dot(N, rho.data(),rho.data()));
+
+		if(nrecycle > 0)
+			updateRecycledSpace(q);
+	}
+
+	if(beta > tol*beta0)
+		std::cout << " ! GCRODR: Hit max iterations!\n";
+
+	gettimeofday(&time2, NULL);
+	double finalwtime = (double)time2.tv_sec + (double)time2.tv_usec * 1.0e-6;
+	double finalctime = (double)clock() / (double)CLOCKS_PER_SEC;
+	walltime += (finalwtime-initialwtime); cputime += (finalctime-initialctime);
+	return iter;
+}
+
 template <short nvars>
 MFIterativeSolver<nvars>::MFIterativeSolver(const UMesh2dh* const mesh, 
 		Preconditioner<nvars> *const precond, Spatial<nvars> *const spatial)
@@ -780,14 +2062,20 @@ void MFIterativeSolver<nvars>::setupPreconditioner()
 	double finalwtime = (double)time2.tv_sec + (double)time2.tv_usec * 1.0e-6;
 	double finalctime = (double)clock() / (double)CLOCKS_PER_SEC;
 	walltime += (finalwtime-initialwtime); cputime += (finalctime-initialctime);
+	setupwalltime += (finalwtime-initialwtime); setupcputime += (finalctime-initialctime);
 }
 
 // Richardson iteration
 template <short nvars>
 MFRichardsonSolver<nvars>::MFRichardsonSolver(const UMesh2dh *const mesh, 
-		Preconditioner<nvars> *const precond, Spatial<nvars> *const spatial)
-	: MFIterativeSolver<nvars>(mesh, precond, spatial)
-{ }
+		Preconditioner<nvars> *const precond, Spatial<nvars> *const spatial,
+		const int anderson_depth)
+	: MFIterativeSolver<nvars>(mesh, precond, spatial), accel(anderson_depth)
+{
+	work.setup(2, m->gnelem(), nvars);
+	if(anderson_depth > 0)
+		accel.setup(m->gnelem(), nvars);
+}
 
 template <short nvars>
 int MFRichardsonSolver<nvars>::solve(const MVector& __restrict__ u,
@@ -796,6 +2084,7 @@ int MFRichardsonSolver<nvars>::solve(const MVector& __restrict__ u,
 		MVector& __restrict__ aux,
 		MVector& __restrict__ du) const
 {
+	perf::ScopedTimer tmr(perf::LINEAR_SOLVE);
 	struct timeval time1, time2;
 	gettimeofday(&time1, NULL);
 	double initialwtime = (double)time1.tv_sec + (double)time1.tv_usec * 1.0e-6;
@@ -805,13 +2094,10 @@ int MFRichardsonSolver<nvars>::solve(const MVector& __restrict__ u,
 	int step = 0;
 
 	// linear system residual
-	MVector s(m->gnelem(), nvars);
+	MVector& s = work.vec(0);
 
 	// linear system defect
-	MVector ddu(m->gnelem(), nvars);
-		//= MVector::Zero(m->gnelem(), nvars);
-	// dummy
-	amat::Array2d<a_real> dum;
+	MVector& ddu = work.vec(1);
 
 	// norm of RHS
 #pragma omp parallel for reduction(+:bnorm) default(shared)
@@ -819,7 +2105,11 @@ int MFRichardsonSolver<nvars>::solve(const MVector& __restrict__ u,
 	{
 		bnorm += res.row(iel).squaredNorm();
 	}
-	bnorm = std::sqrt(bnorm);
+	bnorm = std::sqrt(commSum(bnorm));
+
+	const bool accelerate = accel.historyDepth() > 0;
+	if(accelerate)
+		accel.reset();
 
 	while(step < maxiter)
 	{
@@ -850,7 +2140,7 @@ int MFRichardsonSolver<nvars>::solve(const MVector& __restrict__ u,
 			// compute norm
 			resnorm += s.row(iel).squaredNorm();
 		}
-		resnorm = std::sqrt(resnorm);
+		resnorm = std::sqrt(commSum(resnorm));
 		
 		std::cout << "   MFRichardsonSolver: Lin res = " << resnorm/bnorm << std::endl;
 		
@@ -858,7 +2148,10 @@ int MFRichardsonSolver<nvars>::solve(const MVector& __restrict__ u,
 
 		prec->apply(s.data(), ddu.data());
 
-		axpby(m->gnelem()*nvars, 1.0, du.data(), 1.0, ddu.data());
+		if(accelerate)
+			accel.update(du, ddu);
+		else
+			axpby(m->gnelem()*nvars, 1.0, du.data(), 1.0, ddu.data());
 
 		step++;
 	}
@@ -870,12 +2163,19 @@ int MFRichardsonSolver<nvars>::solve(const MVector& __restrict__ u,
 	return step;
 }
 
+template class MatrixFreeLUSGS<NVARS>;
+template class MatrixFreeLUSGS<1>;
+template class Polynomial<NVARS>;
+template class Polynomial<1>;
+
 template class RichardsonSolver<NVARS>;
 template class BiCGSTAB<NVARS>;
 template class GMRES<NVARS>;
+template class GCRODR<NVARS>;
 template class MFRichardsonSolver<NVARS>;
 template class RichardsonSolver<1>;
 template class BiCGSTAB<1>;
 template class GMRES<1>;
+template class GCRODR<1>;
 
 }
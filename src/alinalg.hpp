@@ -8,6 +8,9 @@
 #include <linearoperator.hpp>
 
 #include "aconstants.hpp"
+#include <vector>
+#include <Eigen/QR>
+#include <Eigen/Cholesky>
 
 #ifndef __AMESH2DH_H
 #include "amesh2dh.hpp"
@@ -17,6 +20,14 @@
 #include "aspatial.hpp"
 #endif
 
+#ifndef __APERF_H
+#include "aperf.hpp"
+#endif
+
+#ifndef __AMEMORY_H
+#include "amemory.hpp"
+#endif
+
 #define __ALINALG_H
 
 namespace blasted {
@@ -32,6 +43,12 @@ using acfd::MVector;
 
 /// A sparse matrix stored in a `DLU' format
 /** Includes some BLAS 2 and preconditioning operations
+ *
+ * On the local mesh of a partitioned domain, the matrix also stores one block for each face
+ * shared with another subdomain, coupling the cell inside to the neighbouring subdomain's
+ * cell. These blocks are used in matrix-vector products, but not by the preconditioners,
+ * which therefore act as block-Jacobi (non-overlapping additive Schwarz) preconditioners
+ * across subdomains, with the chosen preconditioner inside each subdomain.
  */
 template <int bs>
 class DLUMatrix : public LinearOperator<a_real,a_int>
@@ -46,6 +63,13 @@ protected:
 	Matrix<a_real,bs,bs,RowMajor>* L;
 	/// `Upper' blocks
 	Matrix<a_real,bs,bs,RowMajor>* U;
+
+	/// Communication with neighbouring subdomains, or null
+	const acfd::HaloExchange *const halo;
+	/// Blocks coupling cells to neighbouring subdomains, indexed by boundary face
+	Matrix<a_real,bs,bs,RowMajor>* B;
+	/// Entries of the vector being multiplied in neighbouring subdomains' cells
+	mutable MVector xhalo;
 	
 	/// ILU factor - diagonal blocks (also used for BJ and SGS preconditioners)
 	Matrix<a_real,bs,bs,RowMajor>* luD;
@@ -53,6 +77,9 @@ protected:
 	Matrix<a_real,bs,bs,RowMajor>* luL;
 	/// ILU factor - `upper blocks
 	Matrix<a_real,bs,bs,RowMajor>* luU;
+
+	/// Whether the Jacobi and ILU factors overwrite D, L and U \sa setInPlaceFactorization
+	bool inplace;
 	
 	/// Number of sweeps used to build preconditioners
 	const short nbuildsweeps;
@@ -66,9 +93,111 @@ protected:
 	/// Temporary array for triangular solves
 	mutable MVector y;
 
+	/// Cells of the lines used by line preconditioners, one line after another
+	/** Cells that are not on any line form lines of their own.
+	 */
+	std::vector<a_int> linecells;
+	/// Start of each line in \ref linecells; has one more entry than there are lines
+	std::vector<a_int> linestart;
+	/// Interior face between each cell of a line and the next cell, at the same index
+	std::vector<a_int> linefaces;
+	/// Position in \ref linecells of each cell
+	std::vector<a_int> cellpos;
+	/// Inverses of the pivot blocks of the block-tridiagonal LU factorization of each line,
+	/// in the order of \ref linecells
+	Matrix<a_real,bs,bs,RowMajor>* lineD;
+
+	/// The block of row cell i and column cell j, which share interior face 'face'
+	const Matrix<a_real,bs,bs,RowMajor>& offDiagBlock(const a_int i, const a_int j,
+			const a_int face) const
+	{
+		return j > i ? U[face] : L[face];
+	}
+
+	/// Groups cells into lines that follow the strongest connections between cells
+	/** The strength of the connection between two cells is the length of their common face
+	 * divided by the distance between their centres. Lines are grown from the most
+	 * anisotropic cells, ie, those whose strongest connection is several times stronger
+	 * than their weakest. A line is extended from a cell to the neighbour it is most
+	 * strongly connected to, other than the one it was reached from, as long as that
+	 * neighbour is not yet on a line, and the connection is among the neighbour's two
+	 * strongest and several times stronger than the weakest connections of both cells.
+	 */
+	void extractLines();
+
+	/// Solves the block-tridiagonal system of one line with the factorization in \ref lineD
+	/** \param[in] iline The line
+	 * \param[in,out] b The right hand side in the rows of the line's cells; overwritten
+	 * \param[out] z The solution is written into the rows of the line's cells
+	 */
+	void lineSolve(const a_int iline, MVector& b, Eigen::Map<MVector>& z) const;
+
+	/// Start of each block-row's off-diagonal blocks in the ILU schedule; nelem+1 entries
+	/** The ILU schedule lists the off-diagonal blocks of each block-row, lower ones first,
+	 * each sorted by the index of the neighbouring cell, as the factorization needs them.
+	 * For each block, it also lists the pairs of factor blocks L_ik, U_kj whose products are
+	 * subtracted from it. It only depends on the mesh and is computed once, by
+	 * \ref computeILUSchedule, so that \ref precILUSetup only does block arithmetic.
+	 */
+	std::vector<a_int> ilurowstart;
+	/// Start of each block-row's upper blocks in the ILU schedule
+	std::vector<a_int> ilurowupper;
+	/// Interior face of each off-diagonal block in the ILU schedule
+	std::vector<a_int> ilufaces;
+	/// Neighbouring cell, ie. block-column, of each off-diagonal block in the ILU schedule
+	std::vector<a_int> iluelems;
+	/// Start of each off-diagonal block's updates in \ref iluupdates
+	std::vector<a_int> iluupdstart;
+	/// Interior faces of the blocks L_ik and U_kj of each update, in pairs
+	std::vector<a_int> iluupdates;
+
+	/// Computes the ILU schedule from the mesh
+	void computeILUSchedule();
+
+	/// A subdomain of the thread-parallel additive Schwarz preconditioner, and its factors
+	/** Its cells are numbered locally in increasing order of their indices, and its
+	 * storage is allocated and first touched by the thread that works on it.
+	 */
+	struct Subdomain
+	{
+		a_int ownstart;				///< First cell owned by the subdomain
+		a_int ownend;				///< One past the last cell owned by the subdomain
+		std::vector<a_int> cells;	///< Owned and overlap cells, in increasing order
+		/// Start of each local cell's neighbours in \ref nbpos; has one more entry than cells
+		std::vector<a_int> nbstart;
+		/// Start of the neighbours of each local cell having a higher local index
+		std::vector<a_int> nbupper;
+		std::vector<a_int> nbpos;	///< Local index of each neighbour in the subdomain, increasing
+		std::vector<a_int> nbface;	///< Interior face shared with each neighbour
+		/// Inverses of the pivots of the ILU0 factorization, one per local cell
+		Matrix<a_real,bs,bs,RowMajor>* Dinv;
+		/// Off-diagonal blocks of the factors, at the same index as \ref nbpos
+		Matrix<a_real,bs,bs,RowMajor>* off;
+		mutable MVector y;			///< Local vector for the triangular solves
+	};
+
+	/// Subdomains of the additive Schwarz preconditioner, one per thread
+	std::vector<Subdomain> subdomains;
+	/// Number of layers of overlap of the subdomains
+	int schwarzoverlap;
+
+	/// Divides the cells among as many subdomains as there are threads
+	/** Each subdomain owns a contiguous range of cells, and is extended by the given number
+	 * of layers of neighbouring cells.
+	 */
+	void setupSubdomains(const int overlap);
+
+	/// Completes the exchange of the vector being multiplied and adds a times its products
+	/// with the blocks coupling to neighbouring subdomains to z
+	void addHaloProducts(const a_real a, Eigen::Map<MVector>& z) const;
+
 public:
+	/** \param haloexchange Communication with neighbouring subdomains if the mesh is
+	 *   the local mesh of a partitioned domain, or null
+	 */
 	DLUMatrix(const acfd::UMesh2dh *const mesh, 
-			const short nbuildsweeps, const short napplysweeps);
+			const short nbuildsweeps, const short napplysweeps,
+			const acfd::HaloExchange *const haloexchange = nullptr);
 
 	/// De-allocates memory
 	virtual ~DLUMatrix();
@@ -88,8 +217,10 @@ public:
 	 * \param[in] startj The column index
 	 * \param[in] buffer The block of values to be inserted in ROW-MAJOR ordering
 	 * \param[in] lud 0, 1 or 2, depending on whether the block being updated is in the
-	 *   diagonal, lower or upper part of the matrix
-	 * \param[in] faceid The INTERIOR face index of the face shared between cells i and j
+	 *   diagonal, lower or upper part of the matrix; or 3 for the block coupling a cell to
+	 *   a neighbouring subdomain, which is ignored if the matrix has no halo
+	 * \param[in] faceid The INTERIOR face index of the face shared between cells i and j,
+	 *   or the boundary face index for lud = 3
 	 */
 	void submitBlock(const a_int starti, const a_int startj, 
 			const a_real *const buffer,
@@ -140,15 +271,78 @@ public:
 	void precSGSApply(const a_real *const r, a_real *const __restrict z) const;
 
 	/// Computes an incomplete block lower-upper factorization
+	/** The elimination order and the blocks involved in each update are computed from the
+	 * mesh the first time, see \ref ilurowstart.
+	 */
 	void precILUSetup();
 
 	/// Applies a block LU factorization
 	void precILUApply(const a_real *const r, a_real *const __restrict z) const;
 
+	/// Factors the block-tridiagonal part of the matrix along each line of cells
+	/** The lines are extracted from the mesh the first time, see \ref extractLines.
+	 */
+	void precLineSetup();
+
+	/// Applies the line-Jacobi preconditioner
+	/** Solves the block-tridiagonal systems of all lines independently, ignoring the coupling
+	 * between lines.
+	 */
+	void precLineJacobiApply(const a_real *const r, a_real *const __restrict z) const;
+
+	/// Applies symmetric line Gauss-Seidel sweeps, starting from zero
+	/** Each sweep solves the system of each line in turn, forward and then backward over the
+	 * lines, using the latest values in the other lines. The lines are distributed among
+	 * threads, which do not wait for each other's results, like \ref precSGSApply.
+	 * The number of sweeps is the number of application sweeps.
+	 * \warning allocTempVector() must have been called before.
+	 */
+	void precLineSGSApply(const a_real *const r, a_real *const __restrict z) const;
+
+	/// Computes exact ILU0 factorizations of the thread subdomains of the matrix
+	/** The cells are divided into one subdomain per thread when this is first called, or
+	 * when the number of threads has changed, see \ref setupSubdomains. Each thread then
+	 * factors the submatrix of its subdomain sequentially, so that, unlike
+	 * \ref precILUSetup, the result only depends on the number of threads and not on the
+	 * order in which they do their work.
+	 * \param overlap Number of layers of cells by which subdomains overlap each other
+	 */
+	void precSchwarzSetup(const int overlap);
+
+	/// Applies the restricted additive Schwarz preconditioner
+	/** Each thread solves with the factors of its subdomain, and writes the result
+	 * only for the cells it owns.
+	 */
+	void precSchwarzApply(const a_real *const r, a_real *const __restrict z) const;
+
+	/// Number of subdomains of the additive Schwarz preconditioner; 0 before it is set up
+	int numSubdomains() const { return (int)subdomains.size(); }
+
+	/// Number of lines, counting cells not on a line as lines of one cell; 0 before
+	/// line preconditioners are set up
+	a_int numLines() const { return linestart.empty() ? 0 : (a_int)linestart.size()-1; }
+
 	a_int dim() const { return m->gnelem()*bs; }
 	
 	/// Prints diagonal, L or U blocks depending on the argument
 	void printDiagnostic(const char choice) const;
+
+	/// Sets whether the block-Jacobi and ILU0 preconditioners are computed in place
+	/** The factors then overwrite D, L and U instead of being stored separately, which
+	 * saves the memory of a second matrix when the matrix is only used to build one of
+	 * these preconditioners and is recomputed before each setup. Products with the matrix
+	 * are wrong after the setup, and other preconditioners, which need the matrix as well,
+	 * must not be used. ILU0 is only computed in place if it is built in one sweep, as more
+	 * sweeps need the original matrix.
+	 * Must be called before any preconditioner is set up.
+	 */
+	void setInPlaceFactorization(const bool factorinplace) { inplace = factorinplace; }
+
+	/// Adds the memory used by the matrix and its preconditioners to a report
+	/** \param report The report to add to
+	 * \param name Name of the matrix in the report
+	 */
+	void reportMemory(acfd::memory::Report& report, const std::string& name) const;
 };
 
 }
@@ -162,10 +356,15 @@ namespace acfd {
 inline void axpby(const a_int N, const a_real p, a_real *const __restrict z, 
 	const a_real q, const a_real *const x)
 {
+	perf::ScopedTimer tmr(perf::KRYLOV_VECOPS);
 	//a_real *const zz = &z(0,0); const a_real *const xx = &x(0,0);
-#pragma omp parallel for simd default(shared)
-	for(a_int i = 0; i < N; i++) {
-		z[i] = p*z[i] + q*x[i];
+#pragma omp parallel default(shared)
+	{
+		perf::ScopedTimer ttmr(perf::KRYLOV_VECOPS);
+#pragma omp for simd nowait
+		for(a_int i = 0; i < N; i++) {
+			z[i] = p*z[i] + q*x[i];
+		}
 	}
 }
 
@@ -175,23 +374,34 @@ inline void axpbypcz(const a_int N, const a_real p, a_real *const z,
 	const a_real q, const a_real *const x,
 	const a_real r, const a_real *const y)
 {
+	perf::ScopedTimer tmr(perf::KRYLOV_VECOPS);
 	//a_real *const zz = &z(0,0); const a_real *const xx =&x(0,0); const a_real *const yy = &y(0,0);
-#pragma omp parallel for simd default(shared)
-	for(a_int i = 0; i < N; i++) {
-		z[i] = p*z[i] + q*x[i] + r*y[i];
+#pragma omp parallel default(shared)
+	{
+		perf::ScopedTimer ttmr(perf::KRYLOV_VECOPS);
+#pragma omp for simd nowait
+		for(a_int i = 0; i < N; i++) {
+			z[i] = p*z[i] + q*x[i] + r*y[i];
+		}
 	}
 }
 
-/// Dot product of vectors or `double dot' product of matrices
+/// Dot product of vectors or `double dot' product of matrices, over all ranks
 inline a_real dot(const a_int N, const a_real *const a, 
 	const a_real *const b)
 {
+	perf::ScopedTimer tmr(perf::KRYLOV_VECOPS);
 	a_real sum = 0;
-#pragma omp parallel for simd default(shared) reduction(+:sum)
-	for(a_int i = 0; i < N; i++)
-		sum += a[i]*b[i];
+#pragma omp parallel default(shared) reduction(+:sum)
+	{
+		perf::ScopedTimer ttmr(perf::KRYLOV_VECOPS);
+#pragma omp for simd nowait
+		for(a_int i = 0; i < N; i++)
+			sum += a[i]*b[i];
+	}
 
-	return sum;
+	// over all subdomains
+	return commSum(sum);
 }
 
 
@@ -224,6 +434,12 @@ public:
 	 */
 	virtual void apply(const a_real *const r, 
 			a_real *const z) = 0;
+
+	/// Adds the memory used by the preconditioner itself to a report
+	/** Factors stored by the matrix are reported by the matrix. Does nothing by default.
+	 */
+	virtual void reportMemory(memory::Report& report, const std::string& name) const
+	{ }
 };
 
 /// Do-nothing preconditioner
@@ -244,6 +460,7 @@ public:
 	void apply(const a_real *const r, 
 			a_real *const z)
 	{
+		perf::ScopedTimer tmr(perf::PREC_APPLY);
 #pragma omp parallel for simd default(shared)
 		for(a_int i = 0; i < A->dim(); i++)
 			z[i] = r[i];
@@ -260,11 +477,13 @@ public:
 	Jacobi(LinearOperator<a_real,a_int> *const op) : Preconditioner<nvars>(op) { }
 	
 	void compute() {
+		perf::ScopedTimer tmr(perf::PREC_SETUP);
 		A->precJacobiSetup();
 	}
 
 	void apply(const a_real *const r, 
 			a_real *const __restrict z) {
+		perf::ScopedTimer tmr(perf::PREC_APPLY);
 		A->precJacobiApply(r, z);
 	}
 };
@@ -283,11 +502,13 @@ public:
 
 	/// Sets D,L,U and inverts each D
 	void compute() {
+		perf::ScopedTimer tmr(perf::PREC_SETUP);
 		A->precJacobiSetup();
 	}
 
 	void apply(const a_real *const r, 
 			a_real *const __restrict z) {
+		perf::ScopedTimer tmr(perf::PREC_APPLY);
 		A->precSGSApply(r, z);
 	}
 };
@@ -303,16 +524,363 @@ public:
 
 	/// Sets D,L,U and computes the ILU factorization
 	void compute() {
+		perf::ScopedTimer tmr(perf::PREC_SETUP);
 		A->precILUSetup();
 	}
 	
 	/// Solves Mz=r, where M is the preconditioner
 	void apply(const a_real *const r, 
 			a_real *const __restrict z) {
+		perf::ScopedTimer tmr(perf::PREC_APPLY);
 		A->precILUApply(r, z);
 	}
 };
 
+/// Line-Jacobi preconditioner
+/** Only available for DLU matrices; otherwise, block-Jacobi is used instead.
+ */
+template <short nvars>
+class LineJacobi : public Preconditioner<nvars>
+{
+	using Preconditioner<nvars>::A;
+	blasted::DLUMatrix<nvars> *const dlu;
+
+public:
+	LineJacobi(LinearOperator<a_real,a_int> *const op) : Preconditioner<nvars>(op),
+		dlu(dynamic_cast<blasted::DLUMatrix<nvars>*>(op))
+	{
+		if(!dlu)
+			std::cout << " ! LineJacobi: Only available for DLU matrices;"
+				<< " using block-Jacobi instead!\n";
+	}
+
+	/// Extracts lines if needed and factors the line systems
+	void compute() {
+		perf::ScopedTimer tmr(perf::PREC_SETUP);
+		if(dlu)
+			dlu->precLineSetup();
+		else
+			A->precJacobiSetup();
+	}
+
+	void apply(const a_real *const r, 
+			a_real *const __restrict z) {
+		perf::ScopedTimer tmr(perf::PREC_APPLY);
+		if(dlu)
+			dlu->precLineJacobiApply(r, z);
+		else
+			A->precJacobiApply(r, z);
+	}
+};
+
+/// Symmetric line Gauss-Seidel preconditioner
+/** Only available for DLU matrices; otherwise, SGS is used instead.
+ */
+template <short nvars>
+class LineSGS : public Preconditioner<nvars>
+{
+	using Preconditioner<nvars>::A;
+	blasted::DLUMatrix<nvars> *const dlu;
+
+public:
+	LineSGS(LinearOperator<a_real,a_int> *const op) : Preconditioner<nvars>(op),
+		dlu(dynamic_cast<blasted::DLUMatrix<nvars>*>(op))
+	{
+		A->allocTempVector();
+		if(!dlu)
+			std::cout << " ! LineSGS: Only available for DLU matrices; using SGS instead!\n";
+	}
+
+	/// Extracts lines if needed and factors the line systems
+	void compute() {
+		perf::ScopedTimer tmr(perf::PREC_SETUP);
+		if(dlu)
+			dlu->precLineSetup();
+		else
+			A->precJacobiSetup();
+	}
+
+	void apply(const a_real *const r, 
+			a_real *const __restrict z) {
+		perf::ScopedTimer tmr(perf::PREC_APPLY);
+		if(dlu)
+			dlu->precLineSGSApply(r, z);
+		else
+			A->precSGSApply(r, z);
+	}
+};
+
+/// Restricted additive Schwarz preconditioner with one subdomain per thread
+/** Each thread does an exact ILU0 factorization of its own subdomain, see
+ * DLUMatrix::precSchwarzSetup. Only available for DLU matrices; otherwise, ILU0 is used instead.
+ */
+template <short nvars>
+class AdditiveSchwarz : public Preconditioner<nvars>
+{
+	using Preconditioner<nvars>::A;
+	blasted::DLUMatrix<nvars> *const dlu;
+	const int overlap;
+
+public:
+	/** \param[in] op The matrix
+	 * \param[in] n_overlap Number of layers of cells by which subdomains overlap
+	 */
+	AdditiveSchwarz(LinearOperator<a_real,a_int> *const op, const int n_overlap)
+		: Preconditioner<nvars>(op), dlu(dynamic_cast<blasted::DLUMatrix<nvars>*>(op)),
+		overlap(n_overlap)
+	{
+		if(!dlu)
+			std::cout << " ! AdditiveSchwarz: Only available for DLU matrices;"
+				<< " using ILU0 instead!\n";
+	}
+
+	/// Sets up the subdomains if needed and factors their submatrices
+	void compute() {
+		perf::ScopedTimer tmr(perf::PREC_SETUP);
+		if(dlu)
+			dlu->precSchwarzSetup(overlap);
+		else
+			A->precILUSetup();
+	}
+
+	void apply(const a_real *const r, 
+			a_real *const __restrict z) {
+		perf::ScopedTimer tmr(perf::PREC_APPLY);
+		if(dlu)
+			dlu->precSchwarzApply(r, z);
+		else
+			A->precILUApply(r, z);
+	}
+};
+
+/// LU-SGS preconditioner which does not store the off-diagonal blocks of the matrix
+/** The approximate Jacobian is the split-flux one of the spatial discretization; see
+ * Spatial::compute_lusgs_diagonal and Spatial::apply_lusgs. Only the inverted diagonal blocks,
+ * one number per face and one temporary vector are stored, so no matrix is needed at all.
+ * The off-diagonal blocks are recomputed in every application instead.
+ * Since the preconditioner depends on the state and time steps rather than on a matrix,
+ * \ref setState must be called before each \ref compute.
+ */
+template <short nvars>
+class MatrixFreeLUSGS : public Preconditioner<nvars>
+{
+	const UMesh2dh *const m;
+	Spatial<nvars>* space;
+	const MVector* u;
+	const amat::Array2d<a_real>* dtm;
+
+	/// Inverted diagonal blocks
+	a_real *const Dinv;
+	/// Half the spectral radius times the length of each face
+	a_real *const facerad;
+	/// Result of the forward sweep
+	MVector y;
+
+public:
+	/// Allocates storage; no matrix is needed
+	MatrixFreeLUSGS(const UMesh2dh *const mesh);
+
+	~MatrixFreeLUSGS();
+
+	/// Sets the spatial discretization, state and time steps the preconditioner is built from
+	/** The state and time steps are referenced, not copied, and must not change between
+	 * \ref compute and the applications that follow it.
+	 * \param[in] spatial The discretization; must provide matrix-free LU-SGS
+	 * \param[in] state The state
+	 * \param[in] timesteps Local time steps; the pseudo-time term is area/dtm
+	 */
+	void setState(Spatial<nvars> *const spatial, const MVector& state,
+			const amat::Array2d<a_real>& timesteps);
+
+	/// Computes the inverted diagonal blocks
+	void compute();
+
+	void apply(const a_real *const r,
+			a_real *const __restrict z);
+
+	void reportMemory(memory::Report& report, const std::string& name) const;
+};
+
+/// Temporary storage of an iterative solver, sized once and reused by every solve
+/** Vectors have the layout of the residual, ie, number of cells x number of variables.
+ * Memory is only allocated when the workspace is set up with a shape it does not already
+ * have; such allocations are counted, so that it can be checked that solves allocate nothing.
+ */
+class SolverWorkspace
+{
+	/// Work vectors
+	std::vector<MVector> vecs;
+	/// Basis vectors stored as columns, eg. of a Krylov subspace
+	Matrix<a_real,Dynamic,Dynamic,ColMajor> basis;
+	/// Number of allocations made so far
+	size_t nallocs;
+	/// Total number of bytes allocated so far
+	size_t nbytes;
+
+public:
+	SolverWorkspace();
+
+	/// Makes the requested vectors available, allocating only what is not already there
+	/** All vectors and basis vectors are zeroed, in parallel, when they are allocated.
+	 * \param[in] nvecs Number of work vectors
+	 * \param[in] nrows Number of rows of each work vector, usually the number of cells
+	 * \param[in] ncols Number of columns of each work vector, usually the number of variables
+	 * \param[in] nbasis Number of basis vectors, each of length nrows*ncols
+	 */
+	void setup(const int nvecs, const a_int nrows, const int ncols, const int nbasis = 0);
+
+	/// Access to a work vector
+	MVector& vec(const int i) { return vecs[i]; }
+
+	/// Access to the basis vectors
+	Matrix<a_real,Dynamic,Dynamic,ColMajor>& basisVectors() { return basis; }
+
+	/// Number of allocations made by this workspace
+	size_t numAllocations() const { return nallocs; }
+
+	/// Total memory allocated by this workspace in bytes
+	size_t allocatedBytes() const { return nbytes; }
+
+	/// Memory currently held by this workspace in bytes
+	size_t bytes() const;
+};
+
+/// GMRES-polynomial preconditioner
+/** Approximates the inverse of the block-Jacobi scaled matrix \f$ B = D^{-1}A \f$ by the
+ * polynomial \f$ p(B) \f$ for which \f$ 1 - B p(B) \f$ is the residual polynomial of GMRES.
+ * Its roots are the harmonic Ritz values \f$ \theta_i \f$ of B from a few Arnoldi steps,
+ * started from a fixed pseudo-random vector, and the preconditioner is applied as
+ * \f[ z = \sum_i \frac{1}{\theta_i} \prod_{j<i} \left(1-\frac{B}{\theta_j}\right) D^{-1}r. \f]
+ * Complex conjugate roots are combined so that only real arithmetic is needed, and the roots
+ * are ordered by the modified Leja ordering for stability.
+ *
+ * Both setup and application consist only of matrix-vector products with A, products
+ * with the inverted diagonal blocks and vector updates, so they work with any matrix type
+ * and are fully parallel. Each application costs degree-1 matrix-vector products. Since the
+ * polynomial is fixed, the preconditioner is linear and can be used in any Krylov solver or
+ * as a smoother. With degree 1, it is block-Jacobi scaled by the inverse of a Ritz value.
+ */
+template <short nvars>
+class Polynomial : public Preconditioner<nvars>
+{
+	using Preconditioner<nvars>::A;
+
+	/// Maximum degree of the polynomial, the number of Arnoldi steps used to build it
+	const int maxdegree;
+
+	/// Residual, product with A, scaled product with A and Arnoldi start vector, and the
+	///  Arnoldi basis
+	SolverWorkspace work;
+
+	/// Roots of the residual polynomial in Leja order; of conjugate pairs, only the root with
+	///  positive imaginary part is stored
+	std::vector<std::complex<a_real>> roots;
+
+	/// Degree of the current polynomial, which is less than the maximum if Arnoldi broke down
+	int curdegree;
+
+	/// z <- D^(-1) A x
+	void scaledApply(const a_real *const x, a_real *const __restrict z);
+
+public:
+	/** \param[in] op The matrix
+	 * \param[in] degree Maximum degree of the polynomial; at least 1
+	 */
+	Polynomial(LinearOperator<a_real,a_int> *const op, const int degree);
+
+	/// Inverts the diagonal blocks and computes the roots of the polynomial
+	void compute();
+
+	void apply(const a_real *const r,
+			a_real *const __restrict z);
+
+	/// Degree of the polynomial computed in the last setup
+	int degree() const { return curdegree; }
+
+	void reportMemory(memory::Report& report, const std::string& name) const {
+		report.add(name, "workspace", work.bytes());
+	}
+};
+
+/// Anderson acceleration of a fixed-point iteration \f$ x_{k+1} = g(x_k) \f$
+/** Given the iterate \f$ x_k \f$ and its increment \f$ f_k = g(x_k) - x_k \f$, the next
+ * iterate is the combination of the last few iterates that minimizes the linearized
+ * increment. With \f$ \Delta X \f$ and \f$ \Delta F \f$ the differences of successive
+ * iterates and increments over the last m steps,
+ * \f$ x_{k+1} = x_k + \beta f_k - (\Delta X + \beta \Delta F) \gamma \f$, where \f$ \gamma \f$
+ * minimizes \f$ \| f_k - \Delta F \gamma \| \f$. The least-squares problem is solved through
+ * its normal equations, whose matrix is updated by one row and column per step.
+ *
+ * Safeguards:
+ * - The oldest differences are dropped while the normal equations are too ill-conditioned.
+ * - The history is discarded (restart) whenever the norm of the increment grows by more than
+ *   a given factor in one step, which then is a plain, possibly damped, fixed-point step.
+ *
+ * The differences are stored in a \ref SolverWorkspace allocated when the accelerator is
+ * set up, so that updates allocate nothing. Under MPI, all ranks must call update together.
+ */
+class AndersonAccelerator
+{
+	const int depth;						///< Maximum number of differences kept (m)
+	const a_real beta;						///< Mixing (damping) parameter
+	const a_real restartfactor;				///< Growth of the increment norm that causes a restart
+
+	/// Previous iterate and increment as vectors 0 and 1, differences as basis vectors
+	/** The basis vectors are \f$ \Delta X \f$ in columns 0 to m-1, and \f$ \Delta F \f$
+	 * in columns m to 2m-1. They are used as a ring buffer.
+	 */
+	SolverWorkspace work;
+	a_int N;								///< Length of the vectors
+
+	bool haveprev;							///< Whether the previous iterate is stored
+	a_real fprevnorm;						///< Norm of the previous increment
+	int nhist;								///< Number of differences currently stored
+	int newest;								///< Slot of the latest difference
+	int nrestarts;							///< Number of restarts so far
+
+	/// Inner products of the stored increment differences, by slot
+	Matrix<a_real,Dynamic,Dynamic> gram;
+	/// Normal equations for the stored differences, oldest first, and their solution
+	Matrix<a_real,Dynamic,Dynamic> G;
+	Matrix<a_real,Dynamic,1> rhs, gamma;
+	Eigen::LDLT<Matrix<a_real,Dynamic,Dynamic>> ldlt;
+
+	/// Slot of the i-th stored difference, counting from the oldest
+	int slot(const int i) const { return (newest - nhist + 1 + i + depth) % depth; }
+
+	a_real* dx(const int islot) { return &work.basisVectors()(0,islot); }
+	a_real* df(const int islot) { return &work.basisVectors()(0,depth+islot); }
+
+public:
+	/** \param[in] m Number of previous steps used; 0 gives the plain fixed-point iteration
+	 * \param[in] mixing Mixing parameter \f$ \beta \f$, 1 for no damping
+	 * \param[in] restart_factor A restart occurs when the norm of the increment becomes larger
+	 *   than this times the previous one; 0 disables restarts
+	 */
+	AndersonAccelerator(const int m, const a_real mixing = 1.0, const a_real restart_factor = 2.0);
+
+	/// Allocates storage for vectors of a given shape, and resets
+	void setup(const a_int nrows, const int ncols);
+
+	/// Discards the history, eg. when starting to solve a different problem
+	void reset();
+
+	/// Replaces an iterate by the next, accelerated, iterate
+	/** \param[in,out] x The current iterate on input, the next one on output
+	 * \param[in] f The increment of the plain fixed-point iteration at x, ie., g(x)-x
+	 */
+	void update(MVector& x, const MVector& f);
+
+	/// Number of previous steps used
+	int historyDepth() const { return depth; }
+
+	/// Memory used by the stored iterates and differences in bytes
+	size_t bytes() const { return work.bytes(); }
+
+	/// Number of restarts since the accelerator was set up
+	int numRestarts() const { return nrestarts; }
+};
+
 /// Base class for a linear solver
 class LinearSolver
 {
@@ -336,10 +904,20 @@ protected:
 	double tol;                                   ///< Tolerance
 	mutable double walltime;                      ///< Stores wall-clock time measurement of solver
 	mutable double cputime;                       ///< Stores CPU time measurement of the solver
+	mutable double setupwalltime;                 ///< Wall-clock time of preconditioner setup
+	mutable double setupcputime;                  ///< CPU time of preconditioner setup
+	mutable SolverWorkspace work;                 ///< Temporary vectors of the solver
 
 public:
 	IterativeSolverBase(const UMesh2dh* const mesh);
 
+	/// The temporary storage of the solver, eg. to check how much has been allocated
+	const SolverWorkspace& workspace() const { return work; }
+
+	/// Memory used by the temporary storage of the solver in bytes, including that of
+	/// any acceleration
+	virtual size_t workspaceBytes() const { return work.bytes(); }
+
 	//virtual ~IterativeSolverBase();
 	
 	/// Set tolerance and max iterations
@@ -350,12 +928,20 @@ public:
 	/// Sets time accumulators to zero
 	void resetRunTimes() {
 		walltime = 0; cputime = 0;
+		setupwalltime = 0; setupcputime = 0;
 	}
 
 	/// Get timing data
+	/** The times include those of setting up the preconditioner.
+	 */
 	void getRunTimes(double& wall_time, double& cpu_time) const {
 		wall_time = walltime; cpu_time = cputime;
 	}
+
+	/// Get the time taken to set up the preconditioner, which is part of the total time
+	void getPreconditionerSetupTimes(double& wall_time, double& cpu_time) const {
+		wall_time = setupwalltime; cpu_time = setupcputime;
+	}
 };
 
 /// Preconditioned iterative solver that relies on a stored LHS matrix
@@ -393,6 +979,9 @@ public:
 };
 
 /// A solver that just applies the preconditioner repeatedly
+/** Optionally, the iteration is accelerated by Anderson acceleration, which is restarted for
+ * each solve.
+ */
 template <short nvars>
 class RichardsonSolver : public IterativeSolver<nvars>
 {
@@ -403,14 +992,22 @@ class RichardsonSolver : public IterativeSolver<nvars>
 	using IterativeSolver<nvars>::walltime;
 	using IterativeSolver<nvars>::cputime;
 	using IterativeSolver<nvars>::prec;
+	using IterativeSolver<nvars>::work;
+
+	mutable AndersonAccelerator accel;
 
 public:
+	/** \param[in] anderson_depth Number of previous iterates used for Anderson acceleration;
+	 *   0 for none
+	 */
 	RichardsonSolver(const UMesh2dh* const mesh, 
 			LinearOperator<a_real,a_int>* const mat, 
-			Preconditioner<nvars> *const precond);
+			Preconditioner<nvars> *const precond, const int anderson_depth = 0);
 
 	int solve(const MVector& res, 
 		MVector& du) const;
+
+	size_t workspaceBytes() const { return work.bytes() + accel.bytes(); }
 };
 
 /// H.A. Van der Vorst's stabilized biconjugate gradient solver
@@ -426,6 +1023,7 @@ class BiCGSTAB : public IterativeSolver<nvars>
 	using IterativeSolver<nvars>::walltime;
 	using IterativeSolver<nvars>::cputime;
 	using IterativeSolver<nvars>::prec;
+	using IterativeSolver<nvars>::work;
 
 public:
 	BiCGSTAB(const UMesh2dh* const mesh, 
@@ -447,10 +1045,20 @@ class GMRES : public IterativeSolver<nvars>
 	using IterativeSolver<nvars>::walltime;
 	using IterativeSolver<nvars>::cputime;
 	using IterativeSolver<nvars>::prec;
+	using IterativeSolver<nvars>::work;
 	
 	/// Number of Krylov subspace vectors to store
 	int mrestart;
 
+	/// Hessenberg matrix of the Arnoldi process
+	mutable Matrix<a_real,Dynamic,Dynamic> H;
+	/// Right hand side of the least-squares problem
+	mutable Matrix<a_real,Dynamic,1> be1;
+	/// Solution of the least-squares problem
+	mutable Matrix<a_real,Dynamic,1> z;
+	/// Factorization used to solve the least-squares problem
+	mutable Eigen::HouseholderQR<Matrix<a_real,Dynamic,Dynamic>> qr;
+
 public:
 	GMRES(const UMesh2dh* const mesh, 
 			LinearOperator<a_real,a_int>* const mat, 
@@ -461,6 +1069,95 @@ public:
 		MVector& __restrict du) const;
 };
 
+/// Restarted GMRES with a recycled subspace carried over from one solve to the next
+/** This is the GCRO-DR method of Parks et al., "Recycling Krylov subspaces for sequences of
+ * linear systems", SIAM J. Sci. Comput. 28(5), 2006, applied to the left-preconditioned
+ * operator as in \ref GMRES.
+ * At the end of each cycle, the harmonic Ritz vectors of the smallest harmonic Ritz values
+ * are extracted from the cycle's subspace and kept. These approximate the slowly converging
+ * modes, which are then projected out of every later cycle and solve. Since the
+ * matrices of successive pseudo-time steps differ little, the kept subspace remains useful
+ * for the next linear system; there, the image of the subspace is recomputed with the new
+ * matrix and preconditioner at the cost of one product per recycled vector.
+ *
+ * Unlike \ref GMRES, convergence is checked after every iteration, relative to the
+ * preconditioned residual at the start of the solve, and the number of iterations
+ * (applications of the preconditioned operator in cycles) is returned.
+ */
+template <short nvars>
+class GCRODR : public IterativeSolver<nvars>
+{
+	using IterativeSolver<nvars>::m;
+	using IterativeSolver<nvars>::A;
+	using IterativeSolver<nvars>::maxiter;
+	using IterativeSolver<nvars>::tol;
+	using IterativeSolver<nvars>::walltime;
+	using IterativeSolver<nvars>::cputime;
+	using IterativeSolver<nvars>::prec;
+	using IterativeSolver<nvars>::work;
+
+	/// Number of vectors in a cycle, including the recycled ones
+	const int mrestart;
+	/// Maximum number of recycled vectors
+	const int nrecycle;
+
+	/// Current number of recycled vectors
+	mutable int nrec;
+	/// Column of the basis storage where the recycled vectors U start
+	mutable int ucol;
+	/// Column where their images C = M^(-1) A U start
+	mutable int ccol;
+	/// Column where space for the next U and C starts
+	mutable int tcol;
+
+	/// Upper Hessenberg matrix of the cycle, including the blocks of the recycled space
+	mutable Matrix<a_real,Dynamic,Dynamic> G;
+	/// Its triangular factor being built up by Givens rotations
+	mutable Matrix<a_real,Dynamic,Dynamic> R;
+	/// Rotated right hand side of the least-squares problem
+	mutable Matrix<a_real,Dynamic,1> g;
+	/// Cosines and sines of the Givens rotations
+	mutable Matrix<a_real,Dynamic,1> cs, sn;
+	/// Scaling of the recycled vectors to unit length
+	mutable Matrix<a_real,Dynamic,1> d;
+	/// Solution of the least-squares problem
+	mutable Matrix<a_real,Dynamic,1> z;
+	/// Residual of the least-squares problem
+	mutable Matrix<a_real,Dynamic,1> t;
+
+	/// Pointer to a column of the basis storage
+	a_real* col(const int j) const { return &work.basisVectors()(0,j); }
+
+	/// Computes C = M^(-1) A U for a new matrix and orthonormalizes C, updating U to match
+	void updateRecycledImages() const;
+
+	/// Replaces the recycled space by harmonic Ritz vectors of the last cycle
+	/** \param[in] q Number of Arnoldi vectors generated in the cycle
+	 */
+	void updateRecycledSpace(const int q) const;
+
+public:
+	/** \param[in] m_restart Number of vectors per cycle, including the recycled vectors
+	 * \param[in] n_recycle Number of vectors to recycle; at most m_restart/2
+	 */
+	GCRODR(const UMesh2dh* const mesh, 
+			LinearOperator<a_real,a_int>* const mat, 
+			Preconditioner<nvars> *const precond,
+			const int m_restart, const int n_recycle);
+
+	/// Solves the linear system A du = -r
+	/** \return The number of iterations performed
+	 */
+	int solve(const MVector& res, 
+		MVector& __restrict du) const;
+
+	/// Discards the recycled subspace
+	void resetRecycledSpace() { nrec = 0; }
+
+	/// Current number of recycled vectors
+	int recycledDimension() const { return nrec; }
+};
+
 /// Base class for matrix-free solvers
 /** Note that subclasses are matrix-free only with regard to the top-level solver,
  * usually a Krylov subspace solver. The preconditioning matrix is still computed and stored.
@@ -505,7 +1202,7 @@ public:
 };
 
 /// A matrix-free solver that just applies the preconditioner repeatedly
-/// in a defect-correction iteration.
+/// in a defect-correction iteration, optionally with Anderson acceleration.
 template <short nvars>
 class MFRichardsonSolver : public MFIterativeSolver<nvars>
 {
@@ -518,17 +1215,25 @@ class MFRichardsonSolver : public MFIterativeSolver<nvars>
 	using MFIterativeSolver<nvars>::walltime;
 	using MFIterativeSolver<nvars>::cputime;
 	using MFIterativeSolver<nvars>::prec;
+	using MFIterativeSolver<nvars>::work;
 	using MFIterativeSolver<nvars>::space;
 
+	mutable AndersonAccelerator accel;
+
 public:
+	/** \param[in] anderson_depth Number of previous iterates used for Anderson acceleration;
+	 *   0 for none
+	 */
 	MFRichardsonSolver(const UMesh2dh *const mesh, Preconditioner<nvars> *const precond,
-			Spatial<nvars> *const spatial);
+			Spatial<nvars> *const spatial, const int anderson_depth = 0);
 
 	int solve(const MVector& __restrict__ u, 
 		const amat::Array2d<a_real>& dtm,
 		const MVector& __restrict__ res, 
 		MVector& __restrict__ aux,
 		MVector& __restrict__ du) const;
+
+	size_t workspaceBytes() const { return work.bytes() + accel.bytes(); }
 };
 
 
@@ -0,0 +1,277 @@
+/** @file alocator.cpp
+ * @brief Implementation of point location and transfer of cell data between meshes
+ * @author Aditya Kashi
+ */
+
+#include "alocator.hpp"
+#include <algorithm>
+#include <limits>
+
+namespace acfd {
+
+/// Number of vertices of a cell with a given number of nodes
+static inline int numVertices(const int nnode)
+{
+	return (nnode == 3 || nnode == 6) ? 3 : 4;
+}
+
+CellLocator::CellLocator(const UMesh2dh *const mesh) : m(mesh)
+{
+	const a_int nelem = m->gnelem();
+	centres.setup(nelem, NDIM);
+
+	a_real x0 = std::numeric_limits<a_real>::max(), y0 = x0;
+	a_real xmax = -x0, ymax = -y0;
+#pragma omp parallel for default(shared) reduction(min:x0,y0) reduction(max:xmax,ymax)
+	for(a_int ipoin = 0; ipoin < m->gnpoin(); ipoin++) {
+		x0 = std::min(x0, m->gcoords(ipoin,0));
+		xmax = std::max(xmax, m->gcoords(ipoin,0));
+		y0 = std::min(y0, m->gcoords(ipoin,1));
+		ymax = std::max(ymax, m->gcoords(ipoin,1));
+	}
+	xmin = x0; ymin = y0;
+
+	// about one cell per bin, with bins shaped like the domain
+	const a_real lx = std::max(xmax-xmin, 1e-12), ly = std::max(ymax-ymin, 1e-12);
+	nbx = std::max((a_int)1, (a_int)std::sqrt(nelem*lx/ly));
+	nby = std::max((a_int)1, (a_int)(nelem/nbx));
+	dx = lx/nbx;
+	dy = ly/nby;
+
+	// bounding boxes of cells in terms of bins
+	std::vector<a_int> bbox(4*nelem);
+#pragma omp parallel for default(shared)
+	for(a_int iel = 0; iel < nelem; iel++)
+	{
+		const int nv = numVertices(m->gnnode(iel));
+		a_real bx0 = m->gcoords(m->ginpoel(iel,0),0), bx1 = bx0;
+		a_real by0 = m->gcoords(m->ginpoel(iel,0),1), by1 = by0;
+		centres(iel,0) = centres(iel,1) = 0;
+		for(int iv = 0; iv < nv; iv++) {
+			const a_real x = m->gcoords(m->ginpoel(iel,iv),0), y = m->gcoords(m->ginpoel(iel,iv),1);
+			bx0 = std::min(bx0,x); bx1 = std::max(bx1,x);
+			by0 = std::min(by0,y); by1 = std::max(by1,y);
+			centres(iel,0) += x/nv;
+			centres(iel,1) += y/nv;
+		}
+		bbox[4*iel+0] = binIndex(bx0, xmin, dx, nbx);
+		bbox[4*iel+1] = binIndex(bx1, xmin, dx, nbx);
+		bbox[4*iel+2] = binIndex(by0, ymin, dy, nby);
+		bbox[4*iel+3] = binIndex(by1, ymin, dy, nby);
+	}
+
+	// count the cells of each bin, then fill the lists
+	const a_int nbins = nbx*nby;
+	binstart.assign(nbins+1, 0);
+#pragma omp parallel for default(shared)
+	for(a_int iel = 0; iel < nelem; iel++)
+		for(a_int j = bbox[4*iel+2]; j <= bbox[4*iel+3]; j++)
+			for(a_int i = bbox[4*iel+0]; i <= bbox[4*iel+1]; i++)
+			{
+#pragma omp atomic update
+				binstart[j*nbx+i+1]++;
+			}
+	for(a_int ib = 0; ib < nbins; ib++)
+		binstart[ib+1] += binstart[ib];
+
+	bincells.resize(binstart[nbins]);
+	std::vector<a_int> pos(binstart.begin(), binstart.end()-1);
+#pragma omp parallel for default(shared)
+	for(a_int iel = 0; iel < nelem; iel++)
+		for(a_int j = bbox[4*iel+2]; j <= bbox[4*iel+3]; j++)
+			for(a_int i = bbox[4*iel+0]; i <= bbox[4*iel+1]; i++)
+			{
+				a_int k;
+#pragma omp atomic capture
+				k = pos[j*nbx+i]++;
+				bincells[k] = iel;
+			}
+
+	// the order in which threads filled the bins is arbitrary
+#pragma omp parallel for default(shared) schedule(dynamic, 256)
+	for(a_int ib = 0; ib < nbins; ib++)
+		std::sort(bincells.begin()+binstart[ib], bincells.begin()+binstart[ib+1]);
+}
+
+inline a_int CellLocator::binIndex(const a_real x, const a_real x0, const a_real h,
+		const a_int nb) const
+{
+	const a_int i = (a_int)std::floor((x-x0)/h);
+	return std::min(std::max(i, (a_int)0), nb-1);
+}
+
+bool CellLocator::isInCell(const a_int ielem, const a_real x, const a_real y) const
+{
+	const int nv = numVertices(m->gnnode(ielem));
+	a_real xv[4], yv[4];
+	for(int iv = 0; iv < nv; iv++) {
+		xv[iv] = m->gcoords(m->ginpoel(ielem,iv),0);
+		yv[iv] = m->gcoords(m->ginpoel(ielem,iv),1);
+	}
+
+	// orientation of the cell
+	a_real area2 = 0;
+	for(int iv = 0; iv < nv; iv++) {
+		const int jv = (iv+1)%nv;
+		area2 += xv[iv]*yv[jv] - xv[jv]*yv[iv];
+	}
+	const a_real sgn = area2 > 0 ? 1.0 : -1.0;
+
+	// the point must not be on the outer side of any edge
+	for(int iv = 0; iv < nv; iv++) {
+		const int jv = (iv+1)%nv;
+		const a_real ex = xv[jv]-xv[iv], ey = yv[jv]-yv[iv];
+		const a_real cross = ex*(y-yv[iv]) - ey*(x-xv[iv]);
+		if(sgn*cross < -1e-10*(ex*ex+ey*ey))
+			return false;
+	}
+	return true;
+}
+
+a_int CellLocator::findCell(const a_real x, const a_real y) const
+{
+	const a_int i = (a_int)std::floor((x-xmin)/dx), j = (a_int)std::floor((y-ymin)/dy);
+	// allow for points on the boundary of the bin grid
+	if(i < -1 || i > nbx || j < -1 || j > nby)
+		return -1;
+	const a_int ib = binIndex(x, xmin, dx, nbx) + nbx*binIndex(y, ymin, dy, nby);
+	for(a_int k = binstart[ib]; k < binstart[ib+1]; k++)
+		if(isInCell(bincells[k], x, y))
+			return bincells[k];
+	return -1;
+}
+
+void CellLocator::computeWeights(const a_real x, const a_real y, PointLocation& loc) const
+{
+	const a_int ielem = loc.cell;
+	const int nv = numVertices(m->gnnode(ielem));
+	a_real xv[4], yv[4];
+	for(int iv = 0; iv < nv; iv++) {
+		xv[iv] = m->gcoords(m->ginpoel(ielem,iv),0);
+		yv[iv] = m->gcoords(m->ginpoel(ielem,iv),1);
+	}
+
+	if(nv == 3)
+	{
+		// the map is affine, so the reference coordinates solve a 2x2 system
+		const a_real a11 = xv[1]-xv[0], a12 = xv[2]-xv[0];
+		const a_real a21 = yv[1]-yv[0], a22 = yv[2]-yv[0];
+		const a_real det = a11*a22 - a12*a21;
+		loc.xi = ( a22*(x-xv[0]) - a12*(y-yv[0]))/det;
+		loc.eta = (-a21*(x-xv[0]) + a11*(y-yv[0]))/det;
+		loc.weights[0] = 1.0 - loc.xi - loc.eta;
+		loc.weights[1] = loc.xi;
+		loc.weights[2] = loc.eta;
+		loc.weights[3] = 0;
+		return;
+	}
+
+	// Newton iterations for the inverse of the bilinear map, starting from the centre
+	a_real xi = 0.5, eta = 0.5;
+	for(int it = 0; it < 20; it++)
+	{
+		const a_real fx = (1-xi)*(1-eta)*xv[0] + xi*(1-eta)*xv[1] + xi*eta*xv[2] + (1-xi)*eta*xv[3] - x;
+		const a_real fy = (1-xi)*(1-eta)*yv[0] + xi*(1-eta)*yv[1] + xi*eta*yv[2] + (1-xi)*eta*yv[3] - y;
+		const a_real dxdxi = (1-eta)*(xv[1]-xv[0]) + eta*(xv[2]-xv[3]);
+		const a_real dxdeta = (1-xi)*(xv[3]-xv[0]) + xi*(xv[2]-xv[1]);
+		const a_real dydxi = (1-eta)*(yv[1]-yv[0]) + eta*(yv[2]-yv[3]);
+		const a_real dydeta = (1-xi)*(yv[3]-yv[0]) + xi*(yv[2]-yv[1]);
+		const a_real det = dxdxi*dydeta - dxdeta*dydxi;
+		const a_real dxi = ( dydeta*fx - dxdeta*fy)/det;
+		const a_real deta = (-dydxi*fx + dxdxi*fy)/det;
+		xi -= dxi;
+		eta -= deta;
+		if(std::abs(dxi) + std::abs(deta) < 1e-13)
+			break;
+	}
+	loc.xi = xi;
+	loc.eta = eta;
+	loc.weights[0] = (1-xi)*(1-eta);
+	loc.weights[1] = xi*(1-eta);
+	loc.weights[2] = xi*eta;
+	loc.weights[3] = (1-xi)*eta;
+}
+
+bool CellLocator::locate(const a_real x, const a_real y, PointLocation& loc) const
+{
+	loc.cell = findCell(x,y);
+	if(loc.cell < 0)
+		return false;
+	computeWeights(x,y,loc);
+	return true;
+}
+
+a_int CellLocator::locate(const amat::Array2d<a_real>& points, std::vector<PointLocation>& locs) const
+{
+	const a_int npts = points.rows();
+	locs.resize(npts);
+	a_int noutside = 0;
+#pragma omp parallel for default(shared) reduction(+:noutside) schedule(dynamic, 1024)
+	for(a_int ipt = 0; ipt < npts; ipt++)
+		if(!locate(points.get(ipt,0), points.get(ipt,1), locs[ipt]))
+			noutside++;
+	return noutside;
+}
+
+a_int CellLocator::nearestCell(const a_real x, const a_real y) const
+{
+	const a_int bi = binIndex(x, xmin, dx, nbx), bj = binIndex(y, ymin, dy, nby);
+	const a_real h = std::min(dx,dy);
+	a_int best = -1;
+	a_real bestdist2 = std::numeric_limits<a_real>::max();
+
+	for(a_int r = 0; r <= std::max(nbx,nby); r++)
+	{
+		// bins on the square ring at distance r from the point's bin
+		for(a_int j = bj-r; j <= bj+r; j++)
+		{
+			if(j < 0 || j >= nby) continue;
+			const a_int step = (j == bj-r || j == bj+r) ? 1 : 2*r;
+			for(a_int i = bi-r; i <= bi+r; i += std::max(step,(a_int)1))
+			{
+				if(i < 0 || i >= nbx) continue;
+				const a_int ib = j*nbx+i;
+				for(a_int k = binstart[ib]; k < binstart[ib+1]; k++) {
+					const a_int iel = bincells[k];
+					const a_real d2 = (centres(iel,0)-x)*(centres(iel,0)-x)
+						+ (centres(iel,1)-y)*(centres(iel,1)-y);
+					if(d2 < bestdist2) {
+						bestdist2 = d2;
+						best = iel;
+					}
+				}
+			}
+		}
+
+		// cells in bins further out are at least r bins away
+		if(best >= 0 && bestdist2 <= (r*h)*(r*h))
+			break;
+	}
+	return best;
+}
+
+a_int injectCellData(const CellLocator& srcloc, const MVector& usrc,
+		const UMesh2dh& dest, MVector& udest)
+{
+	a_int noutside = 0;
+#pragma omp parallel for default(shared) reduction(+:noutside)
+	for(a_int iel = 0; iel < dest.gnelem(); iel++)
+	{
+		const int nv = numVertices(dest.gnnode(iel));
+		a_real x = 0, y = 0;
+		for(int iv = 0; iv < nv; iv++) {
+			x += dest.gcoords(dest.ginpoel(iel,iv),0)/nv;
+			y += dest.gcoords(dest.ginpoel(iel,iv),1)/nv;
+		}
+
+		a_int isrc = srcloc.findCell(x,y);
+		if(isrc < 0) {
+			isrc = srcloc.nearestCell(x,y);
+			noutside++;
+		}
+		udest.row(iel) = usrc.row(isrc);
+	}
+	return noutside;
+}
+
+}
@@ -0,0 +1,122 @@
+/** @file alocator.hpp
+ * @brief Location of points in the cells of a mesh, and transfer of cell data between meshes
+ * @author Aditya Kashi
+ *
+ * The locator of a mesh is usually obtained through UMesh2dh::cellLocator, which builds it
+ * once and keeps it with the mesh.
+ */
+
+#ifndef __ALOCATOR_H
+#define __ALOCATOR_H 1
+
+#ifndef __AMESH2DH_H
+#include "amesh2dh.hpp"
+#endif
+
+#include <vector>
+
+namespace acfd {
+
+/// Cell containing a point and the point's position within it
+struct PointLocation
+{
+	a_int cell;					///< Containing cell, or -1 if the point is outside the mesh
+	a_real xi, eta;				///< Reference coordinates of the point in the cell
+	/// Weights of the cell's vertices for linear (bilinear on quads) interpolation
+	/** Only the first 3 entries are used for triangles. They sum to 1.
+	 */
+	a_real weights[4];
+};
+
+/// Finds the cell of a mesh containing a given point
+/** The bounding box of the mesh is divided into a uniform grid of about as many bins as
+ * there are cells, and each cell is listed in every bin its bounding box overlaps. A query
+ * then only tests the few cells listed in the bin containing the point. The lists are built
+ * in parallel and sorted, so that results do not depend on the number of threads.
+ *
+ * All queries are const and may be made concurrently from several threads.
+ *
+ * Only the vertices of cells are used, so high-order cells are treated as straight-sided.
+ */
+class CellLocator
+{
+protected:
+	const UMesh2dh *const m;
+
+	a_real xmin, ymin;					///< Lower-left corner of the bin grid
+	a_real dx, dy;						///< Size of each bin
+	a_int nbx, nby;						///< Number of bins in each direction
+
+	std::vector<a_int> binstart;		///< Start of each bin's list in bincells; nbx*nby+1 entries
+	std::vector<a_int> bincells;		///< Cells overlapping each bin
+
+	amat::Array2d<a_real> centres;		///< Vertex averages of cells
+
+	/// Bin index in one direction of a coordinate, clamped to the grid
+	a_int binIndex(const a_real x, const a_real x0, const a_real h, const a_int nb) const;
+
+public:
+	/// Builds the bin grid for a mesh whose topology and areas have been computed
+	CellLocator(const UMesh2dh *const mesh);
+
+	/// Whether a point lies in a cell, including its boundary up to a relative tolerance
+	bool isInCell(const a_int ielem, const a_real x, const a_real y) const;
+
+	/// Cell containing a point, or -1 if the point is outside the mesh
+	/** A point on a face shared by two cells is reported in the one with lower index.
+	 */
+	a_int findCell(const a_real x, const a_real y) const;
+
+	/// Reference coordinates and interpolation weights of a point in a given cell
+	/** Triangles are mapped from the reference triangle with vertices (0,0), (1,0), (0,1) and
+	 * quadrangles from the unit square; the latter map is inverted by Newton iterations.
+	 * \param[in,out] loc On input, loc.cell is the cell; the rest is computed
+	 */
+	void computeWeights(const a_real x, const a_real y, PointLocation& loc) const;
+
+	/// Finds the cell containing a point along with the interpolation weights
+	/** \return False if the point is outside the mesh, in which case loc.cell is -1
+	 */
+	bool locate(const a_real x, const a_real y, PointLocation& loc) const;
+
+	/// Locates many points at once, in parallel
+	/** \param[in] points Coordinates of the points, one point per row
+	 * \param[out] locs Locations of the points; resized as needed
+	 * \return The number of points outside the mesh
+	 */
+	a_int locate(const amat::Array2d<a_real>& points, std::vector<PointLocation>& locs) const;
+
+	/// Cell whose centre is nearest to a point
+	/** Useful for points just outside the mesh, such as those near curved boundaries of a
+	 * finer mesh of the same domain.
+	 */
+	a_int nearestCell(const a_real x, const a_real y) const;
+
+	/// The mesh being searched
+	const UMesh2dh* mesh() const { return m; }
+
+	/// Vertex average of a cell
+	const a_real* cellCentre(const a_int ielem) const { return &centres(ielem,0); }
+
+	/// Number of bins in the grid
+	a_int numBins() const { return nbx*nby; }
+
+	/// Average number of cells listed per bin
+	a_real averageBinLoad() const { return (a_real)bincells.size()/(nbx*nby); }
+};
+
+/// Transfers cell-centred data from one mesh to another by injection
+/** Each cell of the destination mesh gets the value of the source cell containing its
+ * centre, or, if its centre is outside the source mesh, the source cell with the nearest
+ * centre.
+ * \param[in] srcloc Locator for the source mesh
+ * \param[in] usrc Data on the source mesh
+ * \param[in] dest Destination mesh
+ * \param[out] udest Data on the destination mesh; must have the right size
+ * \return The number of destination cells whose centres were outside the source mesh
+ */
+a_int injectCellData(const CellLocator& srcloc, const MVector& usrc,
+		const UMesh2dh& dest, MVector& udest);
+
+}
+#endif
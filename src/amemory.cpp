@@ -0,0 +1,260 @@
+/** @file amemory.cpp
+ * @brief Implementation of NUMA-aware allocation, the memory report and the thread
+ * affinity report
+ * @author Aditya Kashi
+ */
+
+#include "amemory.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <atomic>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifdef __linux__
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#endif
+
+/// Size of a transparent huge page
+#define FVENS_HUGE_PAGE_BYTES 2097152
+
+namespace acfd {
+namespace memory {
+
+/// Counters of allocations made through allocate()
+static std::atomic<size_t> nallocs(0), nbytes(0);
+
+/// Whether huge pages were requested through FVENS_HUGEPAGES
+static bool useHugePages()
+{
+	static const bool use = [](){
+		const char *const env = std::getenv("FVENS_HUGEPAGES");
+		return env != nullptr && std::atoi(env) == 1;
+	}();
+	return use;
+}
+
+void firstTouch(void *const ptr, const size_t bytes)
+{
+	char *const mem = static_cast<char*>(ptr);
+#ifdef _OPENMP
+	if(bytes >= FVENS_FIRST_TOUCH_MIN_BYTES && !omp_in_parallel())
+	{
+#pragma omp parallel default(shared)
+		{
+			const size_t nthreads = omp_get_num_threads();
+			const size_t ithread = omp_get_thread_num();
+			const size_t chunk = bytes/nthreads, rem = bytes%nthreads;
+			const size_t start = ithread*chunk + (ithread < rem ? ithread : rem);
+			std::memset(mem+start, 0, chunk + (ithread < rem ? 1 : 0));
+		}
+		return;
+	}
+#endif
+	std::memset(mem, 0, bytes);
+}
+
+void* allocate(const size_t bytes)
+{
+	if(bytes == 0)
+		return nullptr;
+
+	const bool huge = useHugePages() && bytes >= FVENS_HUGE_PAGE_BYTES;
+	const size_t alignment = huge ? FVENS_HUGE_PAGE_BYTES : FVENS_ALIGNMENT;
+	const size_t size = (bytes + alignment-1)/alignment*alignment;
+
+	void* ptr = nullptr;
+	if(posix_memalign(&ptr, alignment, size) != 0) {
+		std::cout << "! memory: allocate(): Could not allocate " << bytes << " bytes!\n";
+		return nullptr;
+	}
+
+#ifdef __linux__
+	if(huge)
+		madvise(ptr, size, MADV_HUGEPAGE);
+#endif
+
+	nallocs++;
+	nbytes += bytes;
+
+	firstTouch(ptr, bytes);
+	return ptr;
+}
+
+void deallocate(void *const ptr)
+{
+	std::free(ptr);
+}
+
+size_t numAllocations()
+{
+	return nallocs;
+}
+
+size_t allocatedBytes()
+{
+	return nbytes;
+}
+
+void Report::add(const std::string& object, const std::string& item, const size_t bytes)
+{
+	if(bytes > 0)
+		items.push_back({object, item, bytes});
+}
+
+size_t Report::total() const
+{
+	size_t sum = 0;
+	for(const Item& it : items)
+		sum += it.bytes;
+	return sum;
+}
+
+size_t Report::total(const std::string& object) const
+{
+	size_t sum = 0;
+	for(const Item& it : items)
+		if(it.object == object)
+			sum += it.bytes;
+	return sum;
+}
+
+/// Formats a number of bytes in MiB
+static std::string mebibytes(const size_t bytes)
+{
+	std::ostringstream ss;
+	ss << std::fixed << std::setprecision(2) << bytes/1048576.0;
+	return ss.str();
+}
+
+void Report::print(std::ostream& os) const
+{
+	std::vector<std::string> objects;
+	for(const Item& it : items)
+		if(std::find(objects.begin(), objects.end(), it.object) == objects.end())
+			objects.push_back(it.object);
+
+	os << "Memory use (MiB):\n";
+	for(const std::string& obj : objects)
+	{
+		os << "  " << std::left << std::setw(40) << obj << std::right << std::setw(10)
+			<< mebibytes(total(obj)) << '\n';
+		for(const Item& it : items)
+			if(it.object == obj)
+				os << "    " << std::left << std::setw(38) << it.item << std::right
+					<< std::setw(10) << mebibytes(it.bytes) << '\n';
+	}
+	os << "  " << std::left << std::setw(40) << "Total itemized" << std::right << std::setw(10)
+		<< mebibytes(total()) << '\n';
+	os << "  " << std::left << std::setw(40) << "Resident size, current and peak" << std::right
+		<< std::setw(10) << mebibytes(residentBytes()) << std::setw(10)
+		<< mebibytes(peakResidentBytes()) << '\n';
+}
+
+size_t residentBytes()
+{
+#ifdef __linux__
+	std::ifstream statm("/proc/self/statm");
+	size_t pages = 0, resident = 0;
+	if(statm >> pages >> resident)
+		return resident*sysconf(_SC_PAGESIZE);
+#endif
+	return 0;
+}
+
+size_t peakResidentBytes()
+{
+#ifdef __linux__
+	// the kernel updates the maximum lazily, so it can lag behind the current size
+	struct rusage usage;
+	if(getrusage(RUSAGE_SELF, &usage) == 0)
+		return std::max((size_t)usage.ru_maxrss*1024, residentBytes());
+#endif
+	return 0;
+}
+
+/// CPUs on which the calling thread is allowed to run, as a list of ranges
+static std::string allowedCPUs()
+{
+#ifdef __linux__
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	if(sched_getaffinity(0, sizeof(set), &set) != 0)
+		return "?";
+
+	std::string list;
+	for(int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+	{
+		if(!CPU_ISSET(cpu, &set))
+			continue;
+		int last = cpu;
+		while(last+1 < CPU_SETSIZE && CPU_ISSET(last+1, &set))
+			last++;
+		if(!list.empty())
+			list += ",";
+		list += std::to_string(cpu);
+		if(last > cpu)
+			list += "-" + std::to_string(last);
+		cpu = last;
+	}
+	return list;
+#else
+	return "?";
+#endif
+}
+
+void reportAffinity(std::ostream& os)
+{
+	int nthreads = 1;
+#ifdef _OPENMP
+	nthreads = omp_get_max_threads();
+#endif
+	std::vector<int> cpus(nthreads, -1), nodes(nthreads, -1);
+	std::vector<std::string> allowed(nthreads);
+
+#pragma omp parallel default(shared) num_threads(nthreads)
+	{
+		int ithread = 0;
+#ifdef _OPENMP
+		ithread = omp_get_thread_num();
+#endif
+#ifdef __linux__
+		unsigned int cpu = 0, node = 0;
+		if(syscall(SYS_getcpu, &cpu, &node, nullptr) == 0) {
+			cpus[ithread] = cpu;
+			nodes[ithread] = node;
+		}
+#endif
+		allowed[ithread] = allowedCPUs();
+	}
+
+	const char *const bind = std::getenv("OMP_PROC_BIND");
+	const char *const places = std::getenv("OMP_PLACES");
+	os << "Thread placement: " << nthreads << " thread(s), OMP_PROC_BIND="
+		<< (bind ? bind : "(unset)") << ", OMP_PLACES=" << (places ? places : "(unset)")
+		<< ", huge pages " << (useHugePages() ? "on" : "off") << '\n';
+	os << std::setw(8) << "thread" << std::setw(6) << "cpu" << std::setw(6) << "node"
+		<< "  allowed cpus\n";
+	for(int i = 0; i < nthreads; i++)
+		os << std::setw(8) << i << std::setw(6) << cpus[i] << std::setw(6) << nodes[i]
+			<< "  " << allowed[i] << '\n';
+
+	if(nthreads > 1 && (!bind || std::string(bind) == "false" || std::string(bind) == "FALSE"))
+		os << " ! Threads are not bound to cores and may migrate between sockets;"
+			<< " set OMP_PROC_BIND and OMP_PLACES for reproducible timings.\n";
+}
+
+}
+}
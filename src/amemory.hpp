@@ -0,0 +1,171 @@
+/** @file amemory.hpp
+ * @brief NUMA-aware allocation of large arrays, and reports of memory use and of where
+ * threads run
+ * @author Aditya Kashi
+ *
+ * On multi-socket machines, a page of memory is placed on the NUMA node of the thread that
+ * first writes to it. If large arrays were initialized by the master thread only, all of them
+ * would end up on one socket and threads on the other sockets would read remote memory in
+ * every kernel. Arrays allocated here are therefore zeroed in parallel right away, each thread
+ * writing the contiguous part that the default static OpenMP schedule assigns to it. Loops
+ * over cells or faces with the default schedule then mostly touch local memory, as long as
+ * threads are pinned to cores, eg. with OMP_PROC_BIND=close and OMP_PLACES=cores.
+ *
+ * Allocations are aligned to 64 bytes (one cache line). If the environment variable
+ * FVENS_HUGEPAGES is set to 1, allocations of 2 MiB or more are aligned to 2 MiB and marked
+ * for transparent huge pages on Linux; pages are then placed in 2 MiB units.
+ */
+
+#ifndef __AMEMORY_H
+#define __AMEMORY_H 1
+
+#ifndef __ACONSTANTS_H
+#include "aconstants.hpp"
+#endif
+
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+#include <type_traits>
+
+/// Alignment of all arrays allocated through acfd::memory
+#define FVENS_ALIGNMENT 64
+
+/// Arrays smaller than this are zeroed by the allocating thread alone
+#define FVENS_FIRST_TOUCH_MIN_BYTES 65536
+
+namespace acfd {
+namespace memory {
+
+/// Allocates zeroed, aligned memory, first touched in parallel
+/** Returns nullptr if bytes is zero. Must be released with deallocate().
+ * If called from inside a parallel region, the calling thread touches all the memory.
+ */
+void* allocate(const size_t bytes);
+
+/// Releases memory obtained from allocate()
+void deallocate(void *const ptr);
+
+/// Number of successful calls to allocate() so far, from all threads
+size_t numAllocations();
+
+/// Total number of bytes requested from allocate() so far
+size_t allocatedBytes();
+
+/// Zeroes a contiguous block in parallel, splitting it among threads like a static schedule
+void firstTouch(void *const ptr, const size_t bytes);
+
+/// Zeroes an Eigen matrix in parallel; each column is split separately if it is column-major
+/** For use right after allocation of a matrix whose rows are cells or faces, so that the
+ * memory of each row is placed near the thread that works on that row.
+ */
+template <typename EigenMatrix>
+void firstTouch(EigenMatrix& mat)
+{
+	typedef typename EigenMatrix::Scalar T;
+	if(EigenMatrix::IsRowMajor)
+		firstTouch(mat.data(), mat.size()*sizeof(T));
+	else
+		for(Eigen::Index j = 0; j < mat.cols(); j++)
+			firstTouch(mat.data()+j*mat.rows(), mat.rows()*sizeof(T));
+}
+
+/// Allocates an array of n objects, zeroed and first-touched in parallel
+/** Only types which need no destruction are supported, such as numbers and fixed-size
+ * Eigen matrices. The array must be released with deallocate().
+ */
+template <typename T>
+T* allocateArray(const size_t n)
+{
+	static_assert(std::is_trivially_destructible<T>::value,
+			"Only trivially destructible types can be allocated");
+	T *const arr = static_cast<T*>(allocate(n*sizeof(T)));
+	for(size_t i = 0; i < n; i++)
+		new(arr+i) T;
+	return arr;
+}
+
+/// Standard-library allocator that allocates through acfd::memory, for std::vector etc.
+/** Memory is first touched in parallel when it is allocated, so a serial initialization
+ * afterwards does not change where its pages are placed.
+ */
+template <typename T>
+struct Allocator
+{
+	typedef T value_type;
+
+	Allocator() { }
+	template <typename U> Allocator(const Allocator<U>&) { }
+
+	T* allocate(const size_t n)
+	{
+		T *const ptr = static_cast<T*>(memory::allocate(n*sizeof(T)));
+		if(n > 0 && !ptr)
+			throw std::bad_alloc();
+		return ptr;
+	}
+
+	void deallocate(T *const ptr, const size_t) { memory::deallocate(ptr); }
+};
+
+template <typename T, typename U>
+bool operator==(const Allocator<T>&, const Allocator<U>&) { return true; }
+
+template <typename T, typename U>
+bool operator!=(const Allocator<T>&, const Allocator<U>&) { return false; }
+
+/// Prints the CPU and NUMA node of each OpenMP thread and the OpenMP binding settings
+/** Must be called from outside any parallel region.
+ * Warns if threads are not bound to cores, in which case timings with different thread
+ * counts may not be comparable.
+ */
+void reportAffinity(std::ostream& os);
+
+/// Itemized memory use of the main data structures of a run
+/** Objects such as the mesh, discretizations, matrices and solvers add their large arrays
+ * through their reportMemory functions. Small members are not counted, so the total is a
+ * lower bound of the memory used, to be compared with the resident size of the process.
+ */
+class Report
+{
+public:
+	/// Adds an item; items of zero bytes are skipped
+	/** \param[in] object Name of the object, such as "mesh"; items of an object are listed
+	 *   together, in the order in which they were first added
+	 * \param[in] item Name of the item, usually the member
+	 * \param[in] bytes Memory used by the item
+	 */
+	void add(const std::string& object, const std::string& item, const size_t bytes);
+
+	/// Total bytes of all items
+	size_t total() const;
+
+	/// Total bytes of the items of one object
+	size_t total(const std::string& object) const;
+
+	/// Removes all items
+	void clear() { items.clear(); }
+
+	/// Prints the items of each object and the subtotals in MiB, then the total and the
+	/// current and peak resident sizes of the process
+	void print(std::ostream& os) const;
+
+private:
+	struct Item {
+		std::string object;
+		std::string item;
+		size_t bytes;
+	};
+	std::vector<Item> items;
+};
+
+/// Current resident set size of the process in bytes, or 0 if it is not known
+size_t residentBytes();
+
+/// Largest resident set size of the process so far in bytes, or 0 if it is not known
+size_t peakResidentBytes();
+
+}
+}
+#endif
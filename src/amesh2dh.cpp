@@ -1,4 +1,10 @@
 #include "amesh2dh.hpp"
+#include "alocator.hpp"
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 namespace acfd {
 
@@ -12,10 +18,9 @@ UMesh2dh::UMesh2dh(const UMesh2dh& other)
 	nelem = other.nelem;
 	nface = other.nface;
 	ndim = other.ndim;
-	nnode = other.nnode;
 	naface = other.naface;
 	nbface = other.nbface;
-	nfael = other.nfael;
+	facelayout = other.facelayout;
 	maxnnode = other.maxnnode;
 	maxnfael = other.maxnfael;
 	nnofa = other.nnofa;
@@ -50,10 +55,9 @@ UMesh2dh& UMesh2dh::operator=(const UMesh2dh& other)
 	nelem = other.nelem;
 	nface = other.nface;
 	ndim = other.ndim;
-	nnode = other.nnode;
 	naface = other.naface;
 	nbface = other.nbface;
-	nfael = other.nfael;
+	facelayout = other.facelayout;
 	maxnnode = other.maxnnode;
 	maxnfael = other.maxnfael;
 	nnofa = other.nnofa;
@@ -87,6 +91,25 @@ UMesh2dh::~UMesh2dh()
 {
 }
 
+void UMesh2dh::setupElements(const int *const nnodes, const int *const nfaels)
+{
+	const std::shared_ptr<const amat::RaggedLayout> nodelayout
+		= std::make_shared<const amat::RaggedLayout>(nelem, nnodes);
+	inpoel.setup(nodelayout);
+
+	bool samefaces = true;
+	if(nfaels)
+		for(a_int i = 0; i < nelem; i++)
+			if(nfaels[i] != nnodes[i]) {
+				samefaces = false;
+				break;
+			}
+	facelayout = samefaces ? nodelayout : std::make_shared<const amat::RaggedLayout>(nelem, nfaels);
+
+	maxnnode = nodelayout->maxRowSize();
+	maxnfael = facelayout->maxRowSize();
+}
+
 /** (Deprecated) Reads Professor Luo's mesh file, which I call the 'domn' format.
    NOTE: Make sure nnofa is mentioned after ndim and ntype in the mesh file. ntype makes no sense for us now.
    Can only be used for linear mesh having all cells of the same shape.
@@ -119,9 +142,6 @@ void UMesh2dh::readDomn(std::string mfile)
 	infile >> dummy; 				// get time
 	ch = infile.get();			// clear newline
 
-	nnode.resize(nelem,-1);
-	nfael.resize(nelem,-1);
-
 	nbtag = 2;
 	ndtag = 2;
 
@@ -141,13 +161,8 @@ void UMesh2dh::readDomn(std::string mfile)
 	//now populate inpoel
 	for(int i = 0; i < nelem; i++)
 	{
-		//infile >> nnode[i];
 		infile >> dum;
-		nnode[i] = nnode2;
-		//nfael[i] = nnode[i];		// NOTE: assuming linear element
-		nfael[i] = nfael2;
-
-		for(int j = 0; j < nnode[i]; j++)
+		for(int j = 0; j < nnode2; j++)
 			infile >> elms(i,j);
 
 		do
@@ -156,21 +171,17 @@ void UMesh2dh::readDomn(std::string mfile)
 	}
 	std::cout << "UMesh2dh: Populated inpoel.\n";
 
-	maxnnode = 3;
-	for(int i = 0; i < nelem; i++)
-		if(nnode[i] > maxnnode)
-			maxnnode = nnode[i];
-	
-	inpoel.setup(nelem, maxnnode);
+	const std::vector<int> nnodes(nelem, nnode2), nfaels(nelem, nfael2);
+	setupElements(&nnodes[0], &nfaels[0]);
 
 	for(int i = 0; i < nelem; i++)
-		for(int j = 0; j < nnode[i]; j++)
+		for(int j = 0; j < nnode2; j++)
 			inpoel(i,j) = elms.get(i,j);
 	
 	//Correct inpoel:
 	for(int i = 0; i < nelem; i++)
 	{
-		for(int j = 0; j < nnode[i]; j++)
+		for(int j = 0; j < nnode2; j++)
 			inpoel(i,j)--;
 	}
 
@@ -378,24 +389,13 @@ void UMesh2dh::readGmsh2(std::string mfile, int dimensions)
 	for(int i = 0; i < nelm; i++)
 		std::cout << nnodes[i] << " " << nfaels[i] << std::endl;*/
 
-	nnode.reserve(nelem);
-	nfael.reserve(nelem);
-
-	// calculate max nnode and nfael
-	maxnnode = nnodes[nface]; maxnfael = nfaels[nface];
-	for(int i = 0; i < nelm; i++)
-	{
-		if(nnodes[i] > maxnnode)
-			maxnnode = nnodes[i];
-		if(nfaels[i] > maxnfael)
-			maxnfael = nfaels[i];
-	}
+	// the elements come after the boundary faces
+	setupElements(&nnodes[nface], &nfaels[nface]);
 
 	if(nface > 0)
 		bface.setup(nface, nnofa+nbtag);
 	else std::cout << "UMesh2d: readGmsh2(): NOTE: There is no boundary data!" << std::endl;
 
-	inpoel.setup(nelem, maxnnode);
 	vol_regions.setup(nelem, ndtag);
 
 	std::cout << "UMesh2dh: readGmsh2(): No. of points: " << npoin 
@@ -420,8 +420,6 @@ void UMesh2dh::readGmsh2(std::string mfile, int dimensions)
 			inpoel(i,j) = elms(i+nface,j)-1;
 		for(int j = 0; j < ndtag; j++)
 			vol_regions(i,j) = elms(i+nface,j+nnodes[i+nface]);
-		nnode.push_back(nnodes[i+nface]);
-		nfael.push_back(nfaels[i+nface]);
 	}
 	infile.close();
 
@@ -572,20 +570,20 @@ void UMesh2dh::writeGmsh2(std::string mfile)
 	//std::cout << "elements\n";
 	for(int iel = 0; iel < nelem; iel++)
 	{
-		if(nnode[iel] == 3)
+		if(gnnode(iel) == 3)
 			elm_type = 2;
-		else if(nnode[iel] == 4)
+		else if(gnnode(iel) == 4)
 			elm_type = 3;
-		else if(nnode[iel] == 6)
+		else if(gnnode(iel) == 6)
 			elm_type = 9;
-		else if(nnode[iel] == 8)
+		else if(gnnode(iel) == 8)
 			elm_type = 16;
-		else if(nnode[iel]==9)
+		else if(gnnode(iel)==9)
 			elm_type = 10;
 		outf << nface+iel+1 << " " << elm_type << " " << ndtag;
 		for(int i = 0; i < ndtag; i++)
 			outf << " " << vol_regions(iel,i);
-		for(int i = 0; i < nnode[iel]; i++)
+		for(int i = 0; i < gnnode(iel); i++)
 			outf << " " << inpoel(iel,i)+1;
 		outf << '\n';
 	}
@@ -639,12 +637,13 @@ void UMesh2dh::detect_negative_jacobians(std::ofstream& out)
 // Computes areas of linear triangles and quads
 void UMesh2dh::compute_areas()
 {
+	locator.reset();
 	area.setup(nelem,1);
 	for(int i = 0; i < nelem; i++)
 	{
-		if(nnode[i] == 3)
+		if(gnnode(i) == 3)
 			area(i,0) = 0.5*(gcoords(ginpoel(i,0),0)*(gcoords(ginpoel(i,1),1) - gcoords(ginpoel(i,2),1)) - gcoords(ginpoel(i,0),1)*(gcoords(ginpoel(i,1),0)-gcoords(ginpoel(i,2),0)) + gcoords(ginpoel(i,1),0)*gcoords(ginpoel(i,2),1) - gcoords(ginpoel(i,2),0)*gcoords(ginpoel(i,1),1));
-		else if(nnode[i]==4)
+		else if(gnnode(i)==4)
 		{
 			area(i,0) = 0.5*(gcoords(ginpoel(i,0),0)*(gcoords(ginpoel(i,1),1) - gcoords(ginpoel(i,2),1)) - gcoords(ginpoel(i,0),1)*(gcoords(ginpoel(i,1),0)-gcoords(ginpoel(i,2),0)) + gcoords(ginpoel(i,1),0)*gcoords(ginpoel(i,2),1) - gcoords(ginpoel(i,2),0)*gcoords(ginpoel(i,1),1));
 			area(i,0) += 0.5*(gcoords(ginpoel(i,0),0)*(gcoords(ginpoel(i,2),1) - gcoords(ginpoel(i,3),1)) - gcoords(ginpoel(i,0),1)*(gcoords(ginpoel(i,2),0)-gcoords(ginpoel(i,3),0)) + gcoords(ginpoel(i,2),0)*gcoords(ginpoel(i,3),1) - gcoords(ginpoel(i,3),0)*gcoords(ginpoel(i,2),1));
@@ -652,225 +651,222 @@ void UMesh2dh::compute_areas()
 	}
 }
 
-/// \todo: TODO: There is an issue with psup for some boundary nodes belonging to elements of different types. Correct this.
+/// Replaces the entries of an array by their inclusive prefix sums, in parallel
+/** Each thread scans a contiguous block, the block totals are scanned,
+ * and then each block is offset by the total of the blocks before it.
+ */
+static void inclusive_scan(a_int *const a, const a_int n)
+{
+#ifdef _OPENMP
+	const int maxthreads = omp_get_max_threads();
+#else
+	const int maxthreads = 1;
+#endif
+	std::vector<a_int> blocksums(maxthreads+1, 0);
+
+#pragma omp parallel default(shared)
+	{
+#ifdef _OPENMP
+		const int ithr = omp_get_thread_num(), nthr = omp_get_num_threads();
+#else
+		const int ithr = 0, nthr = 1;
+#endif
+		const a_int start = (a_int)((long long)n*ithr/nthr);
+		const a_int end = (a_int)((long long)n*(ithr+1)/nthr);
+		for(a_int i = start+1; i < end; i++)
+			a[i] += a[i-1];
+		blocksums[ithr+1] = end > start ? a[end-1] : 0;
+
+#pragma omp barrier
+#pragma omp single
+		for(int t = 1; t <= nthr; t++)
+			blocksums[t] += blocksums[t-1];
+
+		const a_int offset = blocksums[ithr];
+		for(a_int i = start; i < end; i++)
+			a[i] += offset;
+	}
+}
+
+/** All the structures are computed by parallel passes over points or elements, each pass
+ * writing only to rows owned by the point or element at hand. Storage for the lists is
+ * allocated by counting in one pass and taking prefix sums of the counts. The lists come out
+ * in the same order as they would from a serial loop over elements, so the results do not
+ * depend on the number of threads.
+ * \todo: TODO: There is an issue with psup for some boundary nodes belonging to elements of different types. Correct this.
+ */
 void UMesh2dh::compute_topological()
 {
+	locator.reset();
 #ifdef DEBUG
 	std::cout << "UMesh2dh: compute_topological(): Calculating and storing topological information...\n";
 #endif
 	/// 1. Elements surrounding points
-	//std::cout << "UMesh2d: compute_topological(): Elements surrounding points\n";
 	esup_p.setup(npoin+1,1);
 	esup_p.zeros();
+	a_int *const esupp = &esup_p(0);
 
-	for(int i = 0; i < nelem; i++)
-	{
-		for(int j = 0; j < nnode[i]; j++)
+	// esup_p(i+1) is first set to the number of elements surrounding point i
+#pragma omp parallel for default(shared)
+	for(a_int i = 0; i < nelem; i++)
+		for(int j = 0; j < gnnode(i); j++)
 		{
-			esup_p(inpoel(i,j)+1,0) += 1;	// inpoel(i,j) + 1 : the + 1 is there because the storage corresponding to the first node begins at 0, not at 1
+#pragma omp atomic update
+			esupp[inpoel(i,j)+1]++;
 		}
-	}
-	// Now make the members of esup_p cumulative
-	for(int i = 1; i < npoin+1; i++)
-		esup_p(i,0) += esup_p(i-1,0);
-	// Now populate esup
-	esup.setup(esup_p(npoin,0),1);
-	esup.zeros();
-	for(int i = 0; i < nelem; i++)
+
+	inclusive_scan(esupp, npoin+1);
+
+	esup.setup(esup_p(npoin),1);
+	a_int *const esupl = &esup(0);
+	std::vector<a_int> nextpos(esupp, esupp+npoin);
+
+#pragma omp parallel default(shared)
 	{
-		for(int j = 0; j < nnode[i]; j++)
-		{
-			int ipoin = inpoel(i,j);
-			esup(esup_p(ipoin,0),0) = i;		// now put that element no. in the space pointed to by esup_p(ipoin)
-			esup_p(ipoin,0) += 1;				// an element corresponding to ipoin has been found - increment esup_p for that point
-		}
+#pragma omp for
+		for(a_int i = 0; i < nelem; i++)
+			for(int j = 0; j < gnnode(i); j++)
+			{
+				a_int pos;
+#pragma omp atomic capture
+				pos = nextpos[inpoel(i,j)]++;
+				esupl[pos] = i;
+			}
+
+		// restore ascending order of elements for each point
+#pragma omp for
+		for(a_int ip = 0; ip < npoin; ip++)
+			std::sort(esupl+esupp[ip], esupl+esupp[ip+1]);
 	}
-	//But now esup_p holds increased values - each member increased by the number elements surrounding the corresponding point.
-	// So correct this.
-	for(int i = npoin; i >= 1; i--)
-		esup_p(i,0) = esup_p(i-1,0);
-	esup_p(0,0) = 0;
 	// Elements surrounding points is now done.
 
 	/// 2. Points surrounding points
 #ifdef DEBUG
 	std::cout << "UMesh2dh: compute_topological(): Points surrounding points\n";
 #endif
-	psup_p.setup(npoin+1,1);
-	psup_p.zeros();
-	psup_p(0,0) = 0;
-	amat::Array2d<int > lpoin(npoin,1);  // The ith member indicates the global point number of which the ith point is a surrounding point
-	for(int i = 0; i < npoin; i++) lpoin(i,0) = -1;	// initialize this std::vector to -1
-	int istor = 0;
-
-	// first pass: calculate storage needed for psup
-	for(int ip = 0; ip < npoin; ip++)
+	/* Appends the points surrounding ip to nbrs, in the order in which they are first found
+	 * when going through the surrounding elements, and the nodes of each element, in order.
+	 * All nodes of a triangle are connected to each other, while a node of a quadrangle is
+	 * connected only to the adjacent nodes.
+	 */
+	auto points_surrounding_point = [this](const a_int ip, std::vector<a_int>& nbrs)
 	{
-		lpoin(ip,0) = ip;		// the point ip itself is not counted as a surrounding point of ip
-		// Loop over elements surrounding this point
-		for(int ie = esup_p(ip,0); ie <= esup_p(ip+1,0)-1; ie++)
+		nbrs.clear();
+		for(a_int ie = esup_p(ip); ie < esup_p(ip+1); ie++)
 		{
-			int ielem = esup(ie,0);		// element number
+			const a_int ielem = esup(ie);
 
 			// find local node number of ip in ielem
 			int inode = -1;
-			for(int jnode = 0; jnode < nnode[ielem]; jnode++)
+			for(int jnode = 0; jnode < gnnode(ielem); jnode++)
 				if(inpoel(ielem,jnode) == ip) inode = jnode;
 #ifdef DEBUG
 			if(inode == -1)
 				std::cout << " ! UMesh2dh: compute_topological(): inode not found while computing psup!\n";
 #endif
 
-			std::vector<bool> nbd(nnode[ielem]);		// contains true if that local node number is connected to a particular local node.
-			for(int j = 0; j < nnode[ielem]; j++)
-				nbd[j] = false;
-
-			if(nnode[ielem] == 3)
-				for(size_t i = 0; i < nbd.size(); i++)
-					nbd[i] = true;
-			else if(nnode[ielem] == 4)
-				for(int jnode = 0; jnode < nnode[ielem]; jnode++)
-				{
-					//if(jnode == perm(0,nnode[ielem]-1,inode,1) || jnode == perm(0,nnode[ielem]-1, inode, -1))
-					if(jnode == (inode + 1) % nnode[ielem] || jnode == (inode + nnode[ielem]-1) % nnode[ielem])
-						nbd[jnode] = true;
-				}
-
-			//loop over nodes of the element
-			for(int inode = 0; inode < nnode[ielem]; inode++)
+			for(int jnode = 0; jnode < gnnode(ielem); jnode++)
 			{
-				//Get global index of this node
-				int jpoin = inpoel(ielem, inode);
-				if(lpoin(jpoin,0) != ip && nbd[inode])		// test if this point as already been counted as a surrounding point of ip, and whether it's connected to ip.
-				{
-					istor++;
-					lpoin(jpoin,0) = ip;		// set this point as a surrounding point of ip
-				}
+				bool connected = false;
+				if(gnnode(ielem) == 3)
+					connected = true;
+				else if(gnnode(ielem) == 4)
+					connected = (jnode == (inode+1) % gnnode(ielem)
+					             || jnode == (inode+gnnode(ielem)-1) % gnnode(ielem));
+
+				const a_int jpoin = inpoel(ielem,jnode);
+				if(connected && jpoin != ip && std::find(nbrs.begin(), nbrs.end(), jpoin) == nbrs.end())
+					nbrs.push_back(jpoin);
 			}
 		}
-		psup_p(ip+1,0) = istor;
-	}
+	};
 
-	psup.setup(istor,1);
-	//std::cout << "+++ " << istor << std::endl;
+	psup_p.setup(npoin+1,1);
+	psup_p(0) = 0;
+	a_int *const psupp = &psup_p(0);
 
-	//second pass: populate psup
-	istor = 0;
-	for(int i = 0; i < npoin; i++) lpoin(i,0) = -1;	// initialize lpoin to -1
-	for(int ip = 0; ip < npoin; ip++)
+	// first pass: calculate storage needed for psup
+#pragma omp parallel default(shared)
 	{
-		lpoin(ip,0) = ip;		// the point ip itself is not counted as a surrounding point of ip
-		// Loop over elements surrounding this point
-		for(int ie = esup_p(ip,0); ie <= esup_p(ip+1,0)-1; ie++)
+		std::vector<a_int> nbrs;
+#pragma omp for
+		for(a_int ip = 0; ip < npoin; ip++)
 		{
-			int ielem = esup(ie,0);		// element number
-
-			// find local node number of ip in ielem
-			int inode = -1;
-			for(int jnode = 0; jnode < nnode[ielem]; jnode++)
-				if(inpoel(ielem,jnode) == ip) inode = jnode;
-#ifdef DEBUG
-			if(inode == -1)
-				std::cout << " ! UMesh2dh: compute_topological(): inode not found while computing psup!\n";
-#endif
+			points_surrounding_point(ip, nbrs);
+			psupp[ip+1] = static_cast<a_int>(nbrs.size());
+		}
+	}
 
-			std::vector<bool> nbd(nnode[ielem]);		// nbd[j] contains true if ip is connected to local node number j of ielem.
-			for(int j = 0; j < nnode[ielem]; j++)
-				nbd[j] = false;
+	inclusive_scan(psupp, npoin+1);
 
-			if(nnode[ielem] == 3)
-				for(size_t i = 0; i < nbd.size(); i++)
-					nbd[i] = true;
-			else if(nnode[ielem] == 4)
-				for(int jnode = 0; jnode < nnode[ielem]; jnode++)
-				{
-					//if(jnode == perm(0,nnode[ielem]-1,inode,1) || jnode == perm(0,nnode[ielem]-1, inode, -1))
-					if(jnode == (inode + 1) % nnode[ielem] || jnode == (inode + nnode[ielem]-1) % nnode[ielem])
-						nbd[jnode] = true;
-				}
-
-			//loop over nodes of the element
-			for(int inode = 0; inode < nnode[ielem]; inode++)
-			{
-				//Get global index of this node
-				int jpoin = inpoel(ielem, inode);
-				if(lpoin(jpoin,0) != ip && nbd[inode])		// test of this point as already been counted as a surrounding point of ip
-				{
-					psup(istor,0) = jpoin;
-					istor++;
-					lpoin(jpoin,0) = ip;		// set this point as a surrounding point of ip
-				}
-			}
+	// second pass: populate psup
+	psup.setup(psup_p(npoin),1);
+#pragma omp parallel default(shared)
+	{
+		std::vector<a_int> nbrs;
+#pragma omp for
+		for(a_int ip = 0; ip < npoin; ip++)
+		{
+			points_surrounding_point(ip, nbrs);
+			for(size_t k = 0; k < nbrs.size(); k++)
+				psup(psupp[ip]+k) = nbrs[k];
 		}
 	}
 	//Points surrounding points is now done.
 
 	/// 3. Elements surrounding elements
+	/** The neighbour across a face can only be one of the elements surrounding both its first
+	 * and second nodes. Since the esup lists are sorted, those candidates are found by merging
+	 * the two lists, and only they are checked for a face with the same nodes.
+	 * Only the row of the current element is written, so elements are processed independently.
+	 */
 #ifdef DEBUG
 	std::cout << "UMesh2dh: compute_topological(): Elements surrounding elements...\n";
 #endif
-	//amat::Array2d<int> lpoin(npoin,1);
-	esuel.setup(nelem, maxnfael);
-	for(int ii = 0; ii < nelem; ii++)
-		for(int jj = 0; jj < maxnfael; jj++)
-			esuel(ii,jj) = -1;
-	//lpofa.mprint();
-	amat::Array2d<int > lhelp(nnofa,1);
-	lhelp.zeros();
-	lpoin.zeros();
+	esuel.setup(facelayout);
 
-	for(int ielem = 0; ielem < nelem; ielem++)
+#pragma omp parallel default(shared)
 	{
-		// first get lpofa for this element
-		amat::Array2d<int > lpofai(nfael[ielem], nnofa);	// lpofa(i,j) holds local node number of jth node of ith face (j in [0:nnofa], i in [0:nfael])
-		for(int i = 0; i < nfael[ielem]; i++)
-		{
-			for(int j = 0; j < nnofa; j++)
-			{
-				lpofai(i,j) = (i+j) % nnode[ielem];		// fine as long as operands of % are not negative
-			}
-		}
+		std::vector<a_int> lhelp(nnofa);		// global node numbers of the current face
 
-		for(int ifael = 0; ifael < nfael[ielem]; ifael++)
+#pragma omp for
+		for(a_int ielem = 0; ielem < nelem; ielem++)
 		{
-			for(int i = 0; i < nnofa; i++)
-			{
-				lhelp(i,0) = inpoel(ielem, lpofai(ifael,i));	// lhelp stores global node nos. of current face of current element
-				lpoin(lhelp(i,0)) = 1;
-			}
-			int ipoin = lhelp(0);
-			for(int istor = esup_p(ipoin); istor < esup_p(ipoin+1); istor++)
+			for(int jj = 0; jj < gnfael(ielem); jj++)
+				esuel(ielem,jj) = -1;
+
+			for(int ifael = 0; ifael < gnfael(ielem); ifael++)
 			{
-				int jelem = esup(istor);
+				// local node numbers of face i of an element are (i+j) % nnode, j in [0:nnofa]
+				for(int i = 0; i < nnofa; i++)
+					lhelp[i] = inpoel(ielem, (ifael+i) % gnnode(ielem));
 
-				if(jelem != ielem)
+				a_int ia = esup_p(lhelp[0]), ib = esup_p(lhelp[1]);
+				const a_int iaend = esup_p(lhelp[0]+1), ibend = esup_p(lhelp[1]+1);
+				while(ia < iaend && ib < ibend)
 				{
-					// setup lpofa for jelem
-					amat::Array2d<int > lpofaj;
-					lpofaj.setup(nfael[jelem],nnofa);
-					for(int i = 0; i < nfael[jelem]; i++)
-						for(int j = 0; j < nnofa; j++)
-							lpofaj(i,j) = (i+j)%nnode[jelem];
-
-					for(int jfael = 0; jfael < nfael[jelem]; jfael++)
+					const a_int jelem = esup(ia);
+					if(jelem < esup(ib)) { ia++; continue; }
+					if(jelem > esup(ib)) { ib++; continue; }
+					ia++; ib++;
+					if(jelem == ielem)
+						continue;
+
+					for(int jfael = 0; jfael < gnfael(jelem); jfael++)
 					{
 						//Assume that no. of nodes in face ifael is same as that in face jfael
 						int icoun = 0;
 						for(int jnofa = 0; jnofa < nnofa; jnofa++)
 						{
-							int jpoin = inpoel(jelem, lpofaj(jfael,jnofa));
-							if(lpoin(jpoin)==1) icoun++;
+							const a_int jpoin = inpoel(jelem, (jfael+jnofa) % gnnode(jelem));
+							if(std::find(lhelp.begin(), lhelp.end(), jpoin) != lhelp.end())
+								icoun++;
 						}
-						if(icoun == nnofa)		// nnofa is 2
-						{
+						if(icoun == nnofa)
 							esuel(ielem,ifael) = jelem;
-							esuel(jelem,jfael) = ielem;
-						}
 					}
 				}
 			}
-			for(int i = 0; i < nnofa; i++)
-				lpoin(lhelp(i)) = 0;
 		}
 	}
 
@@ -879,87 +875,78 @@ void UMesh2dh::compute_topological()
 	 * The node ordering of the face is such that the face `points' to the cell with greater index;
 	 * this means the vector starting at node 0 and pointing towards node 1 would rotate clockwise by 90 degrees to point to the cell with greater index.
 	 * Also computes element-face connectivity array elemface in the same loop which computes intfac.
+	 * Boundary faces are numbered first, and then interior faces, in both cases in the order
+	 * of the element to their left; the position of each element's faces is given by prefix sums
+	 * of the number of faces each element owns.
 	 * \note After the following portion, esuel holds (nelem + face no.) for each ghost cell, instead of -1 as before.
 	 */
 #ifdef DEBUG
 	std::cout << "UMesh2dh: compute_topological(): Computing intfac..." << std::endl;
 #endif
-	nbface = naface = 0;
-	// first run: calculate nbface
-	for(int ie = 0; ie < nelem; ie++)
+	// number of boundary and interior faces owned by each element, shifted by one
+	std::vector<a_int> bfstart(nelem+1,0), ifstart(nelem+1,0);
+
+#pragma omp parallel for default(shared)
+	for(a_int ie = 0; ie < nelem; ie++)
 	{
-		for(int in = 0; in < nnode[ie]; in++)
+		for(int in = 0; in < gnnode(ie); in++)
 		{
-			int je = esuel(ie,in);
+			const a_int je = esuel(ie,in);
 			if(je == -1)
-			{
-				//esuel(ie,in) = nelem+nbface;
-				nbface++;
-			}
+				bfstart[ie+1]++;
+			else if(je > ie && je < nelem)
+				ifstart[ie+1]++;
 		}
 	}
+
+	inclusive_scan(&bfstart[0], nelem+1);
+	inclusive_scan(&ifstart[0], nelem+1);
+
+	nbface = bfstart[nelem];
 	std::cout << "UMesh2dh: compute_topological(): Number of boundary faces = " << nbface << std::endl;
-	// calculate number of internal faces
-	naface = nbface;
-	for(int ie = 0; ie < nelem; ie++)
-	{
-		for(int in = 0; in < nnode[ie]; in++)
-		{
-			int je = esuel(ie,in);
-			if(je > ie && je < nelem) naface++;
-		}
-	}
+	naface = nbface + ifstart[nelem];
 	std::cout << "UMesh2dh: compute_topological(): Number of all faces = " << naface << std::endl;
 
 	//allocate intfac and elemface
 	intfac.setup(naface,nnofa+2);
-	elemface.setup(nelem,maxnfael);
+	elemface.setup(facelayout);
 
-	//reset face totals
-	nbface = naface = 0;
-
-	int in1, je, jnode;
-
-	//second run: populate intfac
-	for(int ie = 0; ie < nelem; ie++)
+	/* A thread writes elemface of a neighbouring element je only for the face shared with
+	 * the current element ie < je; the thread handling je never writes that entry.
+	 */
+#pragma omp parallel for default(shared)
+	for(a_int ie = 0; ie < nelem; ie++)
 	{
-		for(int in = 0; in < nnode[ie]; in++)
+		a_int ibface = bfstart[ie];
+		a_int iface = nbface + ifstart[ie];
+		for(int in = 0; in < gnnode(ie); in++)
 		{
-			je = esuel(ie,in);
+			const a_int je = esuel(ie,in);
+			const int in1 = (in+1)%gnnode(ie);
 			if(je == -1)
 			{
-				in1 = (in+1)%nnode[ie];
-				esuel(ie,in) = nelem+nbface;
-				intfac(nbface,0) = ie;
-				intfac(nbface,1) = nelem+nbface;
-				intfac(nbface,2) = inpoel(ie,in);
-				intfac(nbface,3) = inpoel(ie,in1);
-				elemface(ie,in) = nbface;
-
-				nbface++;
+				esuel(ie,in) = nelem+ibface;
+				intfac(ibface,0) = ie;
+				intfac(ibface,1) = nelem+ibface;
+				intfac(ibface,2) = inpoel(ie,in);
+				intfac(ibface,3) = inpoel(ie,in1);
+				elemface(ie,in) = ibface;
+
+				ibface++;
 			}
-		}
-	}
-	naface = nbface;
-	for(int ie = 0; ie < nelem; ie++)
-	{
-		for(int in = 0; in < nnode[ie]; in++)
-		{
-			je = esuel(ie,in);
-			if(je > ie && je < nelem)
+			else if(je > ie && je < nelem)
 			{
-				in1 = (in+1)%nnode[ie];
-				intfac(naface,0) = ie;
-				intfac(naface,1) = je;
-				intfac(naface,2) = inpoel.get(ie,in);
-				intfac(naface,3) = inpoel.get(ie,in1);
-
-				elemface(ie,in) = naface;
-				for(jnode = 0; jnode < nnode[je]; jnode++)
+				intfac(iface,0) = ie;
+				intfac(iface,1) = je;
+				intfac(iface,2) = inpoel.get(ie,in);
+				intfac(iface,3) = inpoel.get(ie,in1);
+
+				elemface(ie,in) = iface;
+				for(int jnode = 0; jnode < gnnode(je); jnode++)
 					if(inpoel.get(ie,in1) == inpoel.get(je,jnode))
-						elemface(je,jnode) = naface;
+						elemface(je,jnode) = iface;
 
-				naface++;
+				iface++;
 			}
 		}
 	}
@@ -967,7 +954,6 @@ void UMesh2dh::compute_topological()
 	/// Finally, calculates bpoints.
 
 	//first get number of bpoints
-	nbpoin = 0;
 	amat::Array2d<int > isbpflag(npoin,1);
 	isbpflag.zeros();
 	for(int i = 0; i < nface; i++)
@@ -975,8 +961,11 @@ void UMesh2dh::compute_topological()
 		for(int j = 0; j < nnofa; j++)
 			isbpflag(bface(i,j)) = 1;
 	}
-	for(int i = 0; i < npoin; i++)
-		if(isbpflag(i)==1) nbpoin++;
+	a_int nbp = 0;
+#pragma omp parallel for default(shared) reduction(+:nbp)
+	for(a_int i = 0; i < npoin; i++)
+		if(isbpflag(i)==1) nbp++;
+	nbpoin = nbp;
 
 	std::cout << "UMesh2dh: compute_topological(): Number of boundary points = " << nbpoin << std::endl;
 
@@ -1048,7 +1037,7 @@ void UMesh2dh::compute_face_data()
 	int i, j, p1, p2;
 
 	//Now compute normals and lengths (only linear meshes!)
-	gallfa.setup(naface, 3+nbtag);
+	gallfa.setup(naface, 3);
 	for(i = 0; i < naface; i++)
 	{
 		gallfa(i,0) = coords(intfac(i,3),1) - coords(intfac(i,2),1);
@@ -1059,10 +1048,11 @@ void UMesh2dh::compute_face_data()
 		gallfa(i,1) /= gallfa(i,2);
 	}
 
-	//Populate boundary flags in gallfa
+	//Populate boundary flags in bfacetags
 #ifdef DEBUG
-	std::cout << "UTriMesh: compute_face_data(): Storing boundary flags in gallfa...\n";
+	std::cout << "UTriMesh: compute_face_data(): Storing boundary flags in bfacetags...\n";
 #endif
+	bfacetags.setup(nbface, nbtag);
 	for(int ied = 0; ied < nbface; ied++)
 	{
 		p1 = intfac(ied,2);
@@ -1080,8 +1070,7 @@ void UMesh2dh::compute_face_data()
 				{
 					for(j = 0; j < nbtag; j++)
 					{
-						gallfa(ied,3+j) = bface.get(i,nnofa+j);
-						gallfa(ied,3+j) = bface.get(i,nnofa+j);
+						bfacetags(ied,j) = bface.get(i,nnofa+j);
 					}
 				}
 			}
@@ -1218,28 +1207,19 @@ UMesh2dh UMesh2dh::convertLinearToQuadratic()
 	/// We first calculate: total number of non-simplicial elements; nnode, nfael in each element; mmax nnode and max nfael.
 	int nelemnonsimp = 0;		// total number of non-simplicial elements
 	
-	q.nnode.resize(nelem);		// allocate
-	q.nfael.resize(nelem);
+	std::vector<int> qnnode(nelem), qnfael(nelem);
 
-	q.maxnfael = maxnfael;
-	q.maxnnode = 0; 
 	for(int ielem = 0; ielem < nelem; ielem++)
 	{
-		q.nfael[ielem] = nfael[ielem];
+		qnfael[ielem] = gnfael(ielem);
 		
-		if(nnode[ielem] >= 4) 	// if mesh is not simplicial
+		if(gnnode(ielem) >= 4) 	// if mesh is not simplicial
 		{
 			nelemnonsimp++;
-			q.nnode[ielem] = nnode[ielem] + nfael[ielem]*parm + 1;
-			if(q.nnode[ielem] > q.maxnnode)
-				q.maxnnode = q.nnode[ielem];
+			qnnode[ielem] = gnnode(ielem) + gnfael(ielem)*parm + 1;
 		}
 		else
-		{
-			q.nnode[ielem] = nnode[ielem] + nfael[ielem]*parm;
-			if(q.nnode[ielem] > q.maxnnode)
-				q.maxnnode = q.nnode[ielem];
-		}	
+			qnnode[ielem] = gnnode(ielem) + gnfael(ielem)*parm;
 	}
 
 	q.ndim = ndim;
@@ -1253,7 +1233,7 @@ UMesh2dh UMesh2dh::convertLinearToQuadratic()
 	q.ndtag = ndtag;
 
 	q.coords.setup(q.npoin, q.ndim);
-	q.inpoel.setup(q.nelem, q.maxnnode);
+	q.setupElements(&qnnode[0], &qnfael[0]);
 	q.bface.setup(q.nface, q.nnofa+q.nbtag);
 
 	/// Next, we copy over low-order mesh data to the new mesh.
@@ -1262,7 +1242,7 @@ UMesh2dh UMesh2dh::convertLinearToQuadratic()
 			q.coords(i,j) = coords(i,j);
 
 	for(int i = 0; i < nelem; i++)
-		for(int j = 0; j < nnode[i]; j++)
+		for(int j = 0; j < gnnode(i); j++)
 			q.inpoel(i,j) = inpoel(i,j);
 
 	for(int i = 0; i < nface; i++)
@@ -1289,14 +1269,14 @@ UMesh2dh UMesh2dh::convertLinearToQuadratic()
 		for(int idim = 0; idim < ndim; idim++)
 			q.coords(npoin+ied*parm,idim) = (coords(p1,idim) + coords(p2,idim))/2.0;
 
-		for(int inode = 0; inode < nnode[ielem]; inode++)
+		for(int inode = 0; inode < gnnode(ielem); inode++)
 		{
 			if(p1 == inpoel(ielem,inode)) lp1 = inode;
 			//if(p2 == inpoel(ielem,inode)) lp2 = inode;
 		}
 
 		// in the left element, the new point is in face ip1 (ie, the face whose first point is ip1 in CCW order)
-		q.inpoel(ielem, nnode[ielem]+lp1) = npoin+ied*parm;
+		q.inpoel(ielem, gnnode(ielem)+lp1) = npoin+ied*parm;
 
 		// find the bface that this face corresponds to
 		for(int ifa = 0; ifa < nface; ifa++)
@@ -1323,24 +1303,24 @@ UMesh2dh UMesh2dh::convertLinearToQuadratic()
 			q.coords(npoin+ied*parm,idim) = (coords(p1,idim) + coords(p2,idim))/2.0;
 
 		// First look at left element
-		for(int inode = 0; inode < nnode[ielem]; inode++)
+		for(int inode = 0; inode < gnnode(ielem); inode++)
 		{
 			if(p1 == inpoel(ielem,inode)) lp1 = inode;
 			if(p2 == inpoel(ielem,inode)) lp2 = inode;
 		}
 
 		// in the left element, the new point is in face ip1 (ie, the face whose first point is ip1 in CCW order)
-		q.inpoel(ielem, nnode[ielem]+lp1) = npoin+ied*parm;
+		q.inpoel(ielem, gnnode(ielem)+lp1) = npoin+ied*parm;
 
 		// Then look at right element
-		for(int inode = 0; inode < nnode[jelem]; inode++)
+		for(int inode = 0; inode < gnnode(jelem); inode++)
 		{
 			if(p1 == inpoel(jelem,inode)) lp1 = inode;
 			if(p2 == inpoel(jelem,inode)) lp2 = inode;
 		}
 
 		// in the right element, the new point is in face ip2
-		q.inpoel(jelem, nnode[jelem]+lp2) = npoin+ied*parm;
+		q.inpoel(jelem, gnnode(jelem)+lp2) = npoin+ied*parm;
 	}
 	
 	// for non-simplicial mesh, add extra points at cell-centres as well
@@ -1352,20 +1332,20 @@ UMesh2dh UMesh2dh::convertLinearToQuadratic()
 		//parmcell = 1;		// number of extra nodes per cell in the interior of the cell
 		double c_x = 0, c_y = 0;
 
-		if(nnode[iel] == 4)	
+		if(gnnode(iel) == 4)	
 		{
 			//parmcell = parm*parm;		// number of interior points to be added
 			// for now, we just add one node at cell center
-				for(int inode = 0; inode < nnode[iel]; inode++)
+				for(int inode = 0; inode < gnnode(iel); inode++)
 				{
 					c_x += coords(inpoel(iel,inode),0);
 					c_y += coords(inpoel(iel,inode),1);
 				}
-				c_x /= nnode[iel];
-				c_y /= nnode[iel];
+				c_x /= gnnode(iel);
+				c_y /= gnnode(iel);
 				q.coords(numpoin+iel,0) = c_x;
 				q.coords(numpoin+iel,1) = c_y;
-				q.inpoel(iel,q.nnode[iel]-1) = numpoin+iel;
+				q.inpoel(iel,q.gnnode(iel)-1) = numpoin+iel;
 		}
 	}
 	std::cout << "UMesh2dh: convertLinearToQuadratic(): Done." << std::endl;
@@ -1387,7 +1367,7 @@ UMesh2dh UMesh2dh::convertQuadToTri() const
 
 	for(int ielem = 0; ielem < nelem; ielem++)
 	{
-		if(nnode[ielem] == 4)
+		if(gnnode(ielem) == 4)
 		{
 			element[0] = inpoel.get(ielem,0);
 			element[1] = inpoel.get(ielem,1);
@@ -1406,7 +1386,7 @@ UMesh2dh UMesh2dh::convertQuadToTri() const
 
 			nelem2 += 2;
 		}
-		else if(nnode[ielem] == nnodet)
+		else if(gnnode(ielem) == nnodet)
 		{
 			for(int i = 0; i < nnodet; i++)
 				element[i] = inpoel.get(ielem,i);
@@ -1428,11 +1408,10 @@ UMesh2dh UMesh2dh::convertQuadToTri() const
 	tm.ndtag = ndtag;
 	tm.nnofa = nnofa;
 
-	tm.nnode.resize(nelem2);
-	tm.nfael.resize(nelem2);
+	const std::vector<int> nnodes(nelem2, nnodet);
 
 	tm.coords = coords;
-	tm.inpoel.setup(tm.nelem, nnodet);
+	tm.setupElements(&nnodes[0], nullptr);
 	tm.vol_regions.setup(tm.nelem, ndtag);
 	tm.bface = bface;
 
@@ -1440,8 +1419,6 @@ UMesh2dh UMesh2dh::convertQuadToTri() const
 	{
 		for(int inode = 0; inode < nnodet; inode++)
 			tm.inpoel(ielem, inode) = elms[ielem][inode];
-		tm.nnode[ielem] = nnodet;
-		tm.nfael[ielem] = nnodet;		// For linear elements
 		for(int i = 0; i < ndtag; i++)
 			tm.vol_regions(ielem,i) = volregs[ielem][i];
 	}
@@ -1449,4 +1426,53 @@ UMesh2dh UMesh2dh::convertQuadToTri() const
 	return tm;
 }
 
+const CellLocator& UMesh2dh::cellLocator() const
+{
+	std::lock_guard<std::mutex> lock(locatormutex);
+	if(!locator)
+		locator = std::make_shared<const CellLocator>(this);
+	return *locator;
+}
+
+void UMesh2dh::freeSetupData()
+{
+	esup_p.clear();
+	esup.clear();
+	psup_p.clear();
+	psup.clear();
+	bpoints.clear();
+	bpointsb.clear();
+	bfacebp.clear();
+	bifmap.clear();
+	ifbmap.clear();
+	isBoundaryMaps = false;
+	intfacbtags.clear();
+	flag_bpoin.clear();
+	jacobians.clear();
+	alloc_jacobians = false;
+}
+
+void UMesh2dh::reportMemory(memory::Report& report, const std::string& name) const
+{
+	report.add(name, "coords", coords.bytes());
+	report.add(name, "inpoel", inpoel.bytes() + inpoel.getLayout()->bytes());
+	if(facelayout != inpoel.getLayout())
+		report.add(name, "face layout", facelayout->bytes());
+	report.add(name, "bface", bface.bytes());
+	report.add(name, "vol_regions", vol_regions.bytes());
+	report.add(name, "flag_bpoin", flag_bpoin.bytes());
+	report.add(name, "esup", esup.bytes() + esup_p.bytes());
+	report.add(name, "psup", psup.bytes() + psup_p.bytes());
+	report.add(name, "esuel", esuel.bytes());
+	report.add(name, "intfac", intfac.bytes());
+	report.add(name, "intfacbtags", intfacbtags.bytes());
+	report.add(name, "elemface", elemface.bytes());
+	report.add(name, "boundary points", bpoints.bytes() + bpointsb.bytes() + bfacebp.bytes());
+	report.add(name, "boundary face maps", bifmap.bytes() + ifbmap.bytes());
+	report.add(name, "jacobians", jacobians.bytes());
+	report.add(name, "area", area.bytes());
+	report.add(name, "gallfa", gallfa.bytes());
+	report.add(name, "bfacetags", bfacetags.bytes());
+}
+
 } // end namespace
@@ -14,8 +14,16 @@
 #include "aarray2d.hpp"
 #endif
 
+#ifndef __ARAGGEDARRAY_H
+#include "araggedarray.hpp"
+#endif
+
+#include <mutex>
+
 namespace acfd {
 
+class CellLocator;
+
 /// General hybrid unstructured mesh class supporting triangular and quadrangular elements
 class UMesh2dh
 {
@@ -24,9 +32,7 @@ private:
 	a_int nelem;					///< Number of elements
 	a_int nface;					///< Number of boundary faces
 	int ndim;						///< \deprecated Dimension of the mesh
-	std::vector<int> nnode;			///< number of nodes to an element, for each element
 	int maxnnode;					///< Maximum number of nodes per element for any element
-	std::vector<int> nfael;			///< number of faces to an element (equal to number of edges to an element in 2D) for each element
 	int maxnfael;					///< Maximum number of faces per element for any element
 	int nnofa;						///< number of nodes in a face
 	a_int naface;					///< total number of (internal and boundary) faces
@@ -35,9 +41,20 @@ private:
 	int nbtag;						///< number of tags for each boundary face
 	int ndtag;						///< number of tags for each element
 	amat::Array2d<double > coords;				///< Specifies coordinates of each node
-	amat::Array2d<a_int > inpoel;				///< Interconnectivity matrix: lists node numbers of nodes in each element
+
+	/// Interconnectivity matrix: lists node numbers of nodes in each element
+	/** The number of nodes of an element is the length of its row, so there is no padding
+	 * in hybrid meshes, and no offsets are stored for meshes with only one kind of element.
+	 */
+	amat::RaggedArray<a_int> inpoel;
+
+	/// Number of faces of each element, as the row lengths of element-face arrays
+	/** For linear meshes, this is the same object as the layout of [inpoel](@ref inpoel).
+	 */
+	std::shared_ptr<const amat::RaggedLayout> facelayout;
+
 	amat::Array2d<a_int > bface;				///< Boundary face data: lists nodes belonging to a boundary face and contains boudnary markers
-	amat::Array2d<double > vol_regions;			///< to hold volume region markers, if any
+	amat::Array2d<int > vol_regions;			///< to hold volume region markers, if any
 	amat::Array2d<a_real > flag_bpoin;			///< Holds 1 or 0 for each point depending on whether or not that point is a boundary point
 
 	/// List of indices of [esup](@ref esup) corresponding to nodes
@@ -53,14 +70,16 @@ private:
 	 */
 	amat::Array2d<a_int > psup;
 	
-	/// Elements surrounding elements
-	amat::Array2d<a_int > esuel;
+	/// Elements surrounding elements, with the layout [facelayout](@ref facelayout)
+	amat::RaggedArray<a_int> esuel;
 	/// Face data structure - contains info about elements and nodes associated with a face
+	/** Boundary faces come first, in [0,nbface), followed by interior faces in [nbface,naface).
+	 */
 	amat::Array2d<a_int > intfac;
 	/// Holds boundary tags (markers) corresponding to intfac
 	amat::Array2d<int > intfacbtags;
-	/// Holds face numbers of faces making up an element
-	amat::Array2d<a_int> elemface;
+	/// Holds face numbers of faces making up an element, with the layout [facelayout](@ref facelayout)
+	amat::RaggedArray<a_int> elemface;
 	
 	/** @brief Boundary points list
 	 * 
@@ -90,6 +109,31 @@ private:
 	 */
 	amat::Array2d<a_real> gallfa;
 
+	/// Boundary markers of the boundary faces in [intfac](@ref intfac) order; nbface x nbtag
+	amat::Array2d<int> bfacetags;
+
+	/// Sets up the layouts of element-node and element-face data and allocates inpoel
+	/** \param nnodes Number of nodes of each element
+	 * \param nfaels Number of faces of each element; if null, it is taken equal to the number
+	 *   of nodes, as for linear elements
+	 */
+	void setupElements(const int *const nnodes, const int *const nfaels);
+
+	/// Spatial index of the cells, built on first use by [cellLocator](@ref cellLocator)
+	/** Not copied along with the mesh, as it refers to this mesh.
+	 */
+	mutable std::shared_ptr<const CellLocator> locator;
+	mutable std::mutex locatormutex;
+
+	/// Builds meshes directly in memory
+	friend class MeshGenerator;
+
+	/// Builds the meshes of subdomains
+	friend class DomainDecomposition;
+
+	/// Builds adapted meshes
+	friend class MeshAdapter;
+
 public:
 	UMesh2dh();
 	UMesh2dh(const UMesh2dh& other);
@@ -102,7 +146,7 @@ public:
 	{
 		return coords.get(pointno,dim);
 	}
-	a_int ginpoel(int elemno, int locnode) const
+	a_int ginpoel(const a_int elemno, const int locnode) const
 	{
 		return inpoel.get(elemno, locnode);
 	}
@@ -130,16 +174,18 @@ public:
 	double gjacobians(a_int ielem) const { return jacobians.get(ielem,0); }
 	a_real garea(const a_int ielem) const { return area.get(ielem,0); }
 	a_real ggallfa(a_int iface, int index) const { return gallfa.get(iface,index); }
+	/// Boundary marker of a boundary face; iface must be less than nbface
+	int gbfacetag(const a_int iface, const int itag) const { return bfacetags.get(iface,itag); }
 	int gflag_bpoin(const a_int pointno) const { return flag_bpoin.get(pointno); }
 
 	a_int gnpoin() const { return npoin; }
 	a_int gnelem() const { return nelem; }
 	a_int gnface() const { return nface; }
 	a_int gnbface() const { return nbface; }
-	int gnnode(int ielem) const { return nnode[ielem]; }
+	int gnnode(const a_int ielem) const { return inpoel.rowSize(ielem); }
 	int gndim() const { return ndim; }
 	a_int gnaface() const {return naface; }
-	int gnfael(int ielem) const { return nfael[ielem]; }
+	int gnfael(const a_int ielem) const { return facelayout->rowSize(ielem); }
 	int gnnofa() const { return nnofa; }
 	int gnbtag() const{ return nbtag; }
 	int gndtag() const { return ndtag; }
@@ -155,8 +201,15 @@ public:
 	void setcoords(amat::Array2d<double >* c)
 	{ coords = *c; }
 
+	/// Sets the connectivity of a mesh whose elements all have inp->cols() nodes
 	void setinpoel(amat::Array2d<int >* inp)
-	{ inpoel = *inp; }
+	{
+		std::vector<int> nnodes(inp->rows(), inp->cols());
+		setupElements(&nnodes[0], nullptr);
+		for(a_int i = 0; i < inp->rows(); i++)
+			for(int j = 0; j < inp->cols(); j++)
+				inpoel(i,j) = inp->get(i,j);
+	}
 
 	void setbface(amat::Array2d<int >* bf)
 	{ bface = *bf; }
@@ -201,7 +254,7 @@ public:
 	 */
 	void compute_topological();
 	
-	/// Computes unit normals and lengths, and sets boundary face tags for all faces in gallfa; only for linear meshes!
+	/// Computes unit normals and lengths of all faces in gallfa, and boundary face tags in bfacetags; only for linear meshes!
 	/** \note Uses intfac, so call only after compute_topological, only for linear mesh
 	 * \note The normal vector is the UNIT normal vector.
 	 */
@@ -228,6 +281,30 @@ public:
 
 	/// Converts quads in a mesh to triangles
 	UMesh2dh convertQuadToTri() const;
+
+	/// Returns a spatial index for finding the cells containing given points
+	/** It is built in parallel on the first call and kept until the mesh changes, ie., until
+	 * [compute_topological](@ref compute_topological) or [compute_areas](@ref compute_areas)
+	 * is called again. Can be called from several threads.
+	 * \note Needs the topology and areas of the mesh to have been computed.
+	 */
+	const CellLocator& cellLocator() const;
+
+	/// Frees the data that is only needed to set up the mesh and its face data
+	/** These are the point connectivities esup and psup, the boundary point lists, the
+	 * boundary face maps, intfacbtags, flag_bpoin and the element jacobians. Discretizations
+	 * and solvers only use the element and face data, which are kept. The mesh can still be
+	 * adapted or partitioned, as that builds new meshes from the element data.
+	 * \warning The functions that access the freed data must not be called afterwards,
+	 *   unless compute_topological() etc. are called again.
+	 */
+	void freeSetupData();
+
+	/// Adds the memory used by the arrays of the mesh to a report
+	/** \param report The report to add to
+	 * \param name Name of the mesh in the report
+	 */
+	void reportMemory(memory::Report& report, const std::string& name) const;
 };
 
 
@@ -0,0 +1,353 @@
+/** @file ameshgen.cpp
+ * @brief Implementation of in-memory mesh generation
+ * @author Aditya Kashi
+ */
+
+#include "ameshgen.hpp"
+#include <limits>
+#include <algorithm>
+#include <sstream>
+
+namespace acfd {
+
+/// A counter-based random number in [0,1), so that every node can be perturbed independently
+/** This is the finalizer of the SplitMix64 generator applied to the key.
+ */
+static inline a_real hashUniform(const unsigned long seed, const unsigned long long key)
+{
+	unsigned long long z = key + 0x9E3779B97F4A7C15ULL*(seed+1);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	z = z ^ (z >> 31);
+	return (z >> 11) * (1.0/9007199254740992.0);
+}
+
+MeshGenerator::Spec::Spec(const Geometry g, const CellShape s, const a_int n_x, const a_int n_y)
+	: geom(g), shape(s), nx(n_x), ny(n_y), perturb(0), seed(1),
+	  xmin(0), xmax(1), ymin(0), ymax(1), rin(0.5), rout(20.0)
+{
+	markers[0] = markers[1] = markers[2] = markers[3] = 4;
+	if(geom == BUMP)
+		markers[0] = markers[2] = 2;
+	else if(geom == CYLINDER)
+		markers[0] = 2;
+}
+
+bool MeshGenerator::parse(const std::string desc, Spec& spec)
+{
+	std::vector<std::string> tokens;
+	std::istringstream ss(desc);
+	std::string token;
+	while(std::getline(ss, token, ':'))
+		tokens.push_back(token);
+	if(tokens.size() < 3 || tokens.size() > 4)
+		return false;
+
+	Geometry geom;
+	if(tokens[0] == "RECT")
+		geom = RECTANGLE;
+	else if(tokens[0] == "BUMP")
+		geom = BUMP;
+	else if(tokens[0] == "CYLINDER")
+		geom = CYLINDER;
+	else
+		return false;
+
+	CellShape shape;
+	if(tokens[1] == "QUAD")
+		shape = QUADRANGLES;
+	else if(tokens[1] == "TRI")
+		shape = TRIANGLES;
+	else if(tokens[1] == "HYBRID")
+		shape = HYBRID;
+	else
+		return false;
+
+	a_int nx, ny;
+	char sep;
+	std::istringstream sizes(tokens[2]);
+	if(!(sizes >> nx >> sep >> ny) || sep != 'x')
+		return false;
+
+	spec = Spec(geom, shape, nx, ny);
+	if(tokens.size() == 4) {
+		std::istringstream pert(tokens[3]);
+		if(!(pert >> spec.perturb))
+			return false;
+	}
+	return true;
+}
+
+bool MeshGenerator::check(const Spec& spec)
+{
+	if(spec.nx < 1 || spec.ny < 1 || (periodic(spec) && spec.nx < 3)) {
+		std::cout << "! MeshGenerator: check(): Invalid number of cells!\n";
+		return false;
+	}
+	if(spec.perturb < 0 || spec.perturb >= 0.25) {
+		std::cout << "! MeshGenerator: check(): The perturbation must be in [0,0.25)!\n";
+		return false;
+	}
+	if(spec.geom == RECTANGLE && (spec.xmax <= spec.xmin || spec.ymax <= spec.ymin)) {
+		std::cout << "! MeshGenerator: check(): Invalid extent of the rectangle!\n";
+		return false;
+	}
+	if(spec.geom == CYLINDER && (spec.rin <= 0 || spec.rout <= spec.rin)) {
+		std::cout << "! MeshGenerator: check(): Invalid radii!\n";
+		return false;
+	}
+
+	// every array must be indexable by a_int
+	const long long maxind = std::numeric_limits<a_int>::max();
+	const long long npx = periodic(spec) ? spec.nx : spec.nx+1;
+	const long long nq = (spec.shape == QUADRANGLES) ? spec.ny : (spec.shape == HYBRID ? spec.ny/2 : 0);
+	const long long nel = nq*spec.nx + 2*(spec.ny-nq)*spec.nx;
+	if(npx*(spec.ny+1)*2 > maxind || nel*4 > maxind) {
+		std::cout << "! MeshGenerator: check(): The mesh is too large for the index type!\n";
+		return false;
+	}
+	return true;
+}
+
+a_int MeshGenerator::nquadrows(const Spec& spec)
+{
+	switch(spec.shape) {
+		case QUADRANGLES: return spec.ny;
+		case HYBRID: return spec.ny/2;
+		default: return 0;
+	}
+}
+
+a_int MeshGenerator::npoints(const Spec& spec)
+{
+	return periodic(spec) ? spec.nx*(spec.ny+1) : (spec.nx+1)*(spec.ny+1);
+}
+
+a_int MeshGenerator::nelements(const Spec& spec)
+{
+	const a_int nq = nquadrows(spec);
+	return nq*spec.nx + 2*(spec.ny-nq)*spec.nx;
+}
+
+a_int MeshGenerator::nboundaryfaces(const Spec& spec)
+{
+	return periodic(spec) ? 2*spec.nx : 2*(spec.nx+spec.ny);
+}
+
+a_int MeshGenerator::firstElement(const Spec& spec, const a_int i, const a_int j)
+{
+	const a_int nq = nquadrows(spec);
+	return j < nq ? j*spec.nx + i : nq*spec.nx + 2*((j-nq)*spec.nx + i);
+}
+
+void MeshGenerator::coordinates(const Spec& spec, const a_int i, const a_int j, a_real *const x)
+{
+	a_real xi = (a_real)i/spec.nx, eta = (a_real)j/spec.ny;
+
+	// perturb interior nodes in the reference square, so that the displacement scales with
+	// the local spacing of the mapped mesh
+	const bool interior = j > 0 && j < spec.ny && (periodic(spec) || (i > 0 && i < spec.nx));
+	if(spec.perturb > 0 && interior) {
+		const unsigned long long key = 2ULL*point(spec,i,j);
+		xi += spec.perturb*(2*hashUniform(spec.seed, key)-1)/spec.nx;
+		eta += spec.perturb*(2*hashUniform(spec.seed, key+1)-1)/spec.ny;
+	}
+
+	switch(spec.geom)
+	{
+		case RECTANGLE:
+			x[0] = spec.xmin + xi*(spec.xmax-spec.xmin);
+			x[1] = spec.ymin + eta*(spec.ymax-spec.ymin);
+			break;
+		case BUMP: {
+			// arc of radius 1.3 through (1,0), (1.5,0.1) and (2,0)
+			x[0] = 3.0*xi;
+			const a_real yb = (x[0] > 1.0 && x[0] < 2.0) ?
+				std::sqrt(1.69 - (x[0]-1.5)*(x[0]-1.5)) - 1.2 : 0.0;
+			x[1] = yb + eta*(1.0-yb);
+			break;
+		}
+		case CYLINDER: {
+			// radial spacing proportional to the radius keeps cells close to square
+			const a_real r = spec.rin*std::pow(spec.rout/spec.rin, eta);
+			const a_real theta = -2.0*PI*xi;
+			x[0] = r*std::cos(theta);
+			x[1] = r*std::sin(theta);
+			break;
+		}
+	}
+}
+
+int MeshGenerator::cellElements(const Spec& spec, const a_int i, const a_int j, a_int elnodes[2][4])
+{
+	const a_int p00 = point(spec,i,j), p10 = point(spec,i+1,j),
+	      p01 = point(spec,i,j+1), p11 = point(spec,i+1,j+1);
+	if(j < nquadrows(spec)) {
+		elnodes[0][0] = p00; elnodes[0][1] = p10; elnodes[0][2] = p11; elnodes[0][3] = p01;
+		return 4;
+	}
+	elnodes[0][0] = p00; elnodes[0][1] = p10; elnodes[0][2] = p11;
+	elnodes[1][0] = p00; elnodes[1][1] = p11; elnodes[1][2] = p01;
+	return 3;
+}
+
+/** Boundary faces are ordered side by side - bottom, right, top and left - and oriented
+ * counter-clockwise around the domain.
+ */
+void MeshGenerator::boundaryFace(const Spec& spec, const a_int iface, a_int fnodes[2], int& marker)
+{
+	a_int k = iface;
+	if(k < spec.nx) {
+		fnodes[0] = point(spec,k,0); fnodes[1] = point(spec,k+1,0);
+		marker = spec.markers[0];
+		return;
+	}
+	k -= spec.nx;
+	if(!periodic(spec)) {
+		if(k < spec.ny) {
+			fnodes[0] = point(spec,spec.nx,k); fnodes[1] = point(spec,spec.nx,k+1);
+			marker = spec.markers[1];
+			return;
+		}
+		k -= spec.ny;
+	}
+	if(k < spec.nx) {
+		fnodes[0] = point(spec,spec.nx-k,spec.ny); fnodes[1] = point(spec,spec.nx-k-1,spec.ny);
+		marker = spec.markers[2];
+		return;
+	}
+	k -= spec.nx;
+	fnodes[0] = point(spec,0,spec.ny-k); fnodes[1] = point(spec,0,spec.ny-k-1);
+	marker = spec.markers[3];
+}
+
+bool MeshGenerator::generate(const Spec& spec, UMesh2dh& m)
+{
+	if(!check(spec))
+		return false;
+
+	const a_int nq = nquadrows(spec);
+	const a_int npx = periodic(spec) ? spec.nx : spec.nx+1;
+
+	m.ndim = 2;
+	m.nnofa = 2;
+	m.nbtag = 2;
+	m.ndtag = 2;
+	m.npoin = npoints(spec);
+	m.nelem = nelements(spec);
+	m.nface = nboundaryfaces(spec);
+	m.alloc_jacobians = false;
+	m.isBoundaryMaps = false;
+
+	std::cout << "MeshGenerator: generate(): Generating a mesh with " << m.npoin << " points, "
+		<< m.nelem << " elements and " << m.nface << " boundary faces.\n";
+
+	// quadrangle rows come first
+	std::vector<int> nnodes(m.nelem, 3);
+	std::fill(nnodes.begin(), nnodes.begin()+nq*spec.nx, 4);
+	m.setupElements(&nnodes[0], nullptr);
+
+	m.coords.setup(m.npoin, m.ndim);
+	m.vol_regions.setup(m.nelem, m.ndtag);
+	m.bface.setup(m.nface, m.nnofa+m.nbtag);
+
+#pragma omp parallel default(shared)
+	{
+#pragma omp for
+		for(a_int j = 0; j <= spec.ny; j++)
+			for(a_int i = 0; i < npx; i++)
+				coordinates(spec, i, j, &m.coords(j*npx+i,0));
+
+#pragma omp for
+		for(a_int j = 0; j < spec.ny; j++)
+			for(a_int i = 0; i < spec.nx; i++)
+			{
+				a_int elnodes[2][4];
+				const int nv = cellElements(spec, i, j, elnodes);
+				const a_int iel = firstElement(spec, i, j);
+				const int nel = nv == 4 ? 1 : 2;
+				for(int k = 0; k < nel; k++)
+				{
+					for(int inode = 0; inode < nv; inode++)
+						m.inpoel(iel+k,inode) = elnodes[k][inode];
+					for(int itag = 0; itag < m.ndtag; itag++)
+						m.vol_regions(iel+k,itag) = 1;
+				}
+			}
+
+#pragma omp for
+		for(a_int iface = 0; iface < m.nface; iface++)
+		{
+			a_int fnodes[2]; int marker;
+			boundaryFace(spec, iface, fnodes, marker);
+			m.bface(iface,0) = fnodes[0]; m.bface(iface,1) = fnodes[1];
+			m.bface(iface,2) = m.bface(iface,3) = marker;
+		}
+	}
+
+	m.flag_bpoin.setup(m.npoin,1);
+	m.flag_bpoin.zeros();
+	for(a_int i = 0; i < m.nface; i++)
+		for(int j = 0; j < m.nnofa; j++)
+			m.flag_bpoin(m.bface(i,j)) = 1;
+
+	return true;
+}
+
+bool MeshGenerator::writeGmsh2(const Spec& spec, const std::string mfile)
+{
+	if(!check(spec))
+		return false;
+
+	std::ofstream outf(mfile);
+	if(!outf) {
+		std::cout << "! MeshGenerator: writeGmsh2(): Could not open " << mfile << "!\n";
+		return false;
+	}
+	std::cout << "MeshGenerator: writeGmsh2(): Writing generated mesh to file " << mfile << std::endl;
+
+	const a_int npx = periodic(spec) ? spec.nx : spec.nx+1;
+	const a_int nface = nboundaryfaces(spec);
+
+	outf << std::setprecision(MESHDATA_DOUBLE_PRECISION);
+	outf << "$MeshFormat\n2.2 0 8\n$EndMeshFormat\n";
+	outf << "$Nodes\n" << npoints(spec) << '\n';
+	for(a_int j = 0; j <= spec.ny; j++)
+		for(a_int i = 0; i < npx; i++)
+		{
+			a_real x[2];
+			coordinates(spec, i, j, x);
+			outf << j*npx+i+1 << " " << x[0] << " " << x[1] << " " << 0.0 << '\n';
+		}
+	outf << "$EndNodes\n";
+
+	outf << "$Elements\n" << nelements(spec)+nface << '\n';
+	for(a_int iface = 0; iface < nface; iface++)
+	{
+		a_int fnodes[2]; int marker;
+		boundaryFace(spec, iface, fnodes, marker);
+		outf << iface+1 << " 1 2 " << marker << " " << marker << " "
+			<< fnodes[0]+1 << " " << fnodes[1]+1 << '\n';
+	}
+	for(a_int j = 0; j < spec.ny; j++)
+		for(a_int i = 0; i < spec.nx; i++)
+		{
+			a_int elnodes[2][4];
+			const int nv = cellElements(spec, i, j, elnodes);
+			const a_int iel = firstElement(spec, i, j);
+			const int nel = nv == 4 ? 1 : 2;
+			for(int k = 0; k < nel; k++)
+			{
+				outf << nface+iel+k+1 << (nv == 4 ? " 3" : " 2") << " 2 1 1";
+				for(int inode = 0; inode < nv; inode++)
+					outf << " " << elnodes[k][inode]+1;
+				outf << '\n';
+			}
+		}
+	outf << "$EndElements\n";
+
+	outf.close();
+	return true;
+}
+
+}
@@ -0,0 +1,125 @@
+/** @file ameshgen.hpp
+ * @brief Generation of meshes of simple domains directly in memory, for scaling studies
+ * @author Aditya Kashi
+ */
+
+#ifndef __AMESHGEN_H
+#define __AMESHGEN_H 1
+
+#ifndef __AMESH2DH_H
+#include "amesh2dh.hpp"
+#endif
+
+namespace acfd {
+
+/// Generates linear meshes of simple domains without going through mesh files
+/** Every mesh is the image of a structured nx by ny grid on the unit square under a mapping
+ * that depends on the geometry. Coordinates, connectivity and boundary faces are computed
+ * independently for each node, cell and face, so they are generated in parallel in memory,
+ * or streamed to a file without ever holding the whole mesh.
+ *
+ * The generated mesh is equivalent to one read by UMesh2dh::readGmsh2, so the usual
+ * sequence of compute_topological(), compute_areas(), compute_jacobians() and
+ * compute_face_data() needs to be called afterwards.
+ * Boundary faces and elements get two tags each, like meshes from Gmsh.
+ */
+class MeshGenerator
+{
+public:
+	/// Domains that can be generated
+	enum Geometry {
+		RECTANGLE,			///< The rectangle [xmin,xmax] x [ymin,ymax]
+		BUMP,				///< The channel [0,3] x [0,1] with a 10% circular-arc bump between x=1 and x=2
+		CYLINDER			///< Annulus between a cylinder of radius rin and a far-field of radius rout
+	};
+
+	/// Kinds of cells
+	enum CellShape {
+		QUADRANGLES,
+		TRIANGLES,			///< Each quadrangle split into two triangles
+		HYBRID				///< Quadrangles in the lower half of the rows (near the cylinder), triangles above
+	};
+
+	/// Description of a mesh to generate
+	/** The index i runs along x for the rectangle and the bump, and clockwise around the cylinder.
+	 * The index j runs along y, or radially outward.
+	 */
+	struct Spec
+	{
+		Geometry geom;
+		CellShape shape;
+		a_int nx;					///< Number of cells in the i-direction
+		a_int ny;					///< Number of cells in the j-direction
+		/// Amplitude of the random displacement of interior nodes, as a fraction of the local spacing
+		/** Each coordinate of a node is moved by at most this fraction of a cell; it must be less
+		 * than 0.25 so that no cell can be inverted.
+		 */
+		a_real perturb;
+		unsigned long seed;			///< Seed for the perturbations; the mesh is a function of the seed only
+		a_real xmin, xmax, ymin, ymax;	///< Extent of the rectangle
+		a_real rin, rout;			///< Radii of the cylinder and the far-field boundary
+		/// Boundary markers for the j=0, i=nx, j=ny and i=0 sides, in that order
+		/** For the cylinder, only the first (wall) and third (far-field) are used. */
+		int markers[4];
+
+		/// Sets the defaults for a geometry: the unit square, or the same cylinder as the test cases,
+		/// with the walls of the bump and the cylinder marked 2 and the rest marked 4.
+		Spec(const Geometry g, const CellShape s, const a_int n_x, const a_int n_y);
+	};
+
+	/// Parses a mesh description of the form <geometry>:<cells>:<nx>x<ny>[:<perturbation>]
+	/** Geometry is one of RECT, BUMP or CYLINDER and cells is one of QUAD, TRI or HYBRID;
+	 * eg. "CYLINDER:HYBRID:512x256" or "RECT:TRI:1000x1000:0.2".
+	 * Other parameters are set to the defaults of the geometry.
+	 * \return False if the string is not such a description, eg. if it is a file name
+	 */
+	static bool parse(const std::string desc, Spec& spec);
+
+	/// Generates the mesh
+	/** \param[in] spec Description of the mesh
+	 * \param[out] m The mesh to generate; any earlier contents are replaced
+	 * \return False if the description is invalid or the mesh is too large for the index type
+	 */
+	static bool generate(const Spec& spec, UMesh2dh& m);
+
+	/// Writes the mesh to a Gmsh 2 file as it is generated, without storing it
+	/** The file is identical to what UMesh2dh::writeGmsh2 would write for the generated mesh.
+	 */
+	static bool writeGmsh2(const Spec& spec, const std::string mfile);
+
+private:
+	/// Returns false and prints a message if the description is invalid
+	static bool check(const Spec& spec);
+
+	static bool periodic(const Spec& spec) { return spec.geom == CYLINDER; }
+
+	/// Number of rows of quadrangles; the remaining rows are triangulated
+	static a_int nquadrows(const Spec& spec);
+
+	static a_int npoints(const Spec& spec);
+	static a_int nelements(const Spec& spec);
+	static a_int nboundaryfaces(const Spec& spec);
+
+	/// Index of the node (i,j)
+	static a_int point(const Spec& spec, const a_int i, const a_int j)
+	{
+		return periodic(spec) ? j*spec.nx + i%spec.nx : j*(spec.nx+1) + i;
+	}
+
+	/// Index of the first element of the cell (i,j)
+	static a_int firstElement(const Spec& spec, const a_int i, const a_int j);
+
+	/// Computes the coordinates of the node (i,j)
+	static void coordinates(const Spec& spec, const a_int i, const a_int j, a_real *const x);
+
+	/// Computes the counter-clockwise node lists of the one or two elements of the cell (i,j)
+	/** \return The number of nodes per element; 4 for one quadrangle, 3 for two triangles
+	 */
+	static int cellElements(const Spec& spec, const a_int i, const a_int j, a_int elnodes[2][4]);
+
+	/// Computes the nodes and the marker of a boundary face
+	static void boundaryFace(const Spec& spec, const a_int iface, a_int fnodes[2], int& marker);
+};
+
+}
+#endif
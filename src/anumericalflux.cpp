@@ -10,11 +10,12 @@
  */
 
 #include "anumericalflux.hpp"
+#include <algorithm>
 
 namespace acfd {
 
 InviscidFlux::InviscidFlux(const IdealGasPhysics *const phyctx) 
-	: physics(phyctx), g(phyctx->gamma())
+	: physics(phyctx), g(phyctx->gamma()), lowmachvmin(0)
 { }
 
 void InviscidFlux::get_jacobian(const a_real *const uleft, const a_real *const uright, 
@@ -22,6 +23,14 @@ void InviscidFlux::get_jacobian(const a_real *const uleft, const a_real *const u
 		a_real *const dfdl, a_real *const dfdr)
 { }
 
+void InviscidFlux::get_flux_jacobian(const a_real *const uleft, const a_real *const uright, 
+		const a_real* const n, 
+		a_real *const flux, a_real *const dfdl, a_real *const dfdr)
+{
+	get_flux(uleft, uright, n, flux);
+	get_jacobian(uleft, uright, n, dfdl, dfdr);
+}
+
 InviscidFlux::~InviscidFlux()
 { }
 
@@ -116,6 +125,53 @@ void LocalLaxFriedrichsFlux::get_jacobian(const a_real *const ul, const a_real *
 		}
 }
 
+/** The pressures, speeds of sound, normal velocities and the spectral radius are computed
+ * once and used for both the flux and the Jacobian; the results are the same as those of
+ * get_flux and get_jacobian.
+ */
+void LocalLaxFriedrichsFlux::get_flux_jacobian(const a_real *const __restrict__ ul, 
+		const a_real *const __restrict__ ur,
+		const a_real* const __restrict__ n, 
+		a_real *const __restrict__ flux, 
+		a_real *const __restrict__ dfdl, a_real *const __restrict__ dfdr)
+{
+	//calculate presures from u
+	const a_real pi = (g-1)*(ul[3] - 0.5*(std::pow(ul[1],2)+std::pow(ul[2],2))/ul[0]);
+	const a_real pj = (g-1)*(ur[3] - 0.5*(std::pow(ur[1],2)+std::pow(ur[2],2))/ur[0]);
+	//calculate speeds of sound
+	const a_real ci = std::sqrt(g*pi/ul[0]);
+	const a_real cj = std::sqrt(g*pj/ur[0]);
+	//calculate normal velocities
+	const a_real vni = (ul[1]*n[0] + ul[2]*n[1])/ul[0];
+	const a_real vnj = (ur[1]*n[0] + ur[2]*n[1])/ur[0];
+	// max eigenvalue
+	const a_real eig = 
+		std::fabs(vni)+ci >= std::fabs(vnj)+cj ? std::fabs(vni)+ci : std::fabs(vnj)+cj;
+	
+	flux[0] = 0.5*( ul[0]*vni + ur[0]*vnj - eig*(ur[0]-ul[0]) );
+	flux[1] = 0.5*( vni*ul[1]+pi*n[0] + vnj*ur[1]+pj*n[0] - eig*(ur[1]-ul[1]) );
+	flux[2] = 0.5*( vni*ul[2]+pi*n[1] + vnj*ur[2]+pj*n[1] - eig*(ur[2]-ul[2]) );
+	flux[3] = 0.5*( vni*(ul[3]+pi) + vnj*(ur[3]+pj) - eig*(ur[3] - ul[3]) );
+
+	// get flux jacobians
+	physics->evaluate_normal_jacobian(ul, n, dfdl);
+	physics->evaluate_normal_jacobian(ur, n, dfdr);
+
+	for(int i = 0; i < NVARS; i++)
+	{
+		dfdl[i*NVARS+i] += eig;
+		dfdr[i*NVARS+i] -= eig;
+	}
+
+	for(int i = 0; i < NVARS*NVARS; i++)
+	{
+		// lower block
+		dfdl[i] = -0.5*dfdl[i];
+		// upper block
+		dfdr[i] =  0.5*dfdr[i];
+	}
+}
+
 void LLF_get_jacobian(const a_real *const __restrict__ ul, 
 		const a_real *const __restrict__ ur,
 		const a_real* const __restrict__ n, 
@@ -288,9 +344,88 @@ RoeFlux::RoeFlux(const IdealGasPhysics *const analyticalflux)
 	: InviscidFlux(analyticalflux)
 { }
 
+void RoeFlux::get_dissipation_matrix(const a_real *const ul, const a_real *const ur,
+		const a_real* const n, a_real *const __restrict D) const
+{
+	const a_real vxi = ul[1]/ul[0]; const a_real vyi = ul[2]/ul[0];
+	const a_real vxj = ur[1]/ur[0]; const a_real vyj = ur[2]/ur[0];
+	const a_real pi = (g-1.0)*(ul[3] - 0.5*ul[0]*(vxi*vxi+vyi*vyi));
+	const a_real pj = (g-1.0)*(ur[3] - 0.5*ur[0]*(vxj*vxj+vyj*vyj));
+	const a_real Hi = (ul[3] + pi)/ul[0];
+	const a_real Hj = (ur[3] + pj)/ur[0];
+
+	// Roe-average state, at which the flux Jacobian is the Roe matrix
+	const a_real Rij = sqrt(ur[0]/ul[0]);
+	const a_real rhoij = Rij*ul[0];
+	const a_real vxij = (Rij*vxj + vxi)/(Rij + 1.0);
+	const a_real vyij = (Rij*vyj + vyi)/(Rij + 1.0);
+	const a_real Hij = (Rij*Hj + Hi)/(Rij + 1.0);
+	const a_real vm2ij = vxij*vxij + vyij*vyij;
+	const a_real vnij = vxij*n[0] + vyij*n[1];
+	const a_real cij = sqrt( (g-1.0)*(Hij - vm2ij*0.5) );
+	const a_real uij[NVARS] = {rhoij, rhoij*vxij, rhoij*vyij, rhoij*(Hij - cij*cij/g)};
+
+	const a_real uref = lowmachvmin > 0 ? physics->getLowMachReferenceVelocity(uij, lowmachvmin)
+		: cij;
+
+	a_real A[NVARS*NVARS], P[NVARS*NVARS], Pinv[NVARS*NVARS];
+	physics->evaluate_normal_jacobian(uij, n, A);
+	physics->getLowMachPreconditioner(uij, uref, P, Pinv);
+
+	// eigenvalues of P^(-1) A, in increasing order, and their absolute values with a Harten
+	// entropy fix
+	a_real l[3];
+	IdealGasPhysics::getLowMachEigenvalues(vnij, cij, uref, l[0], l[2]);
+	l[1] = vnij;
+	const a_real delta = 0.05*(std::fabs(l[0]) > std::fabs(l[2]) ? std::fabs(l[0]) : std::fabs(l[2]));
+	a_real f[3];
+	for(int i = 0; i < 3; i++)
+		f[i] = std::fabs(l[i]) >= delta ? std::fabs(l[i]) : 0.5*(l[i]*l[i]+delta*delta)/delta;
+
+	// coefficients of the interpolating polynomial a0 + a1 x + a2 x^2 from divided differences
+	const a_real d01 = (f[1]-f[0])/(l[1]-l[0]);
+	const a_real d12 = (f[2]-f[1])/(l[2]-l[1]);
+	const a_real d012 = (d12-d01)/(l[2]-l[0]);
+	const a_real a2 = d012;
+	const a_real a1 = d01 - d012*(l[0]+l[1]);
+	const a_real a0 = f[0] - d01*l[0] + d012*l[0]*l[1];
+
+	// D = a0 P + a1 A + a2 A P^(-1) A
+	a_real PinvA[NVARS*NVARS];
+	for(int i = 0; i < NVARS; i++)
+		for(int j = 0; j < NVARS; j++) {
+			PinvA[i*NVARS+j] = 0;
+			for(int k = 0; k < NVARS; k++)
+				PinvA[i*NVARS+j] += Pinv[i*NVARS+k]*A[k*NVARS+j];
+		}
+	for(int i = 0; i < NVARS; i++)
+		for(int j = 0; j < NVARS; j++) {
+			a_real sum = 0;
+			for(int k = 0; k < NVARS; k++)
+				sum += A[i*NVARS+k]*PinvA[k*NVARS+j];
+			D[i*NVARS+j] = a0*P[i*NVARS+j] + a1*A[i*NVARS+j] + a2*sum;
+		}
+}
+
 void RoeFlux::get_flux(const a_real *const __restrict__ ul, const a_real *const __restrict__ ur,
 		const a_real* const __restrict__ n, a_real *const __restrict__ flux)
 {
+	if(lowmachvmin > 0)
+	{
+		a_real D[NVARS*NVARS], fi[NVARS], fj[NVARS];
+		get_dissipation_matrix(ul, ur, n, D);
+		physics->evaluate_normal_flux(ul, n, fi);
+		physics->evaluate_normal_flux(ur, n, fj);
+		for(int ivar = 0; ivar < NVARS; ivar++)
+		{
+			a_real sum = 0;
+			for(int j = 0; j < NVARS; j++)
+				sum += D[ivar*NVARS+j]*(ur[j]-ul[j]);
+			flux[ivar] = 0.5*(fi[ivar]+fj[ivar] - sum);
+		}
+		return;
+	}
+
 	const a_real vxi = ul[1]/ul[0]; const a_real vyi = ul[2]/ul[0];
 	const a_real vxj = ur[1]/ur[0]; const a_real vyj = ur[2]/ur[0];
 	const a_real vni = vxi*n[0] + vyi*n[1];
@@ -346,13 +481,13 @@ void RoeFlux::get_flux(const a_real *const __restrict__ ul, const a_real *const
 	r[0][0] = 1.0;              r[0][1] = 0;						
 	r[0][2] = 1.0;              r[0][3] = 1.0;
 
-	r[1][0] = vxij;             r[1][1] = cij*n[1];				
+	r[1][0] = vxij;             r[1][1] = n[1];				
 	r[1][2] = vxij + cij*n[0];	r[1][3] = vxij - cij*n[0];
 
-	r[2][0] = vyij;             r[2][1] = -cij*n[0];			
+	r[2][0] = vyij;             r[2][1] = -n[0];			
 	r[2][2] = vyij + cij*n[1];  r[2][3] = vyij - cij*n[1];
 
-	r[3][0]= vm2ij*0.5;         r[3][1] = cij*(vxij*n[1]-vyij*n[0]); 
+	r[3][0]= vm2ij*0.5;         r[3][1] = vxij*n[1]-vyij*n[0]; 
 	r[3][2] = Hij + cij*vnij;   r[3][3] = Hij - cij*vnij;
 
 	// according to Fink (just a hack to make the overall flux equal the Roe flux in Fink's paper;
@@ -376,7 +511,7 @@ void RoeFlux::get_flux(const a_real *const __restrict__ ul, const a_real *const
 	// R^(-1)(qR-qL)
 	a_real dw[4];
 	dw[0] = (ur[0]-ul[0]) - (pj-pi)/(cij*cij);
-	dw[1] = (vxj-vxi)*n[1] - (vyj-vyi)*n[0];			// Dr Luo
+	dw[1] = rhoij*((vxj-vxi)*n[1] - (vyj-vyi)*n[0]);	// Dr Luo
 	//dw(1) = rhoij;										// hack for conformance with Fink
 	dw[2] = vnj-vni + (pj-pi)/(rhoij*cij);
 	dw[3] = -(vnj-vni) + (pj-pi)/(rhoij*cij);
@@ -385,8 +520,8 @@ void RoeFlux::get_flux(const a_real *const __restrict__ ul, const a_real *const
 	a_real fi[4], fj[4];
 	fi[0] = ul[0]*vni;						fj[0] = ur[0]*vnj;
 	fi[1] = ul[0]*vni*vxi + pi*n[0];		fj[1] = ur[0]*vnj*vxj + pj*n[0];
-	fj[2] = ul[0]*vni*vyi + pi*n[1];		fj[2] = ur[0]*vnj*vyj + pj*n[1];
-	fj[3] = vni*(ul[3] + pi);				fj[3] = vnj*(ur[3] + pj);
+	fi[2] = ul[0]*vni*vyi + pi*n[1];		fj[2] = ur[0]*vnj*vyj + pj*n[1];
+	fi[3] = vni*(ul[3] + pi);				fj[3] = vnj*(ur[3] + pj);
 
 	// finally compute fluxes
 	for(int ivar = 0; ivar < NVARS; ivar++)
@@ -399,9 +534,19 @@ void RoeFlux::get_flux(const a_real *const __restrict__ ul, const a_real *const
 }
 
 void RoeFlux::get_jacobian(const a_real *const ul, const a_real *const ur, 
-		const a_real* const n, a_real *const dfdl, a_real *const dfdr)
+		const a_real* const n, a_real *const __restrict dfdl, a_real *const __restrict dfdr)
 {
-	std::cout << " ! RoeFlux: Not implemented!\n";
+	a_real D[NVARS*NVARS];
+	get_dissipation_matrix(ul, ur, n, D);
+	physics->evaluate_normal_jacobian(ul, n, dfdl);
+	physics->evaluate_normal_jacobian(ur, n, dfdr);
+
+	for(int i = 0; i < NVARS*NVARS; i++) {
+		// lower block
+		dfdl[i] = -0.5*(dfdl[i] + D[i]);
+		// upper block
+		dfdr[i] = 0.5*(dfdr[i] - D[i]);
+	}
 }
 
 HLLFlux::HLLFlux(const IdealGasPhysics *const analyticalflux) 
@@ -938,6 +1083,21 @@ void HLLCFlux::get_flux(const a_real *const ul, const a_real *const ur, const a_
 	sr = vnj+cj;
 	if(sr < vnij+cij)
 		sr = vnij+cij;
+
+	if(lowmachvmin > 0)
+	{
+		// eigenvalues of the preconditioned system instead (Luo, Baum and Lohner, 2004)
+		a_real lm, lp;
+		IdealGasPhysics::getLowMachEigenvalues(vni, ci, 
+				physics->getLowMachReferenceVelocity(ul, lowmachvmin), sl, lp);
+		IdealGasPhysics::getLowMachEigenvalues(vnj, cj, 
+				physics->getLowMachReferenceVelocity(ur, lowmachvmin), lm, sr);
+		const a_real urij = std::min(std::max(std::sqrt(vm2ij), lowmachvmin), cij);
+		IdealGasPhysics::getLowMachEigenvalues(vnij, cij, urij, lm, lp);
+		sl = std::min(sl, lm);
+		sr = std::max(sr, lp);
+	}
+
 	const a_real sm = ( ur[0]*vnj*(sr-vnj) - ul[0]*vni*(sl-vni) + pi-pj ) 
 		/ ( ur[0]*(sr-vnj) - ul[0]*(sl-vni) );
 
@@ -28,10 +28,23 @@ protected:
 	const IdealGasPhysics *const physics;		///< Analytical flux context
 	a_real g;								///< Adiabatic index
 
+	/// Cut-off of the reference velocity of low-Mach preconditioning; 0 if not preconditioned
+	a_real lowmachvmin;
+
 public:
 	/// Sets up data for the inviscid flux scheme
 	InviscidFlux(const IdealGasPhysics *const analyticalflux);
 
+	/// Makes schemes that support it use dissipation suited to low-Mach preconditioning
+	/** The upwind dissipation is then scaled with the eigenvalues of the preconditioned
+	 * system instead of the speed of sound (see IdealGasPhysics::getLowMachPreconditioner),
+	 * which keeps it of the right size as the Mach number goes to zero.
+	 * \param[in] vmin Cut-off of the reference velocity; 0 turns preconditioning off
+	 */
+	void setLowMachPreconditioning(const a_real vmin) {
+		lowmachvmin = vmin;
+	}
+
 	/** Computes flux across a face with
 	 * \param[in] uleft is the vector of left states for the face
 	 * \param[in] uright is the vector of right states for the face
@@ -52,6 +65,15 @@ public:
 			const a_real* const n,
 			a_real *const dfdl, a_real *const dfdr) = 0;
 
+	/// Computes both the flux and its Jacobians across a face
+	/** The outputs are as in \ref get_flux and \ref get_jacobian. Schemes which can compute
+	 * both from common intermediate quantities (pressures, wave speeds etc.) should override
+	 * this; by default, the two are computed separately.
+	 */
+	virtual void get_flux_jacobian(const a_real *const uleft, const a_real *const uright, 
+			const a_real* const n, 
+			a_real *const flux, a_real *const dfdl, a_real *const dfdr);
+
 	virtual ~InviscidFlux();
 };
 
@@ -63,6 +85,10 @@ public:
 			a_real *const flux);
 	void get_jacobian(const a_real *const uleft, const a_real *const uright, const a_real* const n, 
 			a_real *const dfdl, a_real *const dfdr);
+	/// Computes the flux and its Jacobian with frozen spectral radius together
+	void get_flux_jacobian(const a_real *const uleft, const a_real *const uright, 
+			const a_real* const n, 
+			a_real *const flux, a_real *const dfdl, a_real *const dfdr);
 };
 
 /// Van-Leer flux-vector-splitting
@@ -77,12 +103,26 @@ public:
 };
 
 /// Roe flux-difference splitting Riemann solver for the Euler equations
+/** With low-Mach preconditioning, the dissipation is \f$ P|P^{-1}A| \Delta u \f$ at the Roe
+ * state, where P is the preconditioning matrix (Weiss and Smith).
+ */
 class RoeFlux : public InviscidFlux
 {
+	/// Computes the dissipation matrix at the Roe-average state of two states
+	/** This is \f$ |A| \f$, or \f$ P|P^{-1}A| \f$ with low-Mach preconditioning, where A is
+	 * the Roe matrix. Since the (preconditioned) eigenvalues are distinct, the absolute
+	 * value is the quadratic polynomial in \f$ P^{-1}A \f$ interpolating the absolute
+	 * values, with an entropy fix, at the eigenvalues.
+	 * \param[out] D The row-major matrix
+	 */
+	void get_dissipation_matrix(const a_real *const ul, const a_real *const ur,
+			const a_real* const n, a_real *const D) const;
+
 public:
 	RoeFlux(const IdealGasPhysics *const analyticalflux);
 	void get_flux(const a_real *const ul, const a_real *const ur, const a_real* const n, 
 			a_real *const flux);
+	/// Jacobian with the dissipation matrix frozen
 	void get_jacobian(const a_real *const ul, const a_real *const ur, const a_real* const n, 
 			a_real *const dfdl, a_real *const dfdr);
 };
@@ -116,6 +156,8 @@ public:
 
 /// Harten Lax Van-Leer numerical flux with contact restoration by Toro
 /** Implemented as described by Remaki et al. \cite invflux_remaki
+ * With low-Mach preconditioning, the signal speeds are estimated from the eigenvalues of the
+ * preconditioned system. The Jacobian does not account for this.
  */
 class HLLCFlux : public InviscidFlux
 {
@@ -18,6 +18,15 @@
 
 namespace acfd {
 
+/// Adds the memory used by a matrix to a report; only DLU matrices are itemized
+template <short nvars>
+static void reportMatrixMemory(LinearOperator<a_real,a_int> *const A,
+		memory::Report& report, const std::string& name)
+{
+	if(A && A->type() == 'd')
+		static_cast<blasted::DLUMatrix<nvars>*>(A)->reportMemory(report, name);
+}
+
 template<short nvars>
 SteadyForwardEulerSolver<nvars>::SteadyForwardEulerSolver(const UMesh2dh *const mesh, 
 		Spatial<nvars> *const euler, Spatial<nvars> *const starterfv,const short use_starter, 
@@ -30,6 +39,8 @@ SteadyForwardEulerSolver<nvars>::SteadyForwardEulerSolver(const UMesh2dh *const
 {
 	residual.resize(m->gnelem(),nvars);
 	u.resize(m->gnelem(), nvars);
+	memory::firstTouch(residual);
+	memory::firstTouch(u);
 	dtm.setup(m->gnelem(), 1);
 }
 
@@ -38,6 +49,14 @@ SteadyForwardEulerSolver<nvars>::~SteadyForwardEulerSolver()
 {
 }
 
+template<short nvars>
+void SteadyForwardEulerSolver<nvars>::reportMemory(memory::Report& report,
+		const std::string& name) const
+{
+	SteadySolver<nvars>::reportMemory(report, name);
+	report.add(name, "time steps", dtm.bytes());
+}
+
 template<short nvars>
 void SteadyForwardEulerSolver<nvars>::solve(std::string logfile)
 {
@@ -55,6 +74,7 @@ void SteadyForwardEulerSolver<nvars>::solve(std::string logfile)
 	double initialctime = (double)clock() / (double)CLOCKS_PER_SEC;
 
 	if(usestarter == 1) {
+		prepareWorkspace(true);
 		while(resi/initres > starttol && step < startmaxiter)
 		{
 #pragma omp parallel for simd default(shared)
@@ -68,26 +88,25 @@ void SteadyForwardEulerSolver<nvars>::solve(std::string logfile)
 
 			a_real errmass = 0;
 
-#pragma omp parallel default(shared)
+#pragma omp parallel for simd default(shared) reduction(+:errmass)
+			for(a_int iel = 0; iel < m->gnelem(); iel++)
 			{
-#pragma omp for simd
-				for(a_int iel = 0; iel < m->gnelem(); iel++)
-				{
-					for(short i = 0; i < nvars; i++)
-					{
-						//uold(iel,i) = u(iel,i);
-						u(iel,i) -= startcfl*dtm(iel) * 1.0/m->garea(iel)*residual(iel,i);
-					}
-				}
+				errmass += residual(iel,0)*residual(iel,0)*m->garea(iel);
+			}
 
-#pragma omp for simd reduction(+:errmass)
-				for(a_int iel = 0; iel < m->gnelem(); iel++)
+			applyInversePseudoTimePreconditioner(starter, residual);
+
+#pragma omp parallel for simd default(shared)
+			for(a_int iel = 0; iel < m->gnelem(); iel++)
+			{
+				for(short i = 0; i < nvars; i++)
 				{
-					errmass += residual(iel,0)*residual(iel,0)*m->garea(iel);
+					//uold(iel,i) = u(iel,i);
+					u(iel,i) -= startcfl*dtm(iel) * 1.0/m->garea(iel)*residual(iel,i);
 				}
-			} // end parallel region
+			}
 
-			resi = sqrt(errmass);
+			resi = sqrt(commSum(errmass));
 
 			if(step == 0)
 				initres = resi;
@@ -102,9 +121,13 @@ void SteadyForwardEulerSolver<nvars>::solve(std::string logfile)
 		step = 0;
 		resi = 100.0;
 	}
+	prepareWorkspace(false);
 
 	std::cout << "  SteadyForwardEulerSolver: solve(): Starting main solver.\n";
-	while(resi/initres > tol && step < maxiter)
+	gettimeofday(&time2, NULL);
+	const double mainwtime = (double)time2.tv_sec + (double)time2.tv_usec * 1.0e-6;
+	bool forcesconverged = false, havecoeffs = false;
+	while(resi/initres > tol && step < maxiter && !forcesconverged)
 	{
 #pragma omp parallel for simd default(shared)
 		for(a_int iel = 0; iel < m->gnelem(); iel++) {
@@ -117,37 +140,61 @@ void SteadyForwardEulerSolver<nvars>::solve(std::string logfile)
 
 		a_real errmass = 0;
 
+#pragma omp parallel for simd default(shared) reduction(+:errmass)
+		for(a_int iel = 0; iel < m->gnelem(); iel++)
+		{
+			errmass += residual(iel,0)*residual(iel,0)*m->garea(iel);
+		}
+
+		applyInversePseudoTimePreconditioner(eul, residual);
+
 #pragma omp parallel default(shared)
 		{
+			if(accel) {
 #pragma omp for simd
-			for(a_int iel = 0; iel < m->gnelem(); iel++)
-			{
-				for(short i = 0; i < nvars; i++)
+				for(a_int iel = 0; iel < m->gnelem(); iel++)
+					for(short i = 0; i < nvars; i++)
+						increment(iel,i) = -cfl*dtm(iel) * 1.0/m->garea(iel)*residual(iel,i);
+			}
+			else {
+#pragma omp for simd
+				for(a_int iel = 0; iel < m->gnelem(); iel++)
 				{
-					//uold(iel,i) = u(iel,i);
-					u(iel,i) -= cfl*dtm(iel) * 1.0/m->garea(iel)*residual(iel,i);
+					for(short i = 0; i < nvars; i++)
+					{
+						//uold(iel,i) = u(iel,i);
+						u(iel,i) -= cfl*dtm(iel) * 1.0/m->garea(iel)*residual(iel,i);
+					}
 				}
 			}
-
-#pragma omp for simd reduction(+:errmass)
-			for(a_int iel = 0; iel < m->gnelem(); iel++)
-			{
-				errmass += residual(iel,0)*residual(iel,0)*m->garea(iel);
-			}
 		} // end parallel region
 
-		resi = sqrt(errmass);
+		if(accel)
+			accel->update(u, increment);
+
+		resi = sqrt(commSum(errmass));
 
 		if(step == 0)
 			initres = resi;
 
+		havecoeffs = updateForceCoefficients();
+		forcesconverged = forcesConverged();
+
 		if(step % 50 == 0)
 			std::cout << "  SteadyForwardEulerSolver: solve(): Step " << step 
 				<< ", rel residual " << resi/initres << std::endl;
 
 		step++;
-		if(lognres)
-			convout << step << " " << std::setw(10) << resi/initres << '\n';
+		if(lognres) {
+			convout << step << " " << std::setw(10) << resi/initres;
+			if(havecoeffs)
+				convout << " " << std::setw(14) << coeffs[0] << " " << std::setw(14) << coeffs[1]
+					<< " " << std::setw(14) << coeffs[2];
+			convout << '\n';
+		}
+
+		if(stepcallback)
+			stepcallback(step, u);
 	}
 
 	if(lognres)
@@ -157,22 +204,291 @@ void SteadyForwardEulerSolver<nvars>::solve(std::string logfile)
 	double finalwtime = (double)time2.tv_sec + (double)time2.tv_usec * 1.0e-6;
 	double finalctime = (double)clock() / (double)CLOCKS_PER_SEC;
 	walltime += (finalwtime-initialwtime); cputime += (finalctime-initialctime);
+	const double decadetime = timePerDecade(finalwtime-mainwtime, resi/initres);
 
-	if(step == maxiter)
+	if(forcesconverged)
+		std::cout << " SteadyForwardEulerSolver: solve(): Force coefficients converged.\n";
+	else if(step == maxiter)
 		std::cout << "! SteadyForwardEulerSolver: solve(): Exceeded max iterations!\n";
-	std::cout << " SteadyForwardEulerSolver: solve(): Done, steps = " << step << "\n\n";
+	std::cout << " SteadyForwardEulerSolver: solve(): Done, steps = " << step << "\n";
+	if(havecoeffs)
+		std::cout << " SteadyForwardEulerSolver: solve(): CL = " << coeffs[0] << ", CD = "
+			<< coeffs[1] << ", CM = " << coeffs[2] << std::endl;
+	std::cout << std::endl;
 	std::cout << " SteadyForwardEulerSolver: solve(): Time taken by ODE solver:\n";
 	std::cout << "                                   CPU time = " << cputime 
-		<< ", wall time = " << walltime << std::endl << std::endl;
+		<< ", wall time = " << walltime << std::endl;
+	std::cout << "                                   Wall time of main loop per decade of residual = "
+		<< decadetime << std::endl << std::endl;
 
 	// append data to log file
 	int numthreads = 0;
 #ifdef _OPENMP
 	numthreads = omp_get_max_threads();
 #endif
-	std::ofstream outf; outf.open(logfile, std::ofstream::app);
-	outf << "\t" << numthreads << "\t" << walltime << "\t" << cputime << "\n";
-	outf.close();
+	if(commRank() == 0) {
+		std::ofstream outf; outf.open(logfile, std::ofstream::app);
+		outf << "\t" << numthreads << "\t" << walltime << "\t" << cputime << "\t" << decadetime << "\n";
+		outf.close();
+	}
+}
+
+template<short nvars>
+SteadyRKSolver<nvars>::SteadyRKSolver(const UMesh2dh *const mesh, 
+		Spatial<nvars> *const euler, Spatial<nvars> *const starterfv,const short use_starter, 
+		const double toler, const int maxits, const double cfl_n, 
+		const double ftoler, const int fmaxits, const double fcfl_n,
+		const std::vector<a_real>& stage_coeffs, const a_real smoothing_coeff,
+		const int smoothing_sweeps, bool lognlres)
+
+	: SteadySolver<nvars>(mesh, euler, starterfv, use_starter, lognlres), 
+	alpha(stage_coeffs), epsilon(smoothing_coeff), nsweeps(smoothing_sweeps),
+	tol(toler), maxiter(maxits), cfl(cfl_n), 
+	starttol(ftoler), startmaxiter(fmaxits), startcfl(fcfl_n)
+{
+	residual.resize(m->gnelem(),nvars);
+	u.resize(m->gnelem(), nvars);
+	uold.resize(m->gnelem(), nvars);
+	rsmooth.resize(m->gnelem(), nvars);
+	rtemp.resize(m->gnelem(), nvars);
+	memory::firstTouch(residual);
+	memory::firstTouch(u);
+	memory::firstTouch(uold);
+	memory::firstTouch(rsmooth);
+	memory::firstTouch(rtemp);
+	dtm.setup(m->gnelem(), 1);
+}
+
+template<short nvars>
+std::vector<a_real> SteadyRKSolver<nvars>::stageCoefficients(const int nstages)
+{
+	if(nstages == 4)
+		return {0.1084, 0.2602, 0.5052, 1.0};
+	else if(nstages == 5)
+		return {0.0695, 0.1602, 0.2898, 0.5060, 1.0};
+	else
+		return {};
+}
+
+template<short nvars>
+void SteadyRKSolver<nvars>::reportMemory(memory::Report& report, const std::string& name) const
+{
+	SteadySolver<nvars>::reportMemory(report, name);
+	report.add(name, "time steps", dtm.bytes());
+	report.add(name, "stage storage", (uold.size() + rsmooth.size() + rtemp.size())*sizeof(a_real));
+}
+
+template<short nvars>
+void SteadyRKSolver<nvars>::smoothResidual()
+{
+	const a_int nelem = m->gnelem();
+#pragma omp parallel default(shared)
+	{
+#pragma omp for simd
+		for(a_int iel = 0; iel < nelem; iel++)
+			for(short i = 0; i < nvars; i++)
+				rsmooth(iel,i) = residual(iel,i);
+
+		for(int isweep = 0; isweep < nsweeps; isweep++)
+		{
+			// the implicit barrier at the end of each loop separates the sweeps
+#pragma omp for
+			for(a_int iel = 0; iel < nelem; iel++)
+				for(short i = 0; i < nvars; i++)
+					rtemp(iel,i) = rsmooth(iel,i);
+
+#pragma omp for
+			for(a_int iel = 0; iel < nelem; iel++)
+			{
+				a_real sum[nvars];
+				for(short i = 0; i < nvars; i++)
+					sum[i] = 0;
+				int nnbr = 0;
+
+				// boundary faces and faces on subdomain boundaries have ghost cells >= nelem
+				for(int ifael = 0; ifael < m->gnfael(iel); ifael++) {
+					const a_int jel = m->gesuel(iel,ifael);
+					if(jel < 0 || jel >= nelem)
+						continue;
+					nnbr++;
+					for(short i = 0; i < nvars; i++)
+						sum[i] += rtemp(jel,i);
+				}
+
+				for(short i = 0; i < nvars; i++)
+					rsmooth(iel,i) = (residual(iel,i) + epsilon*sum[i]) / (1.0 + epsilon*nnbr);
+			}
+		}
+	}
+}
+
+template<short nvars>
+a_real SteadyRKSolver<nvars>::rkStep(Spatial<nvars> *const spatial, const double cflnum)
+{
+	a_real errmass = 0;
+
+#pragma omp parallel for simd default(shared)
+	for(a_int iel = 0; iel < m->gnelem(); iel++) {
+		for(short i = 0; i < nvars; i++)
+			uold(iel,i) = u(iel,i);
+	}
+
+	for(size_t istage = 0; istage < alpha.size(); istage++)
+	{
+#pragma omp parallel for simd default(shared)
+		for(a_int iel = 0; iel < m->gnelem(); iel++) {
+			for(short i = 0; i < nvars; i++)
+				residual(iel,i) = 0;
+		}
+
+		// the local time steps are frozen over the stages
+		spatial->compute_residual(u, residual, istage == 0, dtm);
+
+		if(istage == 0) {
+#pragma omp parallel for simd default(shared) reduction(+:errmass)
+			for(a_int iel = 0; iel < m->gnelem(); iel++)
+				errmass += residual(iel,0)*residual(iel,0)*m->garea(iel);
+		}
+
+		applyInversePseudoTimePreconditioner(spatial, residual);
+
+		const MVector* rhs = &residual;
+		if(epsilon > 0 && nsweeps > 0) {
+			smoothResidual();
+			rhs = &rsmooth;
+		}
+
+		const a_real fac = alpha[istage]*cflnum;
+#pragma omp parallel for simd default(shared)
+		for(a_int iel = 0; iel < m->gnelem(); iel++)
+		{
+			for(short i = 0; i < nvars; i++)
+				u(iel,i) = uold(iel,i) - fac*dtm(iel) * 1.0/m->garea(iel)*(*rhs)(iel,i);
+		}
+	}
+
+	return sqrt(commSum(errmass));
+}
+
+template<short nvars>
+void SteadyRKSolver<nvars>::solve(std::string logfile)
+{
+	int step = 0;
+	a_real resi = 1.0;
+	a_real initres = 1.0;
+
+	std::ofstream convout;
+	if(lognres)
+		convout.open(logfile+".conv", std::ofstream::app);
+	
+	struct timeval time1, time2;
+	gettimeofday(&time1, NULL);
+	double initialwtime = (double)time1.tv_sec + (double)time1.tv_usec * 1.0e-6;
+	double initialctime = (double)clock() / (double)CLOCKS_PER_SEC;
+
+	std::cout << "  SteadyRKSolver: solve(): Using " << alpha.size() << " stages";
+	if(epsilon > 0 && nsweeps > 0)
+		std::cout << " and residual smoothing with coefficient " << epsilon << " and "
+			<< nsweeps << " sweeps";
+	std::cout << ".\n";
+
+	if(usestarter == 1) {
+		prepareWorkspace(true);
+		while(resi/initres > starttol && step < startmaxiter)
+		{
+			resi = rkStep(starter, startcfl);
+
+			if(step == 0)
+				initres = resi;
+
+			if(step % 50 == 0)
+				std::cout << "  SteadyRKSolver: solve(): Step " << step 
+					<< ", rel residual " << resi/initres << std::endl;
+
+			step++;
+		}
+		std::cout << "  SteadyRKSolver: solve(): Initial approximate solve done.\n";
+		step = 0;
+		resi = 100.0;
+	}
+	prepareWorkspace(false);
+
+	std::cout << "  SteadyRKSolver: solve(): Starting main solver.\n";
+	gettimeofday(&time2, NULL);
+	const double mainwtime = (double)time2.tv_sec + (double)time2.tv_usec * 1.0e-6;
+	bool forcesconverged = false, havecoeffs = false;
+	while(resi/initres > tol && step < maxiter && !forcesconverged)
+	{
+		resi = rkStep(eul, cfl);
+
+		if(accel) {
+			// the whole multistage step is the fixed-point map
+#pragma omp parallel for simd default(shared)
+			for(a_int iel = 0; iel < m->gnelem(); iel++)
+				for(short i = 0; i < nvars; i++) {
+					increment(iel,i) = u(iel,i) - uold(iel,i);
+					u(iel,i) = uold(iel,i);
+				}
+			accel->update(u, increment);
+		}
+
+		if(step == 0)
+			initres = resi;
+
+		havecoeffs = updateForceCoefficients();
+		forcesconverged = forcesConverged();
+
+		if(step % 50 == 0)
+			std::cout << "  SteadyRKSolver: solve(): Step " << step 
+				<< ", rel residual " << resi/initres << std::endl;
+
+		step++;
+		if(lognres) {
+			convout << step << " " << std::setw(10) << resi/initres;
+			if(havecoeffs)
+				convout << " " << std::setw(14) << coeffs[0] << " " << std::setw(14) << coeffs[1]
+					<< " " << std::setw(14) << coeffs[2];
+			convout << '\n';
+		}
+
+		if(stepcallback)
+			stepcallback(step, u);
+	}
+
+	if(lognres)
+		convout.close();
+	
+	gettimeofday(&time2, NULL);
+	double finalwtime = (double)time2.tv_sec + (double)time2.tv_usec * 1.0e-6;
+	double finalctime = (double)clock() / (double)CLOCKS_PER_SEC;
+	walltime += (finalwtime-initialwtime); cputime += (finalctime-initialctime);
+	const double decadetime = timePerDecade(finalwtime-mainwtime, resi/initres);
+
+	if(forcesconverged)
+		std::cout << " SteadyRKSolver: solve(): Force coefficients converged.\n";
+	else if(step == maxiter)
+		std::cout << "! SteadyRKSolver: solve(): Exceeded max iterations!\n";
+	std::cout << " SteadyRKSolver: solve(): Done, steps = " << step << "\n";
+	if(havecoeffs)
+		std::cout << " SteadyRKSolver: solve(): CL = " << coeffs[0] << ", CD = "
+			<< coeffs[1] << ", CM = " << coeffs[2] << std::endl;
+	std::cout << std::endl;
+	std::cout << " SteadyRKSolver: solve(): Time taken by ODE solver:\n";
+	std::cout << "                         CPU time = " << cputime 
+		<< ", wall time = " << walltime << std::endl;
+	std::cout << "                         Wall time of main loop per decade of residual = "
+		<< decadetime << std::endl << std::endl;
+
+	// append data to log file
+	int numthreads = 0;
+#ifdef _OPENMP
+	numthreads = omp_get_max_threads();
+#endif
+	if(commRank() == 0) {
+		std::ofstream outf; outf.open(logfile, std::ofstream::app);
+		outf << "\t" << numthreads << "\t" << walltime << "\t" << cputime << "\t" << decadetime << "\n";
+		outf.close();
+	}
 }
 
 /// Ordering function for qsort - ascending order
@@ -209,12 +525,14 @@ SteadyBackwardEulerSolver<nvars>::SteadyBackwardEulerSolver(const UMesh2dh*const
 	// NOTE: the number of columns here MUST match the static number of columns, which is nvars.
 	residual.resize(m->gnelem(),nvars);
 	u.resize(m->gnelem(), nvars);
+	memory::firstTouch(residual);
+	memory::firstTouch(u);
 	dtm.setup(m->gnelem(), 1);
 
 	// set Jacobian storage
 	if(mattype == 'd') {
 		// DLU matrix
-		A = new blasted::DLUMatrix<nvars>(m, nbuildsweeps, napplysweeps);
+		A = new blasted::DLUMatrix<nvars>(m, nbuildsweeps, napplysweeps, eul->haloExchange());
 	}
 	else if(mattype == 'c') {
 		// construct non-zero structure for sparse format
@@ -372,6 +690,14 @@ SteadyBackwardEulerSolver<nvars>::SteadyBackwardEulerSolver(const UMesh2dh*const
 		delete [] bcolinds;
 	}
 
+	if(eul->haloExchange()) {
+		if(mattype != 'd')
+			std::cout << "! SteadyBackwardEulerSolver: Only DLU matrices couple subdomains;"
+				<< " the linear solver will only see the local part of the Jacobian!\n";
+		std::cout << " SteadyBackwardEulerSolver: The preconditioner is applied independently"
+			<< " in each subdomain.\n";
+	}
+
 	// select preconditioner
 	if(precond == "J") {
 		prec = new Jacobi<nvars>(A);
@@ -391,6 +717,25 @@ SteadyBackwardEulerSolver<nvars>::SteadyBackwardEulerSolver(const UMesh2dh*const
 		if(mattype != 'c') std::cout << "Block-";
 		std::cout << " ILU0 preconditioner.\n";
 	}
+	else if(precond == "LINEJ") {
+		prec = new LineJacobi<nvars>(A);
+		std::cout << " SteadyBackwardEulerSolver: Selected line-Jacobi preconditioner.\n";
+	}
+	else if(precond == "LINESGS") {
+		prec = new LineSGS<nvars>(A);
+		std::cout << " SteadyBackwardEulerSolver: Selected symmetric line Gauss-Seidel"
+			<< " preconditioner.\n";
+	}
+	else if(precond == "POLY") {
+		prec = new Polynomial<nvars>(A, napplysweeps);
+		std::cout << " SteadyBackwardEulerSolver: Selected GMRES-polynomial preconditioner"
+			<< " of degree " << napplysweeps << ".\n";
+	}
+	else if(precond == "ASILU0") {
+		prec = new AdditiveSchwarz<nvars>(A, nbuildsweeps);
+		std::cout << " SteadyBackwardEulerSolver: Selected additive Schwarz preconditioner with"
+			<< " ILU0 in thread subdomains overlapping by " << nbuildsweeps << " layers.\n";
+	}
 	else {
 		prec = new NoPrec<nvars>(A);
 		std::cout << " SteadyBackwardEulerSolver: No preconditioning will be applied.\n";
@@ -405,6 +750,18 @@ SteadyBackwardEulerSolver<nvars>::SteadyBackwardEulerSolver(const UMesh2dh*const
 		std::cout << " SteadyBackwardEulerSolver: GMRES solver selected, restart after " 
 			<< mrestart << " iterations\n";
 	}
+	else if(linearsolver == "GCRODR") {
+		// a quarter of each cycle is spent on the recycled space
+		linsolv = new GCRODR<nvars>(m, A, prec, mrestart, std::max(1,mrestart/4));
+		std::cout << " SteadyBackwardEulerSolver: Recycling GMRES (GCRO-DR) solver selected, "
+			<< mrestart << " vectors per cycle of which " << std::max(1,mrestart/4)
+			<< " are recycled\n";
+	}
+	else if(linearsolver == "ANDERSON") {
+		linsolv = new RichardsonSolver<nvars>(mesh, A, prec, mrestart);
+		std::cout << " SteadyBackwardEulerSolver: Richardson iteration selected, with Anderson"
+			<< " acceleration using " << mrestart << " previous iterates.\n";
+	}
 	else {
 		linsolv = new RichardsonSolver<nvars>(mesh, A, prec);
 		std::cout << " SteadyBackwardEulerSolver: Richardson iteration selected, no acceleration.\n";
@@ -420,6 +777,17 @@ SteadyBackwardEulerSolver<nvars>::~SteadyBackwardEulerSolver()
 		delete A;
 }
 
+template <short nvars>
+void SteadyBackwardEulerSolver<nvars>::reportMemory(memory::Report& report,
+		const std::string& name) const
+{
+	SteadySolver<nvars>::reportMemory(report, name);
+	report.add(name, "time steps", dtm.bytes());
+	report.add(name, "linear solver workspace", linsolv->workspaceBytes());
+	prec->reportMemory(report, name+" preconditioner");
+	reportMatrixMemory<nvars>(A, report, name+" Jacobian");
+}
+
 template <short nvars>
 void SteadyBackwardEulerSolver<nvars>::solve(std::string logfile)
 {
@@ -441,6 +809,7 @@ void SteadyBackwardEulerSolver<nvars>::solve(std::string logfile)
 	unsigned int avglinsteps = 0;
 	
 	if(usestarter == 1) {
+		prepareWorkspace(true);
 		
 		std::cout << " SteadyBackwardEulerSolver: Starting initialization run..\n";
 
@@ -457,20 +826,16 @@ void SteadyBackwardEulerSolver<nvars>::solve(std::string logfile)
 			//A->setDiagZero();
 			A->setAllZero();
 			
-			// update residual and local time steps
-			starter->compute_residual(u, residual, true, dtm);
-
-			starter->compute_jacobian(u, A);
+			// update residual, local time steps and Jacobian
+			starter->compute_residual_and_jacobian(u, residual, true, dtm, A);
 
 			// add pseudo-time terms to diagonal blocks
 #pragma omp parallel for default(shared)
 			for(a_int iel = 0; iel < m->gnelem(); iel++)
 			{
-				Matrix<a_real,nvars,nvars,RowMajor> db 
-					= Matrix<a_real,nvars,nvars,RowMajor>::Zero();
-
-				for(short i = 0; i < nvars; i++)
-					db(i,i) = m->garea(iel) / (startcfl*dtm(iel));
+				Matrix<a_real,nvars,nvars,RowMajor> db;
+				starter->get_pseudotime_preconditioner(&u(iel,0), db.data(), nullptr);
+				db *= m->garea(iel) / (startcfl*dtm(iel));
 				
 				A->updateDiagBlock(iel*nvars, db.data(), nvars);
 			}
@@ -496,7 +861,7 @@ void SteadyBackwardEulerSolver<nvars>::solve(std::string logfile)
 				}
 			}
 
-			resi = sqrt(errmass);
+			resi = sqrt(commSum(errmass));
 
 			if(step == 0)
 				initres = resi;
@@ -521,6 +886,7 @@ void SteadyBackwardEulerSolver<nvars>::solve(std::string logfile)
 		resi = 1.0;
 		initres = 1.0;
 	}
+	prepareWorkspace(false);
 	
 	gettimeofday(&time2, NULL);
 	double finalwtime = (double)time2.tv_sec + (double)time2.tv_usec * 1.0e-6;
@@ -535,8 +901,13 @@ void SteadyBackwardEulerSolver<nvars>::solve(std::string logfile)
 	gettimeofday(&time1, NULL);
 	linsolv->resetRunTimes();
 
+	// to check that the main loop works in storage allocated beforehand
+	const size_t nallocs = memory::numAllocations(), nbytes = memory::allocatedBytes();
+	const size_t nworkallocs = linsolv->workspace().numAllocations();
+
 	std::cout << " SteadyBackwardEulerSolver: solve(): Starting main solver.\n";
-	while(resi/initres > tol && step < maxiter)
+	bool forcesconverged = false, havecoeffs = false;
+	while(resi/initres > tol && step < maxiter && !forcesconverged)
 	{
 #pragma omp parallel for default(shared)
 		for(a_int iel = 0; iel < m->gnelem(); iel++) {
@@ -549,10 +920,8 @@ void SteadyBackwardEulerSolver<nvars>::solve(std::string logfile)
 		//A->setDiagZero();
 		A->setAllZero();
 		
-		// update residual and local time steps
-		eul->compute_residual(u, residual, true, dtm);
-
-		eul->compute_jacobian(u, A);
+		// update residual, local time steps and Jacobian
+		eul->compute_residual_and_jacobian(u, residual, true, dtm, A);
 		
 		// compute ramped quantities
 		if(step < rampstart) {
@@ -580,11 +949,9 @@ void SteadyBackwardEulerSolver<nvars>::solve(std::string logfile)
 #pragma omp parallel for default(shared)
 		for(a_int iel = 0; iel < m->gnelem(); iel++)
 		{
-			Matrix<a_real,nvars,nvars,RowMajor> db 
-				= Matrix<a_real,nvars,nvars,RowMajor>::Zero();
-
-			for(short i = 0; i < nvars; i++)
-				db(i,i) = m->garea(iel) / (curCFL*dtm(iel));
+			Matrix<a_real,nvars,nvars,RowMajor> db;
+			eul->get_pseudotime_preconditioner(&u(iel,0), db.data(), nullptr);
+			db *= m->garea(iel) / (curCFL*dtm(iel));
 			
 			A->updateDiagBlock(iel*nvars, db.data(), nvars);
 		}
@@ -599,9 +966,11 @@ void SteadyBackwardEulerSolver<nvars>::solve(std::string logfile)
 
 #pragma omp parallel default(shared)
 		{
+			if(!accel) {
 #pragma omp for
-			for(a_int iel = 0; iel < m->gnelem(); iel++) {
-				u.row(iel) += du.row(iel);
+				for(a_int iel = 0; iel < m->gnelem(); iel++) {
+					u.row(iel) += du.row(iel);
+				}
 			}
 #pragma omp for simd reduction(+:errmass)
 			for(a_int iel = 0; iel < m->gnelem(); iel++)
@@ -610,11 +979,17 @@ void SteadyBackwardEulerSolver<nvars>::solve(std::string logfile)
 			}
 		}
 
-		resi = sqrt(errmass);
+		if(accel)
+			accel->update(u, du);
+
+		resi = sqrt(commSum(errmass));
 
 		if(step == 0)
 			initres = resi;
 
+		havecoeffs = updateForceCoefficients();
+		forcesconverged = forcesConverged();
+
 		if(step % 10 == 0) {
 			std::cout << "  SteadyBackwardEulerSolver: solve(): Step " << step 
 				<< ", rel residual " << resi/initres << std::endl;
@@ -624,8 +999,16 @@ void SteadyBackwardEulerSolver<nvars>::solve(std::string logfile)
 
 		step++;
 			
-		if(lognres)
-			convout << step << " " << std::setw(10)  << resi/initres << '\n';
+		if(lognres) {
+			convout << step << " " << std::setw(10)  << resi/initres;
+			if(havecoeffs)
+				convout << " " << std::setw(14) << coeffs[0] << " " << std::setw(14) << coeffs[1]
+					<< " " << std::setw(14) << coeffs[2];
+			convout << '\n';
+		}
+
+		if(stepcallback)
+			stepcallback(step, u);
 	}
 
 	if(lognres)
@@ -637,16 +1020,29 @@ void SteadyBackwardEulerSolver<nvars>::solve(std::string logfile)
 	walltime += (finalwtime-initialwtime); cputime += (finalctime-initialctime);
 	avglinsteps /= step;
 
-	if(step == maxiter)
+	if(forcesconverged)
+		std::cout << " SteadyBackwardEulerSolver: solve(): Force coefficients converged.\n";
+	else if(step == maxiter)
 		std::cout << "! SteadyBackwardEulerSolver: solve(): Exceeded max iterations!\n";
 	std::cout << " SteadyBackwardEulerSolver: solve(): Done, steps = " << step << ", rel residual " 
 		<< resi/initres << std::endl;
+	if(havecoeffs)
+		std::cout << " SteadyBackwardEulerSolver: solve(): CL = " << coeffs[0] << ", CD = "
+			<< coeffs[1] << ", CM = " << coeffs[2] << std::endl;
 
 	double linwtime, linctime;
 	linsolv->getRunTimes(linwtime, linctime);
 	std::cout << "\n SteadyBackwardEulerSolver: solve(): Time taken by linear solver:\n";
 	std::cout << " \t\tWall time = " << linwtime << ", CPU time = " << linctime << std::endl;
+	double precwtime, precctime;
+	linsolv->getPreconditionerSetupTimes(precwtime, precctime);
+	std::cout << " \t\tof which preconditioner setup: Wall time = " << precwtime
+		<< ", CPU time = " << precctime << "; solves: Wall time = " << linwtime-precwtime
+		<< ", CPU time = " << linctime-precctime << std::endl;
 	std::cout << "\t\tAverage number of linear solver iterations = " << avglinsteps << std::endl;
+	std::cout << "\t\tAllocations in main solver = " << memory::numAllocations()-nallocs
+		<< " (" << (memory::allocatedBytes()-nbytes)/1048576.0 << " MiB), by linear solver workspace = "
+		<< linsolv->workspace().numAllocations()-nworkallocs << std::endl;
 	std::cout << "\n SteadyBackwardEulerSolver: solve(): Time taken by ODE solver:" << std::endl;
 	std::cout << " \t\tWall time = " << walltime << ", CPU time = " << cputime << "\n\n";
 
@@ -655,13 +1051,16 @@ void SteadyBackwardEulerSolver<nvars>::solve(std::string logfile)
 #ifdef _OPENMP
 	numthreads = omp_get_max_threads();
 #endif
-	std::ofstream outf; outf.open(logfile, std::ofstream::app);
-	outf << std::setw(10) << m->gnelem() << " "
-		<< std::setw(6) << numthreads << " " << std::setw(10) << linwtime << " " 
-		<< std::setw(10) << linctime << " " << std::setw(10) << avglinsteps << " "
-		<< std::setw(10) << step
-		<< "\n";
-	outf.close();
+	const a_int nelemtotal = (a_int)commSum((a_real)m->gnelem());
+	if(commRank() == 0) {
+		std::ofstream outf; outf.open(logfile, std::ofstream::app);
+		outf << std::setw(10) << nelemtotal << " "
+			<< std::setw(6) << numthreads << " " << std::setw(10) << linwtime << " " 
+			<< std::setw(10) << linctime << " " << std::setw(10) << avglinsteps << " "
+			<< std::setw(10) << step
+			<< "\n";
+		outf.close();
+	}
 }
 
 template <short nvars>
@@ -685,9 +1084,22 @@ SteadyMFBackwardEulerSolver<nvars>::SteadyMFBackwardEulerSolver(const UMesh2dh*c
 	std::cout << " Using matrix-free implicit solver.\n";
 	residual.resize(m->gnelem(),nvars);
 	u.resize(m->gnelem(), nvars);
+	memory::firstTouch(residual);
+	memory::firstTouch(u);
 	dtm.setup(m->gnelem(), 1);
 
-	if(precond == "J") {
+	// the preconditioning matrix is the first-order Jacobian; matrix-free LU-SGS needs none
+	M = nullptr;
+	mflusgs = nullptr;
+	factorsonly = precond == "J" || precond == "ILU0";
+	if(precond != "LUSGS")
+		M = new blasted::DLUMatrix<nvars>(m, nbuildsweeps, napplysweeps, eul->haloExchange());
+
+	if(precond == "LUSGS") {
+		prec = mflusgs = new MatrixFreeLUSGS<nvars>(m);
+		std::cout << " SteadyMFBackwardEulerSolver: Selected matrix-free LU-SGS preconditioner.\n";
+	}
+	else if(precond == "J") {
 		prec = new Jacobi<nvars>(M);
 		std::cout << " SteadyMFBackwardEulerSolver: Selected Block Jacobi preconditioner.\n";
 	}
@@ -699,18 +1111,47 @@ SteadyMFBackwardEulerSolver<nvars>::SteadyMFBackwardEulerSolver(const UMesh2dh*c
 		prec = new ILU0<nvars>(M);
 		std::cout << " SteadyMFBackwardEulerSolver: Selected Block ILU0 preconditioner.\n";
 	}
+	else if(precond == "LINEJ") {
+		prec = new LineJacobi<nvars>(M);
+		std::cout << " SteadyMFBackwardEulerSolver: Selected line-Jacobi preconditioner.\n";
+	}
+	else if(precond == "LINESGS") {
+		prec = new LineSGS<nvars>(M);
+		std::cout << " SteadyMFBackwardEulerSolver: Selected symmetric line Gauss-Seidel"
+			<< " preconditioner.\n";
+	}
+	else if(precond == "POLY") {
+		prec = new Polynomial<nvars>(M, napplysweeps);
+		std::cout << " SteadyMFBackwardEulerSolver: Selected GMRES-polynomial preconditioner"
+			<< " of degree " << napplysweeps << ".\n";
+	}
+	else if(precond == "ASILU0") {
+		prec = new AdditiveSchwarz<nvars>(M, nbuildsweeps);
+		std::cout << " SteadyMFBackwardEulerSolver: Selected additive Schwarz preconditioner with"
+			<< " ILU0 in thread subdomains overlapping by " << nbuildsweeps << " layers.\n";
+	}
 	else {
 		prec = new NoPrec<nvars>(M);
 		std::cout << " SteadyMFBackwardEulerSolver: No preconditioning will be applied.\n";
 	}
 
+	// the starting run has its own solver only if there is one
+	startlinsolv = nullptr;
 	if(linearsolver == "BCGSTB") {
 		//startlinsolv = new BiCGSTAB<nvars>(mesh, prec, starter);
 		//linsolv = new BiCGSTAB<nvars>(mesh, prec, eul);
 		std::cout << " SteadyMFBackwardEulerSolver: BiCGSTAB solver selected.\n";
 	}
+	else if(linearsolver == "ANDERSON") {
+		if(usestarter == 1)
+			startlinsolv = new MFRichardsonSolver<nvars>(mesh, prec, starter, mrestart);
+		linsolv = new MFRichardsonSolver<nvars>(mesh, prec, eul, mrestart);
+		std::cout << " SteadyMFBackwardEulerSolver: Richardson solver selected, with Anderson"
+			<< " acceleration using " << mrestart << " previous iterates.\n";
+	}
 	else {
-		startlinsolv = new MFRichardsonSolver<nvars>(mesh, prec, starter);
+		if(usestarter == 1)
+			startlinsolv = new MFRichardsonSolver<nvars>(mesh, prec, starter);
 		linsolv = new MFRichardsonSolver<nvars>(mesh, prec, eul);
 		std::cout << " SteadyMFBackwardEulerSolver: Richardson solver selected, no acceleration.\n";
 	}
@@ -724,9 +1165,53 @@ SteadyMFBackwardEulerSolver<nvars>::~SteadyMFBackwardEulerSolver()
 	delete linsolv;
 	delete startlinsolv;
 	delete prec;
+	if(M)
+		delete M;
+}
+
+template <short nvars>
+void SteadyMFBackwardEulerSolver<nvars>::setLeanMemory(const bool leanmem)
+{
+	SteadySolver<nvars>::setLeanMemory(leanmem);
+	if(M && factorsonly)
+		static_cast<blasted::DLUMatrix<nvars>*>(M)->setInPlaceFactorization(leanmem);
+}
+
+template <short nvars>
+void SteadyMFBackwardEulerSolver<nvars>::reportMemory(memory::Report& report,
+		const std::string& name) const
+{
+	SteadySolver<nvars>::reportMemory(report, name);
+	report.add(name, "time steps", dtm.bytes());
+	report.add(name, "matrix-free product storage", aux.size()*sizeof(a_real));
+	report.add(name, "linear solver workspace", linsolv->workspaceBytes());
+	if(startlinsolv)
+		report.add(name, "starting linear solver workspace", startlinsolv->workspaceBytes());
+	prec->reportMemory(report, name+" preconditioner");
+	reportMatrixMemory<nvars>(M, report, name+" preconditioning matrix");
+}
+
+template <short nvars>
+void SteadyMFBackwardEulerSolver<nvars>::scaleTimeSteps(const a_real cfl)
+{
+#pragma omp parallel for simd default(shared)
+	for(a_int iel = 0; iel < m->gnelem(); iel++)
+		dtm(iel) *= cfl;
+}
+
+template <short nvars>
+void SteadyMFBackwardEulerSolver<nvars>::addPseudoTimeTerms(const Spatial<nvars> *const spatial)
+{
+#pragma omp parallel for default(shared)
+	for(a_int iel = 0; iel < m->gnelem(); iel++)
+	{
+		Matrix<a_real,nvars,nvars,RowMajor> db;
+		spatial->get_pseudotime_preconditioner(&u(iel,0), db.data(), nullptr);
+		db *= m->garea(iel) / dtm(iel);
+		M->updateDiagBlock(iel*nvars, db.data(), nvars);
+	}
 }
 
-/// \fixme FIXME: Broken by matrices storage changes
 template <short nvars>
 void SteadyMFBackwardEulerSolver<nvars>::solve(std::string logfile)
 {
@@ -743,6 +1228,7 @@ void SteadyMFBackwardEulerSolver<nvars>::solve(std::string logfile)
 	double initialctime = (double)clock() / (double)CLOCKS_PER_SEC;
 	
 	if(usestarter == 1) {
+		prepareWorkspace(true);
 		while(resi/initres > starttol && step < startmaxiter)
 		{
 #pragma omp parallel for default(shared)
@@ -750,33 +1236,21 @@ void SteadyMFBackwardEulerSolver<nvars>::solve(std::string logfile)
 #pragma omp simd
 				for(short i = 0; i < nvars; i++) {
 					residual(iel,i) = 0;
-					for(short j = 0; j < nvars; j++)
-						D[iel](i,j) = 0;
 				}
 			}
-#pragma omp parallel for default(shared)
-			for(int iface = 0; iface < m->gnaface()-m->gnbface(); iface++) {
-#pragma omp simd
-				for(short i = 0; i < nvars; i++)
-					for(short j = 0; j < nvars; j++) {
-						L[iface](i,j) = 0;
-						U[iface](i,j) = 0;
-					}
-			}
 			
 			// update residual and local time steps
 			starter->compute_residual(u, residual, true, dtm);
+			scaleTimeSteps(startcfl);
 
 			// compute first-order Jacobian for preconditioner
-			starter->compute_jacobian(u, M);
-
-			// add pseudo-time terms to diagonal blocks
-#pragma omp parallel for simd default(shared)
-			for(int iel = 0; iel < m->gnelem(); iel++)
-			{
-				for(short i = 0; i < nvars; i++)
-					D[iel](i,i) += m->garea(iel) / (startcfl*dtm(iel));
+			if(M) {
+				M->setAllZero();
+				starter->compute_jacobian(u, M);
+				addPseudoTimeTerms(starter);
 			}
+			else
+				mflusgs->setState(starter, u, dtm);
 
 			// setup and solve linear system for the update du
 			startlinsolv->setupPreconditioner();
@@ -798,7 +1272,7 @@ void SteadyMFBackwardEulerSolver<nvars>::solve(std::string logfile)
 				}
 			}
 
-			resi = sqrt(errmass);
+			resi = sqrt(commSum(errmass));
 
 			if(step == 0)
 				initres = resi;
@@ -819,35 +1293,27 @@ void SteadyMFBackwardEulerSolver<nvars>::solve(std::string logfile)
 		resi = 1.0;
 		initres = 1.0;
 	}
+	prepareWorkspace(false);
+	if(lean) {
+		delete startlinsolv;
+		startlinsolv = nullptr;
+	}
 
 	std::cout << " SteadyMFBackwardEulerSolver: solve(): Starting main solver.\n";
-	while(resi/initres > tol && step < maxiter)
+	bool forcesconverged = false, havecoeffs = false;
+	while(resi/initres > tol && step < maxiter && !forcesconverged)
 	{
 #pragma omp parallel for default(shared)
 		for(int iel = 0; iel < m->gnelem(); iel++) {
 #pragma omp simd
 			for(short i = 0; i < nvars; i++) {
 				residual(iel,i) = 0;
-				for(short j = 0; j < nvars; j++)
-					D[iel](i,j) = 0;
 			}
 		}
-
-#pragma omp parallel for default(shared)
-		for(int iface = 0; iface < m->gnaface()-m->gnbface(); iface++) {
-#pragma omp simd
-			for(short i = 0; i < nvars; i++)
-				for(int j = 0; j < nvars; j++) {
-					L[iface](i,j) = 0;
-					U[iface](i,j) = 0;
-				}
-		}
 		
 		// update residual and local time steps
 		eul->compute_residual(u, residual, true, dtm);
 
-		eul->compute_jacobian(u, M);
-		
 		// compute ramped quantities
 		if(step < rampstart) {
 			curCFL = cflinit;
@@ -870,13 +1336,16 @@ void SteadyMFBackwardEulerSolver<nvars>::solve(std::string logfile)
 			curlinmaxiter = linmaxiterend;
 		}
 
-		// add pseudo-time terms to diagonal blocks
-#pragma omp parallel for simd default(shared)
-		for(int iel = 0; iel < m->gnelem(); iel++)
-		{
-			for(short i = 0; i < nvars; i++)
-				D[iel](i,i) += m->garea(iel) / (curCFL*dtm(iel));
+		scaleTimeSteps(curCFL);
+
+		// compute first-order Jacobian for preconditioner
+		if(M) {
+			M->setAllZero();
+			eul->compute_jacobian(u, M);
+			addPseudoTimeTerms(eul);
 		}
+		else
+			mflusgs->setState(eul, u, dtm);
 
 		// setup and solve linear system for the update du
 		linsolv->setupPreconditioner();
@@ -887,9 +1356,11 @@ void SteadyMFBackwardEulerSolver<nvars>::solve(std::string logfile)
 
 #pragma omp parallel default(shared)
 		{
+			if(!accel) {
 #pragma omp for
-			for(int iel = 0; iel < m->gnelem(); iel++) {
-				u.row(iel) += du.row(iel);
+				for(int iel = 0; iel < m->gnelem(); iel++) {
+					u.row(iel) += du.row(iel);
+				}
 			}
 #pragma omp for simd reduction(+:errmass)
 			for(int iel = 0; iel < m->gnelem(); iel++)
@@ -898,11 +1369,17 @@ void SteadyMFBackwardEulerSolver<nvars>::solve(std::string logfile)
 			}
 		}
 
-		resi = sqrt(errmass);
+		if(accel)
+			accel->update(u, du);
+
+		resi = sqrt(commSum(errmass));
 
 		if(step == 0)
 			initres = resi;
 
+		havecoeffs = updateForceCoefficients();
+		forcesconverged = forcesConverged();
+
 		if(step % 10 == 0) {
 			std::cout << "  SteadyMFBackwardEulerSolver: solve(): Step " << step 
 				<< ", rel residual " << resi/initres << std::endl;
@@ -911,6 +1388,9 @@ void SteadyMFBackwardEulerSolver<nvars>::solve(std::string logfile)
 		}
 
 		step++;
+
+		if(stepcallback)
+			stepcallback(step, u);
 	}
 
 	gettimeofday(&time2, NULL);
@@ -918,24 +1398,36 @@ void SteadyMFBackwardEulerSolver<nvars>::solve(std::string logfile)
 	double finalctime = (double)clock() / (double)CLOCKS_PER_SEC;
 	walltime += (finalwtime-initialwtime); cputime += (finalctime-initialctime);
 
-	if(step == maxiter)
+	if(forcesconverged)
+		std::cout << " SteadyMFBackwardEulerSolver: solve(): Force coefficients converged.\n";
+	else if(step == maxiter)
 		std::cout << "! SteadyMFBackwardEulerSolver: solve(): Exceeded max iterations!\n";
 	std::cout << " SteadyMFBackwardEulerSolver: solve(): Done, steps = " << step 
 		<< ", rel residual " << resi/initres << std::endl;
+	if(havecoeffs)
+		std::cout << " SteadyMFBackwardEulerSolver: solve(): CL = " << coeffs[0] << ", CD = "
+			<< coeffs[1] << ", CM = " << coeffs[2] << std::endl;
 
 	double linwtime, linctime;
 	linsolv->getRunTimes(linwtime, linctime);
 	std::cout << "\n SteadyMFBackwardEulerSolver: solve(): Time taken by linear solver:\n";
 	std::cout << " \t\tWall time = " << linwtime << ", CPU time = " << linctime << std::endl;
+	double precwtime, precctime;
+	linsolv->getPreconditionerSetupTimes(precwtime, precctime);
+	std::cout << " \t\tof which preconditioner setup: Wall time = " << precwtime
+		<< ", CPU time = " << precctime << "; solves: Wall time = " << linwtime-precwtime
+		<< ", CPU time = " << linctime-precctime << std::endl;
 	std::cout << "\n SteadyMFBackwardEulerSolver: solve(): Time taken by ODE solver:" << std::endl;
 	std::cout << " \t\tWall time = " << walltime << ", CPU time = " << cputime << "\n\n";
 }
 
 
 template class SteadyForwardEulerSolver<NVARS>;
+template class SteadyRKSolver<NVARS>;
 template class SteadyBackwardEulerSolver<NVARS>;
 template class SteadyMFBackwardEulerSolver<NVARS>;
 template class SteadyForwardEulerSolver<1>;
+template class SteadyRKSolver<1>;
 template class SteadyBackwardEulerSolver<1>;
 
 }	// end namespace
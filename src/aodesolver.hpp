@@ -34,6 +34,113 @@ protected:
 	double walltime;
 	bool lognres;
 
+	/// Whether force coefficients are computed every step for the convergence history
+	/** Unlike \ref lognres, this must be the same on all ranks, as computing the
+	 * coefficients involves communication.
+	 */
+	bool logforces;
+
+	/// Called after each step of the main loop, if set \sa setStepCallback
+	std::function<void(const int, const MVector&)> stepcallback;
+
+	/// Tolerance on the variation of the force coefficients over the window; 0 if not used
+	a_real forcetol;
+	/// Number of steps over which the variation of the force coefficients is measured
+	int forcewindow;
+	/// Lift, drag and moment coefficients of the last forcewindow steps, as a ring buffer
+	std::vector<a_real> forcehist;
+	int nforcehist;							///< Number of steps recorded in forcehist
+	a_real coeffs[3];						///< Force coefficients at the latest step
+
+	/// Anderson acceleration of the main loop, or null if not used \sa setAcceleration
+	AndersonAccelerator* accel;
+	/// Storage for the increment of the state over a step, when accelerating
+	MVector increment;
+
+	/// Whether memory is saved at some cost in speed \sa setLeanMemory
+	bool lean;
+
+	/// In lean mode, moves the workspace of the discretizations to the one used next
+	/** Called with true before the starter loop and with false before the main loop, so that
+	 * the two discretizations never hold their workspaces at the same time. The workspace of
+	 * the next phase is allocated right away, so that its loop allocates nothing.
+	 */
+	void prepareWorkspace(const bool starterphase) {
+		if(!lean)
+			return;
+		(starterphase ? eul : starter)->releaseWorkspace();
+		(starterphase ? starter : eul)->allocateWorkspace();
+	}
+
+	/// Computes the force coefficients at the current state if they are logged or used
+	/** \return True if they were computed, and are available in \ref coeffs
+	 */
+	bool updateForceCoefficients()
+	{
+		if(!logforces && forcetol <= 0)
+			return false;
+		if(!eul->compute_force_coefficients(u, coeffs))
+			return false;
+		if(forcetol > 0) {
+			const int pos = nforcehist % forcewindow;
+			for(int i = 0; i < 3; i++)
+				forcehist[pos*3+i] = coeffs[i];
+			nforcehist++;
+		}
+		return true;
+	}
+
+	/// Whether each force coefficient has varied by less than the tolerance over the window
+	bool forcesConverged() const
+	{
+		if(forcetol <= 0 || nforcehist < forcewindow)
+			return false;
+		for(int i = 0; i < 3; i++) {
+			a_real cmin = forcehist[i], cmax = forcehist[i];
+			for(int j = 1; j < forcewindow; j++) {
+				cmin = std::min(cmin, forcehist[j*3+i]);
+				cmax = std::max(cmax, forcehist[j*3+i]);
+			}
+			if(cmax-cmin >= forcetol)
+				return false;
+		}
+		return true;
+	}
+
+	/// Multiplies the residual of each cell by the inverse of the matrix multiplying its
+	/// pseudo-time derivative, for explicit steps with a preconditioned pseudo-time term
+	/** Does nothing if the discretization does not precondition the pseudo-time term.
+	 */
+	void applyInversePseudoTimePreconditioner(const Spatial<nvars> *const spatial, MVector& r) const
+	{
+		if(!spatial->preconditionedPseudoTime())
+			return;
+#pragma omp parallel for default(shared)
+		for(a_int iel = 0; iel < m->gnelem(); iel++)
+		{
+			a_real Pinv[nvars*nvars], rtemp[nvars];
+			spatial->get_pseudotime_preconditioner(&u(iel,0), nullptr, Pinv);
+			for(int i = 0; i < nvars; i++) {
+				rtemp[i] = 0;
+				for(int j = 0; j < nvars; j++)
+					rtemp[i] += Pinv[i*nvars+j]*r(iel,j);
+			}
+			for(int i = 0; i < nvars; i++)
+				r(iel,i) = rtemp[i];
+		}
+	}
+
+	/// Wall time per order of magnitude by which the residual dropped
+	/** \param[in] wtime Wall time taken
+	 * \param[in] relres Final residual relative to the initial one
+	 * \return 0 if the residual did not drop
+	 */
+	static double timePerDecade(const double wtime, const a_real relres) {
+		if(!(relres < 1.0) || relres <= 0)
+			return 0;
+		return wtime/(-std::log10(relres));
+	}
+
 public:
 	/** 
 	 * \param[in] mesh Mesh context
@@ -46,7 +153,8 @@ public:
 			Spatial<nvars> *const starterfv, const short use_starter,
 			bool log_nonlinear_residual)
 		: m(mesh), eul(spatial), starter(starterfv), usestarter(use_starter), 
-			cputime{0.0}, walltime{0.0}, lognres{log_nonlinear_residual}
+			cputime{0.0}, walltime{0.0}, lognres{log_nonlinear_residual}, logforces{false},
+			forcetol{0}, forcewindow{1}, nforcehist{0}, accel{nullptr}, lean{false}
 	{ }
 
 	const MVector& residuals() const {
@@ -63,9 +171,89 @@ public:
 		wall_time = walltime; cpu_time = cputime;
 	}
 
+	/// Sets a function to be called after each step of the main (not the starter) loop
+	/** It is passed the number of steps completed and the current state; it can be used
+	 * for output of intermediate solutions. Under MPI, it is called on all ranks.
+	 */
+	void setStepCallback(std::function<void(const int, const MVector&)> callback) {
+		stepcallback = callback;
+	}
+
+	/// Sets whether the force coefficients are computed at every step of the main loop
+	/** They are then written to the convergence history, if it is logged. This must be
+	 * called with the same value on all ranks, including those that do not log.
+	 */
+	void setForceLogging(const bool log) {
+		logforces = log;
+	}
+
+	/// Also stops the main loop once the force coefficients have converged
+	/** The main loop then ends as soon as the lift, drag and moment coefficients have each
+	 * varied by less than a tolerance over the last few steps, even if the residual has not
+	 * yet dropped to its tolerance.
+	 * \param[in] tol Largest allowed difference between the largest and smallest value of
+	 *   each coefficient over the window; 0 disables this criterion
+	 * \param[in] window Number of steps over which the variation is measured
+	 */
+	void setForceTermination(const a_real tol, const int window) {
+		forcetol = tol;
+		forcewindow = std::max(window,2);
+		forcehist.assign(3*forcewindow, 0);
+		nforcehist = 0;
+	}
+
+	/// Lift, drag and moment coefficients at the last step of the main loop
+	/** Only set if they were logged or used for termination.
+	 */
+	const a_real* forceCoefficients() const {
+		return coeffs;
+	}
+
+	/// Accelerates the main loop by Anderson acceleration
+	/** Each step of the main loop is treated as one step of a fixed-point iteration for the
+	 * state, and is replaced by the combination of the last few steps that minimizes the
+	 * increment (\ref AndersonAccelerator). The history is restarted when the increment grows.
+	 * \param[in] depth Number of previous steps used; 0 turns acceleration off
+	 * \param[in] mixing Fraction of each (combined) increment that is applied
+	 */
+	void setAcceleration(const int depth, const a_real mixing) {
+		delete accel;
+		accel = nullptr;
+		if(depth > 0) {
+			accel = new AndersonAccelerator(depth, mixing);
+			accel->setup(m->gnelem(), nvars);
+			increment.resize(m->gnelem(), nvars);
+			memory::firstTouch(increment);
+		}
+	}
+
+	/// Saves memory at some cost in speed
+	/** The starting and main runs then share the workspace of the discretization, which is
+	 * freed by each after use; solvers may free or overwrite more, see the derived classes.
+	 * Must be called before \ref solve.
+	 */
+	virtual void setLeanMemory(const bool leanmem) {
+		lean = leanmem;
+	}
+
+	/// Adds the memory used by the solver to a report
+	/** The mesh and the discretizations are not included, as they are not owned by the solver.
+	 * \param report The report to add to
+	 * \param name Name of the solver in the report
+	 */
+	virtual void reportMemory(memory::Report& report, const std::string& name) const {
+		report.add(name, "state", u.size()*sizeof(a_real));
+		report.add(name, "residual", residual.size()*sizeof(a_real));
+		if(accel)
+			report.add(name, "Anderson acceleration", accel->bytes()
+					+ increment.size()*sizeof(a_real));
+	}
+
 	virtual void solve(std::string logfile) = 0;
 
-	virtual ~SteadySolver() {}
+	virtual ~SteadySolver() {
+		delete accel;
+	}
 };
 	
 /// A driver class for explicit time-stepping to steady state using forward Euler integration
@@ -88,6 +276,18 @@ class SteadyForwardEulerSolver : public SteadySolver<nvars>
 	using SteadySolver<nvars>::cputime;
 	using SteadySolver<nvars>::walltime;
 	using SteadySolver<nvars>::lognres;
+	using SteadySolver<nvars>::stepcallback;
+	using SteadySolver<nvars>::forcetol;
+	using SteadySolver<nvars>::forcewindow;
+	using SteadySolver<nvars>::coeffs;
+	using SteadySolver<nvars>::updateForceCoefficients;
+	using SteadySolver<nvars>::forcesConverged;
+	using SteadySolver<nvars>::accel;
+	using SteadySolver<nvars>::increment;
+	using SteadySolver<nvars>::lean;
+	using SteadySolver<nvars>::prepareWorkspace;
+	using SteadySolver<nvars>::timePerDecade;
+	using SteadySolver<nvars>::applyInversePseudoTimePreconditioner;
 
 	amat::Array2d<a_real> dtm;				///< Stores allowable local time step for each cell
 	const double tol;
@@ -106,10 +306,107 @@ public:
 			bool log_nonlinear_res);
 	~SteadyForwardEulerSolver();
 
+	void reportMemory(memory::Report& report, const std::string& name) const;
+
 	/// Solves the steady problem by a first-order explicit method, using local time-stepping
 	void solve(std::string logfile);
 };
 
+/// Explicit multistage Runge-Kutta time-stepping to steady state, with implicit residual smoothing
+/** Each step consists of the stages
+ * \f$ u^{(k)} = u^n - \alpha_k \Delta t \bar{R}(u^{(k-1)}) \f$, with \f$ u^{(0)} = u^n \f$, for
+ * given coefficients \f$ \alpha_k \f$ the last of which is 1. The local time steps are computed
+ * at the first stage only.
+ *
+ * The residual of each stage is replaced by a smoothed residual \f$ \bar{R} \f$, which solves
+ * \f$ (1+\epsilon n_i) \bar{R}_i - \epsilon \sum_j \bar{R}_j = R_i \f$, where the sum is over
+ * the \f$ n_i \f$ neighbours of cell i. The system is solved approximately by a few Jacobi
+ * sweeps starting from R. This averages the residual over a neighbourhood that grows with the
+ * number of sweeps, and allows CFL numbers several times larger than the scheme without it.
+ * Under MPI, the smoothing does not cross subdomain boundaries.
+ *
+ * \note Make sure compute_topological(), compute_face_data() and compute_areas()
+ * have been called on the mesh object prior to initialzing an object of this class.
+ */
+template <short nvars>
+class SteadyRKSolver : public SteadySolver<nvars>
+{
+	using SteadySolver<nvars>::m;
+	using SteadySolver<nvars>::eul;
+	using SteadySolver<nvars>::starter;
+	using SteadySolver<nvars>::residual;
+	using SteadySolver<nvars>::u;
+	using SteadySolver<nvars>::usestarter;
+	using SteadySolver<nvars>::cputime;
+	using SteadySolver<nvars>::walltime;
+	using SteadySolver<nvars>::lognres;
+	using SteadySolver<nvars>::stepcallback;
+	using SteadySolver<nvars>::forcetol;
+	using SteadySolver<nvars>::forcewindow;
+	using SteadySolver<nvars>::coeffs;
+	using SteadySolver<nvars>::updateForceCoefficients;
+	using SteadySolver<nvars>::forcesConverged;
+	using SteadySolver<nvars>::accel;
+	using SteadySolver<nvars>::increment;
+	using SteadySolver<nvars>::lean;
+	using SteadySolver<nvars>::prepareWorkspace;
+	using SteadySolver<nvars>::timePerDecade;
+	using SteadySolver<nvars>::applyInversePseudoTimePreconditioner;
+
+	amat::Array2d<a_real> dtm;				///< Stores allowable local time step for each cell
+	MVector uold;							///< State at the start of the step
+	MVector rsmooth;						///< Smoothed residual
+	MVector rtemp;							///< Smoothed residual of the previous Jacobi sweep
+
+	const std::vector<a_real> alpha;		///< Stage coefficients
+	const a_real epsilon;					///< Residual smoothing coefficient
+	const int nsweeps;						///< Number of Jacobi sweeps for residual smoothing
+
+	const double tol;
+	const int maxiter;
+	const double cfl;
+	
+	const double starttol;
+	const int startmaxiter;
+	const double startcfl;
+
+	/// Replaces the residual by the smoothed residual, computed into rsmooth
+	void smoothResidual();
+
+	/// Carries out one step with a given spatial discretization
+	/** \return The norm of the density residual at the start of the step
+	 */
+	a_real rkStep(Spatial<nvars> *const spatial, const double cflnum);
+
+public:
+	/**
+	 * \param[in] stage_coeffs Coefficients of the stages, see \ref stageCoefficients
+	 * \param[in] smoothing_coeff Residual smoothing coefficient; 0 turns smoothing off
+	 * \param[in] smoothing_sweeps Number of Jacobi sweeps for residual smoothing
+	 * The other parameters are as for \ref SteadyForwardEulerSolver.
+	 */
+	SteadyRKSolver(const UMesh2dh *const mesh, 
+			Spatial<nvars> *const euler, Spatial<nvars> *const starterfv, 
+			const short use_starter, const double toler, const int maxits, const double cfl,
+			const double ftoler, const int fmaxits, const double fcfl,
+			const std::vector<a_real>& stage_coeffs, const a_real smoothing_coeff,
+			const int smoothing_sweeps, bool log_nonlinear_res);
+
+	/// Stage coefficients of the 4-stage or 5-stage scheme
+	/** These are the coefficients optimized by Van Leer et al. for damping high-frequency
+	 * errors of second-order upwind schemes: 0.1084, 0.2602, 0.5052, 1 and
+	 * 0.0695, 0.1602, 0.2898, 0.5060, 1 respectively. The classical coefficients of Jameson et
+	 * al. for central schemes (1/4, 1/3, 1/2, 1) are less stable with upwind fluxes.
+	 * An empty vector is returned for other numbers of stages.
+	 */
+	static std::vector<a_real> stageCoefficients(const int nstages);
+
+	void reportMemory(memory::Report& report, const std::string& name) const;
+
+	/// Solves the steady problem by the multistage method, using local time-stepping
+	void solve(std::string logfile);
+};
+
 /// Implicit pseudo-time iteration to steady state
 /** Optionally runs a `starter' time stepping loop to generate an initial solution
  * before starting the `main' loop.
@@ -127,6 +424,16 @@ class SteadyBackwardEulerSolver : public SteadySolver<nvars>
 	using SteadySolver<nvars>::cputime;
 	using SteadySolver<nvars>::walltime;
 	using SteadySolver<nvars>::lognres;
+	using SteadySolver<nvars>::stepcallback;
+	using SteadySolver<nvars>::forcetol;
+	using SteadySolver<nvars>::forcewindow;
+	using SteadySolver<nvars>::coeffs;
+	using SteadySolver<nvars>::updateForceCoefficients;
+	using SteadySolver<nvars>::forcesConverged;
+	using SteadySolver<nvars>::accel;
+	using SteadySolver<nvars>::increment;
+	using SteadySolver<nvars>::lean;
+	using SteadySolver<nvars>::prepareWorkspace;
 
 	amat::Array2d<a_real> dtm;               ///< Stores allowable local time step for each cell
 
@@ -196,6 +503,8 @@ public:
 	
 	~SteadyBackwardEulerSolver();
 
+	void reportMemory(memory::Report& report, const std::string& name) const;
+
 	/// Runs the time-stepping loop
 	/** Appends a line of timing-related data to a log file as follows.
 	 *  num-cells num-threads  wall-time  CPU-time   avg-linear-solver-iterations 
@@ -219,6 +528,16 @@ class SteadyMFBackwardEulerSolver : public SteadySolver<nvars>
 	using SteadySolver<nvars>::cputime;
 	using SteadySolver<nvars>::walltime;
 	using SteadySolver<nvars>::lognres;
+	using SteadySolver<nvars>::stepcallback;
+	using SteadySolver<nvars>::forcetol;
+	using SteadySolver<nvars>::forcewindow;
+	using SteadySolver<nvars>::coeffs;
+	using SteadySolver<nvars>::updateForceCoefficients;
+	using SteadySolver<nvars>::forcesConverged;
+	using SteadySolver<nvars>::accel;
+	using SteadySolver<nvars>::increment;
+	using SteadySolver<nvars>::lean;
+	using SteadySolver<nvars>::prepareWorkspace;
 
 	/// Stores allowable local time step for each cell
 	amat::Array2d<a_real> dtm; 
@@ -226,16 +545,16 @@ class SteadyMFBackwardEulerSolver : public SteadySolver<nvars>
 	MFIterativeSolver<nvars> * startlinsolv;    ///< Linear solver context for starting run
 	MFIterativeSolver<nvars> * linsolv;         ///< Linear solver context for main run
 	Preconditioner<nvars>* prec;                ///< preconditioner context
-	LinearOperator<a_real,a_int>* M;            ///< Preconditioning matrix
+	/// Preconditioning matrix; null if the preconditioner needs none
+	LinearOperator<a_real,a_int>* M;
+	/// The preconditioner if it is matrix-free LU-SGS, otherwise null
+	MatrixFreeLUSGS<nvars>* mflusgs;
+	/// Whether the preconditioner only needs the factors of the preconditioning matrix
+	bool factorsonly;
 
 	/// Temporary storage needed for matrix-free derivative evaluation
 	MVector aux;
 
-	// TEMPORARY - REMOVE!
-	Matrix<a_real,nvars,nvars,RowMajor>* D;
-	Matrix<a_real,nvars,nvars,RowMajor>* L;
-	Matrix<a_real,nvars,nvars,RowMajor>* U;
-
 	const double cflinit;
 	double cflfin;
 	int rampstart;
@@ -250,6 +569,15 @@ class SteadyMFBackwardEulerSolver : public SteadySolver<nvars>
 	const int startmaxiter;
 	const double startcfl;
 
+	/// Multiplies the local time steps by the CFL number
+	/** The matrix-free Jacobian-vector products and the preconditioner then both use the
+	 * pseudo-time term area/dtm.
+	 */
+	void scaleTimeSteps(const a_real cfl);
+
+	/// Adds the pseudo-time terms to the diagonal blocks of the preconditioning matrix
+	void addPseudoTimeTerms(const Spatial<nvars> *const spatial);
+
 public:
 	SteadyMFBackwardEulerSolver(const UMesh2dh*const mesh, Spatial<nvars> *const spatial, 
 		Spatial<nvars> *const starterfv, const short use_starter,
@@ -263,6 +591,15 @@ public:
 	
 	~SteadyMFBackwardEulerSolver();
 
+	/// Also factors the preconditioning matrix in place if the preconditioner allows it, and
+	/// frees the linear solver of the starting run after it
+	/** The block-Jacobi and ILU0 preconditioners only need the factors, since the products
+	 * with the Jacobian are matrix-free, see DLUMatrix::setInPlaceFactorization.
+	 */
+	void setLeanMemory(const bool leanmem);
+
+	void reportMemory(memory::Report& report, const std::string& name) const;
+
 	void solve(std::string logfile);
 };
 
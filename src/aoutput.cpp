@@ -3,6 +3,7 @@
  */
 
 #include "aoutput.hpp"
+#include "aperf.hpp"
 
 /* Writes multiple scalar data sets and one vector data set, all cell-centered data, to a file in VTU format.
  * If either x or y is a 0x0 matrix, it is ignored.
@@ -10,6 +11,7 @@
  */
 void writeScalarsVectorToVtu_CellData(std::string fname, const acfd::UMesh2dh& m, const amat::Array2d<double>& x, std::string scaname[], const amat::Array2d<double>& y, std::string vecname)
 {
+	acfd::perf::ScopedTimer tmr(acfd::perf::OUTPUT);
 	int elemcode;
 	std::cout << "aoutput: Writing vtu output to " << fname << "\n";
 	std::ofstream out(fname);
@@ -129,10 +131,12 @@ void writeScalarsVectorToVtu_CellData(std::string fname, const acfd::UMesh2dh& m
 	std::cout << "Vtu file written.\n";
 }
 
-void writeScalarsVectorToVtu_PointData(std::string fname, const acfd::UMesh2dh& m, const amat::Array2d<double>& x, std::string scaname[], const amat::Array2d<double>& y, std::string vecname)
+void writeScalarsVectorToVtu_PointData(std::string fname, const acfd::UMesh2dh& m, const amat::Array2d<double>& x, std::string scaname[], const amat::Array2d<double>& y, std::string vecname, const bool verbose)
 {
+	acfd::perf::ScopedTimer tmr(acfd::perf::OUTPUT);
 	int elemcode;
-	std::cout << "aoutput: Writing vtu output to " << fname << "\n";
+	if(verbose)
+		std::cout << "aoutput: Writing vtu output to " << fname << "\n";
 	std::ofstream out(fname);
 
 	int nscalars = x.cols();
@@ -247,7 +251,8 @@ void writeScalarsVectorToVtu_PointData(std::string fname, const acfd::UMesh2dh&
 	out << "</UnstructuredGrid>\n";
 	out << "</VTKFile>";
 	out.close();
-	std::cout << "Vtu file written.\n";
+	if(verbose)
+		std::cout << "Vtu file written.\n";
 }
 
 
@@ -256,6 +261,7 @@ void writeScalarsVectorToVtu_PointData(std::string fname, const acfd::UMesh2dh&
  */
 void writeMeshToVtu(std::string fname, acfd::UMesh2dh& m)
 {
+	acfd::perf::ScopedTimer tmr(acfd::perf::OUTPUT);
 	std::cout << "Writing vtu output...\n";
 	std::ofstream out(fname);
 
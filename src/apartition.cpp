@@ -0,0 +1,331 @@
+/** @file apartition.cpp
+ * @brief Implementation of domain decomposition and halo exchange
+ * @author Aditya Kashi
+ */
+
+#include "apartition.hpp"
+#include "aperf.hpp"
+#include <algorithm>
+
+namespace acfd {
+
+static int myrank = 0;
+static int nranks = 1;
+
+void commInitialize(int *const argc, char ***const argv)
+{
+#if HAVE_MPI==1
+	int provided;
+	MPI_Init_thread(argc, argv, MPI_THREAD_FUNNELED, &provided);
+	if(provided < MPI_THREAD_FUNNELED)
+		std::cout << "! commInitialize: The MPI library does not support OpenMP threads!\n";
+	MPI_Comm_rank(MPI_COMM_WORLD, &myrank);
+	MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+#endif
+}
+
+void commFinalize()
+{
+#if HAVE_MPI==1
+	MPI_Finalize();
+#endif
+}
+
+int commRank()
+{
+	return myrank;
+}
+
+int commSize()
+{
+	return nranks;
+}
+
+a_real commSum(const a_real val)
+{
+#if HAVE_MPI==1
+	if(nranks > 1) {
+		a_real sum;
+		MPI_Allreduce(&val, &sum, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+		return sum;
+	}
+#endif
+	return val;
+}
+
+DomainDecomposition::DomainDecomposition(const UMesh2dh *const globalmesh)
+	: gm(globalmesh), nparts(commSize())
+{
+	if(gm->gnelem() < nparts)
+		std::cout << "! DomainDecomposition: Fewer cells than ranks!\n";
+
+	amat::Array2d<a_real> centres(gm->gnelem(), NDIM);
+#pragma omp parallel for default(shared)
+	for(a_int iel = 0; iel < gm->gnelem(); iel++)
+		for(int idim = 0; idim < NDIM; idim++)
+		{
+			centres(iel,idim) = 0;
+			for(int inode = 0; inode < gm->gnnode(iel); inode++)
+				centres(iel,idim) += gm->gcoords(gm->ginpoel(iel,inode),idim);
+			centres(iel,idim) /= gm->gnnode(iel);
+		}
+
+	part.resize(gm->gnelem());
+	std::vector<a_int> cells(gm->gnelem());
+	for(a_int iel = 0; iel < gm->gnelem(); iel++)
+		cells[iel] = iel;
+	bisect(centres, &cells[0], gm->gnelem(), 0, nparts);
+
+	std::vector<a_int> ncells(nparts, 0);
+	for(a_int iel = 0; iel < gm->gnelem(); iel++)
+		ncells[part[iel]]++;
+	std::cout << " DomainDecomposition: Partitioned " << gm->gnelem() << " cells into "
+		<< nparts << " subdomains of " << *std::min_element(ncells.begin(),ncells.end())
+		<< " to " << *std::max_element(ncells.begin(),ncells.end()) << " cells.\n";
+}
+
+/** Ties in the coordinate are broken by cell index, so that every rank computes the same
+ * partition.
+ */
+void DomainDecomposition::bisect(const amat::Array2d<a_real>& centres,
+		a_int *const cells, const a_int n, const int firstpart, const int np)
+{
+	if(np == 1) {
+		for(a_int i = 0; i < n; i++)
+			part[cells[i]] = firstpart;
+		return;
+	}
+
+	a_real rmin[NDIM], rmax[NDIM];
+	for(int idim = 0; idim < NDIM; idim++) {
+		rmin[idim] = centres.get(cells[0],idim);
+		rmax[idim] = rmin[idim];
+	}
+	for(a_int i = 1; i < n; i++)
+		for(int idim = 0; idim < NDIM; idim++) {
+			rmin[idim] = std::min(rmin[idim], centres.get(cells[i],idim));
+			rmax[idim] = std::max(rmax[idim], centres.get(cells[i],idim));
+		}
+	int axis = 0;
+	for(int idim = 1; idim < NDIM; idim++)
+		if(rmax[idim]-rmin[idim] > rmax[axis]-rmin[axis])
+			axis = idim;
+
+	const int npleft = np/2;
+	const a_int nleft = (a_int)((long long)n*npleft/np);
+	std::nth_element(cells, cells+nleft, cells+n,
+		[&centres,axis](const a_int a, const a_int b) {
+			return centres.get(a,axis) < centres.get(b,axis)
+				|| (centres.get(a,axis) == centres.get(b,axis) && a < b);
+		});
+
+	bisect(centres, cells, nleft, firstpart, npleft);
+	bisect(centres, cells+nleft, n-nleft, firstpart+npleft, np-npleft);
+}
+
+void DomainDecomposition::extractLocalMesh(UMesh2dh& lm)
+{
+	const int rank = commRank();
+
+	lelems.clear();
+	for(a_int iel = 0; iel < gm->gnelem(); iel++)
+		if(part[iel] == rank)
+			lelems.push_back(iel);
+
+	std::vector<a_int> lpoin(gm->gnpoin(), -1);
+	for(size_t i = 0; i < lelems.size(); i++)
+		for(int inode = 0; inode < gm->gnnode(lelems[i]); inode++)
+			lpoin[gm->ginpoel(lelems[i],inode)] = 0;
+	lpoints.clear();
+	for(a_int ip = 0; ip < gm->gnpoin(); ip++)
+		if(lpoin[ip] == 0) {
+			lpoin[ip] = (a_int)lpoints.size();
+			lpoints.push_back(ip);
+		}
+
+	// boundary faces of the global mesh in this subdomain, then faces shared with other ranks
+	std::vector<a_int> bfaces, sfaces;
+	for(a_int iface = 0; iface < gm->gnbface(); iface++)
+		if(part[gm->gintfac(iface,0)] == rank)
+			bfaces.push_back(iface);
+	for(a_int iface = gm->gnbface(); iface < gm->gnaface(); iface++)
+		if((part[gm->gintfac(iface,0)] == rank) != (part[gm->gintfac(iface,1)] == rank))
+			sfaces.push_back(iface);
+
+	lm.ndim = gm->ndim;
+	lm.nnofa = gm->nnofa;
+	lm.nbtag = std::max(gm->nbtag, 2);
+	lm.ndtag = gm->ndtag;
+	lm.npoin = (a_int)lpoints.size();
+	lm.nelem = (a_int)lelems.size();
+	lm.nface = (a_int)(bfaces.size()+sfaces.size());
+	lm.alloc_jacobians = false;
+	lm.isBoundaryMaps = false;
+
+	std::vector<int> nnodes(lm.nelem);
+	for(a_int iel = 0; iel < lm.nelem; iel++)
+		nnodes[iel] = gm->gnnode(lelems[iel]);
+	lm.setupElements(&nnodes[0], nullptr);
+
+	lm.coords.setup(lm.npoin, lm.ndim);
+	for(a_int ip = 0; ip < lm.npoin; ip++)
+		for(int idim = 0; idim < lm.ndim; idim++)
+			lm.coords(ip,idim) = gm->gcoords(lpoints[ip],idim);
+
+	lm.vol_regions.setup(lm.nelem, lm.ndtag);
+	for(a_int iel = 0; iel < lm.nelem; iel++) {
+		for(int inode = 0; inode < nnodes[iel]; inode++)
+			lm.inpoel(iel,inode) = lpoin[gm->ginpoel(lelems[iel],inode)];
+		for(int itag = 0; itag < lm.ndtag; itag++)
+			lm.vol_regions(iel,itag) = gm->vol_regions.get(lelems[iel],itag);
+	}
+
+	lm.bface.setup(lm.nface, lm.nnofa+lm.nbtag);
+	lm.bface.zeros();
+	for(size_t i = 0; i < bfaces.size(); i++) {
+		for(int j = 0; j < lm.nnofa; j++)
+			lm.bface(i,j) = lpoin[gm->gintfac(bfaces[i],2+j)];
+		for(int j = 0; j < gm->nbtag; j++)
+			lm.bface(i,lm.nnofa+j) = gm->gbfacetag(bfaces[i],j);
+	}
+	for(size_t i = 0; i < sfaces.size(); i++) {
+		const a_int iface = (a_int)bfaces.size()+i;
+		const a_int lelem = gm->gintfac(sfaces[i],0), relem = gm->gintfac(sfaces[i],1);
+		for(int j = 0; j < lm.nnofa; j++)
+			lm.bface(iface,j) = lpoin[gm->gintfac(sfaces[i],2+j)];
+		lm.bface(iface,lm.nnofa) = halo_boundary_tag;
+		lm.bface(iface,lm.nnofa+1) = part[lelem] == rank ? part[relem] : part[lelem];
+	}
+
+	lm.flag_bpoin.setup(lm.npoin,1);
+	lm.flag_bpoin.zeros();
+	for(a_int i = 0; i < lm.nface; i++)
+		for(int j = 0; j < lm.nnofa; j++)
+			lm.flag_bpoin(lm.bface(i,j)) = 1;
+
+	std::cout << " DomainDecomposition: extractLocalMesh(): Rank " << rank << " has "
+		<< lm.nelem << " cells and " << sfaces.size() << " faces shared with other ranks.\n";
+}
+
+void DomainDecomposition::gather(const MVector& local, MVector& global) const
+{
+	const int rank = commRank();
+	if(nparts == 1) {
+		if(rank == 0)
+			global = local;
+		return;
+	}
+
+#if HAVE_MPI==1
+	const a_int ncols = (a_int)local.cols();
+	std::vector<int> counts(nparts, 0), displs(nparts+1, 0);
+	for(a_int iel = 0; iel < gm->gnelem(); iel++)
+		counts[part[iel]] += ncols;
+	for(int ip = 0; ip < nparts; ip++)
+		displs[ip+1] = displs[ip] + counts[ip];
+
+	std::vector<a_real> buffer;
+	if(rank == 0)
+		buffer.resize(displs[nparts]);
+	MPI_Gatherv(local.data(), (int)local.size(), MPI_DOUBLE,
+			rank == 0 ? &buffer[0] : nullptr, &counts[0], &displs[0], MPI_DOUBLE,
+			0, MPI_COMM_WORLD);
+
+	if(rank == 0) {
+		// elements of each rank arrive in increasing global order
+		global.resize(gm->gnelem(), ncols);
+		for(a_int iel = 0; iel < gm->gnelem(); iel++) {
+			for(a_int j = 0; j < ncols; j++)
+				global(iel,j) = buffer[displs[part[iel]]+j];
+			displs[part[iel]] += ncols;
+		}
+	}
+#endif
+}
+
+HaloExchange::HaloExchange(const UMesh2dh *const mesh, const DomainDecomposition& dd)
+	: m(mesh), ncomp(0)
+{
+	struct SharedFace {
+		int rank;
+		a_int gp[2];				///< Global indices of the points, sorted
+		a_int face;
+	};
+	std::vector<SharedFace> shared;
+
+	for(a_int iface = 0; iface < m->gnbface(); iface++)
+		if(m->gbfacetag(iface,0) == DomainDecomposition::halo_boundary_tag)
+		{
+			SharedFace sf;
+			sf.rank = m->gbfacetag(iface,1);
+			sf.gp[0] = dd.globalPoint(m->gintfac(iface,2));
+			sf.gp[1] = dd.globalPoint(m->gintfac(iface,3));
+			if(sf.gp[0] > sf.gp[1])
+				std::swap(sf.gp[0], sf.gp[1]);
+			sf.face = iface;
+			shared.push_back(sf);
+		}
+
+	std::sort(shared.begin(), shared.end(), [](const SharedFace& a, const SharedFace& b) {
+			return a.rank < b.rank || (a.rank == b.rank && (a.gp[0] < b.gp[0]
+				|| (a.gp[0] == b.gp[0] && a.gp[1] < b.gp[1])));
+		});
+
+	faces.resize(shared.size());
+	for(size_t i = 0; i < shared.size(); i++) {
+		faces[i] = shared[i].face;
+		if(i == 0 || shared[i].rank != shared[i-1].rank) {
+			nbdranks.push_back(shared[i].rank);
+			nbdptr.push_back((a_int)i);
+		}
+	}
+	nbdptr.push_back((a_int)shared.size());
+
+#if HAVE_MPI==1
+	requests.resize(2*nbdranks.size());
+#endif
+}
+
+void HaloExchange::begin(const a_real *const src, const bool cellwise, const int ncomps) const
+{
+	perf::ScopedTimer tmr(perf::HALO_EXCHANGE);
+	ncomp = ncomps;
+	const a_int nf = (a_int)faces.size();
+	sendbuf.resize(nf*ncomp);
+	recvbuf.resize(nf*ncomp);
+
+#pragma omp parallel for default(shared)
+	for(a_int i = 0; i < nf; i++) {
+		const a_int row = cellwise ? m->gintfac(faces[i],0) : faces[i];
+		for(int j = 0; j < ncomp; j++)
+			sendbuf[i*ncomp+j] = src[row*ncomp+j];
+	}
+
+#if HAVE_MPI==1
+	const int nn = (int)nbdranks.size();
+	for(int in = 0; in < nn; in++) {
+		const int count = (int)(nbdptr[in+1]-nbdptr[in])*ncomp;
+		MPI_Irecv(&recvbuf[nbdptr[in]*ncomp], count, MPI_DOUBLE, nbdranks[in], 0,
+				MPI_COMM_WORLD, &requests[in]);
+		MPI_Isend(&sendbuf[nbdptr[in]*ncomp], count, MPI_DOUBLE, nbdranks[in], 0,
+				MPI_COMM_WORLD, &requests[nn+in]);
+	}
+#endif
+}
+
+void HaloExchange::end(a_real *const ghostvals) const
+{
+	perf::ScopedTimer tmr(perf::HALO_EXCHANGE);
+#if HAVE_MPI==1
+	if(requests.size() > 0)
+		MPI_Waitall((int)requests.size(), &requests[0], MPI_STATUSES_IGNORE);
+#endif
+
+	const a_int nf = (a_int)faces.size();
+#pragma omp parallel for default(shared)
+	for(a_int i = 0; i < nf; i++)
+		for(int j = 0; j < ncomp; j++)
+			ghostvals[faces[i]*ncomp+j] = recvbuf[i*ncomp+j];
+}
+
+}
@@ -0,0 +1,173 @@
+/** @file apartition.hpp
+ * @brief Domain decomposition among MPI ranks and exchange of ghost data between subdomains
+ * @author Aditya Kashi
+ *
+ * Each rank solves on a local mesh made of the cells it owns. Faces shared with another
+ * rank become boundary faces of the local mesh, marked with
+ * [halo_boundary_tag](@ref DomainDecomposition::halo_boundary_tag); their ghost cells hold
+ * data of the neighbouring rank's cells, communicated by [HaloExchange](@ref HaloExchange),
+ * instead of states computed from boundary conditions.
+ *
+ * If FVENS is built without MPI, there is always exactly one rank and nothing is
+ * communicated.
+ */
+
+#ifndef __APARTITION_H
+#define __APARTITION_H 1
+
+#ifndef __AMESH2DH_H
+#include "amesh2dh.hpp"
+#endif
+
+#if HAVE_MPI==1
+// only the C interface is used; the C++ bindings clash with macros such as DOUBLE_PRECISION
+#define OMPI_SKIP_MPICXX 1
+#define MPICH_SKIP_MPICXX 1
+#include <mpi.h>
+#endif
+
+namespace acfd {
+
+/// Initializes MPI, if available, for use from the master thread of OpenMP regions
+void commInitialize(int *const argc, char ***const argv);
+
+/// Finalizes MPI, if available
+void commFinalize();
+
+/// Rank of this process; 0 if not built with MPI
+int commRank();
+
+/// Number of ranks; 1 if not built with MPI or if MPI has not been initialized
+int commSize();
+
+/// Sum of a value over all ranks
+a_real commSum(const a_real val);
+
+/// Assignment of the cells of a global mesh to ranks, and extraction of local meshes
+class DomainDecomposition
+{
+	const UMesh2dh *const gm;			///< Global mesh
+	const int nparts;					///< Number of subdomains
+	std::vector<int> part;				///< Subdomain of each global element
+	std::vector<a_int> lelems;			///< Global indices of the elements of this rank
+	std::vector<a_int> lpoints;			///< Global indices of the points of this rank
+
+	/// Assigns parts [firstpart,firstpart+np) to n cells by recursive coordinate bisection
+	void bisect(const amat::Array2d<a_real>& centres, a_int *const cells, const a_int n,
+			const int firstpart, const int np);
+
+public:
+	/// Boundary marker of faces shared with other subdomains
+	/** The second tag of such faces is the rank of the neighbouring subdomain.
+	 */
+	static const int halo_boundary_tag = -1;
+
+	/// Partitions the mesh among all ranks by recursive coordinate bisection of cell centres
+	/** Every rank must pass the same global mesh, on which compute_topological() and
+	 * compute_face_data() have been called. The partition is computed redundantly on every
+	 * rank, so no communication is needed.
+	 * Each cut is perpendicular to the longer side of the bounding box of the cells being
+	 * split, and divides them in proportion to the number of parts on each side, so any
+	 * number of ranks is supported.
+	 */
+	DomainDecomposition(const UMesh2dh *const globalmesh);
+
+	/// Builds the mesh of the subdomain of this rank
+	/** Local elements and points are numbered in the order of their global indices.
+	 * Boundary faces of the global mesh keep their markers. As usual, compute_topological(),
+	 * compute_areas(), compute_jacobians() and compute_face_data() need to be called on the
+	 * local mesh afterwards.
+	 */
+	void extractLocalMesh(UMesh2dh& lm);
+
+	/// Global index of a point of the local mesh
+	a_int globalPoint(const a_int ipoin) const { return lpoints[ipoin]; }
+
+	/// Global index of an element of the local mesh
+	a_int globalElem(const a_int ielem) const { return lelems[ielem]; }
+
+	/// Assembles a cell-wise multi-vector in global element order on rank 0
+	/** \param[in] local Values for the local elements of this rank
+	 * \param[out] global On rank 0, values for all elements of the global mesh; not touched
+	 *   on other ranks
+	 */
+	void gather(const MVector& local, MVector& global) const;
+};
+
+/// Communication of cell or face data across faces shared between subdomains
+/** The shared faces are grouped by neighbouring rank and sorted by the global indices of
+ * their points, so both sides of every face agree on where its data goes in the messages.
+ *
+ * Arrays of face data are indexed by boundary face; only the rows of shared faces are read
+ * or written. Only one exchange can be in progress at a time.
+ * All functions must be called outside OpenMP parallel regions, and by all ranks.
+ */
+class HaloExchange
+{
+	const UMesh2dh *const m;
+	std::vector<int> nbdranks;			///< Ranks of neighbouring subdomains
+	std::vector<a_int> nbdptr;			///< Start of the faces shared with each neighbour
+	std::vector<a_int> faces;			///< Local indices of shared faces, grouped by neighbour
+	mutable std::vector<a_real> sendbuf;
+	mutable std::vector<a_real> recvbuf;
+	mutable int ncomp;					///< Number of values per face in the current exchange
+#if HAVE_MPI==1
+	mutable std::vector<MPI_Request> requests;
+#endif
+
+	/// Packs data of the cell inside, or of the face itself, for each shared face and sends it
+	void begin(const a_real *const src, const bool cellwise, const int ncomps) const;
+
+public:
+	/// Finds the faces shared with other subdomains in a local mesh
+	/** \param[in] mesh Local mesh, after compute_face_data()
+	 * \param[in] dd The decomposition that the local mesh was extracted from
+	 */
+	HaloExchange(const UMesh2dh *const mesh, const DomainDecomposition& dd);
+
+	/// Number of faces shared with other subdomains
+	a_int numFaces() const { return (a_int)faces.size(); }
+
+	/// Index of the i-th shared face among the boundary faces of the local mesh
+	a_int face(const a_int i) const { return faces[i]; }
+
+	/// Starts sending the values of the cell inside each shared face
+	/** \param[in] cellvals Row-major array of ncomps values for each cell of the local mesh
+	 */
+	void beginCells(const a_real *const cellvals, const int ncomps) const
+	{
+		begin(cellvals, true, ncomps);
+	}
+
+	/// Starts sending the values at each shared face
+	/** \param[in] facevals Row-major array of ncomps values for each boundary face
+	 */
+	void beginFaces(const a_real *const facevals, const int ncomps) const
+	{
+		begin(facevals, false, ncomps);
+	}
+
+	/// Waits for the data sent by the neighbours and stores it in the rows of the shared faces
+	/** \param[out] ghostvals Row-major array of ncomps values for each boundary face
+	 */
+	void end(a_real *const ghostvals) const;
+
+	/// Stores, for each shared face, the values in the neighbouring subdomain's cell at that face
+	void exchangeCells(const a_real *const cellvals, const int ncomps,
+			a_real *const ghostvals) const
+	{
+		beginCells(cellvals, ncomps);
+		end(ghostvals);
+	}
+
+	/// Stores, for each shared face, the neighbouring subdomain's values at that face
+	void exchangeFaces(const a_real *const facevals, const int ncomps,
+			a_real *const ghostvals) const
+	{
+		beginFaces(facevals, ncomps);
+		end(ghostvals);
+	}
+};
+
+}
+#endif
@@ -0,0 +1,342 @@
+/** @file aperf.cpp
+ * @brief Implementation of the phase timer registry
+ * @author Aditya Kashi
+ */
+
+#include "aperf.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <linux/perf_event.h>
+#endif
+
+/// Cache line size used to estimate memory traffic from LLC misses
+#define PERF_CACHE_LINE_BYTES 64
+
+namespace acfd {
+namespace perf {
+
+bool Registry::enabled = false;
+bool Registry::usecounters = false;
+int Registry::nthreads = 1;
+PhaseRecord* Registry::records = nullptr;
+thread_local bool Registry::background = false;
+
+/// Counter file descriptors, FVENS_PERF_NCOUNTERS for each thread
+static int* counterfds = nullptr;
+
+static const char *const phasenames[NUM_PHASES] = {
+	"residual", "boundary_states", "gradients", "limiter", "flux", "timestep",
+	"jacobian", "flux_jacobian", "prec_setup", "prec_apply", "linear_solve", "krylov_vecops",
+	"output", "halo_exchange"
+};
+
+static inline int getThreadNum()
+{
+#ifdef _OPENMP
+	return omp_get_thread_num();
+#else
+	return 0;
+#endif
+}
+
+/// Whether the caller is inside a parallel region, even one with a single thread
+static inline bool inParallel()
+{
+#ifdef _OPENMP
+	return omp_get_level() > 0;
+#else
+	return false;
+#endif
+}
+
+/// Set once a measurement from a thread without a record has been reported
+static std::atomic<bool> warnedthread(false);
+
+#ifdef __linux__
+/// Opens a counter for the calling thread on any CPU
+static int openCounter(const unsigned int type, const unsigned long long config)
+{
+	struct perf_event_attr attr;
+	std::memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = config;
+	attr.disabled = 0;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+/** Counters are opened by each thread of the OpenMP team for itself, so that a timer
+ * started outside a parallel region can sum the counts of the whole team. This relies on
+ * the runtime re-using the same threads for later parallel regions, as common
+ * implementations do.
+ */
+void Registry::initialize()
+{
+	const char *const env = std::getenv("FVENS_PERF");
+	int level = 0;
+	if(env)
+		level = std::atoi(env);
+	initialize(level);
+}
+
+void Registry::initialize(const int level)
+{
+	if(records)
+		finalize();
+	enabled = (level >= 1);
+	usecounters = false;
+	if(!enabled)
+		return;
+
+#ifdef _OPENMP
+	nthreads = omp_get_max_threads();
+#else
+	nthreads = 1;
+#endif
+	// one record per thread, one for a background thread and one for the phase as a whole
+	records = new PhaseRecord[(nthreads+2)*NUM_PHASES];
+	reset();
+
+	if(level >= 2) {
+#ifdef __linux__
+		counterfds = new int[nthreads*FVENS_PERF_NCOUNTERS];
+		int nfailed = 0;
+#pragma omp parallel default(shared) reduction(+:nfailed)
+		{
+			const int ithr = getThreadNum();
+			counterfds[ithr*FVENS_PERF_NCOUNTERS+0]
+				= openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+			counterfds[ithr*FVENS_PERF_NCOUNTERS+1]
+				= openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+			for(int i = 0; i < FVENS_PERF_NCOUNTERS; i++)
+				if(counterfds[ithr*FVENS_PERF_NCOUNTERS+i] < 0)
+					nfailed++;
+		}
+		if(nfailed > 0) {
+			std::cout << "! perf::Registry: initialize(): Could not open hardware counters;"
+				<< " check /proc/sys/kernel/perf_event_paranoid. Recording times only.\n";
+			for(int i = 0; i < nthreads*FVENS_PERF_NCOUNTERS; i++)
+				if(counterfds[i] >= 0)
+					close(counterfds[i]);
+			delete [] counterfds;
+			counterfds = nullptr;
+		}
+		else
+			usecounters = true;
+#else
+		std::cout << "! perf::Registry: initialize(): Hardware counters are only available"
+			<< " on Linux. Recording times only.\n";
+#endif
+	}
+
+	std::cout << " perf::Registry: Phase timing enabled for " << nthreads << " thread(s)";
+	if(usecounters)
+		std::cout << ", with hardware counters";
+	std::cout << ".\n";
+}
+
+void Registry::finalize()
+{
+#ifdef __linux__
+	if(counterfds) {
+		for(int i = 0; i < nthreads*FVENS_PERF_NCOUNTERS; i++)
+			close(counterfds[i]);
+		delete [] counterfds;
+		counterfds = nullptr;
+	}
+#endif
+	delete [] records;
+	records = nullptr;
+	enabled = usecounters = false;
+}
+
+void Registry::reset()
+{
+	if(!records) return;
+	for(int i = 0; i < (nthreads+2)*NUM_PHASES; i++) {
+		records[i].wtime = 0;
+		records[i].ncalls = 0;
+		for(int j = 0; j < FVENS_PERF_NCOUNTERS; j++)
+			records[i].counters[j] = 0;
+	}
+}
+
+void Registry::readCounters(unsigned long long *const vals)
+{
+	for(int j = 0; j < FVENS_PERF_NCOUNTERS; j++)
+		vals[j] = 0;
+#ifdef __linux__
+	const bool inparallel = inParallel();
+	const int tstart = inparallel ? getThreadNum() : 0;
+	const int tend = inparallel ? tstart+1 : nthreads;
+	for(int ithr = tstart; ithr < tend; ithr++)
+		for(int j = 0; j < FVENS_PERF_NCOUNTERS; j++) {
+			unsigned long long val = 0;
+			if(read(counterfds[ithr*FVENS_PERF_NCOUNTERS+j], &val, sizeof(val)) == sizeof(val))
+				vals[j] += val;
+		}
+#endif
+}
+
+void Registry::record(const Phase phase, const double wtime,
+		const unsigned long long *const counts)
+{
+	int irec;
+	if(background)
+		irec = backgroundRecord(phase);
+	else if(inParallel()) {
+		const int ithr = getThreadNum();
+		if(ithr >= nthreads) {
+			if(!warnedthread.exchange(true))
+				std::cout << "! perf::Registry: record(): Thread " << ithr << " is beyond the "
+					<< nthreads << " thread(s) set up in initialize(); its timings are dropped.\n";
+			return;
+		}
+		irec = ithr*NUM_PHASES + phase;
+	}
+	else
+		irec = wholeRecord(phase);
+
+	PhaseRecord& rec = records[irec];
+	rec.wtime += wtime;
+	rec.ncalls++;
+	if(counts)
+		for(int j = 0; j < FVENS_PERF_NCOUNTERS; j++)
+			rec.counters[j] += counts[j];
+}
+
+/// Adds up two records
+static PhaseRecord addRecords(const PhaseRecord& a, const PhaseRecord& b)
+{
+	PhaseRecord tot;
+	tot.wtime = a.wtime + b.wtime;
+	tot.ncalls = a.ncalls + b.ncalls;
+	for(int j = 0; j < FVENS_PERF_NCOUNTERS; j++)
+		tot.counters[j] = a.counters[j] + b.counters[j];
+	return tot;
+}
+
+double Registry::phaseTime(const Phase phase)
+{
+	if(!records) return 0;
+	return records[wholeRecord(phase)].wtime + records[backgroundRecord(phase)].wtime;
+}
+
+unsigned long Registry::phaseCalls(const Phase phase)
+{
+	if(!records) return 0;
+	return records[wholeRecord(phase)].ncalls + records[backgroundRecord(phase)].ncalls;
+}
+
+const char* Registry::phaseName(const Phase phase)
+{
+	return phasenames[phase];
+}
+
+void Registry::printSummary(std::ostream& out)
+{
+	if(!enabled) return;
+	out << "\n perf::Registry: Phase timings (inclusive):\n";
+	out << "   " << std::setw(16) << std::left << "phase" << std::right
+		<< std::setw(12) << "calls" << std::setw(14) << "wall time (s)"
+		<< std::setw(16) << "max thread (s)";
+	if(usecounters)
+		out << std::setw(16) << "cycles" << std::setw(14) << "LLC misses"
+			<< std::setw(12) << "est. GB";
+	out << '\n';
+	for(int iph = 0; iph < NUM_PHASES; iph++)
+	{
+		const PhaseRecord tot = addRecords(records[wholeRecord((Phase)iph)],
+				records[backgroundRecord((Phase)iph)]);
+		if(tot.ncalls == 0) continue;
+		out << "   " << std::setw(16) << std::left << phasenames[iph] << std::right
+			<< std::setw(12) << tot.ncalls << std::setw(14) << tot.wtime;
+		bool perthread = false;
+		double maxtime = 0;
+		for(int ithr = 0; ithr < nthreads; ithr++) {
+			const PhaseRecord& rec = records[ithr*NUM_PHASES+iph];
+			if(rec.ncalls > 0) {
+				perthread = true;
+				maxtime = std::max(maxtime, rec.wtime);
+			}
+		}
+		if(perthread)
+			out << std::setw(16) << maxtime;
+		else
+			out << std::setw(16) << "-";
+		if(usecounters)
+			out << std::setw(16) << tot.counters[0] << std::setw(14) << tot.counters[1]
+				<< std::setw(12) << tot.counters[1]*(double)PERF_CACHE_LINE_BYTES*1e-9;
+		out << '\n';
+	}
+}
+
+void Registry::dump(const std::string prefix)
+{
+	if(!enabled) return;
+
+	std::ofstream csv(prefix+".perf.csv");
+	csv << "thread,phase,calls,wtime,cycles,llc_misses,est_bytes\n";
+	csv << std::setprecision(10);
+	for(int irow = 0; irow < nthreads+2; irow++)
+		for(int iph = 0; iph < NUM_PHASES; iph++) {
+			const PhaseRecord& rec = records[irow*NUM_PHASES+iph];
+			if(rec.ncalls == 0) continue;
+			if(irow < nthreads)
+				csv << irow;
+			else if(irow == nthreads)
+				csv << "background";
+			else
+				csv << "all";
+			csv << ',' << phasenames[iph] << ',' << rec.ncalls << ',' << rec.wtime << ','
+				<< rec.counters[0] << ',' << rec.counters[1] << ','
+				<< rec.counters[1]*PERF_CACHE_LINE_BYTES << '\n';
+		}
+	csv.close();
+
+	std::ofstream js(prefix+".perf.json");
+	js << std::setprecision(10);
+	js << "{\n  \"nthreads\": " << nthreads << ",\n  \"counters\": "
+		<< (usecounters ? "true" : "false") << ",\n  \"phases\": {\n";
+	bool first = true;
+	for(int iph = 0; iph < NUM_PHASES; iph++)
+	{
+		const PhaseRecord tot = addRecords(records[wholeRecord((Phase)iph)],
+				records[backgroundRecord((Phase)iph)]);
+		if(tot.ncalls == 0) continue;
+		if(!first) js << ",\n";
+		first = false;
+		js << "    \"" << phasenames[iph] << "\": {\"calls\": " << tot.ncalls
+			<< ", \"wtime\": " << tot.wtime << ", \"cycles\": " << tot.counters[0]
+			<< ", \"llc_misses\": " << tot.counters[1]
+			<< ", \"est_bytes\": " << tot.counters[1]*PERF_CACHE_LINE_BYTES
+			<< ", \"per_thread_wtime\": [";
+		for(int ithr = 0; ithr < nthreads; ithr++) {
+			js << records[ithr*NUM_PHASES+iph].wtime;
+			if(ithr < nthreads-1) js << ", ";
+		}
+		js << "], \"background_wtime\": " << records[backgroundRecord((Phase)iph)].wtime << "}";
+	}
+	js << "\n  }\n}\n";
+	js.close();
+
+	std::cout << " perf::Registry: Wrote " << prefix << ".perf.json and "
+		<< prefix << ".perf.csv\n";
+}
+
+}
+}
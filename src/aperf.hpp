@@ -0,0 +1,180 @@
+/** @file aperf.hpp
+ * @brief Lightweight per-phase timers and optional hardware counters for the solver loop
+ * @author Aditya Kashi
+ *
+ * Profiling is switched on at run time through the environment variable FVENS_PERF:
+ *   - unset or 0: disabled; a timer scope costs one load and one branch
+ *   - 1: wall-clock time and call count for each phase
+ *   - 2: as 1, plus Linux perf_event_open counters (cycles, LLC misses and an estimate
+ *     of the memory traffic as LLC misses times the cache-line size)
+ *
+ * Phases are inclusive; eg. the flux phase is also counted in the residual phase. When the
+ * residual and Jacobian are computed together, their shared face loop is a phase of its own,
+ * counted in neither the flux nor the Jacobian phase.
+ *
+ * A timer started outside a parallel region measures the wall time of the phase as a whole.
+ * Timers started inside parallel regions, around the share of the work done by each thread,
+ * make up the per-thread data, from which load imbalance can be seen. Only some kernels
+ * (face loops, Jacobian assembly, vector operations) are timed per thread.
+ */
+
+#ifndef __APERF_H
+#define __APERF_H 1
+
+#ifndef __ACONSTANTS_H
+#include "aconstants.hpp"
+#endif
+
+#include <chrono>
+
+namespace acfd {
+namespace perf {
+
+/// Instrumented phases of a run
+enum Phase {
+	RESIDUAL = 0,			///< Complete residual evaluation
+	BOUNDARY_STATES,		///< Computation of ghost/boundary states
+	GRADIENTS,				///< Gradient reconstruction
+	LIMITER,				///< Computation of (limited) face values
+	FLUX,					///< Face loop computing numerical fluxes
+	TIMESTEP,				///< Local time step computation
+	JACOBIAN,				///< Jacobian assembly
+	FLUX_JACOBIAN,			///< Face loop computing both fluxes and Jacobian blocks
+	PREC_SETUP,				///< Computation of preconditioners
+	PREC_APPLY,				///< Application of preconditioners
+	LINEAR_SOLVE,			///< Complete linear solves
+	KRYLOV_VECOPS,			///< Vector updates and dot products in Krylov solvers
+	OUTPUT,					///< Post-processing and file output
+	HALO_EXCHANGE,			///< Communication of ghost data between subdomains
+	NUM_PHASES
+};
+
+/// Number of hardware counters recorded when counters are requested
+#define FVENS_PERF_NCOUNTERS 2
+
+/// Accumulated data for one phase on one thread, or for the phase as a whole
+/** Records are stored thread-by-thread, so different threads only touch
+ * different stretches of memory.
+ */
+struct PhaseRecord
+{
+	double wtime;								///< Accumulated wall time in seconds
+	unsigned long ncalls;						///< Number of times the phase was entered
+	unsigned long long counters[FVENS_PERF_NCOUNTERS];	///< Cycles and LLC misses
+};
+
+/// Global registry of phase timings
+/** All functions are static; the registry is a process-wide singleton.
+ */
+class Registry
+{
+	static bool enabled;
+	static bool usecounters;
+	static int nthreads;
+	static PhaseRecord* records;
+
+	/// Whether the calling thread was started outside OpenMP, such as an output thread
+	static thread_local bool background;
+
+	/// Index of the record of a phase as a whole, timed outside parallel regions
+	static int wholeRecord(const Phase phase) { return (nthreads+1)*NUM_PHASES + phase; }
+
+	/// Index of the record of the background thread
+	static int backgroundRecord(const Phase phase) { return nthreads*NUM_PHASES + phase; }
+
+public:
+	/// Reads FVENS_PERF from the environment and allocates per-thread storage
+	/** Must be called from outside any parallel region, before the first timed phase.
+	 */
+	static void initialize();
+
+	/// Sets up the registry at a given level (0, 1 or 2; see the file documentation)
+	static void initialize(const int level);
+
+	/// Releases counters and storage
+	static void finalize();
+
+	/// Whether timing is active
+	static bool isEnabled() { return enabled; }
+
+	/// Whether hardware counters are active for the calling thread
+	static bool countersEnabled() { return usecounters && !background; }
+
+	/// Marks the calling thread as a background thread running alongside the OpenMP team
+	/** Its timings are kept in a record of their own, listed as `background' in the
+	 * per-thread data, and hardware counters are not read for it. Only one background thread
+	 * should record timings at a time, and not from inside parallel regions.
+	 */
+	static void setBackgroundThread() { background = true; }
+
+	/// Zeros all accumulated data
+	static void reset();
+
+	/// Reads the hardware counters; summed over the team if called outside a parallel region
+	static void readCounters(unsigned long long *const vals);
+
+	/// Adds a measurement to the appropriate record
+	/** Inside a parallel region, the measurement goes to the record of the calling thread;
+	 * outside, to the record of the phase as a whole (or of the background thread).
+	 */
+	static void record(const Phase phase, const double wtime,
+			const unsigned long long *const counts);
+
+	/// Wall time accumulated for a phase, not counting per-thread measurements
+	static double phaseTime(const Phase phase);
+
+	/// Number of times a phase has been entered, not counting per-thread measurements
+	static unsigned long phaseCalls(const Phase phase);
+
+	/// Name of a phase as it appears in the reports
+	static const char* phaseName(const Phase phase);
+
+	/// Prints a summary of phase timings, with the largest per-thread time where available
+	static void printSummary(std::ostream& out);
+
+	/// Writes per-thread and whole-phase data to <prefix>.perf.json and <prefix>.perf.csv
+	static void dump(const std::string prefix);
+};
+
+/// Times the enclosing scope and adds the measurement to the registry
+/** Usage: `perf::ScopedTimer tmr(perf::FLUX);` at the beginning of a block. To time the
+ * work of each thread, put a timer inside the parallel region, before a worksharing loop
+ * with a `nowait' clause, so that waiting for other threads is not counted.
+ */
+class ScopedTimer
+{
+	const Phase phase;
+	const bool on;
+	std::chrono::steady_clock::time_point start;
+	unsigned long long startcounts[FVENS_PERF_NCOUNTERS];
+
+public:
+	ScopedTimer(const Phase ph) : phase(ph), on(Registry::isEnabled())
+	{
+		if(on) {
+			if(Registry::countersEnabled())
+				Registry::readCounters(startcounts);
+			start = std::chrono::steady_clock::now();
+		}
+	}
+
+	~ScopedTimer()
+	{
+		if(on) {
+			const std::chrono::duration<double> dt = std::chrono::steady_clock::now()-start;
+			if(Registry::countersEnabled()) {
+				unsigned long long counts[FVENS_PERF_NCOUNTERS];
+				Registry::readCounters(counts);
+				for(int i = 0; i < FVENS_PERF_NCOUNTERS; i++)
+					counts[i] -= startcounts[i];
+				Registry::record(phase, dt.count(), counts);
+			}
+			else
+				Registry::record(phase, dt.count(), nullptr);
+		}
+	}
+};
+
+}
+}
+#endif
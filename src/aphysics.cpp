@@ -5,6 +5,7 @@
  */
 
 #include "aphysics.hpp"
+#include <algorithm>
 	
 namespace acfd {
 
@@ -45,4 +46,38 @@ void IdealGasPhysics::evaluate_normal_jacobian(const a_real *const u, const a_re
 	dfdu[15]= g*rhovn/u[0];
 }
 
+a_real IdealGasPhysics::getLowMachReferenceVelocity(const a_real *const u, const a_real vmin) const
+{
+	const a_real vmag2 = (u[1]*u[1] + u[2]*u[2])/(u[0]*u[0]);
+	const a_real p = (g-1.0)*(u[3] - 0.5*u[0]*vmag2);
+	const a_real c = std::sqrt(g*p/u[0]);
+	return std::min(std::max(std::sqrt(vmag2), vmin), c);
+}
+
+void IdealGasPhysics::getLowMachPreconditioner(const a_real *const u, const a_real ur,
+		a_real *const __restrict P, a_real *const __restrict Pinv) const
+{
+	const a_real vx = u[1]/u[0], vy = u[2]/u[0];
+	const a_real vmag2 = vx*vx + vy*vy;
+	const a_real p = (g-1.0)*(u[3] - 0.5*u[0]*vmag2);
+	const a_real c2 = g*p/u[0];
+	const a_real H = (u[3] + p)/u[0];
+
+	const a_real w[NVARS] = {1.0, vx, vy, H};
+	const a_real dpdu[NVARS] = {(g-1.0)*0.5*vmag2, -(g-1.0)*vx, -(g-1.0)*vy, g-1.0};
+
+	// by the Sherman-Morrison formula, using dpdu.w = c^2
+	const a_real k = 1.0/(ur*ur) - 1.0/c2;
+	const a_real kinv = (1.0 - ur*ur/c2)/c2;
+
+	for(int i = 0; i < NVARS; i++)
+		for(int j = 0; j < NVARS; j++) {
+			const a_real delta = i == j ? 1.0 : 0.0;
+			if(P)
+				P[i*NVARS+j] = delta + k*w[i]*dpdu[j];
+			if(Pinv)
+				Pinv[i*NVARS+j] = delta - kinv*w[i]*dpdu[j];
+		}
+}
+
 }
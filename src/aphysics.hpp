@@ -47,6 +47,48 @@ public:
 	void evaluate_normal_jacobian(const a_real *const u, const a_real* const n, 
 			a_real *const __restrict dfdu) const;
 
+	/// Reference velocity of low-Mach preconditioning at a state
+	/** This is the flow speed, but not less than a cut-off nor more than the speed of sound.
+	 * \param[in] u Conserved variables
+	 * \param[in] vmin The cut-off, which keeps the preconditioner bounded near stagnation points
+	 */
+	a_real getLowMachReferenceVelocity(const a_real *const u, const a_real vmin) const;
+
+	/// Computes the Weiss-Smith low-Mach preconditioning matrix in conserved variables
+	/** The preconditioner is the Jacobian of the conserved variables with respect to
+	 * (p, vx, vy, T) with \f$ \partial\rho/\partial p \f$ replaced by
+	 * \f$ 1/U_r^2 - \rho_T/(\rho c_p) \f$ (Weiss and Smith, AIAA J. 33(11), 1995),
+	 * transformed to conserved variables. For an ideal gas, this is the rank-one update
+	 * \f$ P = I + (1/U_r^2 - 1/c^2) w (\partial p/\partial u)^T \f$ of the identity, where
+	 * \f$ w = (1, v_x, v_y, H)^T \f$; it is the identity when \f$ U_r = c \f$.
+	 * \param[in] u Conserved variables
+	 * \param[in] ur Reference velocity, see \ref getLowMachReferenceVelocity
+	 * \param[out] P The preconditioning matrix stored row-major, if not null
+	 * \param[out] Pinv Its inverse stored row-major, if not null
+	 */
+	void getLowMachPreconditioner(const a_real *const u, const a_real ur,
+			a_real *const P, a_real *const Pinv) const;
+
+	/// Eigenvalues of the preconditioned flux Jacobian \f$ P^{-1} \partial f/\partial u \f$
+	/** These are the normal velocity (twice), and \f$ v_n' \pm c' \f$ with
+	 * \f$ v_n' = v_n (1-\alpha) \f$, \f$ c' = \sqrt{\alpha^2 v_n^2 + U_r^2} \f$ and
+	 * \f$ \alpha = (1 - U_r^2/c^2)/2 \f$.
+	 * \param[in] vn Normal velocity
+	 * \param[in] c Speed of sound
+	 * \param[in] ur Reference velocity
+	 * \param[out] lminus The smaller acoustic eigenvalue
+	 * \param[out] lplus The larger acoustic eigenvalue
+	 */
+	static void getLowMachEigenvalues(const a_real vn, const a_real c, const a_real ur,
+			a_real& lminus, a_real& lplus)
+	{
+		const a_real alpha = 0.5*(1.0 - ur*ur/(c*c));
+		const a_real vnp = vn*(1.0-alpha);
+		const a_real cp = std::sqrt(alpha*alpha*vn*vn + ur*ur);
+		lminus = vnp - cp;
+		lplus = vnp + cp;
+	}
+
 	/// Convert conserved variables to primitive variables (density, velocities, pressure)
 	/*void convertConservedToPrimitive(const a_real *const uc, a_real *const up);
 
@@ -0,0 +1,150 @@
+/**
+ * @file araggedarray.hpp
+ * @brief Compact storage for arrays whose rows have different lengths, such as element
+ * connectivity of hybrid meshes.
+ *
+ * Part of FVENS.
+ * @author Aditya Kashi
+ */
+
+#ifndef __ARAGGEDARRAY_H
+#define __ARAGGEDARRAY_H 1
+
+#ifndef __ACONSTANTS_H
+#include <aconstants.hpp>
+#endif
+
+#ifndef __AMEMORY_H
+#include "amemory.hpp"
+#endif
+
+#include <memory>
+
+namespace amat {
+
+using acfd::a_int;
+
+/// Positions of the rows of a ragged array in its contiguous storage
+/** If all rows have the same length, no offsets are stored and the start of row i is i times
+ * the row length. Otherwise the start of each row is stored, in compressed-row (CSR) form.
+ * Both cases are handled without branches: in the uniform case, stride is the row length,
+ * mask is zero and ptr = {0}; otherwise, stride is zero and mask has all bits set.
+ *
+ * A layout never changes after it is built, so arrays with the same row lengths (eg. the
+ * element-surrounding-element and element-face arrays of a mesh) share one layout.
+ */
+class RaggedLayout
+{
+	a_int nrows;
+	a_int stride;
+	a_int mask;
+	int maxrow;
+	std::vector<a_int, acfd::memory::Allocator<a_int>> ptr;
+
+public:
+	/// Uniform layout of nr rows of length rowsize
+	RaggedLayout(const a_int nr, const int rowsize)
+		: nrows(nr), stride(rowsize), mask(0), maxrow(rowsize), ptr(1,0)
+	{ }
+
+	/// Layout with the given row lengths; uniform if all lengths are equal
+	RaggedLayout(const a_int nr, const int *const rowsizes)
+		: nrows(nr), stride(0), mask(0), maxrow(0), ptr(1,0)
+	{
+		bool uniform = true;
+		for(a_int i = 0; i < nr; i++) {
+			if(rowsizes[i] != rowsizes[0]) uniform = false;
+			if(rowsizes[i] > maxrow) maxrow = rowsizes[i];
+		}
+		if(nr == 0 || uniform) {
+			stride = nr > 0 ? rowsizes[0] : 0;
+			return;
+		}
+
+		mask = ~(a_int)0;
+		ptr.resize(nr+1);
+		ptr[0] = 0;
+		for(a_int i = 0; i < nr; i++)
+			ptr[i+1] = ptr[i] + rowsizes[i];
+	}
+
+	a_int rows() const { return nrows; }
+
+	/// Whether all rows have the same length
+	bool uniform() const { return mask == 0; }
+
+	/// Length of the longest row
+	int maxRowSize() const { return maxrow; }
+
+	/// Position of the first entry of row i
+	a_int start(const a_int i) const { return i*stride + ptr[i & mask]; }
+
+	/// Length of row i
+	int rowSize(const a_int i) const { return (int)(stride + ptr[(i+1) & mask] - ptr[i & mask]); }
+
+	/// Total number of entries
+	a_int total() const { return start(nrows); }
+
+	/// Memory used by the offsets in bytes
+	size_t bytes() const { return ptr.capacity()*sizeof(a_int); }
+};
+
+/// A two-dimensional array whose rows can have different lengths, stored contiguously
+/** Copies share the layout but not the data.
+ * The entries are allocated through acfd::memory, so large arrays are first touched by all
+ * threads.
+ */
+template <class T>
+class RaggedArray
+{
+	std::shared_ptr<const RaggedLayout> layout;
+	std::vector<T, acfd::memory::Allocator<T>> data;
+
+public:
+	RaggedArray() { }
+
+	/// Allocates storage for a layout; the entries are value-initialized
+	void setup(const std::shared_ptr<const RaggedLayout>& lay)
+	{
+		layout = lay;
+		data.assign(lay->total(), T());
+	}
+
+	/// The layout, for setting up other arrays with the same row lengths
+	const std::shared_ptr<const RaggedLayout>& getLayout() const { return layout; }
+
+	a_int rows() const { return layout ? layout->rows() : 0; }
+	int rowSize(const a_int i) const { return layout->rowSize(i); }
+
+	T get(const a_int i, const int j) const
+	{
+#ifdef DEBUG
+		if(i >= layout->rows() || j >= layout->rowSize(i) || i < 0 || j < 0) {
+			std::cout << "! RaggedArray: get(): Index out of range!\n";
+			return data[0];
+		}
+#endif
+		return data[layout->start(i)+j];
+	}
+
+	T& operator()(const a_int i, const int j)
+	{
+#ifdef DEBUG
+		if(i >= layout->rows() || j >= layout->rowSize(i) || i < 0 || j < 0) {
+			std::cout << "! RaggedArray: (): Index out of range!\n";
+			return data[0];
+		}
+#endif
+		return data[layout->start(i)+j];
+	}
+
+	/// Pointer to the first entry of row i
+	const T* row(const a_int i) const { return &data[layout->start(i)]; }
+
+	/// Memory used by the entries in bytes, not counting the layout
+	size_t bytes() const { return data.capacity()*sizeof(T); }
+};
+
+} //end namespace amat
+
+#endif
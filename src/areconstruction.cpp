@@ -297,5 +297,8 @@ template class WeightedLeastSquaresReconstruction<NVARS>;
 template class ConstantReconstruction<1>;
 template class GreenGaussReconstruction<1>;
 template class WeightedLeastSquaresReconstruction<1>;
+template class ConstantReconstruction<NVARS*NENSEMBLE>;
+template class GreenGaussReconstruction<NVARS*NENSEMBLE>;
+template class WeightedLeastSquaresReconstruction<NVARS*NENSEMBLE>;
 
 } // end namespace
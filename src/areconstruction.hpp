@@ -36,6 +36,9 @@ public:
 	virtual void compute_gradients(const Matrix<a_real,Dynamic,Dynamic,RowMajor>*const unk, 
 			const amat::Array2d<a_real>*const unkg, 
 			amat::Array2d<a_real>*const gradx, amat::Array2d<a_real>*const grady) = 0;
+
+	/// Memory used by the data of the reconstruction in bytes
+	virtual size_t bytes() const { return 0; }
 };
 
 /// Simply sets the gradient to zero
@@ -87,6 +90,10 @@ public:
 	void compute_gradients(const Matrix<a_real,Dynamic,Dynamic,RowMajor> *const unk, 
 			const amat::Array2d<a_real>*const unkg, 
 			amat::Array2d<a_real>*const gradx, amat::Array2d<a_real>*const grady);
+
+	size_t bytes() const {
+		return V.capacity()*sizeof(Matrix<a_real,2,2>) + f.capacity()*sizeof(Matrix<a_real,2,nvars>);
+	}
 };
 
 
@@ -6,11 +6,14 @@
 
 #include "aspatial.hpp"
 #include "alinalg.hpp"
+#include "aperf.hpp"
+#include <Eigen/LU>
 
 namespace acfd {
 
 template<short nvars>
-Spatial<nvars>::Spatial(const UMesh2dh *const mesh) : m(mesh), eps{sqrt(ZERO_TOL)/10.0}
+Spatial<nvars>::Spatial(const UMesh2dh *const mesh, const HaloExchange *const haloexchange)
+	: m(mesh), halo(haloexchange), eps{sqrt(ZERO_TOL)/10.0}
 {
 	rc.setup(m->gnelem(),m->gndim());
 	rcg.setup(m->gnbface(),m->gndim());
@@ -36,6 +39,9 @@ Spatial<nvars>::Spatial(const UMesh2dh *const mesh) : m(mesh), eps{sqrt(ZERO_TOL
 	compute_ghost_cell_coords_about_midpoint();
 	//compute_ghost_cell_coords_about_face();
 
+	if(halo)
+		halo->exchangeCells(&rc(0,0), NDIM, &rcg(0,0));
+
 	//Calculate and store coordinates of Gauss points
 	// Gauss points are uniformly distributed along the face.
 	for(a_int ied = 0; ied < m->gnaface(); ied++)
@@ -58,6 +64,13 @@ Spatial<nvars>::~Spatial()
 	delete [] gr;
 }
 
+template<short nvars>
+void Spatial<nvars>::reportMemory(memory::Report& report, const std::string& name) const
+{
+	report.add(name, "cell centres", rc.bytes() + rcg.bytes());
+	report.add(name, "Gauss points", m->gnaface()*(sizeof(amat::Array2d<a_real>) + gr[0].bytes()));
+}
+
 template<short nvars>
 void Spatial<nvars>::compute_ghost_cell_coords_about_midpoint()
 {
@@ -135,8 +148,7 @@ void Spatial<nvars>::compute_jac_vec(const MVector& resu, const MVector& u,
 	axpbypcz(N, 0.0,aux.data(), 1.0,u.data(), eps/vnorm,v.data());
 	
 	// compute residual at the perturbed state and store in the output variable prod
-	amat::Array2d<a_real> _dtm;		// dummy
-	compute_residual(aux, prod, false, _dtm);
+	compute_residual(aux, prod, false, nodtm);
 	
 	// compute the Jacobian vector product
 #pragma omp parallel for simd default(shared)
@@ -144,7 +156,18 @@ void Spatial<nvars>::compute_jac_vec(const MVector& resu, const MVector& u,
 		prod.data()[i] = (prod.data()[i] - resu.data()[i]) / (eps/vnorm);
 
 	// add time term to the output vector if necessary
-	if(add_time_deriv) {
+	if(add_time_deriv && preconditionedPseudoTime()) {
+#pragma omp parallel for default(shared)
+		for(a_int iel = 0; iel < m->gnelem(); iel++)
+		{
+			a_real P[nvars*nvars];
+			get_pseudotime_preconditioner(&u(iel,0), P, nullptr);
+			for(int ivar = 0; ivar < nvars; ivar++)
+				for(int jvar = 0; jvar < nvars; jvar++)
+					prod(iel,ivar) += m->garea(iel)/dtm(iel)*P[ivar*nvars+jvar]*v(iel,jvar);
+		}
+	}
+	else if(add_time_deriv) {
 #pragma omp parallel for simd default(shared)
 		for(a_int iel = 0; iel < m->gnelem(); iel++)
 			for(int ivar = 0; ivar < nvars; ivar++)
@@ -169,8 +192,7 @@ void Spatial<nvars>::compute_jac_gemv(const a_real a, const MVector& resu,
 	axpbypcz(N, 0.0,aux.data(), 1.0,u.data(), eps/vnorm,v.data());
 	
 	// compute residual at the perturbed state and store in the output variable prod
-	amat::Array2d<a_real> _dtm;		// dummy
-	compute_residual(aux, prod, false, _dtm);
+	compute_residual(aux, prod, false, nodtm);
 	
 	// compute the Jacobian vector product and vector add
 #pragma omp parallel for simd default(shared)
@@ -178,7 +200,18 @@ void Spatial<nvars>::compute_jac_gemv(const a_real a, const MVector& resu,
 		prod.data()[i] = a*(prod.data()[i] - resu.data()[i]) / (eps/vnorm) + b*w.data()[i];
 
 	// add time term to the output vector if necessary
-	if(add_time_deriv) {
+	if(add_time_deriv && preconditionedPseudoTime()) {
+#pragma omp parallel for default(shared)
+		for(a_int iel = 0; iel < m->gnelem(); iel++)
+		{
+			a_real P[nvars*nvars];
+			get_pseudotime_preconditioner(&u(iel,0), P, nullptr);
+			for(int ivar = 0; ivar < nvars; ivar++)
+				for(int jvar = 0; jvar < nvars; jvar++)
+					prod(iel,ivar) += a*m->garea(iel)/dtm(iel)*P[ivar*nvars+jvar]*v(iel,jvar);
+		}
+	}
+	else if(add_time_deriv) {
 #pragma omp parallel for simd default(shared)
 		for(a_int iel = 0; iel < m->gnelem(); iel++)
 			for(int ivar = 0; ivar < nvars; ivar++)
@@ -186,6 +219,16 @@ void Spatial<nvars>::compute_jac_gemv(const a_real a, const MVector& resu,
 	}
 }
 
+template <short nvars>
+void Spatial<nvars>::compute_residual_and_jacobian(const MVector& u, 
+		MVector& __restrict residual, 
+		const bool gettimesteps, amat::Array2d<a_real>& __restrict dtm,
+		LinearOperator<a_real,a_int> *const A)
+{
+	compute_residual(u, residual, gettimesteps, dtm);
+	compute_jacobian(u, A);
+}
+
 /** Solution for supersonic vortex case given by Krivodonova and Berger.
  * Lilia Krivodonova and Marsha Berger, "High-order accurate implementation of 
  * solid wall boundary conditions in curved geometries",
@@ -215,22 +258,20 @@ void get_supersonicvortex_initial_velocity(const a_real vmag, const a_real x, co
 /** The adiabatic index is set to 1.4 here.
  */
 EulerFV::EulerFV(const UMesh2dh *const mesh, 
-		std::string invflux, std::string jacflux, std::string reconst, std::string limiter)
-	: Spatial<NVARS>(mesh), g(1.4), physics(g)
+		std::string invflux, std::string jacflux, std::string reconst, std::string limiter,
+		const HaloExchange *const haloexchange)
+	: Spatial<NVARS>(mesh, haloexchange), g(1.4), physics(g)
 {
 	/// \todo TODO: Take the boundary flags below as input from control file
 	solid_wall_id = 2;
 	inflow_outflow_id = 4;
 	supersonic_vortex_case_inflow = 10;
+	momentref_x = 0.25;
 
 	// allocation
 	uinf.setup(1, NVARS);
-	integ.setup(m->gnelem(), 1);
-	dudx.setup(m->gnelem(), NVARS);
-	dudy.setup(m->gnelem(), NVARS);
-	ug.setup(m->gnbface(),NVARS);
-	uleft.setup(m->gnaface(), NVARS);
-	uright.setup(m->gnaface(), NVARS);
+	if(halo)
+		uhalo.setup(m->gnbface(),NVARS);
 
 	// set inviscid flux scheme
 	if(invflux == "VANLEER") {
@@ -315,7 +356,7 @@ EulerFV::EulerFV(const UMesh2dh *const mesh,
 	// set limiter
 	if(limiter == "NONE")
 	{
-		lim = new NoLimiter(m, &rcg, &rc, gr);
+		lim = new NoLimiter<NVARS>(m, &rcg, &rc, gr);
 		std::cout << "  EulerFV: No limiter will be used." << std::endl;
 	}
 	else if(limiter == "WENO")
@@ -325,7 +366,7 @@ EulerFV::EulerFV(const UMesh2dh *const mesh,
 	}
 	else if(limiter == "VANALBADA")
 	{
-		lim = new VanAlbadaLimiter(m, &rcg, &rc, gr);
+		lim = new VanAlbadaLimiter<NVARS>(m, &rcg, &rc, gr);
 		std::cout << "  EulerFV: Van Albada limiter selected.\n";
 	}
 	else if(limiter == "BARTHJESPERSEN")
@@ -338,6 +379,11 @@ EulerFV::EulerFV(const UMesh2dh *const mesh,
 		lim = new VenkatakrishnanLimiter(m, &rcg, &rc, gr, 5.75);
 		std::cout << "  EulerFV: Venkatakrishnan limiter selected.\n";
 	}
+
+	exactJacobian = !secondOrderRequested && invflux == jacflux;
+	lowmachvmin = 0;
+
+	allocateWorkspace();
 }
 
 EulerFV::~EulerFV()
@@ -394,8 +440,131 @@ void EulerFV::loaddata(const short inittype, const a_real Minf, const a_real vin
 #endif
 }
 
+void EulerFV::setLowMachPreconditioning(const a_real factor)
+{
+	// uinf is non-dimensionalized by the free-stream density and speed
+	const a_real vinf = std::sqrt(uinf(0,1)*uinf(0,1) + uinf(0,2)*uinf(0,2))/uinf(0,0);
+	lowmachvmin = factor > 0 ? factor*vinf : 0;
+	inviflux->setLowMachPreconditioning(lowmachvmin);
+	jflux->setLowMachPreconditioning(lowmachvmin);
+}
+
+void EulerFV::get_pseudotime_preconditioner(const a_real *const u, a_real *const P,
+		a_real *const Pinv) const
+{
+	if(lowmachvmin <= 0) {
+		Spatial<NVARS>::get_pseudotime_preconditioner(u, P, Pinv);
+		return;
+	}
+	physics.getLowMachPreconditioner(u, physics.getLowMachReferenceVelocity(u, lowmachvmin),
+			P, Pinv);
+}
+
+bool EulerFV::compute_lusgs_diagonal(const MVector& u, const amat::Array2d<a_real>& dtm,
+		a_real *const Dinv, a_real *const facerad)
+{
+	// spectral radii at faces
+#pragma omp parallel for default(shared)
+	for(a_int iface = 0; iface < m->gnaface(); iface++)
+	{
+		const a_int lelem = m->gintfac(iface,0);
+		const a_int relem = m->gintfac(iface,1);
+		const a_real n[NDIM] = {m->ggallfa(iface,0), m->ggallfa(iface,1)};
+
+		const a_real pi = (g-1)*(u(lelem,3) - 0.5*(u(lelem,1)*u(lelem,1)
+					+ u(lelem,2)*u(lelem,2))/u(lelem,0));
+		const a_real vni = (u(lelem,1)*n[0] + u(lelem,2)*n[1])/u(lelem,0);
+		a_real rad = std::fabs(vni) + std::sqrt(g*pi/u(lelem,0));
+
+		if(iface >= m->gnbface()) {
+			const a_real pj = (g-1)*(u(relem,3) - 0.5*(u(relem,1)*u(relem,1)
+						+ u(relem,2)*u(relem,2))/u(relem,0));
+			const a_real vnj = (u(relem,1)*n[0] + u(relem,2)*n[1])/u(relem,0);
+			rad = std::max(rad, std::fabs(vnj) + std::sqrt(g*pj/u(relem,0)));
+		}
+
+		facerad[iface] = 0.5*rad*m->ggallfa(iface,2);
+	}
+
+	// diagonal blocks
+#pragma omp parallel for default(shared)
+	for(a_int iel = 0; iel < m->gnelem(); iel++)
+	{
+		Eigen::Map<Matrix<a_real,NVARS,NVARS,RowMajor>> Di(Dinv + iel*NVARS*NVARS);
+		a_real rad = 0;
+		for(int ifael = 0; ifael < m->gnfael(iel); ifael++)
+			rad += facerad[m->gelemface(iel,ifael)];
+
+		if(lowmachvmin > 0) {
+			Matrix<a_real,NVARS,NVARS,RowMajor> db;
+			get_pseudotime_preconditioner(&u(iel,0), db.data(), nullptr);
+			db *= m->garea(iel)/dtm(iel);
+			db.diagonal().array() += rad;
+			Di = db.inverse();
+		}
+		else
+			Di = Matrix<a_real,NVARS,NVARS,RowMajor>::Identity() / (m->garea(iel)/dtm(iel) + rad);
+	}
+
+	return true;
+}
+
+void EulerFV::apply_lusgs(const MVector& u, const a_real *const Dinv,
+		const a_real *const facerad, const a_real *const rr,
+		a_real *const __restrict yy, a_real *const __restrict zz) const
+{
+	Eigen::Map<const MVector> r(rr, m->gnelem(), NVARS);
+	Eigen::Map<MVector> y(yy, m->gnelem(), NVARS);
+	Eigen::Map<MVector> z(zz, m->gnelem(), NVARS);
+	const a_int chunk = 200;
+
+	/* Computes the product of the off-diagonal blocks of cell iel with the vector v, for
+	 * neighbours whose index is less than iel if lower is true and greater otherwise.
+	 */
+	auto offdiagProduct = [&](const a_int iel, const a_real *const v, const bool lower)
+	{
+		Matrix<a_real,NVARS,1> inter = Matrix<a_real,NVARS,1>::Zero();
+		for(int ifael = 0; ifael < m->gnfael(iel); ifael++)
+		{
+			const a_int nbdelem = m->gesuel(iel,ifael);
+			if(nbdelem >= m->gnelem() || nbdelem < 0 || (lower != (nbdelem < iel)))
+				continue;
+
+			const a_int face = m->gelemface(iel,ifael);
+			// normal pointing out of iel
+			const a_real sign = m->gintfac(face,0) == iel ? 1.0 : -1.0;
+			const a_real n[NDIM] = {sign*m->ggallfa(face,0), sign*m->ggallfa(face,1)};
+
+			Eigen::Map<const Matrix<a_real,NVARS,1>> vj(v + nbdelem*NVARS);
+			Matrix<a_real,NVARS,NVARS,RowMajor> A;
+			physics.evaluate_normal_jacobian(&u(nbdelem,0), n, A.data());
+			inter += 0.5*m->ggallfa(face,2)*(A*vj) - facerad[face]*vj;
+		}
+		return inter;
+	};
+
+	// forward sweep (D+L)y = r
+#pragma omp parallel for default(shared) schedule(dynamic, chunk)
+	for(a_int iel = 0; iel < m->gnelem(); iel++)
+	{
+		Eigen::Map<const Matrix<a_real,NVARS,NVARS,RowMajor>> Di(Dinv + iel*NVARS*NVARS);
+		const Matrix<a_real,NVARS,1> inter = offdiagProduct(iel, yy, true);
+		y.row(iel).noalias() = (Di*(r.row(iel).transpose() - inter)).transpose();
+	}
+
+	// backward sweep (D+U)z = Dy
+#pragma omp parallel for default(shared) schedule(dynamic, chunk)
+	for(a_int iel = m->gnelem()-1; iel >= 0; iel--)
+	{
+		Eigen::Map<const Matrix<a_real,NVARS,NVARS,RowMajor>> Di(Dinv + iel*NVARS*NVARS);
+		const Matrix<a_real,NVARS,1> inter = offdiagProduct(iel, zz, false);
+		z.row(iel).noalias() = y.row(iel) - (Di*inter).transpose();
+	}
+}
+
 void EulerFV::compute_boundary_states(const amat::Array2d<a_real>& ins, amat::Array2d<a_real>& bs)
 {
+	perf::ScopedTimer tmr(perf::BOUNDARY_STATES);
 #pragma omp parallel for default(shared)
 	for(a_int ied = 0; ied < m->gnbface(); ied++)
 	{
@@ -417,7 +586,7 @@ void EulerFV::compute_boundary_state(const int ied, const a_real *const ins, a_r
 	a_real vninf = (uinf(0,1)*nx + uinf(0,2)*ny)/uinf(0,0);
 	a_real Mninf = vninf/cinf;*/
 
-	if(m->ggallfa(ied,3) == solid_wall_id)
+	if(m->gbfacetag(ied,0) == solid_wall_id)
 	{
 		bs[0] = ins[0];
 		bs[1] = ins[1] - 2*vni*nx*bs[0];
@@ -431,7 +600,7 @@ void EulerFV::compute_boundary_state(const int ied, const a_real *const ins, a_r
 	 * Commented below: Kind of according to FUN3D BCs paper
 	 * TODO: \todo Instead, the Mach number based on the Riemann solution state should be used.
 	 */
-	if(m->ggallfa(ied,3) == inflow_outflow_id)
+	if(m->gbfacetag(ied,0) == inflow_outflow_id)
 	{
 		/*if(Mni <= 0)
 		{*/
@@ -478,7 +647,12 @@ void EulerFV::compute_boundary_state(const int ied, const a_real *const ins, a_r
 				bs(ied,i) = ins.get(ied,i);*/
 	}
 	
-	if(m->ggallfa(ied,3) == supersonic_vortex_case_inflow) {
+	if(m->gbfacetag(ied,0) == DomainDecomposition::halo_boundary_tag) {
+		for(short i = 0; i < NVARS; i++)
+			bs[i] = uhalo(ied,i);
+	}
+	
+	if(m->gbfacetag(ied,0) == supersonic_vortex_case_inflow) {
 		// y-coordinate of face center
 		a_real r = 0.5*(m->gcoords(m->gintfac(ied,2),1) + m->gcoords(m->gintfac(ied,3),1));
 		a_real ri = 1.0, Mi = 2.25, rhoi = 1.0;
@@ -486,9 +660,49 @@ void EulerFV::compute_boundary_state(const int ied, const a_real *const ins, a_r
 	}
 }
 
-void EulerFV::compute_residual(const MVector& u, MVector& __restrict residual, 
-		const bool gettimesteps, amat::Array2d<a_real>& __restrict dtm)
+void EulerFV::allocateWorkspace()
+{
+	if(uleft.msize() > 0)
+		return;
+	integ.setup(m->gnelem(), 1);
+	if(secondOrderRequested) {
+		dudx.setup(m->gnelem(), NVARS);
+		dudy.setup(m->gnelem(), NVARS);
+	}
+	ug.setup(m->gnbface(),NVARS);
+	uleft.setup(m->gnaface(), NVARS);
+	uright.setup(m->gnaface(), NVARS);
+}
+
+void EulerFV::releaseWorkspace()
+{
+	integ.clear();
+	dudx.clear();
+	dudy.clear();
+	ug.clear();
+	uleft.clear();
+	uright.clear();
+}
+
+void EulerFV::reportMemory(memory::Report& report, const std::string& name) const
+{
+	Spatial<NVARS>::reportMemory(report, name);
+	report.add(name, "face states", uleft.bytes() + uright.bytes());
+	report.add(name, "ghost states", ug.bytes() + uhalo.bytes());
+	report.add(name, "gradients", dudx.bytes() + dudy.bytes());
+	report.add(name, "integrated spectral radii", integ.bytes());
+	report.add(name, "reconstruction", rec->bytes());
+	report.add(name, "limiter", lim->bytes());
+}
+
+void EulerFV::compute_face_states(const MVector& u)
 {
+	allocateWorkspace();
+
+	// states of neighbouring subdomains' cells serve as ghost states
+	if(halo)
+		halo->exchangeCells(u.data(), NVARS, &uhalo(0,0));
+
 #pragma omp parallel default(shared)
 	{
 #pragma omp for simd
@@ -512,8 +726,14 @@ void EulerFV::compute_residual(const MVector& u, MVector& __restrict residual,
 		// get cell average values at ghost cells using BCs
 		compute_boundary_states(uleft, ug);
 
-		rec->compute_gradients(&u, &ug, &dudx, &dudy);
-		lim->compute_face_values(u, ug, dudx, dudy, uleft, uright);
+		{
+			perf::ScopedTimer tmr(perf::GRADIENTS);
+			rec->compute_gradients(&u, &ug, &dudx, &dudy);
+		}
+		{
+			perf::ScopedTimer tmr(perf::LIMITER);
+			lim->compute_face_values(u, ug, dudx, dudy, uleft, uright);
+		}
 	}
 	else
 	{
@@ -536,6 +756,70 @@ void EulerFV::compute_residual(const MVector& u, MVector& __restrict residual,
 	// set right (ghost) state for boundary faces
 	compute_boundary_states(uleft,uright);
 
+	/* Across faces shared with other subdomains, the right state is the neighbour's
+	 * reconstructed left state, which carries its (limited) gradients.
+	 */
+	if(halo && secondOrderRequested)
+		halo->exchangeFaces(&uleft(0,0), NVARS, &uright(0,0));
+}
+
+void EulerFV::compute_timesteps(amat::Array2d<a_real>& __restrict dtm)
+{
+	perf::ScopedTimer tmr(perf::TIMESTEP);
+#pragma omp parallel for simd default(shared)
+	for(a_int iel = 0; iel < m->gnelem(); iel++)
+	{
+		dtm(iel) = m->garea(iel)/integ(iel);
+	}
+}
+
+void EulerFV::add_face_flux(const a_int ied, const a_real *const n, const a_real len,
+		a_real *const fluxes, MVector& __restrict residual)
+{
+	const a_int lelem = m->gintfac(ied,0);
+	const a_int relem = m->gintfac(ied,1);
+
+	// integrate over the face
+	for(short ivar = 0; ivar < NVARS; ivar++)
+			fluxes[ivar] *= len;
+
+	//calculate presures from u
+	const a_real pi = (g-1)*(uleft(ied,3) 
+			- 0.5*(pow(uleft(ied,1),2)+pow(uleft(ied,2),2))/uleft(ied,0));
+	const a_real pj = (g-1)*(uright(ied,3) 
+			- 0.5*(pow(uright(ied,1),2)+pow(uright(ied,2),2))/uright(ied,0));
+	//calculate speeds of sound
+	const a_real ci = sqrt(g*pi/uleft(ied,0));
+	const a_real cj = sqrt(g*pj/uright(ied,0));
+	//calculate normal velocities
+	const a_real vni = (uleft(ied,1)*n[0] +uleft(ied,2)*n[1])/uleft(ied,0);
+	const a_real vnj = (uright(ied,1)*n[0] + uright(ied,2)*n[1])/uright(ied,0);
+
+	for(int ivar = 0; ivar < NVARS; ivar++) {
+#pragma omp atomic
+		residual(lelem,ivar) += fluxes[ivar];
+	}
+	if(relem < m->gnelem()) {
+		for(int ivar = 0; ivar < NVARS; ivar++) {
+#pragma omp atomic
+			residual(relem,ivar) -= fluxes[ivar];
+		}
+	}
+#pragma omp atomic
+	integ(lelem) += spectralRadius(&uleft(ied,0), vni, ci)*len;
+	if(relem < m->gnelem()) {
+#pragma omp atomic
+		integ(relem) += spectralRadius(&uright(ied,0), vnj, cj)*len;
+	}
+}
+
+void EulerFV::compute_residual(const MVector& u, MVector& __restrict residual, 
+		const bool gettimesteps, amat::Array2d<a_real>& __restrict dtm)
+{
+	perf::ScopedTimer rtmr(perf::RESIDUAL);
+
+	compute_face_states(u);
+
 	/** Compute fluxes.
 	 * The integral of the maximum magnitude of eigenvalue over each face is also computed:
 	 * \f[
@@ -544,63 +828,29 @@ void EulerFV::compute_residual(const MVector& u, MVector& __restrict residual,
 	 * so that time steps can be calculated for explicit time stepping.
 	 */
 
-#pragma omp parallel default(shared)
 	{
-#pragma omp for
-		for(a_int ied = 0; ied < m->gnaface(); ied++)
+		perf::ScopedTimer tmr(perf::FLUX);
+#pragma omp parallel default(shared)
 		{
-			a_real n[NDIM];
-			n[0] = m->ggallfa(ied,0);
-			n[1] = m->ggallfa(ied,1);
-			a_real len = m->ggallfa(ied,2);
-			const int lelem = m->gintfac(ied,0);
-			const int relem = m->gintfac(ied,1);
-			a_real fluxes[NVARS];
+			perf::ScopedTimer ttmr(perf::FLUX);
+#pragma omp for nowait
+			for(a_int ied = 0; ied < m->gnaface(); ied++)
+			{
+				a_real n[NDIM];
+				n[0] = m->ggallfa(ied,0);
+				n[1] = m->ggallfa(ied,1);
+				a_real len = m->ggallfa(ied,2);
+				a_real fluxes[NVARS];
 
-			inviflux->get_flux(&uleft(ied,0), &uright(ied,0), n, fluxes);
+				inviflux->get_flux(&uleft(ied,0), &uright(ied,0), n, fluxes);
 
-			// integrate over the face
-			for(short ivar = 0; ivar < NVARS; ivar++)
-					fluxes[ivar] *= len;
-
-			//calculate presures from u
-			const a_real pi = (g-1)*(uleft(ied,3) 
-					- 0.5*(pow(uleft(ied,1),2)+pow(uleft(ied,2),2))/uleft(ied,0));
-			const a_real pj = (g-1)*(uright(ied,3) 
-					- 0.5*(pow(uright(ied,1),2)+pow(uright(ied,2),2))/uright(ied,0));
-			//calculate speeds of sound
-			const a_real ci = sqrt(g*pi/uleft(ied,0));
-			const a_real cj = sqrt(g*pj/uright(ied,0));
-			//calculate normal velocities
-			const a_real vni = (uleft(ied,1)*n[0] +uleft(ied,2)*n[1])/uleft(ied,0);
-			const a_real vnj = (uright(ied,1)*n[0] + uright(ied,2)*n[1])/uright(ied,0);
-
-			for(int ivar = 0; ivar < NVARS; ivar++) {
-#pragma omp atomic
-				residual(lelem,ivar) += fluxes[ivar];
-			}
-			if(relem < m->gnelem()) {
-				for(int ivar = 0; ivar < NVARS; ivar++) {
-#pragma omp atomic
-					residual(relem,ivar) -= fluxes[ivar];
-				}
-			}
-#pragma omp atomic
-			integ(lelem) += (fabs(vni)+ci)*len;
-			if(relem < m->gnelem()) {
-#pragma omp atomic
-				integ(relem) += (fabs(vnj)+cj)*len;
+				add_face_flux(ied, n, len, fluxes, residual);
 			}
 		}
+	}
 
-#pragma omp barrier
-		if(gettimesteps)
-#pragma omp for simd
-			for(a_int iel = 0; iel < m->gnelem(); iel++)
-			{
-				dtm(iel) = m->garea(iel)/integ(iel);
-			}
-	} // end parallel region
+	if(gettimesteps)
+		compute_timesteps(dtm);
 }
 
 #if HAVE_PETSC==1
@@ -721,82 +971,234 @@ void EulerFV::compute_jacobian(const MVector& u, const bool blocked, Mat A)
 void EulerFV::compute_jacobian(const MVector& u, 
 				LinearOperator<a_real,a_int> *const __restrict A)
 {
-#pragma omp parallel for default(shared)
-	for(a_int iface = 0; iface < m->gnbface(); iface++)
+	perf::ScopedTimer tmr(perf::JACOBIAN);
+
+	if(halo)
+		halo->exchangeCells(u.data(), NVARS, &uhalo(0,0));
+
+#pragma omp parallel default(shared)
 	{
-		a_int lelem = m->gintfac(iface,0);
-		a_real n[NDIM];
-		n[0] = m->ggallfa(iface,0);
-		n[1] = m->ggallfa(iface,1);
-		a_real len = m->ggallfa(iface,2);
-		a_real uface[NVARS];
-		Matrix<a_real,NVARS,NVARS,RowMajor> left;
-		Matrix<a_real,NVARS,NVARS,RowMajor> right;
-		
-		compute_boundary_state(iface, &u(lelem,0), uface);
-		jflux->get_jacobian(&u(lelem,0), uface, n, &left(0,0), &right(0,0));
-		
-		// multiply by length of face and negate, as -ve of L is added to D
-		left = -len*left;
-		A->updateDiagBlock(lelem*NVARS, left.data(), NVARS);
+		perf::ScopedTimer ttmr(perf::JACOBIAN);
+#pragma omp for
+		for(a_int iface = 0; iface < m->gnbface(); iface++)
+		{
+			a_int lelem = m->gintfac(iface,0);
+			a_real n[NDIM];
+			n[0] = m->ggallfa(iface,0);
+			n[1] = m->ggallfa(iface,1);
+			a_real len = m->ggallfa(iface,2);
+			a_real uface[NVARS];
+			Matrix<a_real,NVARS,NVARS,RowMajor> left;
+			Matrix<a_real,NVARS,NVARS,RowMajor> right;
+			
+			compute_boundary_state(iface, &u(lelem,0), uface);
+			jflux->get_jacobian(&u(lelem,0), uface, n, &left(0,0), &right(0,0));
+			
+			// multiply by length of face and negate, as -ve of L is added to D
+			left = -len*left;
+			A->updateDiagBlock(lelem*NVARS, left.data(), NVARS);
+
+			// coupling to the neighbouring subdomain's cell, like an upper block
+			if(m->gbfacetag(iface,0) == DomainDecomposition::halo_boundary_tag && A->type() == 'd') {
+				right = len*right;
+				A->submitBlock(lelem*NVARS, lelem*NVARS, right.data(), 3, iface);
+			}
 
-		/*for(int i = 0; i < NVARS; i++)
-			for(int j = 0; j < NVARS; j++) {
-				left(i,j) *= len;
+			/*for(int i = 0; i < NVARS; i++)
+				for(int j = 0; j < NVARS; j++) {
+					left(i,j) *= len;
 #pragma omp atomic update
-				D[lelem](i,j) -= left(i,j);
-			}*/
-	}
+					D[lelem](i,j) -= left(i,j);
+				}*/
+		}
 
-#pragma omp parallel for default(shared)
-	for(a_int iface = m->gnbface(); iface < m->gnaface(); iface++)
-	{
-		a_int intface = iface-m->gnbface();
-		a_int lelem = m->gintfac(iface,0);
-		a_int relem = m->gintfac(iface,1);
-		a_real n[NDIM];
-		n[0] = m->ggallfa(iface,0);
-		n[1] = m->ggallfa(iface,1);
-		a_real len = m->ggallfa(iface,2);
-		Matrix<a_real,NVARS,NVARS,RowMajor> L;
-		Matrix<a_real,NVARS,NVARS,RowMajor> U;
-	
-		/// NOTE: the values of L and U get REPLACED here, not added to
-		//jflux->get_jacobian(&u(lelem,0), &u(relem,0), n, &L[intface](0,0), &U[intface](0,0));
-		jflux->get_jacobian(&u(lelem,0), &u(relem,0), n, &L(0,0), &U(0,0));
-
-		/*for(int i = 0; i < NVARS; i++)
-			for(int j = 0; j < NVARS; j++) {
-				L[intface](i,j) *= len;
-				U[intface](i,j) *= len;
+#pragma omp for nowait
+		for(a_int iface = m->gnbface(); iface < m->gnaface(); iface++)
+		{
+			a_int intface = iface-m->gnbface();
+			a_int lelem = m->gintfac(iface,0);
+			a_int relem = m->gintfac(iface,1);
+			a_real n[NDIM];
+			n[0] = m->ggallfa(iface,0);
+			n[1] = m->ggallfa(iface,1);
+			a_real len = m->ggallfa(iface,2);
+			Matrix<a_real,NVARS,NVARS,RowMajor> L;
+			Matrix<a_real,NVARS,NVARS,RowMajor> U;
+		
+			/// NOTE: the values of L and U get REPLACED here, not added to
+			//jflux->get_jacobian(&u(lelem,0), &u(relem,0), n, &L[intface](0,0), &U[intface](0,0));
+			jflux->get_jacobian(&u(lelem,0), &u(relem,0), n, &L(0,0), &U(0,0));
+
+			/*for(int i = 0; i < NVARS; i++)
+				for(int j = 0; j < NVARS; j++) {
+					L[intface](i,j) *= len;
+					U[intface](i,j) *= len;
 #pragma omp atomic update
-				D[lelem](i,j) -= L[intface](i,j);
+					D[lelem](i,j) -= L[intface](i,j);
 #pragma omp atomic update
-				D[relem](i,j) -= U[intface](i,j);
-			}*/
-		
-		L *= len; U *= len;
-		if(A->type()=='d') {
-			A->submitBlock(relem*NVARS,lelem*NVARS, L.data(), 1,intface);
-			A->submitBlock(lelem*NVARS,relem*NVARS, U.data(), 2,intface);
-		}
-		else {
-			A->submitBlock(relem*NVARS,lelem*NVARS, L.data(), NVARS,NVARS);
-			A->submitBlock(lelem*NVARS,relem*NVARS, U.data(), NVARS,NVARS);
+					D[relem](i,j) -= U[intface](i,j);
+				}*/
+			
+			L *= len; U *= len;
+			if(A->type()=='d') {
+				A->submitBlock(relem*NVARS,lelem*NVARS, L.data(), 1,intface);
+				A->submitBlock(lelem*NVARS,relem*NVARS, U.data(), 2,intface);
+			}
+			else {
+				A->submitBlock(relem*NVARS,lelem*NVARS, L.data(), NVARS,NVARS);
+				A->submitBlock(lelem*NVARS,relem*NVARS, U.data(), NVARS,NVARS);
+			}
+
+			// negative L and U contribute to diagonal blocks
+			L *= -1.0; U *= -1.0;
+			A->updateDiagBlock(lelem*NVARS, L.data(), NVARS);
+			A->updateDiagBlock(relem*NVARS, U.data(), NVARS);
 		}
+	}
+}
+
+/** The flux of each face is computed from the reconstructed face states as in
+ * \ref compute_residual, and its contributions to the Jacobian as in \ref compute_jacobian.
+ * If exactJacobian is set, the face states are the cell-centred (or ghost) states used by
+ * the Jacobian, so the flux and both Jacobian blocks come from one call to the flux scheme.
+ */
+void EulerFV::compute_residual_and_jacobian(const MVector& u, MVector& __restrict residual,
+		const bool gettimesteps, amat::Array2d<a_real>& __restrict dtm,
+		LinearOperator<a_real,a_int> *const __restrict A)
+{
+	perf::ScopedTimer rtmr(perf::RESIDUAL);
+
+	compute_face_states(u);
+
+	{
+		perf::ScopedTimer tmr(perf::FLUX_JACOBIAN);
+#pragma omp parallel default(shared)
+		{
+			perf::ScopedTimer ttmr(perf::FLUX_JACOBIAN);
+#pragma omp for nowait
+			for(a_int ied = 0; ied < m->gnaface(); ied++)
+			{
+				a_real n[NDIM];
+				n[0] = m->ggallfa(ied,0);
+				n[1] = m->ggallfa(ied,1);
+				const a_real len = m->ggallfa(ied,2);
+				const a_int lelem = m->gintfac(ied,0);
+				const a_int relem = m->gintfac(ied,1);
+				a_real fluxes[NVARS];
+				Matrix<a_real,NVARS,NVARS,RowMajor> L;
+				Matrix<a_real,NVARS,NVARS,RowMajor> U;
+
+				if(exactJacobian)
+					inviflux->get_flux_jacobian(&uleft(ied,0), &uright(ied,0), n, 
+							fluxes, &L(0,0), &U(0,0));
+				else {
+					inviflux->get_flux(&uleft(ied,0), &uright(ied,0), n, fluxes);
+					if(ied < m->gnbface()) {
+						a_real uface[NVARS];
+						compute_boundary_state(ied, &u(lelem,0), uface);
+						jflux->get_jacobian(&u(lelem,0), uface, n, &L(0,0), &U(0,0));
+					}
+					else
+						jflux->get_jacobian(&u(lelem,0), &u(relem,0), n, &L(0,0), &U(0,0));
+				}
 
-		// negative L and U contribute to diagonal blocks
-		L *= -1.0; U *= -1.0;
-		A->updateDiagBlock(lelem*NVARS, L.data(), NVARS);
-		A->updateDiagBlock(relem*NVARS, U.data(), NVARS);
+				add_face_flux(ied, n, len, fluxes, residual);
+
+				if(ied < m->gnbface())
+				{
+					// multiply by length of face and negate, as -ve of L is added to D
+					L = -len*L;
+					A->updateDiagBlock(lelem*NVARS, L.data(), NVARS);
+
+					// coupling to the neighbouring subdomain's cell, like an upper block
+					if(m->gbfacetag(ied,0) == DomainDecomposition::halo_boundary_tag 
+							&& A->type() == 'd') 
+					{
+						U = len*U;
+						A->submitBlock(lelem*NVARS, lelem*NVARS, U.data(), 3, ied);
+					}
+				}
+				else
+				{
+					const a_int intface = ied-m->gnbface();
+					L *= len; U *= len;
+					if(A->type()=='d') {
+						A->submitBlock(relem*NVARS,lelem*NVARS, L.data(), 1,intface);
+						A->submitBlock(lelem*NVARS,relem*NVARS, U.data(), 2,intface);
+					}
+					else {
+						A->submitBlock(relem*NVARS,lelem*NVARS, L.data(), NVARS,NVARS);
+						A->submitBlock(lelem*NVARS,relem*NVARS, U.data(), NVARS,NVARS);
+					}
+
+					// negative L and U contribute to diagonal blocks
+					L *= -1.0; U *= -1.0;
+					A->updateDiagBlock(lelem*NVARS, L.data(), NVARS);
+					A->updateDiagBlock(relem*NVARS, U.data(), NVARS);
+				}
+			}
+		}
 	}
+
+	if(gettimesteps)
+		compute_timesteps(dtm);
 }
 
 #endif
 
 void EulerFV::postprocess_point(const MVector& u, amat::Array2d<a_real>& scalars, amat::Array2d<a_real>& velocities)
 {
+	perf::ScopedTimer tmr(perf::OUTPUT);
 	std::cout << "EulerFV: postprocess_point(): Creating output arrays...\n";
+
+	compute_point_data(u, scalars, velocities);
+
+	compute_entropy_cell(u);
+
+	std::cout << "EulerFV: postprocess_point(): Done.\n";
+}
+
+bool EulerFV::compute_force_coefficients(const MVector& u, a_real *const coeffs)
+{
+	const a_real vinf2 = (uinf(0,1)*uinf(0,1) + uinf(0,2)*uinf(0,2))/(uinf(0,0)*uinf(0,0));
+	const a_real pinf = (g-1)*(uinf(0,3) - 0.5*uinf(0,0)*vinf2);
+	const a_real qinf = 0.5*uinf(0,0)*vinf2;
+	const a_real alpha = atan2(uinf(0,2), uinf(0,1));
+
+	a_real fx = 0, fy = 0, mz = 0;
+#pragma omp parallel for default(shared) reduction(+:fx,fy,mz)
+	for(a_int ied = 0; ied < m->gnbface(); ied++)
+	{
+		if(m->gbfacetag(ied,0) != solid_wall_id)
+			continue;
+
+		const a_int lelem = m->gintfac(ied,0);
+		const a_real p = (g-1)*(u(lelem,3) 
+				- 0.5*(u(lelem,1)*u(lelem,1)+u(lelem,2)*u(lelem,2))/u(lelem,0));
+
+		// the face normal points out of the domain, ie., into the body
+		const a_real len = m->ggallfa(ied,2);
+		const a_real dfx = (p-pinf)*m->ggallfa(ied,0)*len;
+		const a_real dfy = (p-pinf)*m->ggallfa(ied,1)*len;
+		const a_real xm = 0.5*(m->gcoords(m->gintfac(ied,2),0) + m->gcoords(m->gintfac(ied,3),0));
+		const a_real ym = 0.5*(m->gcoords(m->gintfac(ied,2),1) + m->gcoords(m->gintfac(ied,3),1));
+
+		fx += dfx;
+		fy += dfy;
+		mz += (xm-momentref_x)*dfy - ym*dfx;
+	}
+
+	fx = commSum(fx); fy = commSum(fy); mz = commSum(mz);
+
+	coeffs[0] = (-fx*sin(alpha) + fy*cos(alpha))/qinf;
+	coeffs[1] = (fx*cos(alpha) + fy*sin(alpha))/qinf;
+	coeffs[2] = -mz/qinf;
+	return true;
+}
+
+void EulerFV::compute_point_data(const MVector& u, amat::Array2d<a_real>& scalars, 
+		amat::Array2d<a_real>& velocities) const
+{
 	scalars.setup(m->gnpoin(),3);
 	velocities.setup(m->gnpoin(),2);
 	
@@ -805,36 +1207,38 @@ void EulerFV::postprocess_point(const MVector& u, amat::Array2d<a_real>& scalars
 	up.zeros();
 	areasum.zeros();
 
-	for(a_int ielem = 0; ielem < m->gnelem(); ielem++)
+#pragma omp parallel default(shared)
 	{
-		for(int inode = 0; inode < m->gnnode(ielem); inode++)
-			for(int ivar = 0; ivar < NVARS; ivar++)
+#pragma omp for
+		for(a_int ielem = 0; ielem < m->gnelem(); ielem++)
+		{
+			for(int inode = 0; inode < m->gnnode(ielem); inode++)
 			{
-				up(m->ginpoel(ielem,inode),ivar) += u(ielem,ivar)*m->garea(ielem);
-				areasum(m->ginpoel(ielem,inode)) += m->garea(ielem);
+				const a_int ipoin = m->ginpoel(ielem,inode);
+				for(int ivar = 0; ivar < NVARS; ivar++) {
+#pragma omp atomic update
+					up(ipoin,ivar) += u(ielem,ivar)*m->garea(ielem);
+				}
+#pragma omp atomic update
+				areasum(ipoin) += m->garea(ielem);
 			}
-	}
+		}
 
-	for(a_int ipoin = 0; ipoin < m->gnpoin(); ipoin++)
-		for(short ivar = 0; ivar < NVARS; ivar++)
-			up(ipoin,ivar) /= areasum(ipoin);
-	
-	for(a_int ipoin = 0; ipoin < m->gnpoin(); ipoin++)
-	{
-		scalars(ipoin,0) = up(ipoin,0);
-		velocities(ipoin,0) = up(ipoin,1)/up(ipoin,0);
-		velocities(ipoin,1) = up(ipoin,2)/up(ipoin,0);
-		//velocities(ipoin,0) = dudx(ipoin,1);
-		//velocities(ipoin,1) = dudy(ipoin,1);
-		a_real vmag2 = pow(velocities(ipoin,0), 2) + pow(velocities(ipoin,1), 2);
-		scalars(ipoin,2) = up(ipoin,0)*(g-1) * (up(ipoin,3)/up(ipoin,0) - 0.5*vmag2);		// pressure
-		a_real c = sqrt(g*scalars(ipoin,2)/up(ipoin,0));
-		scalars(ipoin,1) = sqrt(vmag2)/c;
+#pragma omp for
+		for(a_int ipoin = 0; ipoin < m->gnpoin(); ipoin++)
+		{
+			for(short ivar = 0; ivar < NVARS; ivar++)
+				up(ipoin,ivar) /= areasum(ipoin);
+
+			scalars(ipoin,0) = up(ipoin,0);
+			velocities(ipoin,0) = up(ipoin,1)/up(ipoin,0);
+			velocities(ipoin,1) = up(ipoin,2)/up(ipoin,0);
+			a_real vmag2 = pow(velocities(ipoin,0), 2) + pow(velocities(ipoin,1), 2);
+			scalars(ipoin,2) = up(ipoin,0)*(g-1) * (up(ipoin,3)/up(ipoin,0) - 0.5*vmag2);	// pressure
+			a_real c = sqrt(g*scalars(ipoin,2)/up(ipoin,0));
+			scalars(ipoin,1) = sqrt(vmag2)/c;
+		}
 	}
-
-	compute_entropy_cell(u);
-
-	std::cout << "EulerFV: postprocess_point(): Done.\n";
 }
 
 void EulerFV::postprocess_cell(const MVector& u, amat::Array2d<a_real>& scalars, 
@@ -862,27 +1266,60 @@ void EulerFV::postprocess_cell(const MVector& u, amat::Array2d<a_real>& scalars,
 }
 
 a_real EulerFV::compute_entropy_cell(const MVector& u)
+{
+	const a_real error = compute_entropy_error(u);
+
+	a_real h = 1.0/sqrt(m->gnelem());
+ 
+	std::cout << "EulerFV:   " << log10(h) << "  " 
+		<< std::setprecision(10) << log10(error) << std::endl;
+
+	return error;
+}
+
+a_real EulerFV::compute_entropy_error(const MVector& u) const
 {
 	a_real vmaginf2 = uinf(0,1)/uinf(0,0)*uinf(0,1)/uinf(0,0) 
 		              + uinf(0,2)/uinf(0,0)*uinf(0,2)/uinf(0,0);
 	a_real sinf = ( uinf(0,0)*(g-1) * (uinf(0,3)/uinf(0,0) - 0.5*vmaginf2) ) / pow(uinf(0,0),g);
 
-	amat::Array2d<a_real> s_err(m->gnelem(),1);
 	a_real error = 0;
+#pragma omp parallel for default(shared) reduction(+:error)
 	for(a_int iel = 0; iel < m->gnelem(); iel++)
 	{
 		a_real p = (g-1) * ( u(iel,3) - 0.5*(u(iel,1)*u(iel,1)+u(iel,2)*u(iel,2))/u(iel,0) );
-		s_err(iel) = (p / pow(u(iel,0),g) - sinf) / sinf;
-		error += s_err(iel)*s_err(iel)*m->garea(iel);
+		const a_real s_err = (p / pow(u(iel,0),g) - sinf) / sinf;
+		error += s_err*s_err*m->garea(iel);
 	}
-	error = sqrt(error);
+	return sqrt(error);
+}
 
-	a_real h = 1.0/sqrt(m->gnelem());
- 
-	std::cout << "EulerFV:   " << log10(h) << "  " 
-		<< std::setprecision(10) << log10(error) << std::endl;
+void EulerFV::compute_refinement_indicator(const MVector& u, a_real *const indicator) const
+{
+	const a_real vmaginf2 = (uinf(0,1)*uinf(0,1) + uinf(0,2)*uinf(0,2))/(uinf(0,0)*uinf(0,0));
+	const a_real sinf = (uinf(0,0)*(g-1) * (uinf(0,3)/uinf(0,0) - 0.5*vmaginf2)) / pow(uinf(0,0),g);
 
-	return error;
+	auto entropy = [&](const a_int iel) {
+		const a_real p = (g-1) * (u(iel,3) - 0.5*(u(iel,1)*u(iel,1)+u(iel,2)*u(iel,2))/u(iel,0));
+		return p / pow(u(iel,0),g);
+	};
+
+#pragma omp parallel for default(shared)
+	for(a_int iel = 0; iel < m->gnelem(); iel++)
+	{
+		const a_real si = entropy(iel);
+		a_real ind = 0;
+		for(int ifael = 0; ifael < m->gnfael(iel); ifael++)
+		{
+			const a_int jel = m->gesuel(iel,ifael);
+			if(jel >= m->gnelem())
+				continue;
+			const a_real drho = 2.0*std::abs(u(jel,0)-u(iel,0)) / (u(jel,0)+u(iel,0));
+			const a_real ds = std::abs(entropy(jel)-si) / sinf;
+			ind = std::max(ind, drho + ds);
+		}
+		indicator[iel] = ind;
+	}
 }
 
 
@@ -921,6 +1358,7 @@ template<short nvars>
 void Diffusion<nvars>::compute_boundary_states(const amat::Array2d<a_real>& instates, 
                                                 amat::Array2d<a_real>& bounstates)
 {
+	perf::ScopedTimer tmr(perf::BOUNDARY_STATES);
 	for(a_int ied = 0; ied < m->gnbface(); ied++)
 		compute_boundary_state(ied, &instates(ied,0), &bounstates(ied,0));
 }
@@ -986,10 +1424,7 @@ DiffusionMA<nvars>::~DiffusionMA()
 }
 
 template<short nvars>
-void DiffusionMA<nvars>::compute_residual(const MVector& u, 
-                                          MVector& __restrict residual, 
-                                          const bool gettimesteps, 
-										  amat::Array2d<a_real>& __restrict dtm)
+void DiffusionMA<nvars>::compute_gradients(const MVector& u)
 {
 	for(a_int ied = 0; ied < m->gnbface(); ied++)
 	{
@@ -999,54 +1434,45 @@ void DiffusionMA<nvars>::compute_residual(const MVector& u,
 	}
 	
 	compute_boundary_states(uleft, ug);
-	rec->compute_gradients(&u, &ug, &dudx, &dudy);
-	
-	for(a_int iface = m->gnbface(); iface < m->gnaface(); iface++)
 	{
-		a_int lelem = m->gintfac(iface,0);
-		a_int relem = m->gintfac(iface,1);
-		a_real len = m->ggallfa(iface,2);
-		a_real dr[NDIM], dist=0, sn=0, gradterm[nvars];
-		for(int i = 0; i < NDIM; i++) {
-			dr[i] = rc(relem,i)-rc(lelem,i);
-			dist += dr[i]*dr[i];
-		}
-		dist = sqrt(dist);
-		for(int i = 0; i < NDIM; i++) {
-			sn += dr[i]/dist * m->ggallfa(iface,i);
-		}
-
-		// compute modified gradient
-		for(short ivar = 0; ivar < nvars; ivar++) {
-			gradterm[ivar] 
-			 = 0.5*(dudx(lelem,ivar)+dudx(relem,ivar)) * (m->ggallfa(iface,0) - sn*dr[0]/dist)
-			 + 0.5*(dudy(lelem,ivar)+dudy(relem,ivar)) * (m->ggallfa(iface,1) - sn*dr[1]/dist);
-		}
+		perf::ScopedTimer tmr(perf::GRADIENTS);
+		rec->compute_gradients(&u, &ug, &dudx, &dudy);
+	}
+}
 
-		for(short ivar = 0; ivar < nvars; ivar++){
-			a_real flux {diffusivity * 
-				(gradterm[ivar] + (u(relem,ivar)-u(lelem,ivar))/dist * sn) * len};
-#pragma omp atomic
-			residual(lelem,ivar) -= flux;
-#pragma omp atomic
-			residual(relem,ivar) += flux;
-		}
+template<short nvars>
+void DiffusionMA<nvars>::face_geometry(const a_int iface, 
+		a_real *const dr, a_real& dist, a_real& sn) const
+{
+	const a_int lelem = m->gintfac(iface,0);
+	dist = 0; sn = 0;
+	for(int i = 0; i < NDIM; i++) {
+		if(iface < m->gnbface())
+			dr[i] = rcg(iface,i)-rc(lelem,i);
+		else
+			dr[i] = rc(m->gintfac(iface,1),i)-rc(lelem,i);
+		dist += dr[i]*dr[i];
 	}
-	
-	for(int iface = 0; iface < m->gnbface(); iface++)
+	dist = sqrt(dist);
+	for(int i = 0; i < NDIM; i++) {
+		sn += dr[i]/dist * m->ggallfa(iface,i);
+	}
+}
+
+/** At boundary faces, the gradient of the interior cell is used and the ghost state is the
+ * right state.
+ */
+template<short nvars>
+void DiffusionMA<nvars>::add_face_flux(const a_int iface, 
+		const a_real *const dr, const a_real dist, const a_real sn,
+		const MVector& u, MVector& __restrict residual) const
+{
+	const a_int lelem = m->gintfac(iface,0);
+	const a_real len = m->ggallfa(iface,2);
+	a_real gradterm[nvars];
+
+	if(iface < m->gnbface())
 	{
-		a_int lelem = m->gintfac(iface,0);
-		a_real len = m->ggallfa(iface,2);
-		a_real dr[NDIM], dist=0, sn=0, gradterm[nvars];
-		for(int i = 0; i < NDIM; i++) {
-			dr[i] = rcg(iface,i)-rc(lelem,i);
-			dist += dr[i]*dr[i];
-		}
-		dist = sqrt(dist);
-		for(int i = 0; i < NDIM; i++) {
-			sn += dr[i]/dist * m->ggallfa(iface,i);
-		}
-		
 		// compute modified gradient
 		for(short ivar = 0; ivar < nvars; ivar++)
 			gradterm[ivar] = dudx(lelem,ivar) * (m->ggallfa(iface,0) - sn*dr[0]/dist)
@@ -1057,8 +1483,76 @@ void DiffusionMA<nvars>::compute_residual(const MVector& u,
 			residual(lelem,ivar) -= diffusivity * 
 				( (ug(iface,ivar)-u(lelem,ivar))/dist*sn + gradterm[ivar]) * len;
 		}
+		return;
+	}
+
+	const a_int relem = m->gintfac(iface,1);
+
+	// compute modified gradient
+	for(short ivar = 0; ivar < nvars; ivar++) {
+		gradterm[ivar] 
+		 = 0.5*(dudx(lelem,ivar)+dudx(relem,ivar)) * (m->ggallfa(iface,0) - sn*dr[0]/dist)
+		 + 0.5*(dudy(lelem,ivar)+dudy(relem,ivar)) * (m->ggallfa(iface,1) - sn*dr[1]/dist);
+	}
+
+	for(short ivar = 0; ivar < nvars; ivar++){
+		a_real flux {diffusivity * 
+			(gradterm[ivar] + (u(relem,ivar)-u(lelem,ivar))/dist * sn) * len};
+#pragma omp atomic
+		residual(lelem,ivar) -= flux;
+#pragma omp atomic
+		residual(relem,ivar) += flux;
+	}
+}
+
+/** For now, this is the same as the thin-layer Jacobian
+ */
+template<short nvars>
+void DiffusionMA<nvars>::add_face_jacobian(const a_int iface, 
+		const a_real dist, const a_real sn, LinearOperator<a_real,a_int> *const A) const
+{
+	const a_int lelem = m->gintfac(iface,0);
+	const a_real len = m->ggallfa(iface,2);
+
+	a_real ll[nvars*nvars];
+	for(short ivar = 0; ivar < nvars; ivar++) {
+		for(short jvar = 0; jvar < nvars; jvar++)
+			ll[ivar*nvars+jvar] = 0;
+		
+		ll[ivar*nvars+ivar] = diffusivity * sn*len/dist;
+	}
+
+	if(iface < m->gnbface()) {
+		A->updateDiagBlock(lelem*nvars, ll, nvars);
+		return;
+	}
+
+	const a_int relem = m->gintfac(iface,1);
+	for(short ivar = 0; ivar < nvars; ivar++)
+		ll[ivar*nvars+ivar] *= -1;
+
+	a_int faceid = iface - m->gnbface();
+	if(A->type() == 'd') {
+		A->submitBlock(relem*nvars,lelem*nvars, ll, 1,faceid);
+		A->submitBlock(lelem*nvars,relem*nvars, ll, 2,faceid);
+	}
+	else {
+		A->submitBlock(relem*nvars,lelem*nvars, ll, nvars,nvars);
+		A->submitBlock(lelem*nvars,relem*nvars, ll, nvars,nvars);
 	}
+	
+	for(short ivar = 0; ivar < nvars; ivar++)
+		ll[ivar*nvars+ivar] *= -1;
+
+	A->updateDiagBlock(lelem*nvars, ll, nvars);
+	A->updateDiagBlock(relem*nvars, ll, nvars);
+}
 
+template<short nvars>
+void DiffusionMA<nvars>::add_source_and_timesteps(const MVector& u, 
+		MVector& __restrict residual, 
+		const bool gettimesteps, amat::Array2d<a_real>& __restrict dtm) const
+{
 	for(int iel = 0; iel < m->gnelem(); iel++) {
 		if(gettimesteps)
 			dtm(iel) = h[iel]*h[iel]/diffusivity;
@@ -1070,79 +1564,86 @@ void DiffusionMA<nvars>::compute_residual(const MVector& u,
 	}
 }
 
-/** For now, this is the same as the thin-layer Jacobian
- */
 template<short nvars>
-void DiffusionMA<nvars>::compute_jacobian(const MVector& u,
-		LinearOperator<a_real,a_int> *const A)
+void DiffusionMA<nvars>::compute_residual(const MVector& u, 
+                                          MVector& __restrict residual, 
+                                          const bool gettimesteps, 
+										  amat::Array2d<a_real>& __restrict dtm)
 {
+	perf::ScopedTimer rtmr(perf::RESIDUAL);
+
+	compute_gradients(u);
+	
+	perf::ScopedTimer ftmr(perf::FLUX);
 	for(a_int iface = m->gnbface(); iface < m->gnaface(); iface++)
 	{
-		//a_int intface = iface-m->gnbface();
-		a_int lelem = m->gintfac(iface,0);
-		a_int relem = m->gintfac(iface,1);
-		a_real len = m->ggallfa(iface,2);
-
-		a_real dr[NDIM], dist=0, sn=0;
-		for(int i = 0; i < NDIM; i++) {
-			dr[i] = rc(relem,i)-rc(lelem,i);
-			dist += dr[i]*dr[i];
-		}
-		dist = sqrt(dist);
-		for(int i = 0; i < NDIM; i++) {
-			sn += dr[i]/dist * m->ggallfa(iface,i);
-		}
+		a_real dr[NDIM], dist, sn;
+		face_geometry(iface, dr, dist, sn);
+		add_face_flux(iface, dr, dist, sn, u, residual);
+	}
+	
+	for(a_int iface = 0; iface < m->gnbface(); iface++)
+	{
+		a_real dr[NDIM], dist, sn;
+		face_geometry(iface, dr, dist, sn);
+		add_face_flux(iface, dr, dist, sn, u, residual);
+	}
 
-		a_real ll[nvars*nvars];
-		for(short ivar = 0; ivar < nvars; ivar++) {
-			for(short jvar = 0; jvar < nvars; jvar++)
-				ll[ivar*nvars+jvar] = 0;
-			
-			ll[ivar*nvars+ivar] = -diffusivity * sn*len/dist;
-		}
+	add_source_and_timesteps(u, residual, gettimesteps, dtm);
+}
 
-		a_int faceid = iface - m->gnbface();
-		if(A->type() == 'd') {
-			A->submitBlock(relem*nvars,lelem*nvars, ll, 1,faceid);
-			A->submitBlock(lelem*nvars,relem*nvars, ll, 2,faceid);
-		}
-		else {
-			A->submitBlock(relem*nvars,lelem*nvars, ll, nvars,nvars);
-			A->submitBlock(lelem*nvars,relem*nvars, ll, nvars,nvars);
-		}
-		
-		for(short ivar = 0; ivar < nvars; ivar++)
-			ll[ivar*nvars+ivar] *= -1;
+template<short nvars>
+void DiffusionMA<nvars>::compute_jacobian(const MVector& u,
+		LinearOperator<a_real,a_int> *const A)
+{
+	perf::ScopedTimer tmr(perf::JACOBIAN);
 
-		A->updateDiagBlock(lelem*nvars, ll, nvars);
-		A->updateDiagBlock(relem*nvars, ll, nvars);
+	for(a_int iface = m->gnbface(); iface < m->gnaface(); iface++)
+	{
+		a_real dr[NDIM], dist, sn;
+		face_geometry(iface, dr, dist, sn);
+		add_face_jacobian(iface, dist, sn, A);
 	}
 	
 	for(a_int iface = 0; iface < m->gnbface(); iface++)
 	{
-		a_int lelem = m->gintfac(iface,0);
-		a_real len = m->ggallfa(iface,2);
-
-		a_real dr[NDIM], dist=0, sn=0;
-		for(int i = 0; i < NDIM; i++) {
-			dr[i] = rcg(iface,i)-rc(lelem,i);
-			dist += dr[i]*dr[i];
-		}
-		dist = sqrt(dist);
-		for(int i = 0; i < NDIM; i++) {
-			sn += dr[i]/dist * m->ggallfa(iface,i);
-		}
+		a_real dr[NDIM], dist, sn;
+		face_geometry(iface, dr, dist, sn);
+		add_face_jacobian(iface, dist, sn, A);
+	}
+}
 
-		a_real ll[nvars*nvars];
-		for(short ivar = 0; ivar < nvars; ivar++) {
-			for(short jvar = 0; jvar < nvars; jvar++)
-				ll[ivar*nvars+jvar] = 0;
-			
-			ll[ivar*nvars+ivar] = diffusivity * sn*len/dist;
-		}
+/** The geometric quantities of each face are computed once and used for both the flux and
+ * the Jacobian blocks.
+ */
+template<short nvars>
+void DiffusionMA<nvars>::compute_residual_and_jacobian(const MVector& u, 
+		MVector& __restrict residual, 
+		const bool gettimesteps, amat::Array2d<a_real>& __restrict dtm,
+		LinearOperator<a_real,a_int> *const A)
+{
+	perf::ScopedTimer rtmr(perf::RESIDUAL);
 
-		A->updateDiagBlock(lelem*nvars, ll, nvars);
+	compute_gradients(u);
+	
+	perf::ScopedTimer ftmr(perf::FLUX_JACOBIAN);
+	for(a_int iface = m->gnbface(); iface < m->gnaface(); iface++)
+	{
+		a_real dr[NDIM], dist, sn;
+		face_geometry(iface, dr, dist, sn);
+		add_face_flux(iface, dr, dist, sn, u, residual);
+		add_face_jacobian(iface, dist, sn, A);
+	}
+	
+	for(a_int iface = 0; iface < m->gnbface(); iface++)
+	{
+		a_real dr[NDIM], dist, sn;
+		face_geometry(iface, dr, dist, sn);
+		add_face_flux(iface, dr, dist, sn, u, residual);
+		add_face_jacobian(iface, dist, sn, A);
 	}
+
+	add_source_and_timesteps(u, residual, gettimesteps, dtm);
 }
 
 template class DiffusionMA<1>;
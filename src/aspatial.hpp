@@ -30,6 +30,12 @@
 #include "areconstruction.hpp"
 #endif
 
+#ifndef __APARTITION_H
+#include "apartition.hpp"
+#endif
+
+#include <algorithm>
+
 #if HAVE_PETSC==1
 #include <petscmat.h>
 #endif
@@ -44,6 +50,9 @@ protected:
 	/// Mesh context
 	const UMesh2dh *const m;
 
+	/// Communication with neighbouring subdomains; null if the mesh is not partitioned
+	const HaloExchange *const halo;
+
 	/// Cell centers
 	amat::Array2d<a_real> rc;
 
@@ -63,14 +72,22 @@ protected:
 	/// step length for finite difference Jacobian
 	const a_real eps;
 
+	/// Empty array passed as local time steps to residual computations that do not need them
+	amat::Array2d<a_real> nodtm;
+
 public:
 	/// Common setup required for finite volume discretizations
 	/** Computes and stores cell centre coordinates, ghost cells' centres, and 
 	 * quadrature point coordinates.
+	 * The ghost cells of faces shared with other subdomains are placed at the centres of
+	 * the neighbouring subdomains' cells.
 	 */
-	Spatial(const UMesh2dh *const mesh);
+	Spatial(const UMesh2dh *const mesh, const HaloExchange *const haloexchange = nullptr);
 
 	virtual ~Spatial();
+
+	/// Communication context for partitioned meshes, or null
+	const HaloExchange* haloExchange() const { return halo; }
 	
 	/// Computes the residual and local time steps
 	/** \param[in] u The state at which the residual is to be computed
@@ -84,6 +101,101 @@ public:
 	/// Computes the Jacobian matrix of the residual
 	virtual void compute_jacobian(const MVector& u, LinearOperator<a_real,a_int> *const A) = 0;
 
+	/// Computes the residual, local time steps and the Jacobian matrix of the residual
+	/** The arguments are as in \ref compute_residual and \ref compute_jacobian, and the
+	 * results are the same as those of calling the two in turn. Discretizations which can
+	 * compute both in one traversal of the faces should override this; by default, the two
+	 * functions are called one after the other.
+	 */
+	virtual void compute_residual_and_jacobian(const MVector& u, MVector& __restrict residual,
+			const bool gettimesteps, amat::Array2d<a_real>& __restrict dtm,
+			LinearOperator<a_real,a_int> *const A);
+
+	/// Computes lift, drag and pitching moment coefficients from the forces on solid walls
+	/** Only a loop over boundary faces is needed, so this is cheap enough for every step.
+	 * Under MPI, it must be called on all ranks, and each gets the coefficients of the
+	 * whole domain.
+	 * \param[in] u The state
+	 * \param[out] coeffs The lift, drag and moment coefficients, in that order
+	 * \return False if the discretization has no such forces, in which case coeffs is not set
+	 */
+	virtual bool compute_force_coefficients(const MVector& u, a_real *const coeffs) {
+		return false;
+	}
+
+	/// Whether the pseudo-time derivative is multiplied by a preconditioning matrix
+	/** If so, the time term of each cell is \f$ \frac{A}{\Delta t} P(u) \f$ instead of
+	 * \f$ \frac{A}{\Delta t} I \f$, with P from \ref get_pseudotime_preconditioner.
+	 */
+	virtual bool preconditionedPseudoTime() const {
+		return false;
+	}
+
+	/// Computes the matrix multiplying the pseudo-time derivative of a cell, and its inverse
+	/** The default is the identity.
+	 * \param[in] u The state of the cell
+	 * \param[out] P The row-major nvars x nvars matrix, if not null
+	 * \param[out] Pinv Its inverse, if not null
+	 */
+	virtual void get_pseudotime_preconditioner(const a_real *const u, a_real *const P,
+			a_real *const Pinv) const
+	{
+		for(int i = 0; i < nvars; i++)
+			for(int j = 0; j < nvars; j++) {
+				if(P) P[i*nvars+j] = i==j ? 1.0 : 0.0;
+				if(Pinv) Pinv[i*nvars+j] = i==j ? 1.0 : 0.0;
+			}
+	}
+
+	/// Computes the data of the matrix-free LU-SGS preconditioner
+	/** The preconditioner is built from the Jameson-Yoon split-flux approximation of the
+	 * first-order Jacobian, in which the flux Jacobian across a face is split using the
+	 * spectral radius. Only the inverted diagonal blocks and one number per face are stored;
+	 * the off-diagonal blocks are never formed. See \ref apply_lusgs.
+	 * \param[in] u The state
+	 * \param[in] dtm Local time steps of the pseudo-time term, which is area/dtm of each cell
+	 * \param[out] Dinv The inverted diagonal blocks, row-major, nvars*nvars per cell
+	 * \param[out] facerad Half the spectral radius times the length, for each face
+	 * \return False if the discretization does not provide matrix-free LU-SGS; nothing is
+	 *   computed then
+	 */
+	virtual bool compute_lusgs_diagonal(const MVector& u, const amat::Array2d<a_real>& dtm,
+			a_real *const Dinv, a_real *const facerad)
+	{
+		return false;
+	}
+
+	/// Applies the matrix-free LU-SGS preconditioner, ie, solves (D+L) D^(-1) (D+U) z = r
+	/** The products with the off-diagonal blocks are recomputed during the forward and
+	 * backward sweeps from the flux Jacobians of the neighbouring cells.
+	 * \param[in] u The state at which \ref compute_lusgs_diagonal was called
+	 * \param[in] Dinv The inverted diagonal blocks from \ref compute_lusgs_diagonal
+	 * \param[in] facerad The face data from \ref compute_lusgs_diagonal
+	 * \param[in] r The right hand side
+	 * \param y Temporary storage of the same size as r
+	 * \param[out] z The result
+	 */
+	virtual void apply_lusgs(const MVector& u, const a_real *const Dinv,
+			const a_real *const facerad, const a_real *const r,
+			a_real *const __restrict y, a_real *const __restrict z) const
+	{ }
+
+	/// Frees the storage that is only used while residuals or Jacobians are computed
+	/** It is allocated again when it is next needed, or by \ref allocateWorkspace. Two
+	 * discretizations used one after the other, such as that of a starting run and the main
+	 * one, can thus share this memory. Does nothing by default.
+	 */
+	virtual void releaseWorkspace() { }
+
+	/// Allocates the storage freed by \ref releaseWorkspace, if it is not allocated
+	virtual void allocateWorkspace() { }
+
+	/// Adds the memory used by the discretization to a report
+	/** \param report The report to add to
+	 * \param name Name of the discretization in the report
+	 */
+	virtual void reportMemory(memory::Report& report, const std::string& name) const;
+
 	/// Computes the Frechet derivative of the residual along a given direction 
 	/// using finite difference
 	/** \param[in] resu The residual vector at the state at which the derivative is to be computed
@@ -115,6 +227,8 @@ public:
  */
 class EulerFV : public Spatial<NVARS>
 {
+	friend class EulerFVEnsemble;
+
 protected:
 	amat::Array2d<a_real> uinf;				///< Free-stream/reference condition
 	a_real g;								///< adiabatic index
@@ -147,15 +261,16 @@ protected:
 	/// Ghost cell flow quantities
 	amat::Array2d<a_real> ug;
 
+	/// States of the neighbouring subdomains' cells across faces shared with them
+	amat::Array2d<a_real> uhalo;
+
 	amat::Array2d<a_real> dudx;				///< X-gradients at cell centres
 	amat::Array2d<a_real> dudy;				///< Y-gradients at cell centres
 
 	int solid_wall_id;						///< Boundary marker corresponding to solid wall
 	int inflow_outflow_id;					///< Boundary marker corresponding to inflow/outflow
 	int supersonic_vortex_case_inflow;		///< Inflow boundary marker for supersonic vortex case
-	
-	amat::Array2d<a_real> scalars;			///< Holds density, Mach number and pressure for cells
-	amat::Array2d<a_real> velocities;		///< Holds velocity components for each cell
+	a_real momentref_x;						///< x-coordinate of the moment reference point
 	
 	amat::Array2d<a_real> uleft;			///< Left state at faces
 	amat::Array2d<a_real> uright;			///< Right state at faces
@@ -174,6 +289,41 @@ protected:
 	/// Computes ghost cell state across the face denoted by the first parameter
 	void compute_boundary_state(const int ied, const a_real *const ins, a_real *const bs);
 
+	/// Computes the left and right states at all faces, zeroing the integrated spectral radii
+	/** Exchanges halo cell states if needed, and reconstructs if second order is requested.
+	 * Allocates the workspace again if it was released.
+	 */
+	void compute_face_states(const MVector& u);
+
+	/// Computes local time steps from the integrated spectral radii
+	void compute_timesteps(amat::Array2d<a_real>& __restrict dtm);
+
+	/// Integrates the numerical flux of a face and adds it to the residual
+	/** Also adds the integrated spectral radius of the face to \ref integ of its cells.
+	 * \param[in,out] fluxes The flux per unit length on input, integrated over the face
+	 *   on output
+	 */
+	void add_face_flux(const a_int ied, const a_real *const n, const a_real len,
+			a_real *const fluxes, MVector& __restrict residual);
+
+	/// Whether the flux and Jacobian schemes are the same and the first-order Jacobian is
+	/// therefore that of the residual; both are then computed from the same intermediates
+	bool exactJacobian;
+
+	/// Cut-off of the reference velocity of low-Mach preconditioning; 0 if not preconditioned
+	a_real lowmachvmin;
+
+	/// Largest magnitude of the eigenvalues of the normal flux Jacobian, which are those of
+	/// the preconditioned system with low-Mach preconditioning
+	a_real spectralRadius(const a_real *const u, const a_real vn, const a_real c) const {
+		if(lowmachvmin <= 0)
+			return std::fabs(vn) + c;
+		a_real lm, lp;
+		IdealGasPhysics::getLowMachEigenvalues(vn, c,
+				physics.getLowMachReferenceVelocity(u, lowmachvmin), lm, lp);
+		return std::max(std::fabs(lm), std::fabs(lp));
+	}
+
 public:
 
 	/// Sets data and various numerics objects
@@ -182,9 +332,12 @@ public:
 	 * \param[in] reconst The method used for gradient reconstruction 
 	 *   - NONE, GREENGAUSS, LEASTSQUARES
 	 * \param[in] limiter The kind of slope limiter to use - NONE, WENO
+	 * \param[in] haloexchange Communication with neighbouring subdomains if the mesh is
+	 *   the local mesh of a partitioned domain, or null
 	 */
 	EulerFV(const UMesh2dh *const mesh, std::string invflux, 
-			std::string jacflux, std::string reconst, std::string limiter);
+			std::string jacflux, std::string reconst, std::string limiter,
+			const HaloExchange *const haloexchange = nullptr);
 	
 	~EulerFV();
 	
@@ -192,6 +345,64 @@ public:
 	void loaddata(const short inittype, const a_real Minf, const a_real vinf, const a_real a, 
 			const a_real rhoinf, MVector& u);
 
+	/// Turns on Weiss-Smith low-Mach preconditioning of the pseudo-time derivative
+	/** The pseudo-time term of each cell is multiplied by the preconditioning matrix of
+	 * IdealGasPhysics::getLowMachPreconditioner, and local time steps come from the
+	 * eigenvalues of the preconditioned system. The Roe and HLLC fluxes switch to the
+	 * dissipation of the preconditioned system, which is needed for accuracy at low Mach
+	 * numbers. Other fluxes are unchanged, so with them only the convergence rate changes,
+	 * not the converged solution.
+	 * Must be called after \ref loaddata.
+	 * \param[in] factor The cut-off of the reference velocity relative to the free-stream
+	 *   speed; 0 turns preconditioning off
+	 */
+	void setLowMachPreconditioning(const a_real factor);
+
+	/// Frees the face and ghost states, gradients and integrated spectral radii
+	void releaseWorkspace();
+
+	/// Allocates the face and ghost states, gradients and integrated spectral radii
+	/** Gradients are only allocated if second order is requested.
+	 */
+	void allocateWorkspace();
+
+	void reportMemory(memory::Report& report, const std::string& name) const;
+
+	bool preconditionedPseudoTime() const {
+		return lowmachvmin > 0;
+	}
+
+	void get_pseudotime_preconditioner(const a_real *const u, a_real *const P,
+			a_real *const Pinv) const;
+
+	/// Computes the inverted diagonal blocks of the split-flux approximate Jacobian
+	/** With \f$ \rho_f \f$ the larger of \f$ |v_n|+c \f$ of the two cells adjoining face f,
+	 * the diagonal block of cell i is
+	 * \f$ \frac{A_i}{\Delta t_i} P_i + \frac12 \sum_f \rho_f l_f I \f$, as the flux Jacobians
+	 * of the cell itself sum to zero over its faces. At boundary faces, only the state of
+	 * the cell is used and the dependence of the boundary state on it is neglected.
+	 * The spectral radius of the unpreconditioned flux Jacobian is used even with low-Mach
+	 * preconditioning, as it bounds the dissipation of all the fluxes; the smaller radius of
+	 * the preconditioned system makes the sweeps diverge with fluxes that are not
+	 * preconditioned.
+	 */
+	bool compute_lusgs_diagonal(const MVector& u, const amat::Array2d<a_real>& dtm,
+			a_real *const Dinv, a_real *const facerad);
+
+	/// Applies matrix-free LU-SGS using the split-flux off-diagonal blocks
+	/** The product of the off-diagonal block coupling cell i to cell j with a vector v is
+	 * \f$ \frac12 l_{ij} (A_j(n_{ij}) v - \rho_{ij} v) \f$, where \f$ A_j(n_{ij}) \f$ is the
+	 * analytical flux Jacobian at the state of cell j and \f$ n_{ij} \f$ points out of cell i.
+	 * The Jacobian-vector product is used instead of a difference of fluxes so that the
+	 * preconditioner is linear, as Krylov solvers need.
+	 * Like the SGS preconditioner of DLUMatrix, the sweeps are shared among threads
+	 * without waiting, so threads may use old values from neighbouring chunks.
+	 * Faces shared with other subdomains are treated as boundary faces.
+	 */
+	void apply_lusgs(const MVector& u, const a_real *const Dinv,
+			const a_real *const facerad, const a_real *const r,
+			a_real *const __restrict y, a_real *const __restrict z) const;
+
 	/// Calls functions to assemble the [right hand side](@ref residual)
 	/** This invokes flux calculation after zeroing the residuals and also computes local time steps.
 	 */
@@ -205,8 +416,21 @@ public:
 	/// Computes the residual Jacobian as arrays of diagonal blocks for each cell, 
 	/// and lower and upper blocks for each face
 	/** A is not zeroed before use.
+	 * For faces shared with other subdomains, the block coupling the cell to the
+	 * neighbouring subdomain's cell is submitted with lud = 3 and the boundary face index,
+	 * if A is a DLU matrix.
 	 */
 	void compute_jacobian(const MVector& u, LinearOperator<a_real,a_int> *const A);
+
+	/// Computes the residual, time steps and Jacobian in one loop over faces
+	/** The flux and its Jacobian are computed together for each face. For a first-order
+	 * discretization whose Jacobian flux is the residual flux, they are obtained from one
+	 * call to InviscidFlux::get_flux_jacobian at the same states. Otherwise, the Jacobian is
+	 * computed from the cell-centred states as in \ref compute_jacobian, in the same loop.
+	 */
+	void compute_residual_and_jacobian(const MVector& u, MVector& __restrict residual,
+			const bool gettimesteps, amat::Array2d<a_real>& __restrict dtm,
+			LinearOperator<a_real,a_int> *const A);
 #endif
 
 	/// Compute cell-centred quantities to export
@@ -219,10 +443,39 @@ public:
 	void postprocess_point(const MVector& u, amat::Array2d<a_real>& scalars, 
 			amat::Array2d<a_real>& velocities);
 
+	/// Computes lift, drag and pitching moment coefficients from the pressure on solid walls
+	/** The pressure on each wall face is that of the adjoining cell. The coefficients are
+	 * normalized by the free-stream dynamic pressure and a reference length of 1, lift and drag
+	 * being normal and parallel to the free stream. The moment is taken about
+	 * (\ref momentref_x, 0) and is positive nose-up.
+	 */
+	bool compute_force_coefficients(const MVector& u, a_real *const coeffs);
+
+	/// Computes nodal density, Mach number, pressure and velocity
+	/** Does the work of \ref postprocess_point without printing anything. As it only reads
+	 * the mesh and the free-stream state, it can run concurrently with residual computations.
+	 */
+	void compute_point_data(const MVector& u, amat::Array2d<a_real>& scalars, 
+			amat::Array2d<a_real>& velocities) const;
+
 	/// Compute norm of cell-centered entropy production
 	/** Call aftr computing pressure etc \sa postprocess_cell
 	 */
 	a_real compute_entropy_cell(const MVector& u);
+
+	/// Computes the norm of the relative entropy deviation from free-stream without printing it
+	a_real compute_entropy_error(const MVector& u) const;
+
+	/// Computes an indicator of where the mesh should be refined
+	/** For each cell, this is the largest jump across its interior faces of the density,
+	 * relative to the mean density of the two cells, plus that of the entropy, relative to the
+	 * free-stream entropy. These undivided differences pick up shocks, which density jumps show,
+	 * and wakes and vortices, which entropy jumps show; they decrease as cells get smaller
+	 * in smooth regions, but not at discontinuities.
+	 * \param[in] u The state of all cells
+	 * \param[out] indicator Indicator values, one per cell
+	 */
+	void compute_refinement_indicator(const MVector& u, a_real *const indicator) const;
 };
 
 /// Spatial discretization of diffusion operator with constant difusivity
@@ -290,6 +543,29 @@ class DiffusionMA : public Diffusion<nvars>
 	amat::Array2d<a_real> uright;			///< Right state at each face
 	amat::Array2d<a_real> ug;				///< Boundary states
 
+	/// Computes the ghost states at boundary faces and the gradients at cell centres
+	void compute_gradients(const MVector& u);
+
+	/// Computes the geometric quantities of a face used by the modified-gradient flux
+	/** \param[out] dr The vector from the left cell centre to the right cell centre,
+	 *   or to the ghost point at boundary faces
+	 * \param[out] dist The length of dr
+	 * \param[out] sn The component of the unit normal of the face along dr
+	 */
+	void face_geometry(const a_int iface, a_real *const dr, a_real& dist, a_real& sn) const;
+
+	/// Adds the diffusive flux through a face to the residual
+	void add_face_flux(const a_int iface, const a_real *const dr, const a_real dist,
+			const a_real sn, const MVector& u, MVector& __restrict residual) const;
+
+	/// Adds the contributions of a face to the Jacobian
+	void add_face_jacobian(const a_int iface, const a_real dist, const a_real sn,
+			LinearOperator<a_real,a_int> *const A) const;
+
+	/// Subtracts the source term from the residual and computes the time steps if asked
+	void add_source_and_timesteps(const MVector& u, MVector& __restrict residual,
+			const bool gettimesteps, amat::Array2d<a_real>& __restrict dtm) const;
+
 public:
 	DiffusionMA(const UMesh2dh *const mesh, const a_real diffcoeff, const a_real bvalue,
 			std::function <
@@ -306,6 +582,13 @@ public:
 	void compute_jacobian(const MVector& u, 
 			LinearOperator<a_real,a_int> *const A);
 
+	/// Computes the residual and its Jacobian in one loop over faces
+	/** The source term is added, and time steps computed, as in \ref compute_residual.
+	 */
+	void compute_residual_and_jacobian(const MVector& u, MVector& __restrict residual,
+			const bool gettimesteps, amat::Array2d<a_real>& __restrict dtm,
+			LinearOperator<a_real,a_int> *const A);
+
 	~DiffusionMA();
 	
 	using Diffusion<nvars>::postprocess_point;
@@ -0,0 +1,581 @@
+/** @file fvens_bench.cpp
+ * @brief Timing of the main computational kernels over a range of thread counts
+ * @author Aditya Kashi
+ *
+ * Usage:
+ *
+ *     fvens_bench [-r <repeats>] [-t <max threads>] [-o <csv file>] <mesh> [<mesh> ...]
+ *
+ * where each mesh is either a Gmsh 2 mesh file, eg. from testcases/(case)/grids, or a
+ * description of a generated mesh as accepted by MeshGenerator::parse, such as
+ * RECT:QUAD:1000x1000 or CYLINDER:TRI:512x256:0.2.
+ *
+ * Thread counts are swept in powers of 2 up to the maximum number of threads.
+ *
+ * Bandwidth and flop rates are effective rates computed from simple models of each kernel.
+ * The bytes counted are the sizes of the arrays a kernel has to stream at least once;
+ * re-reads of neighbouring cells' data are assumed to hit in cache.
+ * Flops are only counted for the linear algebra kernels, whose operation counts are fixed.
+ */
+
+#include "aodesolver.hpp"
+#include "ameshgen.hpp"
+#include "aperf.hpp"
+#include "amemory.hpp"
+#include "alocator.hpp"
+#include <cstring>
+#include <cstdlib>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace acfd;
+
+/// Timing of one kernel at one thread count
+struct BenchResult
+{
+	std::string mesh;
+	std::string kernel;
+	int nthreads;
+	double time;				///< Average wall time per call in seconds
+	double bytes;				///< Modelled data movement per call
+	double flops;				///< Floating-point operations per call; zero if not counted
+};
+
+/// Suppresses standard output while in scope, to keep setup messages out of the report
+class QuietScope
+{
+	std::streambuf *const orig;
+public:
+	QuietScope() : orig(std::cout.rdbuf(nullptr)) { }
+	~QuietScope() { std::cout.rdbuf(orig); std::cout.clear(); }
+};
+
+static double wallTime()
+{
+	struct timeval t;
+	gettimeofday(&t, NULL);
+	return (double)t.tv_sec + (double)t.tv_usec * 1.0e-6;
+}
+
+/// Returns the average wall time of one call of the kernel, after one warm-up call
+template <typename Kernel>
+static double timeKernel(const int nrepeat, Kernel kernel)
+{
+	kernel();
+	const double start = wallTime();
+	for(int i = 0; i < nrepeat; i++)
+		kernel();
+	return (wallTime()-start)/nrepeat;
+}
+
+/// Returns the average time per call spent in a phase while running the kernel
+template <typename Kernel>
+static double timePhase(const int nrepeat, const perf::Phase phase, Kernel kernel)
+{
+	kernel();
+	perf::Registry::reset();
+	for(int i = 0; i < nrepeat; i++)
+		kernel();
+	return perf::Registry::phaseTime(phase)/nrepeat;
+}
+
+static void setNumThreads(const int nthreads)
+{
+#ifdef _OPENMP
+	omp_set_num_threads(nthreads);
+#endif
+}
+
+/// Reads or generates the mesh described by the argument and computes all mesh data
+static bool setupMesh(const std::string meshdesc, UMesh2dh& m)
+{
+	MeshGenerator::Spec spec(MeshGenerator::RECTANGLE, MeshGenerator::QUADRANGLES, 1, 1);
+	QuietScope quiet;
+	if(MeshGenerator::parse(meshdesc, spec)) {
+		if(!MeshGenerator::generate(spec, m))
+			return false;
+	}
+	else {
+		std::ifstream test(meshdesc);
+		if(!test)
+			return false;
+		test.close();
+		m.readGmsh2(meshdesc, 2);
+	}
+
+	m.compute_topological();
+	m.compute_areas();
+	m.compute_jacobians();
+	m.compute_face_data();
+	return true;
+}
+
+/// Free-stream state with a smooth perturbation, so that limiters and fluxes do some work
+static void setState(const UMesh2dh& m, EulerFV& prob, MVector& u)
+{
+	prob.loaddata(0, 0.5, 1.0, 2.0*PI/180.0, 1.0, u);
+#pragma omp parallel for default(shared)
+	for(a_int iel = 0; iel < m.gnelem(); iel++)
+		for(int ivar = 0; ivar < NVARS; ivar++)
+			u(iel,ivar) *= 1.0 + 0.05*std::sin(0.37*iel + ivar);
+}
+
+static void zeroResidual(MVector& r)
+{
+#pragma omp parallel for default(shared)
+	for(a_int iel = 0; iel < r.rows(); iel++)
+		for(int ivar = 0; ivar < NVARS; ivar++)
+			r(iel,ivar) = 0;
+}
+
+/// Runs all kernels on one mesh with one thread count
+static void benchMesh(const std::string meshname, const UMesh2dh& m, const int nthreads,
+		const int nrepeat, std::vector<BenchResult>& results)
+{
+	const double R = sizeof(a_real), I = sizeof(a_int);
+	const double nv = NVARS, bs2 = NVARS*NVARS;
+	const double N = m.gnelem(), F = m.gnaface(), Fb = m.gnbface(), Fi = F-Fb;
+	int maxnfael = 0;
+	for(a_int iel = 0; iel < m.gnelem(); iel++)
+		if(m.gnfael(iel) > maxnfael) maxnfael = m.gnfael(iel);
+	// connectivity needed to traverse the neighbours of all cells
+	const double cellconn = 2.0*N*maxnfael*I;
+
+	auto add = [&](const std::string kernel, const double time, const double bytes,
+			const double flops)
+	{
+		BenchResult res;
+		res.mesh = meshname; res.kernel = kernel; res.nthreads = nthreads;
+		res.time = time; res.bytes = bytes; res.flops = flops;
+		results.push_back(res);
+	};
+
+	MVector u(m.gnelem(), NVARS), r(m.gnelem(), NVARS);
+	amat::Array2d<a_real> dtm(m.gnelem(), 1);
+
+	// complete residual with the commonly used second-order scheme
+	{
+		EulerFV* prob;
+		{
+			QuietScope quiet;
+			prob = new EulerFV(&m, "HLLC", "HLL", "LEASTSQUARES", "VENKATAKRISHNAN");
+			setState(m, *prob, u);
+		}
+		const double t = timeKernel(nrepeat, [&]() {
+				zeroResidual(r);
+				prob->compute_residual(u, r, true, dtm);
+			});
+		// state, gradients written and read, residual read and written; face states written
+		// and read; face geometry; integrated wave speeds, areas and time steps
+		add("residual", t, 7*N*nv*R + 4*F*nv*R + F*3*R + F*2*I + 3*N*R, 0);
+		delete prob;
+	}
+
+	// point location: building the bin grid, and finding one point inside each cell
+	{
+		const double tb = timeKernel(nrepeat, [&]() { CellLocator loc(&m); });
+		CellLocator loc(&m);
+		// connectivity and coordinates read; centres and bin lists written and sorted
+		add("locator:build", tb, N*maxnfael*I + 2*N*R + 3*loc.averageBinLoad()*loc.numBins()*I, 0);
+
+		amat::Array2d<a_real> points(m.gnelem(), NDIM);
+#pragma omp parallel for default(shared)
+		for(a_int iel = 0; iel < m.gnelem(); iel++)
+			for(int idim = 0; idim < NDIM; idim++)
+				points(iel,idim) = 0.75*loc.cellCentre(iel)[idim]
+					+ 0.25*m.gcoords(m.ginpoel(iel,0),idim);
+		std::vector<PointLocation> locs;
+		const double tl = timeKernel(nrepeat, [&]() { loc.locate(points, locs); });
+		add("locator:locate", tl, N*NDIM*R + N*sizeof(PointLocation), 0);
+	}
+
+	// reconstructions
+	const char *const recs[] = {"GREENGAUSS", "LEASTSQUARES"};
+	for(const char *const rec : recs)
+	{
+		EulerFV* prob;
+		{
+			QuietScope quiet;
+			prob = new EulerFV(&m, "HLLC", "HLL", rec, "NONE");
+			setState(m, *prob, u);
+		}
+		const double t = timePhase(nrepeat, perf::GRADIENTS, [&]() {
+				zeroResidual(r);
+				prob->compute_residual(u, r, false, dtm);
+			});
+		add(std::string("gradients:")+rec, t,
+			N*nv*R + Fb*nv*R + 2*N*nv*R + N*2*R + cellconn/2, 0);
+		delete prob;
+	}
+
+	// limiters
+	const char *const lims[] = {"NONE", "WENO", "VANALBADA", "BARTHJESPERSEN", "VENKATAKRISHNAN"};
+	for(const char *const lim : lims)
+	{
+		EulerFV* prob;
+		{
+			QuietScope quiet;
+			prob = new EulerFV(&m, "HLLC", "HLL", "LEASTSQUARES", lim);
+			setState(m, *prob, u);
+		}
+		const double t = timePhase(nrepeat, perf::LIMITER, [&]() {
+				zeroResidual(r);
+				prob->compute_residual(u, r, false, dtm);
+			});
+		add(std::string("limiter:")+lim, t,
+			N*nv*R + 2*N*nv*R + 2*F*nv*R + F*2*R + F*2*I, 0);
+		delete prob;
+	}
+
+	// numerical fluxes and their Jacobians, on left and right cell-centred states
+	{
+		IdealGasPhysics physics(1.4);
+		amat::Array2d<a_real> ul(m.gnaface(), NVARS), ur(m.gnaface(), NVARS);
+		amat::Array2d<a_real> flux(m.gnaface(), NVARS);
+		amat::Array2d<a_real> dfdl(m.gnaface(), NVARS*NVARS), dfdr(m.gnaface(), NVARS*NVARS);
+		{
+			QuietScope quiet;
+			EulerFV prob(&m, "HLLC", "HLL", "NONE", "NONE");
+			setState(m, prob, u);
+		}
+#pragma omp parallel for default(shared)
+		for(a_int iface = 0; iface < m.gnaface(); iface++) {
+			const a_int lelem = m.gintfac(iface,0);
+			const a_int relem = iface < m.gnbface() ? lelem : m.gintfac(iface,1);
+			for(int ivar = 0; ivar < NVARS; ivar++) {
+				ul(iface,ivar) = u(lelem,ivar);
+				ur(iface,ivar) = u(relem,ivar);
+			}
+		}
+
+		InviscidFlux* fluxes[] = {new LocalLaxFriedrichsFlux(&physics), new VanLeerFlux(&physics),
+			new RoeFlux(&physics), new HLLFlux(&physics), new HLLCFlux(&physics)};
+		const char *const fluxnames[] = {"LLF", "VANLEER", "ROE", "HLL", "HLLC"};
+		// LLF, Roe and HLL have Jacobians; those of Van Leer and HLLC are not implemented
+		const bool hasjacobian[] = {true, false, true, true, false};
+
+		for(int iflux = 0; iflux < 5; iflux++)
+		{
+			InviscidFlux *const inviflux = fluxes[iflux];
+			double t = timeKernel(nrepeat, [&]() {
+#pragma omp parallel for default(shared)
+					for(a_int iface = 0; iface < m.gnaface(); iface++) {
+						const a_real n[NDIM] = {m.ggallfa(iface,0), m.ggallfa(iface,1)};
+						inviflux->get_flux(&ul(iface,0), &ur(iface,0), n, &flux(iface,0));
+					}
+				});
+			add(std::string("flux:")+fluxnames[iflux], t, F*(3*nv*R + 2*R), 0);
+
+			if(!hasjacobian[iflux]) {
+				delete inviflux;
+				continue;
+			}
+
+			t = timeKernel(nrepeat, [&]() {
+#pragma omp parallel for default(shared)
+					for(a_int iface = 0; iface < m.gnaface(); iface++) {
+						const a_real n[NDIM] = {m.ggallfa(iface,0), m.ggallfa(iface,1)};
+						inviflux->get_jacobian(&ul(iface,0), &ur(iface,0), n,
+								&dfdl(iface,0), &dfdr(iface,0));
+					}
+				});
+			add(std::string("fluxjac:")+fluxnames[iflux], t, F*(2*nv*R + 2*R + 2*bs2*R), 0);
+			delete inviflux;
+		}
+	}
+
+	// Jacobian assembly and sparse linear algebra
+	EulerFV* prob;
+	blasted::DLUMatrix<NVARS>* A;
+	{
+		QuietScope quiet;
+		prob = new EulerFV(&m, "HLLC", "HLL", "NONE", "NONE");
+		setState(m, *prob, u);
+		A = new blasted::DLUMatrix<NVARS>(&m, 1, 1);
+	}
+
+	const double t = timeKernel(nrepeat, [&]() {
+			A->setAllZero();
+			prob->compute_jacobian(u, A);
+		});
+	add("jacobian", t, N*nv*R + F*3*R + F*2*I + 2*N*bs2*R + 2*Fi*bs2*R, 0);
+
+	// first-order residual and Jacobian of an implicit step, in two face loops and in one
+	{
+		EulerFV* fprob;
+		{
+			QuietScope quiet;
+			fprob = new EulerFV(&m, "LLF", "LLF", "NONE", "NONE");
+			setState(m, *fprob, u);
+		}
+		const double resbytes = 3*N*nv*R + 4*F*nv*R + F*3*R + F*2*I + 3*N*R;
+		const double jacbytes = N*nv*R + F*3*R + F*2*I + 2*N*bs2*R + 2*Fi*bs2*R;
+		double tf = timeKernel(nrepeat, [&]() {
+				zeroResidual(r);
+				A->setAllZero();
+				fprob->compute_residual(u, r, true, dtm);
+				fprob->compute_jacobian(u, A);
+			});
+		add("residual+jacobian:separate", tf, resbytes + jacbytes, 0);
+		tf = timeKernel(nrepeat, [&]() {
+				zeroResidual(r);
+				A->setAllZero();
+				fprob->compute_residual_and_jacobian(u, r, true, dtm, A);
+			});
+		// the cell states and face geometry are read only once
+		add("residual+jacobian:fused", tf, resbytes + jacbytes - N*nv*R - F*3*R - F*2*I, 0);
+		delete fprob;
+	}
+
+	// pseudo-time term, so that the linear systems are like those of an implicit solve
+	zeroResidual(r);
+	prob->compute_residual(u, r, true, dtm);
+#pragma omp parallel for default(shared)
+	for(a_int iel = 0; iel < m.gnelem(); iel++)
+	{
+		Matrix<a_real,NVARS,NVARS,RowMajor> db = Matrix<a_real,NVARS,NVARS,RowMajor>::Zero();
+		for(int i = 0; i < NVARS; i++)
+			db(i,i) = m.garea(iel)/(100.0*dtm(iel));
+		A->updateDiagBlock(iel*NVARS, db.data(), NVARS);
+	}
+
+	MVector x = MVector::Ones(m.gnelem(), NVARS), z(m.gnelem(), NVARS);
+	const double spmvbytes = (N+2*Fi)*bs2*R + 2*N*nv*R + cellconn;
+	const double spmvflops = 2*bs2*(N+2*Fi);
+
+	double tk = timeKernel(nrepeat, [&]() { A->apply(1.0, x.data(), z.data()); });
+	add("dlu_apply", tk, spmvbytes, spmvflops);
+
+	{
+		QuietScope quiet;
+		A->precJacobiSetup();
+		A->allocTempVector();
+	}
+	tk = timeKernel(nrepeat, [&]() { A->precJacobiSetup(); });
+	add("jacobi_setup", tk, 2*N*bs2*R, 0);
+
+	tk = timeKernel(nrepeat, [&]() { A->precJacobiApply(x.data(), z.data()); });
+	add("jacobi_apply", tk, N*bs2*R + 2*N*nv*R, 2*bs2*N);
+
+	// one forward and one backward sweep
+	tk = timeKernel(nrepeat, [&]() { A->precSGSApply(x.data(), z.data()); });
+	add("sgs_apply", tk,
+		(Fi*bs2*R + N*bs2*R + 2*N*nv*R + cellconn) + (Fi*bs2*R + 2*N*bs2*R + 2*N*nv*R + cellconn),
+		2*bs2*(Fi+N) + 2*bs2*(Fi+2*N));
+
+	{
+		QuietScope quiet;
+		A->precILUSetup();
+	}
+	// the elimination schedule, computed at the first setup, has 3 entries per off-diagonal
+	// block and 2 per block-row, neglecting the updates
+	tk = timeKernel(nrepeat, [&]() { A->precILUSetup(); });
+	add("ilu_setup", tk, 2*(N+2*Fi)*bs2*R + 6*Fi*I + 2*N*I, 0);
+
+	tk = timeKernel(nrepeat, [&]() { A->precILUApply(x.data(), z.data()); });
+	add("ilu_apply", tk,
+		(Fi*bs2*R + 2*N*nv*R + cellconn) + (Fi*bs2*R + N*bs2*R + 2*N*nv*R + cellconn),
+		2*bs2*Fi + 2*bs2*(Fi+N));
+
+	// line preconditioners; lines are extracted at the first setup, outside the timing, and
+	// at most all cells are on lines, which is assumed in the models
+	{
+		QuietScope quiet;
+		A->precLineSetup();
+	}
+	tk = timeKernel(nrepeat, [&]() { A->precLineSetup(); });
+	add("line_setup", tk, 4*N*bs2*R + 3*N*I, 0);
+
+	tk = timeKernel(nrepeat, [&]() { A->precLineJacobiApply(x.data(), z.data()); });
+	add("linejacobi_apply", tk, 3*N*bs2*R + 4*N*nv*R + 3*N*I, 8*bs2*N);
+
+	// one forward and one backward sweep over the lines
+	tk = timeKernel(nrepeat, [&]() { A->precLineSGSApply(x.data(), z.data()); });
+	add("linesgs_apply", tk, 2*(2*Fi*bs2*R + 3*N*bs2*R + 4*N*nv*R + cellconn + 3*N*I),
+		2*(4*bs2*Fi + 8*bs2*N));
+
+	// additive Schwarz with exact ILU0 in thread subdomains overlapping by one layer;
+	// subdomains are set up at the first setup, outside the timing, and overlap is neglected
+	{
+		QuietScope quiet;
+		A->precSchwarzSetup(1);
+	}
+	tk = timeKernel(nrepeat, [&]() { A->precSchwarzSetup(1); });
+	add("schwarz_setup", tk, 2*(N+2*Fi)*bs2*R + 2*cellconn, 0);
+
+	tk = timeKernel(nrepeat, [&]() { A->precSchwarzApply(x.data(), z.data()); });
+	add("schwarz_apply", tk, (N+2*Fi)*bs2*R + 2*N*nv*R + 2*N*nv*R + 2*cellconn,
+		2*bs2*(N+2*Fi));
+
+	// GMRES-polynomial of degree 4: 4 Arnoldi steps to set it up, 3 products to apply it
+	{
+		Polynomial<NVARS> poly(A, 4);
+		{
+			QuietScope quiet;
+			poly.compute();
+		}
+		const double scaledbytes = spmvbytes + N*bs2*R + 2*N*nv*R;
+		const double scaledflops = spmvflops + 2*bs2*N;
+		tk = timeKernel(nrepeat, [&]() { poly.compute(); });
+		add("poly4_setup", tk, 2*N*bs2*R + 4*scaledbytes + 10*5*N*nv*R,
+			4*scaledflops + 10*4*N*nv);
+
+		tk = timeKernel(nrepeat, [&]() { poly.apply(x.data(), z.data()); });
+		add("poly4_apply", tk, N*bs2*R + 2*N*nv*R + 3*scaledbytes + 4*3*N*nv*R,
+			2*bs2*N + 3*scaledflops + 4*3*N*nv);
+	}
+
+	// matrix-free LU-SGS, with the same pseudo-time term; the flux Jacobians of the
+	// neighbouring cells are recomputed in each sweep, which is not counted in the flops
+	{
+		amat::Array2d<a_real> dtmcfl(m.gnelem(), 1);
+		for(a_int iel = 0; iel < m.gnelem(); iel++)
+			dtmcfl(iel) = 100.0*dtm(iel);
+		MatrixFreeLUSGS<NVARS> lusgs(&m);
+		lusgs.setState(prob, u, dtmcfl);
+		tk = timeKernel(nrepeat, [&]() { lusgs.compute(); });
+		add("lusgs_setup", tk, 2*N*nv*R + F*(4*R + 2*I) + 2*N*R + 2*F*R + cellconn/2 + N*bs2*R,
+			0);
+
+		tk = timeKernel(nrepeat, [&]() { lusgs.apply(x.data(), z.data()); });
+		add("lusgs_apply", tk, 2*(Fi*(2*nv*R + 4*R + I) + N*bs2*R + 2*N*nv*R + cellconn),
+			2*(2*bs2*(Fi+N)));
+	}
+
+	// Krylov solvers, ILU0-preconditioned, with a fixed number of iterations
+	{
+		ILU0<NVARS> prec(A);
+		RichardsonSolver<NVARS> rich(&m, A, &prec);
+		BiCGSTAB<NVARS> bicg(&m, A, &prec);
+		GMRES<NVARS> gmres(&m, A, &prec, 30);
+		rich.setParams(1e-30, 10);
+		bicg.setParams(1e-30, 10);
+		gmres.setParams(1e-30, 1);
+		IterativeSolver<NVARS> *const solvers[] = {&rich, &bicg, &gmres};
+		const char *const solvernames[] = {"richardson:10", "bicgstab:10", "gmres30:1"};
+		for(int is = 0; is < 3; is++) {
+			const size_t nallocs = solvers[is]->workspace().numAllocations();
+			tk = timeKernel(nrepeat, [&]() {
+					QuietScope quiet;
+					z.setZero();
+					solvers[is]->solve(r, z);
+				});
+			add(std::string("krylov:")+solvernames[is], tk, 0, 0);
+			if(solvers[is]->workspace().numAllocations() != nallocs)
+				std::cout << " ! " << solvernames[is] << " allocated storage while solving!\n";
+		}
+	}
+
+	delete A;
+	delete prob;
+}
+
+static void printUsage()
+{
+	std::cout << "Usage: fvens_bench [-r <repeats>] [-t <max threads>] [-o <csv file>] "
+		<< "<mesh> [<mesh> ...]\n"
+		<< " where each mesh is a Gmsh 2 file, or <geometry>:<cells>:<nx>x<ny>[:<perturbation>]\n"
+		<< " for a generated mesh, with geometry RECT, BUMP or CYLINDER and cells QUAD, TRI or HYBRID.\n";
+}
+
+int main(int argc, char* argv[])
+{
+	int nrepeat = 10;
+	int maxthreads = 1;
+#ifdef _OPENMP
+	maxthreads = omp_get_max_threads();
+#endif
+	std::string csvfile;
+	std::vector<std::string> meshes;
+
+	for(int i = 1; i < argc; i++)
+	{
+		if(std::strcmp(argv[i],"-r") == 0 && i+1 < argc)
+			nrepeat = std::atoi(argv[++i]);
+		else if(std::strcmp(argv[i],"-t") == 0 && i+1 < argc)
+			maxthreads = std::atoi(argv[++i]);
+		else if(std::strcmp(argv[i],"-o") == 0 && i+1 < argc)
+			csvfile = argv[++i];
+		else if(argv[i][0] == '-') {
+			printUsage();
+			return -1;
+		}
+		else
+			meshes.push_back(argv[i]);
+	}
+	if(meshes.size() == 0 || nrepeat < 1 || maxthreads < 1) {
+		printUsage();
+		return -1;
+	}
+
+	std::vector<int> threadcounts;
+	for(int nt = 1; nt < maxthreads; nt *= 2)
+		threadcounts.push_back(nt);
+	threadcounts.push_back(maxthreads);
+
+	// phase timers are used to time the reconstruction and limiter in place
+	setNumThreads(maxthreads);
+	{
+		QuietScope quiet;
+		perf::Registry::initialize(1);
+	}
+	memory::reportAffinity(std::cout);
+
+	std::vector<BenchResult> results;
+
+	for(const std::string& meshname : meshes)
+	{
+		UMesh2dh m;
+		setNumThreads(maxthreads);
+		if(!setupMesh(meshname, m)) {
+			std::cout << "! fvens_bench: Could not set up mesh " << meshname << "\n";
+			continue;
+		}
+
+		std::cout << "\nMesh " << meshname << ": " << m.gnelem() << " cells, "
+			<< m.gnaface() << " faces\n";
+		std::cout << std::setw(28) << std::left << "kernel" << std::right
+			<< std::setw(8) << "threads" << std::setw(14) << "time (ms)"
+			<< std::setw(10) << "GB/s" << std::setw(10) << "GFLOP/s" << '\n';
+
+		for(const int nt : threadcounts)
+		{
+			setNumThreads(nt);
+			const size_t start = results.size();
+			benchMesh(meshname, m, nt, nrepeat, results);
+
+			for(size_t i = start; i < results.size(); i++) {
+				const BenchResult& res = results[i];
+				std::cout << std::setw(28) << std::left << res.kernel << std::right
+					<< std::setw(8) << res.nthreads
+					<< std::setw(14) << std::setprecision(4) << res.time*1e3;
+				if(res.bytes > 0)
+					std::cout << std::setw(10) << std::setprecision(3) << res.bytes/res.time*1e-9;
+				else
+					std::cout << std::setw(10) << "-";
+				if(res.flops > 0)
+					std::cout << std::setw(10) << std::setprecision(3) << res.flops/res.time*1e-9;
+				else
+					std::cout << std::setw(10) << "-";
+				std::cout << '\n';
+			}
+		}
+	}
+
+	if(csvfile.size() > 0)
+	{
+		std::ofstream csv(csvfile);
+		csv << "mesh,kernel,threads,time,bytes,flops\n";
+		csv << std::setprecision(10);
+		for(const BenchResult& res : results)
+			csv << res.mesh << ',' << res.kernel << ',' << res.nthreads << ',' << res.time << ','
+				<< res.bytes << ',' << res.flops << '\n';
+		csv.close();
+		std::cout << "\nfvens_bench: Results written to " << csvfile << '\n';
+	}
+
+	perf::Registry::finalize();
+	return 0;
+}
@@ -1,15 +1,126 @@
 #include "aoutput.hpp"
 #include "aodesolver.hpp"
+#include "aperf.hpp"
+#include "amemory.hpp"
+#include "ameshgen.hpp"
+#include "apartition.hpp"
+#include "aensemble.hpp"
+#include "aasyncoutput.hpp"
+#include "alocator.hpp"
+#include "aadaptation.hpp"
+#include <sstream>
+#include <chrono>
 
 using namespace amat;
 using namespace std;
 using namespace acfd;
 
+/// Reads the Mach number and angle of attack (in degrees) of each case from a file
+/** Each line holds one case; lines starting with '#' are ignored.
+ */
+static bool readCases(const string casefile, vector<a_real>& machs, vector<a_real>& alphas)
+{
+	ifstream fin(casefile);
+	if(!fin) {
+		cout << "! Could not open ensemble case file " << casefile << "!\n";
+		return false;
+	}
+	string line;
+	while(getline(fin, line)) {
+		if(line.empty() || line[0] == '#')
+			continue;
+		istringstream ls(line);
+		a_real mach, alpha;
+		if(ls >> mach >> alpha) {
+			machs.push_back(mach);
+			alphas.push_back(alpha);
+		}
+	}
+	return machs.size() > 0;
+}
+
+/// Inserts a tag, such as the index of a case, before the extension of a file name
+static string taggedFileName(const string name, const string tag)
+{
+	const size_t dot = name.find_last_of('.');
+	const size_t slash = name.find_last_of('/');
+	if(dot == string::npos || (slash != string::npos && dot < slash))
+		return name + tag;
+	return name.substr(0,dot) + tag + name.substr(dot);
+}
+
+/// Reads a Gmsh file, or generates a mesh from a description, and computes its geometry
+static bool setupMesh(const string meshfile, UMesh2dh& m)
+{
+	MeshGenerator::Spec genspec(MeshGenerator::RECTANGLE, MeshGenerator::QUADRANGLES, 1, 1);
+	if(MeshGenerator::parse(meshfile, genspec)) {
+		if(!MeshGenerator::generate(genspec, m))
+			return false;
+	}
+	else
+		m.readGmsh2(meshfile,2);
+	m.compute_topological();
+	m.compute_areas();
+	m.compute_jacobians();
+	m.compute_face_data();
+	return true;
+}
+
 int main(int argc, char* argv[])
 {
+	commInitialize(&argc, &argv);
+	// only the first rank reports progress
+	if(commRank() > 0)
+		cout.rdbuf(nullptr);
+
+	// the optional argument '-ensemble <case file>' solves all cases in the file,
+	// '-output-interval <n>' writes the solution every n steps of the main loop,
+	// '-sequence <mesh>,<mesh>,...' first solves on the given coarser meshes, coarsest first,
+	// '-adapt <cycles>[:<refine fraction>[:<coarsen fraction>[:<max level>]]]' adapts
+	// the mesh to the solution and solves again the given number of times,
+	// '-memory-report' prints the memory used by the main objects before and after solving,
+	// and '-lean' frees or shares storage that is not needed during the solve
+	string casefile;
+	int outinterval = 0;
+	bool memreport = false, lean = false;
+	vector<string> seqmeshes;
+	int adaptcycles = 0, adaptmaxlevel = 3;
+	a_real refinefraction = 0.1, coarsenfraction = 0.2;
+	vector<char*> args;
+	for(int i = 0; i < argc; i++) {
+		if(string(argv[i]) == "-ensemble" && i+1 < argc)
+			casefile = argv[++i];
+		else if(string(argv[i]) == "-output-interval" && i+1 < argc)
+			outinterval = atoi(argv[++i]);
+		else if(string(argv[i]) == "-sequence" && i+1 < argc) {
+			istringstream ls(argv[++i]);
+			string name;
+			while(getline(ls, name, ','))
+				if(!name.empty())
+					seqmeshes.push_back(name);
+		}
+		else if(string(argv[i]) == "-adapt" && i+1 < argc) {
+			istringstream ls(argv[++i]);
+			string val;
+			if(getline(ls, val, ':')) adaptcycles = stoi(val);
+			if(getline(ls, val, ':')) refinefraction = stod(val);
+			if(getline(ls, val, ':')) coarsenfraction = stod(val);
+			if(getline(ls, val, ':')) adaptmaxlevel = stoi(val);
+		}
+		else if(string(argv[i]) == "-memory-report")
+			memreport = true;
+		else if(string(argv[i]) == "-lean")
+			lean = true;
+		else
+			args.push_back(argv[i]);
+	}
+	argc = (int)args.size();
+	argv = args.data();
+
 	if(argc < 2)
 	{
 		cout << "Please give a control file name.\n";
+		commFinalize();
 		return -1;
 	}
 
@@ -67,8 +178,57 @@ int main(int argc, char* argv[])
 	}
 	else
 		invfluxjac = invflux;
+
+	// Optional entries at the end: the run can be stopped once the force coefficients stop
+	// changing, the multistage explicit scheme can be tuned, the pseudo-time iteration can be
+	// accelerated and low-Mach preconditioning can be turned on. Anything else is skipped,
+	// such as the implicit solver settings in control files for explicit runs.
+	double forcetol = 0;
+	int forcewindow = 0;
+	double smoothcoeff = 1.0;
+	int smoothsweeps = 4;
+	string stagecoeffs;
+	int andersondepth = 0;
+	double andersonmixing = 1.0;
+	double lowmachfactor = 0;
+	while(control >> dum) {
+		if(dum == "-force-coefficient-tolerance")
+			control >> forcetol;
+		else if(dum == "-force-coefficient-window")
+			control >> forcewindow;
+		else if(dum == "-residual-smoothing-coefficient")
+			control >> smoothcoeff;
+		else if(dum == "-residual-smoothing-sweeps")
+			control >> smoothsweeps;
+		else if(dum == "-stage-coefficients")
+			control >> stagecoeffs;
+		else if(dum == "-anderson-depth")
+			control >> andersondepth;
+		else if(dum == "-anderson-mixing")
+			control >> andersonmixing;
+		else if(dum == "-low-mach-preconditioning")
+			control >> lowmachfactor;
+	}
 	control.close();
 
+	// stage coefficients of the multistage scheme
+	vector<a_real> rkalpha;
+	if(timesteptype == "RK4" || timesteptype == "RK5") {
+		rkalpha = SteadyRKSolver<4>::stageCoefficients(timesteptype == "RK4" ? 4 : 5);
+		if(!stagecoeffs.empty()) {
+			rkalpha.clear();
+			istringstream ss(stagecoeffs);
+			string c;
+			while(getline(ss, c, ','))
+				rkalpha.push_back(stod(c));
+		}
+		if(rkalpha.empty()) {
+			cout << "! Invalid stage coefficients!\n";
+			commFinalize();
+			return -1;
+		}
+	}
+
 	std::locale loc;
 
 	if(usemf == "YES")
@@ -76,7 +236,7 @@ int main(int argc, char* argv[])
 	else
 		use_matrix_free = false;
 	
-	if(lognresstr == "YES")
+	if(lognresstr == "YES" && commRank() == 0)
 		lognres = true;
 	else
 		lognres = false;
@@ -89,51 +249,353 @@ int main(int argc, char* argv[])
 			std::cout << "! Mesh file not given in command line!\n";
 	}
 
+	perf::Registry::initialize();
+	memory::reportAffinity(cout);
+
 	// Set up mesh
 
-	UMesh2dh m;
-	m.readGmsh2(meshfile,2);
-	m.compute_topological();
-	m.compute_areas();
-	m.compute_jacobians();
-	m.compute_face_data();
+	UMesh2dh gm;
+	if(!setupMesh(meshfile, gm)) {
+		commFinalize();
+		return -1;
+	}
+
+	// With several ranks, every rank reads the whole mesh and keeps its own subdomain
+	UMesh2dh lm;
+	DomainDecomposition* dd = nullptr;
+	HaloExchange* halo = nullptr;
+	if(commSize() > 1) {
+		dd = new DomainDecomposition(&gm);
+		dd->extractLocalMesh(lm);
+		lm.compute_topological();
+		lm.compute_areas();
+		lm.compute_jacobians();
+		lm.compute_face_data();
+		halo = new HaloExchange(&lm, *dd);
+	}
+	const UMesh2dh& m = commSize() > 1 ? lm : gm;
+
+	if(!seqmeshes.empty() && (commSize() > 1 || !casefile.empty())) {
+		cout << "! Grid sequencing cannot be used with more than one process or in ensemble mode!\n";
+		commFinalize();
+		return -1;
+	}
+	if(adaptcycles > 0 && (commSize() > 1 || !casefile.empty())) {
+		cout << "! Adaptation cannot be used with more than one process or in ensemble mode!\n";
+		commFinalize();
+		return -1;
+	}
+
+	if(!casefile.empty())
+	{
+		vector<a_real> machs, alphas;
+		if(commSize() > 1) {
+			cout << "! Ensemble mode cannot be used with more than one process!\n";
+			commFinalize();
+			return -1;
+		}
+		if(!readCases(casefile, machs, alphas)) {
+			commFinalize();
+			return -1;
+		}
+		const int ncases = (int)machs.size();
+		if(lowmachfactor > 0)
+			cout << "! Low-Mach preconditioning is not available in ensemble mode; ignored.\n";
+		cout << "Solving " << ncases << " cases in ensembles of " << NENSEMBLE << ".\n";
+
+		EulerFVEnsemble prob(&m, invflux, invfluxjac, reconst, limiter);
+		EulerFVEnsemble startprob(&m, invflux, invfluxjac, "NONE", "NONE");
+		if(lean)
+			gm.freeSetupData();
+		vector<int> steps(ncases);
+		vector<a_real> relres(ncases);
+		AsyncOutput output(&m);
+
+		for(int first = 0; first < ncases; first += NENSEMBLE)
+		{
+			const int nmem = min(NENSEMBLE, ncases-first);
+
+			// the members are about to be reset; their last solutions must be written first
+			output.finish();
+
+			SteadyEnsembleSolver time(&m, &prob, &startprob, nmem, usestarter,
+					timesteptype == "IMPLICIT", initcfl, endcfl, rampstart, rampend,
+					tolerance, maxiter, firsttolerance, firstmaxiter, firstcfl,
+					lintol, linmaxiterstart, linmaxiterend, linsolver, prec, restart_vecs,
+					nbuildsweeps, napplysweeps);
+
+			// unused members of the last ensemble get a copy of its last case
+			for(int k = 0; k < NENSEMBLE; k++) {
+				const int icase = min(first+k, ncases-1);
+				startprob.loaddata(k, inittype, machs[icase], vinf, alphas[icase]*PI/180, rho_inf,
+						time.unknowns());
+				prob.loaddata(k, inittype, machs[icase], vinf, alphas[icase]*PI/180, rho_inf,
+						time.unknowns());
+			}
+
+			time.solve(logfile, first);
+
+			MVector uk(m.gnelem(), NVARS);
+			for(int k = 0; k < nmem; k++) {
+				EulerFVEnsemble::extractMember(time.unknowns(), k, uk);
+				output.request(prob.member(k), uk, taggedFileName(outf, "-case"+to_string(first+k)));
+				steps[first+k] = time.steps(k);
+				relres[first+k] = time.relativeResidual(k);
+			}
+		}
+
+		cout << "\n" << setw(6) << "case" << setw(10) << "Mach" << setw(10) << "alpha"
+			<< setw(8) << "steps" << setw(14) << "rel residual\n";
+		for(int i = 0; i < ncases; i++)
+			cout << setw(6) << i << setw(10) << machs[i] << setw(10) << alphas[i]
+				<< setw(8) << steps[i] << setw(14) << relres[i] << '\n';
+		output.finish();
+
+		perf::Registry::printSummary(std::cout);
+		perf::Registry::dump(logfile);
+		perf::Registry::finalize();
+		cout << "\n--------------- End --------------------- \n\n";
+		commFinalize();
+		return 0;
+	}
 
 	// set up problem
 	
+	auto createSolver = [&](const UMesh2dh *const mesh, EulerFV *const p, EulerFV *const sp,
+			const short starter) -> SteadySolver<4>*
+	{
+		SteadySolver<4>* ts;
+		if(timesteptype == "IMPLICIT") {
+			if(use_matrix_free)
+				ts = new SteadyMFBackwardEulerSolver<4>(mesh, p, sp, starter, initcfl, endcfl, rampstart, rampend, tolerance, maxiter, 
+					lintol, linmaxiterstart, linmaxiterend, linsolver, prec, nbuildsweeps, napplysweeps, firsttolerance, firstmaxiter, firstcfl, restart_vecs, lognres);
+			else
+				ts = new SteadyBackwardEulerSolver<4>(mesh, p, sp, starter, initcfl, endcfl, rampstart, rampend, tolerance, maxiter, 
+					mattype, lintol, linmaxiterstart, linmaxiterend, linsolver, prec, nbuildsweeps, napplysweeps, firsttolerance, firstmaxiter, firstcfl, restart_vecs, lognres);
+			std::cout << "Setting up backward Euler temporal scheme.\n";
+		}
+		else if(!rkalpha.empty()) {
+			ts = new SteadyRKSolver<4>(mesh, p, sp, starter, tolerance, maxiter, initcfl, firsttolerance, firstmaxiter, firstcfl,
+				rkalpha, smoothcoeff, smoothsweeps, lognres);
+			std::cout << "Setting up explicit multistage temporal scheme.\n";
+		}
+		else {
+			ts = new SteadyForwardEulerSolver<4>(mesh, p, sp, starter, tolerance, maxiter, initcfl, firsttolerance, firstmaxiter, firstcfl, lognres);
+			std::cout << "Setting up explicit forward Euler temporal scheme.\n";
+		}
+		// on all ranks, as the coefficients are summed over them
+		ts->setForceLogging(lognresstr == "YES");
+		if(forcetol > 0)
+			ts->setForceTermination(forcetol, forcewindow);
+		if(andersondepth > 0) {
+			ts->setAcceleration(andersondepth, andersonmixing);
+			std::cout << "Using Anderson acceleration with " << andersondepth << " previous steps.\n";
+		}
+		ts->setLeanMemory(lean);
+		return ts;
+	};
+
+	auto reportMemory = [&](const UMesh2dh *const mesh, const EulerFV *const p,
+			const EulerFV *const sp, const SteadySolver<4> *const ts)
+	{
+		memory::Report report;
+		mesh->reportMemory(report, "mesh");
+		p->reportMemory(report, "discretization");
+		sp->reportMemory(report, "starting discretization");
+		ts->reportMemory(report, "solver");
+		report.print(cout);
+	};
+
+	/* Grid sequencing: the problem is solved on each coarser mesh in turn, starting from the
+	 * solution on the previous one, and the last of these solutions is the initial guess on
+	 * the main mesh. Only the coarsest level uses the first-order starter.
+	 */
+	vector<UMesh2dh> levels(seqmeshes.size());
+	MVector useq;
+	const CellLocator* seqloc = nullptr;
+	for(size_t il = 0; il < levels.size(); il++)
+	{
+		cout << "\nGrid sequencing: level " << il << ", mesh " << seqmeshes[il] << '\n';
+		if(!setupMesh(seqmeshes[il], levels[il])) {
+			commFinalize();
+			return -1;
+		}
+		const auto start = std::chrono::steady_clock::now();
+
+		EulerFV lprob(&levels[il], invflux, invfluxjac, reconst, limiter);
+		EulerFV lstartprob(&levels[il], invflux, invfluxjac, "NONE", "NONE");
+		if(lean)
+			levels[il].freeSetupData();
+		SteadySolver<4>* ltime = createSolver(&levels[il], &lprob, &lstartprob,
+				il == 0 ? usestarter : 0);
+		lstartprob.loaddata(inittype, M_inf, vinf, alpha*PI/180, rho_inf, ltime->unknowns());
+		lprob.loaddata(inittype, M_inf, vinf, alpha*PI/180, rho_inf, ltime->unknowns());
+		lstartprob.setLowMachPreconditioning(lowmachfactor);
+		lprob.setLowMachPreconditioning(lowmachfactor);
+		if(seqloc)
+			injectCellData(*seqloc, useq, levels[il], ltime->unknowns());
+
+		ltime->solve(taggedFileName(logfile, "-level"+to_string(il)));
+
+		useq = ltime->unknowns();
+		delete ltime;
+		seqloc = &levels[il].cellLocator();
+
+		const std::chrono::duration<double> dt = std::chrono::steady_clock::now() - start;
+		cout << "Grid sequencing: level " << il << " (" << levels[il].gnelem()
+			<< " cells) took " << dt.count() << "s.\n";
+	}
+	if(seqloc)
+		cout << "\nGrid sequencing: main mesh, " << m.gnelem() << " cells\n";
+
 	std::cout << "Setting up main spatial scheme.\n";
-	EulerFV prob(&m, invflux, invfluxjac, reconst, limiter);
+	EulerFV prob(&m, invflux, invfluxjac, reconst, limiter, halo);
 	std::cout << "Setting up spatial scheme for the initial guess.\n";
-	EulerFV startprob(&m, invflux, invfluxjac, "NONE", "NONE");
+	EulerFV startprob(&m, invflux, invfluxjac, "NONE", "NONE", halo);
 	
-	SteadySolver<4>* time;
-	if(timesteptype == "IMPLICIT") {
-		if(use_matrix_free)
-			time = new SteadyMFBackwardEulerSolver<4>(&m, &prob, &startprob, usestarter, initcfl, endcfl, rampstart, rampend, tolerance, maxiter, 
-				lintol, linmaxiterstart, linmaxiterend, linsolver, prec, nbuildsweeps, napplysweeps, firsttolerance, firstmaxiter, firstcfl, restart_vecs, lognres);
-		else
-			time = new SteadyBackwardEulerSolver<4>(&m, &prob, &startprob, usestarter, initcfl, endcfl, rampstart, rampend, tolerance, maxiter, 
-				mattype, lintol, linmaxiterstart, linmaxiterend, linsolver, prec, nbuildsweeps, napplysweeps, firsttolerance, firstmaxiter, firstcfl, restart_vecs, lognres);
-		std::cout << "Setting up backward Euler temporal scheme.\n";
-	}
-	else {
-		time = new SteadyForwardEulerSolver<4>(&m, &prob, &startprob, usestarter, tolerance, maxiter, initcfl, firsttolerance, firstmaxiter, firstcfl, lognres);
-		std::cout << "Setting up explicit forward Euler temporal scheme.\n";
-	}
+	SteadySolver<4>* time = createSolver(&m, &prob, &startprob, seqloc ? 0 : usestarter);
 	
 	startprob.loaddata(inittype, M_inf, vinf, alpha*PI/180, rho_inf, time->unknowns());
 	prob.loaddata(inittype, M_inf, vinf, alpha*PI/180, rho_inf, time->unknowns());
+	startprob.setLowMachPreconditioning(lowmachfactor);
+	prob.setLowMachPreconditioning(lowmachfactor);
+	if(lowmachfactor > 0)
+		cout << "Using low-Mach preconditioning with a cut-off of " << lowmachfactor
+			<< " times the free-stream speed.\n";
+
+	if(seqloc) {
+		const a_int nout = injectCellData(*seqloc, useq, m, time->unknowns());
+		if(nout > 0)
+			cout << " Grid sequencing: " << nout
+				<< " cell centres of the main mesh were outside the last coarse mesh.\n";
+	}
+
+	/* Solutions are post-processed and written by a background thread. With several ranks,
+	 * they are gathered to and written on the global mesh by the first rank.
+	 */
+	EulerFV* post = nullptr;
+	AsyncOutput* output = nullptr;
+	if(commRank() == 0) {
+		if(dd) {
+			post = new EulerFV(&gm, invflux, invfluxjac, "NONE", "NONE");
+			MVector uinit(gm.gnelem(), NVARS);
+			post->loaddata(inittype, M_inf, vinf, alpha*PI/180, rho_inf, uinit);
+		}
+		output = new AsyncOutput(dd ? &gm : &m);
+	}
+	// connectivity only needed to set up the meshes and discretizations
+	if(lean) {
+		gm.freeSetupData();
+		lm.freeSetupData();
+	}
+	// the discretization on the mesh being solved on, which changes if the mesh is adapted
+	const EulerFV* curprob = &prob;
+	MVector ug;
+	auto writeSolution = [&](const MVector& usol, const string fname) {
+		if(dd) {
+			dd->gather(usol, ug);
+			if(output)
+				output->request(*post, ug, fname);
+		}
+		else
+			output->request(*curprob, usol, fname);
+	};
+
+	string steptag = "-step";
+	auto setOutputInterval = [&](SteadySolver<4> *const ts) {
+		if(outinterval > 0)
+			ts->setStepCallback([&](const int step, const MVector& usol) {
+					if(step % outinterval == 0)
+						writeSolution(usol, taggedFileName(outf, steptag+to_string(step)));
+				});
+	};
+	setOutputInterval(time);
+
+	if(memreport)
+		reportMemory(&m, &prob, &startprob, time);
 
 	// computation
 	time->solve(logfile);
 
-	Array2d<a_real> scalars;
-	Array2d<a_real> velocities;
-	prob.postprocess_point(time->unknowns(), scalars, velocities);
+	/* Adaptation: the mesh is refined where the indicator is large and coarsened where it is
+	 * small, and the problem is solved again on the new mesh from the transferred solution.
+	 * The solution before each adaptation is written to its own file. The meshes of two
+	 * consecutive cycles are needed at a time, so two are used in turn.
+	 */
+	MeshAdapter* adapter = adaptcycles > 0 ? new MeshAdapter(m, adaptmaxlevel) : nullptr;
+	UMesh2dh adaptmeshes[2];
+	EulerFV *aprob = nullptr, *astartprob = nullptr;
+	const UMesh2dh* curmesh = &m;
+	for(int icycle = 0; icycle < adaptcycles; icycle++)
+	{
+		if(!time->residuals().allFinite() || !time->unknowns().allFinite()) {
+			cout << "! The solution is not finite; no further adaptation cycles.\n";
+			break;
+		}
+
+		writeSolution(time->unknowns(), taggedFileName(outf, "-adapt"+to_string(icycle)));
 
-	string scalarnames[] = {"density", "mach-number", "pressure"};
-	writeScalarsVectorToVtu_PointData(outf, m, scalars, scalarnames, velocities, "velocity");
+		vector<a_real> indicator(curmesh->gnelem());
+		curprob->compute_refinement_indicator(time->unknowns(), &indicator[0]);
 
+		cout << "\nAdaptation cycle " << icycle+1 << '\n';
+		UMesh2dh& nm = adaptmeshes[icycle%2];
+		MVector unew;
+		// the output thread may still be using the mesh and discretization being replaced
+		output->finish();
+		if(!adapter->adapt(&indicator[0], refinefraction, coarsenfraction, time->unknowns(),
+					nm, unew))
+			break;
+
+		delete time;
+		delete astartprob;
+		delete aprob;
+		aprob = new EulerFV(&nm, invflux, invfluxjac, reconst, limiter);
+		astartprob = new EulerFV(&nm, invflux, invfluxjac, "NONE", "NONE");
+		if(lean)
+			nm.freeSetupData();
+		time = createSolver(&nm, aprob, astartprob, 0);
+		astartprob->loaddata(inittype, M_inf, vinf, alpha*PI/180, rho_inf, time->unknowns());
+		aprob->loaddata(inittype, M_inf, vinf, alpha*PI/180, rho_inf, time->unknowns());
+		astartprob->setLowMachPreconditioning(lowmachfactor);
+		aprob->setLowMachPreconditioning(lowmachfactor);
+		time->unknowns() = unew;
+
+		delete output;
+		output = new AsyncOutput(&nm);
+		curmesh = &nm;
+		curprob = aprob;
+		steptag = "-adapt"+to_string(icycle+1)+"-step";
+		setOutputInterval(time);
+
+		time->solve(taggedFileName(logfile, "-adapt"+to_string(icycle+1)));
+	}
+
+	if(memreport)
+		reportMemory(curmesh, curprob, astartprob ? astartprob : &startprob, time);
+
+	writeSolution(time->unknowns(), outf);
+	if(output) {
+		output->finish();
+		cout << " Solver was blocked by output for " << output->blockedTime() << "s over "
+			<< output->numSnapshots() << " snapshot(s).\n";
+	}
+
+	delete output;
+	delete post;
 	delete time;
+	delete astartprob;
+	delete aprob;
+	delete adapter;
+	delete halo;
+	delete dd;
+	if(commRank() == 0) {
+		perf::Registry::printSummary(std::cout);
+		perf::Registry::dump(logfile);
+	}
+	perf::Registry::finalize();
+
 	cout << "\n--------------- End --------------------- \n\n";
+	commFinalize();
 	return 0;
 }
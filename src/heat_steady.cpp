@@ -1,5 +1,7 @@
 #include "aoutput.hpp"
 #include "aodesolver.hpp"
+#include "aperf.hpp"
+#include "ameshgen.hpp"
 
 using namespace amat;
 using namespace std;
@@ -79,10 +81,18 @@ int main(int argc, char* argv[])
 
 	a_real err = 0;
 
+	perf::Registry::initialize();
+
 	// Set up mesh
 
 	UMesh2dh m;
-	m.readGmsh2(meshfile,2);
+	MeshGenerator::Spec genspec(MeshGenerator::RECTANGLE, MeshGenerator::QUADRANGLES, 1, 1);
+	if(MeshGenerator::parse(meshfile, genspec)) {
+		if(!MeshGenerator::generate(genspec, m))
+			return -1;
+	}
+	else
+		m.readGmsh2(meshfile,2);
 	m.compute_topological();
 	m.compute_areas();
 	m.compute_jacobians();
@@ -161,6 +171,10 @@ int main(int argc, char* argv[])
 	string scaname[1] = {"some-quantity"}; string vecname;
 	writeScalarsVectorToVtu_PointData(outf, m, outputarr, scaname, dummy, vecname);
 
+	perf::Registry::printSummary(std::cout);
+	perf::Registry::dump(logfile);
+	perf::Registry::finalize();
+
 	cout << "\n--------------- End --------------------- \n\n";
 	return 0;
 }
@@ -0,0 +1,27 @@
+#include "../ameshgen.hpp"
+
+using namespace acfd;
+using namespace std;
+
+/** Writes a generated mesh straight to a Gmsh 2 file, without holding the mesh in memory.
+ * Usage: generatemesh <geometry>:<cells>:<nx>x<ny>[:<perturbation>] <output file>
+ */
+int main(int argc, char* argv[])
+{
+	if(argc < 3) {
+		cout << "Usage: generatemesh <geometry>:<cells>:<nx>x<ny>[:<perturbation>] <output file>\n";
+		return -1;
+	}
+
+	MeshGenerator::Spec spec(MeshGenerator::RECTANGLE, MeshGenerator::QUADRANGLES, 1, 1);
+	if(!MeshGenerator::parse(argv[1], spec)) {
+		cout << "Invalid mesh description. Exiting." << endl;
+		return -1;
+	}
+
+	if(!MeshGenerator::writeGmsh2(spec, argv[2]))
+		return -1;
+
+	cout << endl;
+	return 0;
+}